@@ -39,6 +39,7 @@
 #include <linux/slab.h>
 #include <linux/workqueue.h>
 #include <linux/netdevice.h>
+#include <linux/jhash.h>
 #include <net/addrconf.h>
 
 #include <rdma/ib_cache.h>
@@ -86,6 +87,9 @@ struct roce_gid_ndev_storage {
 struct ib_gid_table_entry {
 	struct kref			kref;
 	struct work_struct		del_work;
+	/* Linked on the table hash while the entry is VALID */
+	struct hlist_node		hnode;
+	struct rcu_head			rcu;
 	struct ib_gid_attr		attr;
 	void				*context;
 	/* Store the ndev pointer to release reference later on in
@@ -118,6 +122,12 @@ struct ib_gid_table {
 	 */
 	rwlock_t			rwlock;
 	struct ib_gid_table_entry	**data_vec;
+	/* Valid entries hashed by GID value. Modified under both lock and
+	 * the write side of rwlock; readers may walk it under either lock or
+	 * under RCU, in which case entries are freed after a grace period.
+	 */
+	struct hlist_head		*hash;
+	u32				hash_mask;
 	/* bit field, each bit indicates the index of default GID */
 	u32				default_gid_indices;
 };
@@ -259,7 +269,8 @@ static void free_gid_entry_locked(struct ib_gid_table_entry *entry)
 
 	if (entry->ndev_storage)
 		call_rcu(&entry->ndev_storage->rcu_head, put_gid_ndev);
-	kfree(entry);
+	/* Lockless lookups may still be looking at the entry */
+	kfree_rcu(entry, rcu);
 }
 
 static void free_gid_entry(struct kref *kref)
@@ -313,12 +324,20 @@ alloc_gid_entry(const struct ib_gid_attr *attr)
 		entry->ndev_storage->ndev = ndev;
 	}
 	kref_init(&entry->kref);
+	INIT_HLIST_NODE(&entry->hnode);
 	memcpy(&entry->attr, attr, sizeof(*attr));
 	INIT_WORK(&entry->del_work, free_gid_work);
 	entry->state = GID_TABLE_ENTRY_INVALID;
 	return entry;
 }
 
+static struct hlist_head *gid_hash_head(struct ib_gid_table *table,
+					const union ib_gid *gid)
+{
+	return &table->hash[jhash(gid->raw, sizeof(gid->raw), 0) &
+			    table->hash_mask];
+}
+
 static void store_gid_entry(struct ib_gid_table *table,
 			    struct ib_gid_table_entry *entry)
 {
@@ -331,6 +350,8 @@ static void store_gid_entry(struct ib_gid_table *table,
 	lockdep_assert_held(&table->lock);
 	write_lock_irq(&table->rwlock);
 	table->data_vec[entry->attr.index] = entry;
+	hlist_add_head_rcu(&entry->hnode,
+			   gid_hash_head(table, &entry->attr.gid));
 	write_unlock_irq(&table->rwlock);
 }
 
@@ -394,6 +415,7 @@ static void del_gid(struct ib_device *ib_dev, u32 port,
 	write_lock_irq(&table->rwlock);
 	entry = table->data_vec[ix];
 	entry->state = GID_TABLE_ENTRY_PENDING_DEL;
+	hlist_del_init_rcu(&entry->hnode);
 	/*
 	 * For non RoCE protocol, GID entry slot is ready to use.
 	 */
@@ -463,6 +485,56 @@ done:
 	return ret;
 }
 
+static bool gid_entry_match(const struct ib_gid_table *table,
+			    const struct ib_gid_table_entry *data,
+			    const union ib_gid *gid,
+			    const struct ib_gid_attr *val, bool default_gid,
+			    unsigned long mask)
+{
+	const struct ib_gid_attr *attr = &data->attr;
+
+	if (mask & GID_ATTR_FIND_MASK_GID_TYPE &&
+	    attr->gid_type != val->gid_type)
+		return false;
+
+	if (mask & GID_ATTR_FIND_MASK_GID &&
+	    memcmp(gid, &attr->gid, sizeof(*gid)))
+		return false;
+
+	if (mask & GID_ATTR_FIND_MASK_NETDEV &&
+	    rcu_access_pointer(attr->ndev) != val->ndev)
+		return false;
+
+	if (mask & GID_ATTR_FIND_MASK_DEFAULT &&
+	    is_gid_index_default(table, attr->index) != default_gid)
+		return false;
+
+	return true;
+}
+
+/*
+ * Look up a valid entry through the GID hash. The caller must hold rwlock
+ * or lock, or be in an RCU read side critical section.
+ */
+static struct ib_gid_table_entry *
+find_gid_entry(struct ib_gid_table *table, const union ib_gid *gid,
+	       const struct ib_gid_attr *val, bool default_gid,
+	       unsigned long mask)
+{
+	struct ib_gid_table_entry *data;
+
+	hlist_for_each_entry_rcu(data, gid_hash_head(table, gid), hnode,
+				 lockdep_is_held(&table->lock) ||
+				 lockdep_is_held(&table->rwlock)) {
+		if (READ_ONCE(data->state) != GID_TABLE_ENTRY_VALID)
+			continue;
+		if (gid_entry_match(table, data, gid, val, default_gid,
+				    mask | GID_ATTR_FIND_MASK_GID))
+			return data;
+	}
+	return NULL;
+}
+
 /* rwlock should be read locked, or lock should be held */
 static int find_gid(struct ib_gid_table *table, const union ib_gid *gid,
 		    const struct ib_gid_attr *val, bool default_gid,
@@ -471,10 +543,28 @@ static int find_gid(struct ib_gid_table *table, const union ib_gid *gid,
 	int i = 0;
 	int found = -1;
 	int empty = pempty ? -1 : 0;
+	bool scan = true;
+
+	/*
+	 * Lookups by GID value go through the hash, so the linear walk is
+	 * only needed to find a free slot or to match without a GID.
+	 */
+	if (mask & GID_ATTR_FIND_MASK_GID) {
+		struct ib_gid_table_entry *data;
+
+		data = find_gid_entry(table, gid, val, default_gid, mask);
+		if (data)
+			found = data->attr.index;
+		if (!pempty || found >= 0) {
+			if (pempty)
+				*pempty = -1;
+			return found;
+		}
+		scan = false;
+	}
 
-	while (i < table->sz && (found < 0 || empty < 0)) {
+	while (i < table->sz && ((scan && found < 0) || empty < 0)) {
 		struct ib_gid_table_entry *data = table->data_vec[i];
-		struct ib_gid_attr *attr;
 		int curr_index = i;
 
 		i++;
@@ -509,24 +599,10 @@ static int find_gid(struct ib_gid_table *table, const union ib_gid *gid,
 		if (!is_gid_entry_valid(data))
 			continue;
 
-		if (found >= 0)
+		if (!scan || found >= 0)
 			continue;
 
-		attr = &data->attr;
-		if (mask & GID_ATTR_FIND_MASK_GID_TYPE &&
-		    attr->gid_type != val->gid_type)
-			continue;
-
-		if (mask & GID_ATTR_FIND_MASK_GID &&
-		    memcmp(gid, &data->attr.gid, sizeof(*gid)))
-			continue;
-
-		if (mask & GID_ATTR_FIND_MASK_NETDEV &&
-		    attr->ndev != val->ndev)
-			continue;
-
-		if (mask & GID_ATTR_FIND_MASK_DEFAULT &&
-		    is_gid_index_default(table, curr_index) != default_gid)
+		if (!gid_entry_match(table, data, gid, val, default_gid, mask))
 			continue;
 
 		found = curr_index;
@@ -686,13 +762,11 @@ rdma_find_gid_by_port(struct ib_device *ib_dev,
 		      enum ib_gid_type gid_type,
 		      u32 port, struct net_device *ndev)
 {
-	int local_index;
+	struct ib_gid_table_entry *entry;
 	struct ib_gid_table *table;
 	unsigned long mask = GID_ATTR_FIND_MASK_GID |
 			     GID_ATTR_FIND_MASK_GID_TYPE;
 	struct ib_gid_attr val = {.ndev = ndev, .gid_type = gid_type};
-	const struct ib_gid_attr *attr;
-	unsigned long flags;
 
 	if (!rdma_is_port_valid(ib_dev, port))
 		return ERR_PTR(-ENOENT);
@@ -702,16 +776,13 @@ rdma_find_gid_by_port(struct ib_device *ib_dev,
 	if (ndev)
 		mask |= GID_ATTR_FIND_MASK_NETDEV;
 
-	read_lock_irqsave(&table->rwlock, flags);
-	local_index = find_gid(table, gid, &val, false, mask, NULL);
-	if (local_index >= 0) {
-		get_gid_entry(table->data_vec[local_index]);
-		attr = &table->data_vec[local_index]->attr;
-		read_unlock_irqrestore(&table->rwlock, flags);
-		return attr;
+	rcu_read_lock();
+	entry = find_gid_entry(table, gid, &val, false, mask);
+	if (entry && kref_get_unless_zero(&entry->kref)) {
+		rcu_read_unlock();
+		return &entry->attr;
 	}
-
-	read_unlock_irqrestore(&table->rwlock, flags);
+	rcu_read_unlock();
 	return ERR_PTR(-ENOENT);
 }
 EXPORT_SYMBOL(rdma_find_gid_by_port);
@@ -741,9 +812,9 @@ const struct ib_gid_attr *rdma_find_gid_by_filter(
 	void *context)
 {
 	const struct ib_gid_attr *res = ERR_PTR(-ENOENT);
+	struct ib_gid_table_entry *entry;
 	struct ib_gid_table *table;
 	unsigned long flags;
-	unsigned int i;
 
 	if (!rdma_is_port_valid(ib_dev, port))
 		return ERR_PTR(-EINVAL);
@@ -751,9 +822,7 @@ const struct ib_gid_attr *rdma_find_gid_by_filter(
 	table = rdma_gid_table(ib_dev, port);
 
 	read_lock_irqsave(&table->rwlock, flags);
-	for (i = 0; i < table->sz; i++) {
-		struct ib_gid_table_entry *entry = table->data_vec[i];
-
+	hlist_for_each_entry(entry, gid_hash_head(table, gid), hnode) {
 		if (!is_gid_entry_valid(entry))
 			continue;
 
@@ -781,12 +850,21 @@ static struct ib_gid_table *alloc_gid_table(int sz)
 	if (!table->data_vec)
 		goto err_free_table;
 
+	/* One bucket per slot keeps chains short even for full tables */
+	table->hash_mask = roundup_pow_of_two(max(sz, 1)) - 1;
+	table->hash = kvcalloc(table->hash_mask + 1, sizeof(*table->hash),
+			       GFP_KERNEL);
+	if (!table->hash)
+		goto err_free_data_vec;
+
 	mutex_init(&table->lock);
 
 	table->sz = sz;
 	rwlock_init(&table->rwlock);
 	return table;
 
+err_free_data_vec:
+	kfree(table->data_vec);
 err_free_table:
 	kfree(table);
 	return NULL;
@@ -815,6 +893,7 @@ static void release_gid_table(struct ib_device *device,
 		return;
 
 	mutex_destroy(&table->lock);
+	kvfree(table->hash);
 	kfree(table->data_vec);
 	kfree(table);
 }
@@ -1026,24 +1105,19 @@ const struct ib_gid_attr *rdma_find_gid(struct ib_device *device,
 	if (ndev)
 		mask |= GID_ATTR_FIND_MASK_NETDEV;
 
+	rcu_read_lock();
 	rdma_for_each_port(device, p) {
+		struct ib_gid_table_entry *entry;
 		struct ib_gid_table *table;
-		unsigned long flags;
-		int index;
 
 		table = device->port_data[p].cache.gid;
-		read_lock_irqsave(&table->rwlock, flags);
-		index = find_gid(table, gid, &gid_attr_val, false, mask, NULL);
-		if (index >= 0) {
-			const struct ib_gid_attr *attr;
-
-			get_gid_entry(table->data_vec[index]);
-			attr = &table->data_vec[index]->attr;
-			read_unlock_irqrestore(&table->rwlock, flags);
-			return attr;
+		entry = find_gid_entry(table, gid, &gid_attr_val, false, mask);
+		if (entry && kref_get_unless_zero(&entry->kref)) {
+			rcu_read_unlock();
+			return &entry->attr;
 		}
-		read_unlock_irqrestore(&table->rwlock, flags);
 	}
+	rcu_read_unlock();
 
 	return ERR_PTR(-ENOENT);
 }
@@ -1727,3 +1801,7 @@ bool rdma_check_gid_user_access(const struct ib_gid_attr *attr)
 	return allow;
 }
 
+
+#if IS_ENABLED(CONFIG_INFINIBAND_GID_CACHE_KUNIT_TEST)
+#include "cache_kunit.c"
+#endif
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0 OR Linux-OpenIB
+/*
+ * Copyright (c) 2022 NVIDIA Corporation & Affiliates. All rights reserved.
+ *
+ * KUnit tests for the GID table hash. Included from cache.c so that the
+ * table helpers can be exercised without a registered device.
+ */
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <net/ipv6.h>
+
+#define GID_TEST_ENTRIES	8192
+/* One spare slot for the free slot lookup */
+#define GID_TEST_TABLE_SZ	(GID_TEST_ENTRIES + 1)
+#define GID_TEST_MASK		(GID_ATTR_FIND_MASK_GID | \
+				 GID_ATTR_FIND_MASK_GID_TYPE)
+
+struct gid_cache_test {
+	struct ib_device *device;
+	struct ib_gid_table *table;
+};
+
+/* IPv4 mapped GIDs, as a host with one address per container has */
+static void gid_cache_test_gid(union ib_gid *gid, u32 i)
+{
+	ipv6_addr_set_v4mapped(htonl(0x0a000000 + i),
+			       (struct in6_addr *)gid->raw);
+}
+
+static int gid_cache_test_init(struct kunit *test)
+{
+	struct ib_gid_table_entry *entry;
+	struct ib_gid_attr attr = {};
+	struct gid_cache_test *t;
+	u32 i;
+
+	t = kunit_kzalloc(test, sizeof(*t), GFP_KERNEL);
+	if (!t)
+		return -ENOMEM;
+	t->device = kunit_kzalloc(test, sizeof(*t->device), GFP_KERNEL);
+	if (!t->device)
+		return -ENOMEM;
+	t->table = alloc_gid_table(GID_TEST_TABLE_SZ);
+	if (!t->table)
+		return -ENOMEM;
+	test->priv = t;
+
+	attr.device = t->device;
+	attr.port_num = 1;
+	attr.gid_type = IB_GID_TYPE_ROCE_UDP_ENCAP;
+	mutex_lock(&t->table->lock);
+	for (i = 0; i < GID_TEST_ENTRIES; i++) {
+		gid_cache_test_gid(&attr.gid, i);
+		attr.index = i;
+		entry = alloc_gid_entry(&attr);
+		if (!entry) {
+			mutex_unlock(&t->table->lock);
+			return -ENOMEM;
+		}
+		store_gid_entry(t->table, entry);
+	}
+	mutex_unlock(&t->table->lock);
+	return 0;
+}
+
+static void gid_cache_test_exit(struct kunit *test)
+{
+	struct gid_cache_test *t = test->priv;
+	int i;
+
+	if (!t || !t->table)
+		return;
+	for (i = 0; i < t->table->sz; i++) {
+		kfree(t->table->data_vec[i]);
+		t->table->data_vec[i] = NULL;
+	}
+	release_gid_table(t->device, t->table);
+}
+
+static int gid_cache_test_find(struct ib_gid_table *table,
+			       const union ib_gid *gid,
+			       enum ib_gid_type gid_type, int *pempty)
+{
+	struct ib_gid_attr val = { .gid_type = gid_type };
+	unsigned long flags;
+	int ix;
+
+	read_lock_irqsave(&table->rwlock, flags);
+	ix = find_gid(table, gid, &val, false, GID_TEST_MASK, pempty);
+	read_unlock_irqrestore(&table->rwlock, flags);
+	return ix;
+}
+
+/* The walk over data_vec that find_gid() did before the hash */
+static int gid_cache_test_scan(struct ib_gid_table *table,
+			       const union ib_gid *gid,
+			       enum ib_gid_type gid_type)
+{
+	struct ib_gid_attr val = { .gid_type = gid_type };
+	unsigned long flags;
+	int i, ix = -1;
+
+	read_lock_irqsave(&table->rwlock, flags);
+	for (i = 0; i < table->sz; i++) {
+		struct ib_gid_table_entry *data = table->data_vec[i];
+
+		if (is_gid_entry_valid(data) &&
+		    gid_entry_match(table, data, gid, &val, false,
+				    GID_TEST_MASK)) {
+			ix = i;
+			break;
+		}
+	}
+	read_unlock_irqrestore(&table->rwlock, flags);
+	return ix;
+}
+
+static void gid_cache_find_all(struct kunit *test)
+{
+	struct gid_cache_test *t = test->priv;
+	union ib_gid gid;
+	u32 i;
+
+	for (i = 0; i < GID_TEST_ENTRIES; i++) {
+		gid_cache_test_gid(&gid, i);
+		KUNIT_EXPECT_EQ(test, gid_cache_test_find(t->table, &gid,
+				IB_GID_TYPE_ROCE_UDP_ENCAP, NULL), (int)i);
+	}
+
+	/* The GID type is matched within the bucket */
+	gid_cache_test_gid(&gid, 0);
+	KUNIT_EXPECT_EQ(test, gid_cache_test_find(t->table, &gid,
+			IB_GID_TYPE_ROCE, NULL), -1);
+
+	gid_cache_test_gid(&gid, GID_TEST_ENTRIES);
+	KUNIT_EXPECT_EQ(test, gid_cache_test_find(t->table, &gid,
+			IB_GID_TYPE_ROCE_UDP_ENCAP, NULL), -1);
+}
+
+static void gid_cache_find_empty(struct kunit *test)
+{
+	struct gid_cache_test *t = test->priv;
+	union ib_gid gid;
+	int empty;
+
+	/* A duplicate is reported without looking for a free slot */
+	gid_cache_test_gid(&gid, GID_TEST_ENTRIES / 2);
+	KUNIT_EXPECT_EQ(test, gid_cache_test_find(t->table, &gid,
+			IB_GID_TYPE_ROCE_UDP_ENCAP, &empty),
+			GID_TEST_ENTRIES / 2);
+	KUNIT_EXPECT_EQ(test, empty, -1);
+
+	gid_cache_test_gid(&gid, GID_TEST_ENTRIES);
+	KUNIT_EXPECT_EQ(test, gid_cache_test_find(t->table, &gid,
+			IB_GID_TYPE_ROCE_UDP_ENCAP, &empty), -1);
+	KUNIT_EXPECT_EQ(test, empty, GID_TEST_ENTRIES);
+}
+
+static void gid_cache_lookup_cost(struct kunit *test)
+{
+	struct gid_cache_test *t = test->priv;
+	u64 start, hashed, linear;
+	union ib_gid gid;
+	u32 i;
+
+	start = ktime_get_ns();
+	for (i = 0; i < GID_TEST_ENTRIES; i++) {
+		gid_cache_test_gid(&gid, i);
+		KUNIT_ASSERT_EQ(test, gid_cache_test_find(t->table, &gid,
+				IB_GID_TYPE_ROCE_UDP_ENCAP, NULL), (int)i);
+	}
+	hashed = ktime_get_ns() - start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < GID_TEST_ENTRIES; i++) {
+		gid_cache_test_gid(&gid, i);
+		KUNIT_ASSERT_EQ(test, gid_cache_test_scan(t->table, &gid,
+				IB_GID_TYPE_ROCE_UDP_ENCAP), (int)i);
+		cond_resched();
+	}
+	linear = ktime_get_ns() - start;
+
+	kunit_info(test, "%d GIDs: hashed lookup %llu ns, linear walk %llu ns\n",
+		   GID_TEST_ENTRIES, div_u64(hashed, GID_TEST_ENTRIES),
+		   div_u64(linear, GID_TEST_ENTRIES));
+	KUNIT_EXPECT_LT(test, hashed, linear);
+}
+
+static struct kunit_case gid_cache_test_cases[] = {
+	KUNIT_CASE(gid_cache_find_all),
+	KUNIT_CASE(gid_cache_find_empty),
+	KUNIT_CASE(gid_cache_lookup_cost),
+	{}
+};
+
+static struct kunit_suite gid_cache_test_suite = {
+	.name = "ib_gid_cache",
+	.init = gid_cache_test_init,
+	.exit = gid_cache_test_exit,
+	.test_cases = gid_cache_test_cases,
+};
+
+kunit_test_suite(gid_cache_test_suite);
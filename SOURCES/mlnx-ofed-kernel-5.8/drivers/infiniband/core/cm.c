@@ -12,10 +12,11 @@
 #include <linux/device.h>
 #include <linux/module.h>
 #include <linux/err.h>
+#include <linux/hash.h>
 #include <linux/idr.h>
 #include <linux/interrupt.h>
 #include <linux/random.h>
-#include <linux/rbtree.h>
+#include <linux/rculist.h>
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/sysfs.h>
@@ -107,16 +108,34 @@ static struct ib_client cm_client = {
 	.remove = cm_remove_one
 };
 
+/*
+ * The lookup tables are hashed and searched under RCU.  Each bucket of the
+ * remote tables has its own lock for inserts and removals, so that REQs and
+ * REPs arriving on different connections do not contend.  Listens are rare,
+ * they are serialized by listen_lock instead.
+ */
+#define CM_HASH_BITS	10
+#define CM_HASH_SIZE	(1 << CM_HASH_BITS)
+
+struct cm_hash_bucket {
+	spinlock_t lock;
+	struct hlist_head head;
+};
+
 static struct ib_cm {
 	spinlock_t lock;
 	struct list_head device_list;
 	rwlock_t device_lock;
-	struct rb_root listen_service_table;
+	/* Listeners with a full service mask, hashed by device and service ID */
+	struct hlist_head listen_service_table[CM_HASH_SIZE];
+	/* Listeners with a partial service mask */
+	struct hlist_head listen_mask_list;
+	spinlock_t listen_lock;
 	u64 listen_service_id;
-	/* struct rb_root peer_service_table; todo: fix peer to peer */
-	struct rb_root remote_qp_table;
-	struct rb_root remote_id_table;
-	struct rb_root remote_sidr_table;
+	/* todo: fix peer to peer */
+	struct cm_hash_bucket remote_qp_table[CM_HASH_SIZE];
+	struct cm_hash_bucket remote_id_table[CM_HASH_SIZE];
+	struct cm_hash_bucket remote_sidr_table[CM_HASH_SIZE];
 	struct xarray local_id_table;
 	u32 local_id_next;
 	__be32 random_id_operand;
@@ -188,14 +207,15 @@ struct cm_work {
 	__be32 local_id;			/* Established / timewait */
 	__be32 remote_id;
 	struct ib_cm_event cm_event;
+	struct rcu_head rcu;
 	struct sa_path_rec path[];
 };
 
 struct cm_timewait_info {
 	struct cm_work work;
 	struct list_head list;
-	struct rb_node remote_qp_node;
-	struct rb_node remote_id_node;
+	struct hlist_node remote_qp_node;
+	struct hlist_node remote_id_node;
 	__be64 remote_ca_guid;
 	__be32 remote_qpn;
 	u8 inserted_remote_qp;
@@ -205,14 +225,14 @@ struct cm_timewait_info {
 struct cm_id_private {
 	struct ib_cm_id	id;
 
-	struct rb_node service_node;
-	struct rb_node sidr_id_node;
+	struct hlist_node service_node;
+	struct hlist_node sidr_id_node;
 	u32 sidr_slid;
 	spinlock_t lock;	/* Do not acquire inside cm.lock */
 	struct completion comp;
 	refcount_t refcount;
 	/* Number of clients sharing this ib_cm_id. Only valid for listeners.
-	 * Protected by the cm.lock spinlock.
+	 * Protected by the cm.listen_lock spinlock.
 	 */
 	int listen_sharecount;
 	struct rcu_head rcu;
@@ -581,29 +601,61 @@ static struct cm_id_private *cm_acquire_id(__be32 local_id, __be32 remote_id)
 	return cm_id_priv;
 }
 
-/*
- * Trivial helpers to strip endian annotation and compare; the
- * endianness doesn't actually matter since we just need a stable
- * order for the RB tree.
- */
-static int be32_lt(__be32 a, __be32 b)
+static u32 cm_listen_hash(struct ib_device *device, __be64 service_id)
+{
+	return hash_64((__force u64)service_id ^ (unsigned long)device,
+		       CM_HASH_BITS);
+}
+
+static u32 cm_remote_hash(__be64 remote_ca_guid, __be32 id)
 {
-	return (__force u32) a < (__force u32) b;
+	return hash_64((__force u64)remote_ca_guid ^ (__force u32)id,
+		       CM_HASH_BITS);
 }
 
-static int be32_gt(__be32 a, __be32 b)
+static bool cm_listen_overlaps(struct cm_id_private *a,
+			       struct cm_id_private *b)
 {
-	return (__force u32) a > (__force u32) b;
+	return a->id.device == b->id.device &&
+	       (a->id.service_mask & b->id.service_id) ==
+	       (b->id.service_mask & a->id.service_id);
 }
 
-static int be64_lt(__be64 a, __be64 b)
+static bool cm_listen_is_masked(struct cm_id_private *cm_id_priv)
 {
-	return (__force u64) a < (__force u64) b;
+	return cm_id_priv->id.service_mask != ~cpu_to_be64(0);
 }
 
-static int be64_gt(__be64 a, __be64 b)
+static struct cm_id_private *
+cm_find_listen_overlap(struct cm_id_private *cm_id_priv)
 {
-	return (__force u64) a > (__force u64) b;
+	struct cm_id_private *cur_cm_id_priv;
+	int i;
+
+	lockdep_assert_held(&cm.listen_lock);
+
+	hlist_for_each_entry(cur_cm_id_priv, &cm.listen_mask_list,
+			     service_node)
+		if (cm_listen_overlaps(cur_cm_id_priv, cm_id_priv))
+			return cur_cm_id_priv;
+
+	if (!cm_listen_is_masked(cm_id_priv)) {
+		i = cm_listen_hash(cm_id_priv->id.device,
+				   cm_id_priv->id.service_id);
+		hlist_for_each_entry(cur_cm_id_priv,
+				     &cm.listen_service_table[i], service_node)
+			if (cm_listen_overlaps(cur_cm_id_priv, cm_id_priv))
+				return cur_cm_id_priv;
+		return NULL;
+	}
+
+	/* A masked listen may cover any of the hashed IDs */
+	for (i = 0; i < CM_HASH_SIZE; i++)
+		hlist_for_each_entry(cur_cm_id_priv,
+				     &cm.listen_service_table[i], service_node)
+			if (cm_listen_overlaps(cur_cm_id_priv, cm_id_priv))
+				return cur_cm_id_priv;
+	return NULL;
 }
 
 /*
@@ -614,202 +666,190 @@ static int be64_gt(__be64 a, __be64 b)
 static struct cm_id_private *cm_insert_listen(struct cm_id_private *cm_id_priv,
 					      ib_cm_handler shared_handler)
 {
-	struct rb_node **link = &cm.listen_service_table.rb_node;
-	struct rb_node *parent = NULL;
 	struct cm_id_private *cur_cm_id_priv;
-	__be64 service_id = cm_id_priv->id.service_id;
-	__be64 service_mask = cm_id_priv->id.service_mask;
 	unsigned long flags;
 
-	spin_lock_irqsave(&cm.lock, flags);
-	while (*link) {
-		parent = *link;
-		cur_cm_id_priv = rb_entry(parent, struct cm_id_private,
-					  service_node);
-		if ((cur_cm_id_priv->id.service_mask & service_id) ==
-		    (service_mask & cur_cm_id_priv->id.service_id) &&
-		    (cm_id_priv->id.device == cur_cm_id_priv->id.device)) {
-			/*
-			 * Sharing an ib_cm_id with different handlers is not
-			 * supported
-			 */
-			if (cur_cm_id_priv->id.cm_handler != shared_handler ||
-			    cur_cm_id_priv->id.context ||
-			    WARN_ON(!cur_cm_id_priv->id.cm_handler)) {
-				spin_unlock_irqrestore(&cm.lock, flags);
-				return NULL;
-			}
-			refcount_inc(&cur_cm_id_priv->refcount);
-			cur_cm_id_priv->listen_sharecount++;
-			spin_unlock_irqrestore(&cm.lock, flags);
-			return cur_cm_id_priv;
+	spin_lock_irqsave(&cm.listen_lock, flags);
+	cur_cm_id_priv = cm_find_listen_overlap(cm_id_priv);
+	if (cur_cm_id_priv) {
+		/*
+		 * Sharing an ib_cm_id with different handlers is not
+		 * supported
+		 */
+		if (cur_cm_id_priv->id.cm_handler != shared_handler ||
+		    cur_cm_id_priv->id.context ||
+		    WARN_ON(!cur_cm_id_priv->id.cm_handler)) {
+			spin_unlock_irqrestore(&cm.listen_lock, flags);
+			return NULL;
 		}
-
-		if (cm_id_priv->id.device < cur_cm_id_priv->id.device)
-			link = &(*link)->rb_left;
-		else if (cm_id_priv->id.device > cur_cm_id_priv->id.device)
-			link = &(*link)->rb_right;
-		else if (be64_lt(service_id, cur_cm_id_priv->id.service_id))
-			link = &(*link)->rb_left;
-		else if (be64_gt(service_id, cur_cm_id_priv->id.service_id))
-			link = &(*link)->rb_right;
-		else
-			link = &(*link)->rb_right;
+		refcount_inc(&cur_cm_id_priv->refcount);
+		cur_cm_id_priv->listen_sharecount++;
+		spin_unlock_irqrestore(&cm.listen_lock, flags);
+		return cur_cm_id_priv;
 	}
+
 	cm_id_priv->listen_sharecount++;
-	rb_link_node(&cm_id_priv->service_node, parent, link);
-	rb_insert_color(&cm_id_priv->service_node, &cm.listen_service_table);
-	spin_unlock_irqrestore(&cm.lock, flags);
+	if (cm_listen_is_masked(cm_id_priv))
+		hlist_add_head_rcu(&cm_id_priv->service_node,
+				   &cm.listen_mask_list);
+	else
+		hlist_add_head_rcu(&cm_id_priv->service_node,
+				   &cm.listen_service_table[cm_listen_hash(
+					   cm_id_priv->id.device,
+					   cm_id_priv->id.service_id)]);
+	spin_unlock_irqrestore(&cm.listen_lock, flags);
 	return cm_id_priv;
 }
 
+static void cm_remove_listen(struct cm_id_private *cm_id_priv)
+{
+	lockdep_assert_held(&cm.listen_lock);
+
+	hlist_del_init_rcu(&cm_id_priv->service_node);
+}
+
 static struct cm_id_private *cm_find_listen(struct ib_device *device,
 					    __be64 service_id)
 {
-	struct rb_node *node = cm.listen_service_table.rb_node;
 	struct cm_id_private *cm_id_priv;
 
-	while (node) {
-		cm_id_priv = rb_entry(node, struct cm_id_private, service_node);
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(cm_id_priv,
+				 &cm.listen_service_table[cm_listen_hash(
+					 device, service_id)], service_node) {
+		if (cm_id_priv->id.service_id == service_id &&
+		    cm_id_priv->id.device == device &&
+		    refcount_inc_not_zero(&cm_id_priv->refcount))
+			goto out;
+	}
+	hlist_for_each_entry_rcu(cm_id_priv, &cm.listen_mask_list,
+				 service_node) {
 		if ((cm_id_priv->id.service_mask & service_id) ==
 		     cm_id_priv->id.service_id &&
-		    (cm_id_priv->id.device == device)) {
-			refcount_inc(&cm_id_priv->refcount);
-			return cm_id_priv;
-		}
-		if (device < cm_id_priv->id.device)
-			node = node->rb_left;
-		else if (device > cm_id_priv->id.device)
-			node = node->rb_right;
-		else if (be64_lt(service_id, cm_id_priv->id.service_id))
-			node = node->rb_left;
-		else if (be64_gt(service_id, cm_id_priv->id.service_id))
-			node = node->rb_right;
-		else
-			node = node->rb_right;
+		    cm_id_priv->id.device == device &&
+		    refcount_inc_not_zero(&cm_id_priv->refcount))
+			goto out;
 	}
-	return NULL;
+	cm_id_priv = NULL;
+out:
+	rcu_read_unlock();
+	return cm_id_priv;
 }
 
+/*
+ * The remote tables return the colliding entry on a failed insert.  Callers
+ * must hold rcu_read_lock() while they look at it; timewait_info is freed
+ * through RCU so that it stays valid even if it is removed concurrently.
+ */
 static struct cm_timewait_info *
 cm_insert_remote_id(struct cm_timewait_info *timewait_info)
 {
-	struct rb_node **link = &cm.remote_id_table.rb_node;
-	struct rb_node *parent = NULL;
 	struct cm_timewait_info *cur_timewait_info;
 	__be64 remote_ca_guid = timewait_info->remote_ca_guid;
 	__be32 remote_id = timewait_info->work.remote_id;
+	struct cm_hash_bucket *bucket;
+	unsigned long flags;
 
-	while (*link) {
-		parent = *link;
-		cur_timewait_info = rb_entry(parent, struct cm_timewait_info,
-					     remote_id_node);
-		if (be32_lt(remote_id, cur_timewait_info->work.remote_id))
-			link = &(*link)->rb_left;
-		else if (be32_gt(remote_id, cur_timewait_info->work.remote_id))
-			link = &(*link)->rb_right;
-		else if (be64_lt(remote_ca_guid, cur_timewait_info->remote_ca_guid))
-			link = &(*link)->rb_left;
-		else if (be64_gt(remote_ca_guid, cur_timewait_info->remote_ca_guid))
-			link = &(*link)->rb_right;
-		else
+	bucket = &cm.remote_id_table[cm_remote_hash(remote_ca_guid, remote_id)];
+	spin_lock_irqsave(&bucket->lock, flags);
+	hlist_for_each_entry(cur_timewait_info, &bucket->head, remote_id_node) {
+		if (cur_timewait_info->work.remote_id == remote_id &&
+		    cur_timewait_info->remote_ca_guid == remote_ca_guid) {
+			spin_unlock_irqrestore(&bucket->lock, flags);
 			return cur_timewait_info;
+		}
 	}
 	timewait_info->inserted_remote_id = 1;
-	rb_link_node(&timewait_info->remote_id_node, parent, link);
-	rb_insert_color(&timewait_info->remote_id_node, &cm.remote_id_table);
+	hlist_add_head_rcu(&timewait_info->remote_id_node, &bucket->head);
+	spin_unlock_irqrestore(&bucket->lock, flags);
 	return NULL;
 }
 
 static struct cm_id_private *cm_find_remote_id(__be64 remote_ca_guid,
 					       __be32 remote_id)
 {
-	struct rb_node *node = cm.remote_id_table.rb_node;
 	struct cm_timewait_info *timewait_info;
 	struct cm_id_private *res = NULL;
+	struct cm_hash_bucket *bucket;
 
-	spin_lock_irq(&cm.lock);
-	while (node) {
-		timewait_info = rb_entry(node, struct cm_timewait_info,
-					 remote_id_node);
-		if (be32_lt(remote_id, timewait_info->work.remote_id))
-			node = node->rb_left;
-		else if (be32_gt(remote_id, timewait_info->work.remote_id))
-			node = node->rb_right;
-		else if (be64_lt(remote_ca_guid, timewait_info->remote_ca_guid))
-			node = node->rb_left;
-		else if (be64_gt(remote_ca_guid, timewait_info->remote_ca_guid))
-			node = node->rb_right;
-		else {
+	bucket = &cm.remote_id_table[cm_remote_hash(remote_ca_guid, remote_id)];
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(timewait_info, &bucket->head, remote_id_node) {
+		if (timewait_info->work.remote_id == remote_id &&
+		    timewait_info->remote_ca_guid == remote_ca_guid) {
 			res = cm_acquire_id(timewait_info->work.local_id,
-					     timewait_info->work.remote_id);
+					    timewait_info->work.remote_id);
 			break;
 		}
 	}
-	spin_unlock_irq(&cm.lock);
+	rcu_read_unlock();
 	return res;
 }
 
 static struct cm_timewait_info *
 cm_insert_remote_qpn(struct cm_timewait_info *timewait_info)
 {
-	struct rb_node **link = &cm.remote_qp_table.rb_node;
-	struct rb_node *parent = NULL;
 	struct cm_timewait_info *cur_timewait_info;
 	__be64 remote_ca_guid = timewait_info->remote_ca_guid;
 	__be32 remote_qpn = timewait_info->remote_qpn;
+	struct cm_hash_bucket *bucket;
+	unsigned long flags;
 
-	while (*link) {
-		parent = *link;
-		cur_timewait_info = rb_entry(parent, struct cm_timewait_info,
-					     remote_qp_node);
-		if (be32_lt(remote_qpn, cur_timewait_info->remote_qpn))
-			link = &(*link)->rb_left;
-		else if (be32_gt(remote_qpn, cur_timewait_info->remote_qpn))
-			link = &(*link)->rb_right;
-		else if (be64_lt(remote_ca_guid, cur_timewait_info->remote_ca_guid))
-			link = &(*link)->rb_left;
-		else if (be64_gt(remote_ca_guid, cur_timewait_info->remote_ca_guid))
-			link = &(*link)->rb_right;
-		else
+	bucket = &cm.remote_qp_table[cm_remote_hash(remote_ca_guid,
+						    remote_qpn)];
+	spin_lock_irqsave(&bucket->lock, flags);
+	hlist_for_each_entry(cur_timewait_info, &bucket->head, remote_qp_node) {
+		if (cur_timewait_info->remote_qpn == remote_qpn &&
+		    cur_timewait_info->remote_ca_guid == remote_ca_guid) {
+			spin_unlock_irqrestore(&bucket->lock, flags);
 			return cur_timewait_info;
+		}
 	}
 	timewait_info->inserted_remote_qp = 1;
-	rb_link_node(&timewait_info->remote_qp_node, parent, link);
-	rb_insert_color(&timewait_info->remote_qp_node, &cm.remote_qp_table);
+	hlist_add_head_rcu(&timewait_info->remote_qp_node, &bucket->head);
+	spin_unlock_irqrestore(&bucket->lock, flags);
 	return NULL;
 }
 
+static struct cm_hash_bucket *cm_sidr_bucket(struct cm_id_private *cm_id_priv)
+{
+	return &cm.remote_sidr_table[hash_64(
+		(u64)cm_id_priv->sidr_slid << 32 |
+		(__force u32)cm_id_priv->id.remote_id, CM_HASH_BITS)];
+}
+
 static struct cm_id_private *
 cm_insert_remote_sidr(struct cm_id_private *cm_id_priv)
 {
-	struct rb_node **link = &cm.remote_sidr_table.rb_node;
-	struct rb_node *parent = NULL;
+	struct cm_hash_bucket *bucket = cm_sidr_bucket(cm_id_priv);
 	struct cm_id_private *cur_cm_id_priv;
 	__be32 remote_id = cm_id_priv->id.remote_id;
+	unsigned long flags;
 
-	while (*link) {
-		parent = *link;
-		cur_cm_id_priv = rb_entry(parent, struct cm_id_private,
-					  sidr_id_node);
-		if (be32_lt(remote_id, cur_cm_id_priv->id.remote_id))
-			link = &(*link)->rb_left;
-		else if (be32_gt(remote_id, cur_cm_id_priv->id.remote_id))
-			link = &(*link)->rb_right;
-		else {
-			if (cur_cm_id_priv->sidr_slid < cm_id_priv->sidr_slid)
-				link = &(*link)->rb_left;
-			else if (cur_cm_id_priv->sidr_slid > cm_id_priv->sidr_slid)
-				link = &(*link)->rb_right;
-			else
-				return cur_cm_id_priv;
+	spin_lock_irqsave(&bucket->lock, flags);
+	hlist_for_each_entry(cur_cm_id_priv, &bucket->head, sidr_id_node) {
+		if (cur_cm_id_priv->id.remote_id == remote_id &&
+		    cur_cm_id_priv->sidr_slid == cm_id_priv->sidr_slid) {
+			spin_unlock_irqrestore(&bucket->lock, flags);
+			return cur_cm_id_priv;
 		}
 	}
-	rb_link_node(&cm_id_priv->sidr_id_node, parent, link);
-	rb_insert_color(&cm_id_priv->sidr_id_node, &cm.remote_sidr_table);
+	hlist_add_head_rcu(&cm_id_priv->sidr_id_node, &bucket->head);
+	spin_unlock_irqrestore(&bucket->lock, flags);
 	return NULL;
 }
 
+static void cm_remove_remote_sidr(struct cm_id_private *cm_id_priv)
+{
+	struct cm_hash_bucket *bucket = cm_sidr_bucket(cm_id_priv);
+	unsigned long flags;
+
+	spin_lock_irqsave(&bucket->lock, flags);
+	if (!hlist_unhashed(&cm_id_priv->sidr_id_node))
+		hlist_del_init_rcu(&cm_id_priv->sidr_id_node);
+	spin_unlock_irqrestore(&bucket->lock, flags);
+}
+
 static struct cm_id_private *cm_alloc_id_priv(struct ib_device *device,
 					      ib_cm_handler cm_handler,
 					      void *context)
@@ -828,8 +868,8 @@ static struct cm_id_private *cm_alloc_id_priv(struct ib_device *device,
 	cm_id_priv->id.context = context;
 	cm_id_priv->id.remote_cm_qpn = 1;
 
-	RB_CLEAR_NODE(&cm_id_priv->service_node);
-	RB_CLEAR_NODE(&cm_id_priv->sidr_id_node);
+	INIT_HLIST_NODE(&cm_id_priv->service_node);
+	INIT_HLIST_NODE(&cm_id_priv->sidr_id_node);
 	spin_lock_init(&cm_id_priv->lock);
 	init_completion(&cm_id_priv->comp);
 	INIT_LIST_HEAD(&cm_id_priv->work_list);
@@ -890,7 +930,8 @@ static void cm_free_work(struct cm_work *work)
 {
 	if (work->mad_recv_wc)
 		ib_free_recv_mad(work->mad_recv_wc);
-	kfree(work);
+	/* A timewait_info may still be seen by readers of the remote tables */
+	kfree_rcu(work, rcu);
 }
 
 static void cm_queue_work_unlock(struct cm_id_private *cm_id_priv,
@@ -951,18 +992,37 @@ static u8 cm_ack_timeout(u8 ca_ack_delay, u8 packet_life_time)
 static void cm_remove_remote(struct cm_id_private *cm_id_priv)
 {
 	struct cm_timewait_info *timewait_info = cm_id_priv->timewait_info;
+	struct cm_hash_bucket *bucket;
+	unsigned long flags;
 
 	if (timewait_info->inserted_remote_id) {
-		rb_erase(&timewait_info->remote_id_node, &cm.remote_id_table);
+		bucket = &cm.remote_id_table[cm_remote_hash(
+			timewait_info->remote_ca_guid,
+			timewait_info->work.remote_id)];
+		spin_lock_irqsave(&bucket->lock, flags);
+		hlist_del_rcu(&timewait_info->remote_id_node);
+		spin_unlock_irqrestore(&bucket->lock, flags);
 		timewait_info->inserted_remote_id = 0;
 	}
 
 	if (timewait_info->inserted_remote_qp) {
-		rb_erase(&timewait_info->remote_qp_node, &cm.remote_qp_table);
+		bucket = &cm.remote_qp_table[cm_remote_hash(
+			timewait_info->remote_ca_guid,
+			timewait_info->remote_qpn)];
+		spin_lock_irqsave(&bucket->lock, flags);
+		hlist_del_rcu(&timewait_info->remote_qp_node);
+		spin_unlock_irqrestore(&bucket->lock, flags);
 		timewait_info->inserted_remote_qp = 0;
 	}
 }
 
+static void cm_free_timewait_info(struct cm_id_private *cm_id_priv)
+{
+	cm_remove_remote(cm_id_priv);
+	kfree_rcu(cm_id_priv->timewait_info, work.rcu);
+	cm_id_priv->timewait_info = NULL;
+}
+
 static struct cm_timewait_info *cm_create_timewait_info(__be32 local_id)
 {
 	struct cm_timewait_info *timewait_info;
@@ -989,8 +1049,9 @@ static void cm_enter_timewait(struct cm_id_private *cm_id_priv)
 	if (!cm_dev)
 		return;
 
-	spin_lock_irqsave(&cm.lock, flags);
 	cm_remove_remote(cm_id_priv);
+
+	spin_lock_irqsave(&cm.lock, flags);
 	list_add_tail(&cm_id_priv->timewait_info->list, &cm.timewait_list);
 	spin_unlock_irqrestore(&cm.lock, flags);
 
@@ -1019,18 +1080,11 @@ static void cm_enter_timewait(struct cm_id_private *cm_id_priv)
 
 static void cm_reset_to_idle(struct cm_id_private *cm_id_priv)
 {
-	unsigned long flags;
-
 	lockdep_assert_held(&cm_id_priv->lock);
 
 	cm_id_priv->id.state = IB_CM_IDLE;
-	if (cm_id_priv->timewait_info) {
-		spin_lock_irqsave(&cm.lock, flags);
-		cm_remove_remote(cm_id_priv);
-		spin_unlock_irqrestore(&cm.lock, flags);
-		kfree(cm_id_priv->timewait_info);
-		cm_id_priv->timewait_info = NULL;
-	}
+	if (cm_id_priv->timewait_info)
+		cm_free_timewait_info(cm_id_priv);
 }
 
 static void cm_destroy_id(struct ib_cm_id *cm_id, int err)
@@ -1043,19 +1097,18 @@ static void cm_destroy_id(struct ib_cm_id *cm_id, int err)
 retest:
 	switch (cm_id->state) {
 	case IB_CM_LISTEN:
-		spin_lock(&cm.lock);
+		spin_lock(&cm.listen_lock);
 		if (--cm_id_priv->listen_sharecount > 0) {
 			/* The id is still shared. */
 			WARN_ON(refcount_read(&cm_id_priv->refcount) == 1);
-			spin_unlock(&cm.lock);
+			spin_unlock(&cm.listen_lock);
 			spin_unlock_irq(&cm_id_priv->lock);
 			cm_deref_id(cm_id_priv);
 			return;
 		}
 		cm_id->state = IB_CM_IDLE;
-		rb_erase(&cm_id_priv->service_node, &cm.listen_service_table);
-		RB_CLEAR_NODE(&cm_id_priv->service_node);
-		spin_unlock(&cm.lock);
+		cm_remove_listen(cm_id_priv);
+		spin_unlock(&cm.listen_lock);
 		break;
 	case IB_CM_SIDR_REQ_SENT:
 		cm_id->state = IB_CM_IDLE;
@@ -1126,19 +1179,13 @@ retest:
 	}
 	WARN_ON(cm_id->state != IB_CM_IDLE);
 
-	spin_lock(&cm.lock);
 	/* Required for cleanup paths related cm_req_handler() */
-	if (cm_id_priv->timewait_info) {
-		cm_remove_remote(cm_id_priv);
-		kfree(cm_id_priv->timewait_info);
-		cm_id_priv->timewait_info = NULL;
-	}
+	if (cm_id_priv->timewait_info)
+		cm_free_timewait_info(cm_id_priv);
 
 	WARN_ON(cm_id_priv->listen_sharecount);
-	WARN_ON(!RB_EMPTY_NODE(&cm_id_priv->service_node));
-	if (!RB_EMPTY_NODE(&cm_id_priv->sidr_id_node))
-		rb_erase(&cm_id_priv->sidr_id_node, &cm.remote_sidr_table);
-	spin_unlock(&cm.lock);
+	WARN_ON(!hlist_unhashed(&cm_id_priv->service_node));
+	cm_remove_remote_sidr(cm_id_priv);
 	spin_unlock_irq(&cm_id_priv->lock);
 
 	xa_erase(&cm.local_id_table, cm_local_id(cm_id->local_id));
@@ -1990,12 +2037,12 @@ static struct cm_id_private *cm_match_req(struct cm_work *work,
 	req_msg = (struct cm_req_msg *)work->mad_recv_wc->recv_buf.mad;
 
 	/* Check for possible duplicate REQ. */
-	spin_lock_irq(&cm.lock);
+	rcu_read_lock();
 	timewait_info = cm_insert_remote_id(cm_id_priv->timewait_info);
 	if (timewait_info) {
 		cur_cm_id_priv = cm_acquire_id(timewait_info->work.local_id,
 					   timewait_info->work.remote_id);
-		spin_unlock_irq(&cm.lock);
+		rcu_read_unlock();
 		if (cur_cm_id_priv) {
 			cm_dup_req_handler(work, cur_cm_id_priv);
 			cm_deref_id(cur_cm_id_priv);
@@ -2010,7 +2057,7 @@ static struct cm_id_private *cm_match_req(struct cm_work *work,
 		cur_cm_id_priv = cm_acquire_id(timewait_info->work.local_id,
 					   timewait_info->work.remote_id);
 
-		spin_unlock_irq(&cm.lock);
+		rcu_read_unlock();
 		cm_issue_rej(work->port, work->mad_recv_wc,
 			     IB_CM_REJ_STALE_CONN, CM_MSG_RESPONSE_REQ,
 			     NULL, 0);
@@ -2021,19 +2068,19 @@ static struct cm_id_private *cm_match_req(struct cm_work *work,
 		return NULL;
 	}
 
+	rcu_read_unlock();
+
 	/* Find matching listen request. */
 	listen_cm_id_priv = cm_find_listen(
 		cm_id_priv->id.device,
 		cpu_to_be64(IBA_GET(CM_REQ_SERVICE_ID, req_msg)));
 	if (!listen_cm_id_priv) {
 		cm_remove_remote(cm_id_priv);
-		spin_unlock_irq(&cm.lock);
 		cm_issue_rej(work->port, work->mad_recv_wc,
 			     IB_CM_REJ_INVALID_SERVICE_ID, CM_MSG_RESPONSE_REQ,
 			     NULL, 0);
 		return NULL;
 	}
-	spin_unlock_irq(&cm.lock);
 	return listen_cm_id_priv;
 }
 
@@ -2512,10 +2559,10 @@ static int cm_rep_handler(struct cm_work *work)
 		cpu_to_be64(IBA_GET(CM_REP_LOCAL_CA_GUID, rep_msg));
 	cm_id_priv->timewait_info->remote_qpn = cm_rep_get_qpn(rep_msg, cm_id_priv->qp_type);
 
-	spin_lock(&cm.lock);
+	rcu_read_lock();
 	/* Check for duplicate REP. */
 	if (cm_insert_remote_id(cm_id_priv->timewait_info)) {
-		spin_unlock(&cm.lock);
+		rcu_read_unlock();
 		spin_unlock_irq(&cm_id_priv->lock);
 		ret = -EINVAL;
 		trace_icm_insert_failed_err(
@@ -2529,7 +2576,7 @@ static int cm_rep_handler(struct cm_work *work)
 		cur_cm_id_priv = cm_acquire_id(timewait_info->work.local_id,
 					   timewait_info->work.remote_id);
 
-		spin_unlock(&cm.lock);
+		rcu_read_unlock();
 		spin_unlock_irq(&cm_id_priv->lock);
 		cm_issue_rej(work->port, work->mad_recv_wc,
 			     IB_CM_REJ_STALE_CONN, CM_MSG_RESPONSE_REP,
@@ -2546,7 +2593,7 @@ static int cm_rep_handler(struct cm_work *work)
 
 		goto error;
 	}
-	spin_unlock(&cm.lock);
+	rcu_read_unlock();
 
 	cm_id_priv->id.state = IB_CM_REP_RCVD;
 	cm_id_priv->id.remote_id =
@@ -3589,10 +3636,8 @@ static int cm_sidr_req_handler(struct cm_work *work)
 	if (ret)
 		goto out;
 
-	spin_lock_irq(&cm.lock);
 	listen_cm_id_priv = cm_insert_remote_sidr(cm_id_priv);
 	if (listen_cm_id_priv) {
-		spin_unlock_irq(&cm.lock);
 		atomic_long_inc(&work->port->counters[CM_RECV_DUPLICATES]
 						     [CM_SIDR_REQ_COUNTER]);
 		goto out; /* Duplicate message. */
@@ -3601,13 +3646,11 @@ static int cm_sidr_req_handler(struct cm_work *work)
 	listen_cm_id_priv = cm_find_listen(cm_id_priv->id.device,
 					   cm_id_priv->id.service_id);
 	if (!listen_cm_id_priv) {
-		spin_unlock_irq(&cm.lock);
 		ib_send_cm_sidr_rep(&cm_id_priv->id,
 				    &(struct ib_cm_sidr_rep_param){
 					    .status = IB_SIDR_UNSUPPORTED });
 		goto out; /* No match. */
 	}
-	spin_unlock_irq(&cm.lock);
 
 	cm_id_priv->id.cm_handler = listen_cm_id_priv->id.cm_handler;
 	cm_id_priv->id.context = listen_cm_id_priv->id.context;
@@ -3665,7 +3708,6 @@ static int cm_send_sidr_rep_locked(struct cm_id_private *cm_id_priv,
 				   struct ib_cm_sidr_rep_param *param)
 {
 	struct ib_mad_send_buf *msg;
-	unsigned long flags;
 	int ret;
 
 	lockdep_assert_held(&cm_id_priv->lock);
@@ -3691,12 +3733,7 @@ static int cm_send_sidr_rep_locked(struct cm_id_private *cm_id_priv,
 		return ret;
 	}
 	cm_id_priv->id.state = IB_CM_IDLE;
-	spin_lock_irqsave(&cm.lock, flags);
-	if (!RB_EMPTY_NODE(&cm_id_priv->sidr_id_node)) {
-		rb_erase(&cm_id_priv->sidr_id_node, &cm.remote_sidr_table);
-		RB_CLEAR_NODE(&cm_id_priv->sidr_id_node);
-	}
-	spin_unlock_irqrestore(&cm.lock, flags);
+	cm_remove_remote_sidr(cm_id_priv);
 	return 0;
 }
 
@@ -4493,16 +4530,23 @@ static void cm_remove_one(struct ib_device *ib_device, void *client_data)
 
 static int __init ib_cm_init(void)
 {
-	int ret;
+	int ret, i;
 
 	INIT_LIST_HEAD(&cm.device_list);
 	rwlock_init(&cm.device_lock);
 	spin_lock_init(&cm.lock);
-	cm.listen_service_table = RB_ROOT;
+	spin_lock_init(&cm.listen_lock);
+	INIT_HLIST_HEAD(&cm.listen_mask_list);
+	for (i = 0; i < CM_HASH_SIZE; i++) {
+		INIT_HLIST_HEAD(&cm.listen_service_table[i]);
+		spin_lock_init(&cm.remote_id_table[i].lock);
+		INIT_HLIST_HEAD(&cm.remote_id_table[i].head);
+		spin_lock_init(&cm.remote_qp_table[i].lock);
+		INIT_HLIST_HEAD(&cm.remote_qp_table[i].head);
+		spin_lock_init(&cm.remote_sidr_table[i].lock);
+		INIT_HLIST_HEAD(&cm.remote_sidr_table[i].head);
+	}
 	cm.listen_service_id = be64_to_cpu(IB_CM_ASSIGN_SERVICE_ID);
-	cm.remote_id_table = RB_ROOT;
-	cm.remote_qp_table = RB_ROOT;
-	cm.remote_sidr_table = RB_ROOT;
 	xa_init_flags(&cm.local_id_table, XA_FLAGS_ALLOC);
 	get_random_bytes(&cm.random_id_operand, sizeof cm.random_id_operand);
 	INIT_LIST_HEAD(&cm.timewait_list);
@@ -10,6 +10,8 @@
 #include <linux/in.h>
 #include <linux/in6.h>
 #include <linux/mutex.h>
+#include <linux/bitmap.h>
+#include <linux/hash.h>
 #include <linux/random.h>
 #include <linux/rbtree.h>
 #include <linux/igmp.h>
@@ -178,11 +180,29 @@ static struct workqueue_struct *cma_wq;
 static struct workqueue_struct *cma_netevent_wq;
 static unsigned int cma_pernet_id;
 
+/*
+ * Bind lists are protected by a small array of mutexes hashed by port space
+ * and port number instead of the global lock, so binds to different ports
+ * proceed in parallel.  Lock ordering is lock -> bind lock.
+ */
+#define CMA_BIND_LOCK_BITS	6
+static struct mutex cma_bind_locks[1 << CMA_BIND_LOCK_BITS];
+
+#define CMA_MAX_PORTS		(U16_MAX + 1)
+
+struct cma_ps {
+	struct xarray xa;
+	/* Ports that have a bind list, used to find a free port quickly */
+	unsigned long *in_use;
+	/* Where each CPU continues its search for a free port */
+	unsigned int __percpu *hint;
+};
+
 struct cma_pernet {
-	struct xarray tcp_ps;
-	struct xarray udp_ps;
-	struct xarray ipoib_ps;
-	struct xarray ib_ps;
+	struct cma_ps tcp_ps;
+	struct cma_ps udp_ps;
+	struct cma_ps ipoib_ps;
+	struct cma_ps ib_ps;
 };
 
 static struct cma_pernet *cma_pernet(struct net *net)
@@ -191,7 +211,7 @@ static struct cma_pernet *cma_pernet(struct net *net)
 }
 
 static
-struct xarray *cma_pernet_xa(struct net *net, enum rdma_ucm_port_space ps)
+struct cma_ps *cma_pernet_ps(struct net *net, enum rdma_ucm_port_space ps)
 {
 	struct cma_pernet *pernet = cma_pernet(net);
 
@@ -230,28 +250,44 @@ struct rdma_bind_list {
 	unsigned short		port;
 };
 
+static struct mutex *cma_bind_lock(enum rdma_ucm_port_space ps,
+				   unsigned short snum)
+{
+	return &cma_bind_locks[hash_32((u32)ps << 16 | snum,
+				       CMA_BIND_LOCK_BITS)];
+}
+
 static int cma_ps_alloc(struct net *net, enum rdma_ucm_port_space ps,
 			struct rdma_bind_list *bind_list, int snum)
 {
-	struct xarray *xa = cma_pernet_xa(net, ps);
+	struct cma_ps *cps = cma_pernet_ps(net, ps);
+	int ret;
+
+	lockdep_assert_held(cma_bind_lock(ps, snum));
 
-	return xa_insert(xa, snum, bind_list, GFP_KERNEL);
+	ret = xa_insert(&cps->xa, snum, bind_list, GFP_KERNEL);
+	if (!ret)
+		set_bit(snum, cps->in_use);
+	return ret;
 }
 
 static struct rdma_bind_list *cma_ps_find(struct net *net,
 					  enum rdma_ucm_port_space ps, int snum)
 {
-	struct xarray *xa = cma_pernet_xa(net, ps);
+	struct cma_ps *cps = cma_pernet_ps(net, ps);
 
-	return xa_load(xa, snum);
+	return xa_load(&cps->xa, snum);
 }
 
 static void cma_ps_remove(struct net *net, enum rdma_ucm_port_space ps,
 			  int snum)
 {
-	struct xarray *xa = cma_pernet_xa(net, ps);
+	struct cma_ps *cps = cma_pernet_ps(net, ps);
 
-	xa_erase(xa, snum);
+	lockdep_assert_held(cma_bind_lock(ps, snum));
+
+	xa_erase(&cps->xa, snum);
+	clear_bit(snum, cps->in_use);
 }
 
 enum {
@@ -1787,6 +1823,8 @@ static struct rdma_id_private *cma_find_listener(
 	if (!bind_list)
 		return ERR_PTR(-EINVAL);
 
+	lockdep_assert_held(cma_bind_lock(bind_list->ps, bind_list->port));
+
 	hlist_for_each_entry(id_priv, &bind_list->owners, node) {
 		if (cma_match_private_data(id_priv, ib_event->private_data)) {
 			if (id_priv->id.device == cm_id->device &&
@@ -1814,6 +1852,7 @@ cma_ib_id_from_event(struct ib_cm_id *cm_id,
 {
 	struct rdma_bind_list *bind_list;
 	struct rdma_id_private *id_priv;
+	struct mutex *bind_lock;
 	int err;
 
 	err = cma_save_req_info(ib_event, req);
@@ -1830,7 +1869,10 @@ cma_ib_id_from_event(struct ib_cm_id *cm_id,
 		}
 	}
 
+	bind_lock = cma_bind_lock(rdma_ps_from_service_id(req->service_id),
+				  cma_port_from_service_id(req->service_id));
 	mutex_lock(&lock);
+	mutex_lock(bind_lock);
 	/*
 	 * Net namespace might be getting deleted while route lookup,
 	 * cm_id lookup is in progress. Therefore, perform netdevice
@@ -1872,6 +1914,7 @@ cma_ib_id_from_event(struct ib_cm_id *cm_id,
 	id_priv = cma_find_listener(bind_list, cm_id, ib_event, req, *net_dev);
 err:
 	rcu_read_unlock();
+	mutex_unlock(bind_lock);
 	mutex_unlock(&lock);
 	if (IS_ERR(id_priv) && *net_dev) {
 		dev_put(*net_dev);
@@ -1957,17 +2000,19 @@ static void cma_release_port(struct rdma_id_private *id_priv)
 {
 	struct rdma_bind_list *bind_list = id_priv->bind_list;
 	struct net *net = id_priv->id.route.addr.dev_addr.net;
+	struct mutex *bind_lock;
 
 	if (!bind_list)
 		return;
 
-	mutex_lock(&lock);
+	bind_lock = cma_bind_lock(bind_list->ps, bind_list->port);
+	mutex_lock(bind_lock);
 	hlist_del(&id_priv->node);
 	if (hlist_empty(&bind_list->owners)) {
 		cma_ps_remove(net, bind_list->ps, bind_list->port);
 		kfree(bind_list);
 	}
-	mutex_unlock(&lock);
+	mutex_unlock(bind_lock);
 }
 
 static void destroy_mc(struct rdma_id_private *id_priv,
@@ -3722,7 +3767,7 @@ static void cma_bind_port(struct rdma_bind_list *bind_list,
 	u64 sid, mask;
 	__be16 port;
 
-	lockdep_assert_held(&lock);
+	lockdep_assert_held(cma_bind_lock(bind_list->ps, bind_list->port));
 
 	addr = cma_src_addr(id_priv);
 	port = htons(bind_list->port);
@@ -3752,7 +3797,7 @@ static int cma_alloc_port(enum rdma_ucm_port_space ps,
 	struct rdma_bind_list *bind_list;
 	int ret;
 
-	lockdep_assert_held(&lock);
+	lockdep_assert_held(cma_bind_lock(ps, snum));
 
 	bind_list = kzalloc(sizeof *bind_list, GFP_KERNEL);
 	if (!bind_list)
@@ -3780,7 +3825,7 @@ static int cma_port_is_unique(struct rdma_bind_list *bind_list,
 	struct sockaddr  *saddr = cma_src_addr(id_priv);
 	__be16 dport = cma_port(daddr);
 
-	lockdep_assert_held(&lock);
+	lockdep_assert_held(cma_bind_lock(bind_list->ps, bind_list->port));
 
 	hlist_for_each_entry(cur_id, &bind_list->owners, node) {
 		struct sockaddr  *cur_daddr = cma_dst_addr(cur_id);
@@ -3813,49 +3858,95 @@ static int cma_port_is_unique(struct rdma_bind_list *bind_list,
 	return 0;
 }
 
-static int cma_alloc_any_port(enum rdma_ucm_port_space ps,
-			      struct rdma_id_private *id_priv)
+static int cma_try_port(enum rdma_ucm_port_space ps,
+			struct rdma_id_private *id_priv, unsigned short snum,
+			bool shared)
 {
-	static unsigned int last_used_port;
-	int low, high, remaining;
-	unsigned int rover;
 	struct net *net = id_priv->id.route.addr.dev_addr.net;
+	struct mutex *bind_lock = cma_bind_lock(ps, snum);
+	struct rdma_bind_list *bind_list;
+	int ret;
 
-	lockdep_assert_held(&lock);
+	mutex_lock(bind_lock);
+	bind_list = cma_ps_find(net, ps, snum);
+	if (!bind_list) {
+		ret = cma_alloc_port(ps, id_priv, snum);
+	} else if (shared) {
+		ret = cma_port_is_unique(bind_list, id_priv);
+		if (!ret)
+			cma_bind_port(bind_list, id_priv);
+	} else {
+		/* Lost a race with another bind to this port */
+		ret = -EADDRNOTAVAIL;
+	}
+	mutex_unlock(bind_lock);
+	return ret;
+}
+
+/*
+ * Every port of the local range is bound already, look for one that can be
+ * shared with this ID.
+ */
+static int cma_alloc_shared_port(enum rdma_ucm_port_space ps,
+				 struct rdma_id_private *id_priv,
+				 int low, int high)
+{
+	int remaining = (high - low) + 1;
+	unsigned int rover;
+	int ret;
 
-	inet_get_local_port_range(net, &low, &high);
-	remaining = (high - low) + 1;
 	rover = prandom_u32() % remaining + low;
-retry:
-	if (last_used_port != rover) {
-		struct rdma_bind_list *bind_list;
-		int ret;
+	while (remaining--) {
+		ret = cma_try_port(ps, id_priv, rover, true);
+		if (ret != -EADDRNOTAVAIL)
+			return ret;
+		if (++rover > high)
+			rover = low;
+	}
+	return -EADDRNOTAVAIL;
+}
 
-		bind_list = cma_ps_find(net, ps, (unsigned short)rover);
+static int cma_alloc_any_port(enum rdma_ucm_port_space ps,
+			      struct rdma_id_private *id_priv)
+{
+	struct net *net = id_priv->id.route.addr.dev_addr.net;
+	struct cma_ps *cps = cma_pernet_ps(net, ps);
+	unsigned int start, rover, end;
+	int low, high, ret;
 
-		if (!bind_list) {
-			ret = cma_alloc_port(ps, id_priv, rover);
-		} else {
-			ret = cma_port_is_unique(bind_list, id_priv);
-			if (!ret)
-				cma_bind_port(bind_list, id_priv);
+	inet_get_local_port_range(net, &low, &high);
+
+	/*
+	 * Continue after the port this CPU handed out last, which also avoids
+	 * re-using a port immediately after it is closed.  The hint is only
+	 * advisory, it does not matter if we migrate while using it.
+	 */
+	start = raw_cpu_read(*cps->hint);
+	if (start < low || start > high)
+		start = prandom_u32() % ((high - low) + 1) + low;
+
+	rover = start;
+	end = high + 1;
+	for (;;) {
+		rover = find_next_zero_bit(cps->in_use, end, rover);
+		if (rover >= end) {
+			if (end == start)
+				break;
+			/* wrap around to the start of the range */
+			rover = low;
+			end = start;
+			continue;
 		}
-		/*
-		 * Remember previously used port number in order to avoid
-		 * re-using same port immediately after it is closed.
-		 */
+
+		ret = cma_try_port(ps, id_priv, rover, false);
 		if (!ret)
-			last_used_port = rover;
+			raw_cpu_write(*cps->hint, rover + 1);
 		if (ret != -EADDRNOTAVAIL)
 			return ret;
-	}
-	if (--remaining) {
 		rover++;
-		if ((rover < low) || (rover > high))
-			rover = low;
-		goto retry;
 	}
-	return -EADDRNOTAVAIL;
+
+	return cma_alloc_shared_port(ps, id_priv, low, high);
 }
 
 /*
@@ -3870,7 +3961,7 @@ static int cma_check_port(struct rdma_bind_list *bind_list,
 	struct rdma_id_private *cur_id;
 	struct sockaddr *addr, *cur_addr;
 
-	lockdep_assert_held(&lock);
+	lockdep_assert_held(cma_bind_lock(bind_list->ps, bind_list->port));
 
 	addr = cma_src_addr(id_priv);
 	hlist_for_each_entry(cur_id, &bind_list->owners, node) {
@@ -3898,15 +3989,16 @@ static int cma_use_port(enum rdma_ucm_port_space ps,
 			struct rdma_id_private *id_priv)
 {
 	struct rdma_bind_list *bind_list;
+	struct mutex *bind_lock;
 	unsigned short snum;
 	int ret;
 
-	lockdep_assert_held(&lock);
-
 	snum = ntohs(cma_port(cma_src_addr(id_priv)));
 	if (snum < PROT_SOCK && !capable(CAP_NET_BIND_SERVICE))
 		return -EACCES;
 
+	bind_lock = cma_bind_lock(ps, snum);
+	mutex_lock(bind_lock);
 	bind_list = cma_ps_find(id_priv->id.route.addr.dev_addr.net, ps, snum);
 	if (!bind_list) {
 		ret = cma_alloc_port(ps, id_priv, snum);
@@ -3915,6 +4007,7 @@ static int cma_use_port(enum rdma_ucm_port_space ps,
 		if (!ret)
 			cma_bind_port(bind_list, id_priv);
 	}
+	mutex_unlock(bind_lock);
 	return ret;
 }
 
@@ -3977,12 +4070,10 @@ static int cma_get_port(struct rdma_id_private *id_priv)
 	if (!ps)
 		return -EPROTONOSUPPORT;
 
-	mutex_lock(&lock);
 	if (cma_any_port(cma_src_addr(id_priv)))
 		ret = cma_alloc_any_port(ps, id_priv);
 	else
 		ret = cma_use_port(ps, id_priv);
-	mutex_unlock(&lock);
 
 	return ret;
 }
@@ -4035,10 +4126,15 @@ int rdma_listen(struct rdma_cm_id *id, int backlog)
 	 * any more, and has to be unique in the bind list.
 	 */
 	if (id_priv->reuseaddr) {
+		struct mutex *bind_lock = cma_bind_lock(id_priv->bind_list->ps,
+							id_priv->bind_list->port);
+
 		mutex_lock(&lock);
+		mutex_lock(bind_lock);
 		ret = cma_check_port(id_priv->bind_list, id_priv, 0);
 		if (!ret)
 			id_priv->reuseaddr = 0;
+		mutex_unlock(bind_lock);
 		mutex_unlock(&lock);
 		if (ret)
 			goto err;
@@ -5371,26 +5467,64 @@ static void cma_remove_one(struct ib_device *device, void *client_data)
 	kfree(cma_dev);
 }
 
+static int cma_init_ps(struct cma_ps *cps)
+{
+	xa_init(&cps->xa);
+	cps->in_use = bitmap_zalloc(CMA_MAX_PORTS, GFP_KERNEL);
+	if (!cps->in_use)
+		return -ENOMEM;
+	cps->hint = alloc_percpu(unsigned int);
+	if (!cps->hint) {
+		bitmap_free(cps->in_use);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static void cma_exit_ps(struct cma_ps *cps)
+{
+	WARN_ON(!xa_empty(&cps->xa));
+	free_percpu(cps->hint);
+	bitmap_free(cps->in_use);
+}
+
 static int cma_init_net(struct net *net)
 {
 	struct cma_pernet *pernet = cma_pernet(net);
+	int ret;
 
-	xa_init(&pernet->tcp_ps);
-	xa_init(&pernet->udp_ps);
-	xa_init(&pernet->ipoib_ps);
-	xa_init(&pernet->ib_ps);
+	ret = cma_init_ps(&pernet->tcp_ps);
+	if (ret)
+		return ret;
+	ret = cma_init_ps(&pernet->udp_ps);
+	if (ret)
+		goto err_tcp;
+	ret = cma_init_ps(&pernet->ipoib_ps);
+	if (ret)
+		goto err_udp;
+	ret = cma_init_ps(&pernet->ib_ps);
+	if (ret)
+		goto err_ipoib;
 
 	return 0;
+
+err_ipoib:
+	cma_exit_ps(&pernet->ipoib_ps);
+err_udp:
+	cma_exit_ps(&pernet->udp_ps);
+err_tcp:
+	cma_exit_ps(&pernet->tcp_ps);
+	return ret;
 }
 
 static void cma_exit_net(struct net *net)
 {
 	struct cma_pernet *pernet = cma_pernet(net);
 
-	WARN_ON(!xa_empty(&pernet->tcp_ps));
-	WARN_ON(!xa_empty(&pernet->udp_ps));
-	WARN_ON(!xa_empty(&pernet->ipoib_ps));
-	WARN_ON(!xa_empty(&pernet->ib_ps));
+	cma_exit_ps(&pernet->tcp_ps);
+	cma_exit_ps(&pernet->udp_ps);
+	cma_exit_ps(&pernet->ipoib_ps);
+	cma_exit_ps(&pernet->ib_ps);
 }
 
 static struct pernet_operations cma_pernet_operations = {
@@ -5402,7 +5536,10 @@ static struct pernet_operations cma_pernet_operations = {
 
 static int __init cma_init(void)
 {
-	int ret;
+	int ret, i;
+
+	for (i = 0; i < ARRAY_SIZE(cma_bind_locks); i++)
+		mutex_init(&cma_bind_locks[i]);
 
 	/*
 	 * There is a rare lock ordering dependency in cma_netdev_callback()
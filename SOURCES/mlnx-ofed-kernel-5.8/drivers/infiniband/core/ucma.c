@@ -116,6 +116,8 @@ struct ucma_event {
 	struct ucma_multicast	*mc;
 	struct list_head	list;
 	struct rdma_ucm_event_resp resp;
+	/* Only for connect requests, reported by RDMA_USER_CM_CMD_GET_EVENTS */
+	struct rdma_ucm_req_info *req_info;
 };
 
 static DEFINE_XARRAY_ALLOC(ctx_table);
@@ -123,6 +125,7 @@ static DEFINE_XARRAY_ALLOC(multicast_table);
 
 static const struct file_operations ucma_fops;
 static int ucma_destroy_private_ctx(struct ucma_context *ctx);
+static struct rdma_ucm_req_info *ucma_create_req_info(struct rdma_cm_id *cm_id);
 
 static inline struct ucma_context *_ucma_find_context(int id,
 						      struct ucma_file *file)
@@ -256,6 +259,12 @@ static void ucma_copy_ud_event(struct ib_device *device,
 	dst->qkey = src->qkey;
 }
 
+static void ucma_free_uevent(struct ucma_event *uevent)
+{
+	kfree(uevent->req_info);
+	kfree(uevent);
+}
+
 static struct ucma_event *ucma_create_uevent(struct ucma_context *ctx,
 					     struct rdma_cm_event *event)
 {
@@ -312,6 +321,8 @@ static int ucma_connect_event_handler(struct rdma_cm_id *cm_id,
 		goto err_alloc;
 	uevent->conn_req_ctx = ctx;
 	uevent->resp.id = ctx->id;
+	/* Not fatal, userspace falls back to querying the new id */
+	uevent->req_info = ucma_create_req_info(cm_id);
 
 	ctx->cm_id->context = ctx;
 
@@ -366,11 +377,42 @@ static int ucma_event_handler(struct rdma_cm_id *cm_id,
 	return 0;
 }
 
+/* On success returns with file->mut held and at least one event queued */
+static int ucma_wait_event(struct ucma_file *file)
+{
+	mutex_lock(&file->mut);
+	while (list_empty(&file->event_list)) {
+		mutex_unlock(&file->mut);
+
+		if (file->filp->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		if (wait_event_interruptible(file->poll_wait,
+					     !list_empty(&file->event_list)))
+			return -ERESTARTSYS;
+
+		mutex_lock(&file->mut);
+	}
+	return 0;
+}
+
+/* Called with file->mut held once the event was copied to userspace */
+static void ucma_report_event(struct ucma_event *uevent)
+{
+	list_del(&uevent->list);
+	uevent->ctx->events_reported++;
+	if (uevent->mc)
+		uevent->mc->events_reported++;
+	if (uevent->resp.event == RDMA_CM_EVENT_CONNECT_REQUEST)
+		atomic_inc(&uevent->ctx->backlog);
+}
+
 static ssize_t ucma_get_event(struct ucma_file *file, const char __user *inbuf,
 			      int in_len, int out_len)
 {
 	struct rdma_ucm_get_event cmd;
 	struct ucma_event *uevent;
+	int ret;
 
 	/*
 	 * Old 32 bit user space does not send the 4 byte padding in the
@@ -383,19 +425,9 @@ static ssize_t ucma_get_event(struct ucma_file *file, const char __user *inbuf,
 	if (copy_from_user(&cmd, inbuf, sizeof(cmd)))
 		return -EFAULT;
 
-	mutex_lock(&file->mut);
-	while (list_empty(&file->event_list)) {
-		mutex_unlock(&file->mut);
-
-		if (file->filp->f_flags & O_NONBLOCK)
-			return -EAGAIN;
-
-		if (wait_event_interruptible(file->poll_wait,
-					     !list_empty(&file->event_list)))
-			return -ERESTARTSYS;
-
-		mutex_lock(&file->mut);
-	}
+	ret = ucma_wait_event(file);
+	if (ret)
+		return ret;
 
 	uevent = list_first_entry(&file->event_list, struct ucma_event, list);
 
@@ -406,18 +438,84 @@ static ssize_t ucma_get_event(struct ucma_file *file, const char __user *inbuf,
 		return -EFAULT;
 	}
 
-	list_del(&uevent->list);
-	uevent->ctx->events_reported++;
-	if (uevent->mc)
-		uevent->mc->events_reported++;
-	if (uevent->resp.event == RDMA_CM_EVENT_CONNECT_REQUEST)
-		atomic_inc(&uevent->ctx->backlog);
+	ucma_report_event(uevent);
 	mutex_unlock(&file->mut);
 
-	kfree(uevent);
+	ucma_free_uevent(uevent);
 	return 0;
 }
 
+/*
+ * Like ucma_get_event(), but reports every queued event that fits in the
+ * response after waiting for the first one.  Connect requests carry the
+ * address, GID and path information of the new id, which saves the
+ * RDMA_USER_CM_CMD_QUERY round trips userspace otherwise makes for each.
+ */
+static ssize_t ucma_get_events(struct ucma_file *file,
+			       const char __user *inbuf,
+			       int in_len, int out_len)
+{
+	struct rdma_ucm_get_events_resp __user *response;
+	struct rdma_ucm_get_events_resp resp = {};
+	struct rdma_ucm_get_events cmd;
+	struct ucma_event *uevent, *tmp;
+	struct rdma_ucm_event_ex *ev;
+	u32 max_events;
+	LIST_HEAD(list);
+	int ret;
+
+	if (copy_from_user(&cmd, inbuf, sizeof(cmd)))
+		return -EFAULT;
+
+	if (out_len < sizeof(resp))
+		return -ENOSPC;
+	max_events = min_t(u32, cmd.max_events,
+			   (out_len - sizeof(resp)) / sizeof(*ev));
+	if (!max_events)
+		return -ENOSPC;
+
+	ev = kmalloc(sizeof(*ev), GFP_KERNEL);
+	if (!ev)
+		return -ENOMEM;
+
+	ret = ucma_wait_event(file);
+	if (ret)
+		goto out;
+
+	response = u64_to_user_ptr(cmd.response);
+	while (resp.num_events < max_events &&
+	       !list_empty(&file->event_list)) {
+		uevent = list_first_entry(&file->event_list, struct ucma_event,
+					  list);
+
+		memset(ev, 0, sizeof(*ev));
+		ev->event = uevent->resp;
+		if (uevent->req_info) {
+			ev->flags = RDMA_UCM_EVENT_F_REQ_INFO;
+			ev->req_info = *uevent->req_info;
+		}
+
+		if (copy_to_user(&response->events[resp.num_events], ev,
+				 sizeof(*ev)))
+			break;
+
+		ucma_report_event(uevent);
+		list_add_tail(&uevent->list, &list);
+		resp.num_events++;
+	}
+	mutex_unlock(&file->mut);
+
+	list_for_each_entry_safe(uevent, tmp, &list, list)
+		ucma_free_uevent(uevent);
+
+	if (!resp.num_events ||
+	    copy_to_user(response, &resp, sizeof(resp)))
+		ret = -EFAULT;
+out:
+	kfree(ev);
+	return ret;
+}
+
 static int ucma_get_qp_type(struct rdma_ucm_create_id *cmd, enum ib_qp_type *qp_type)
 {
 	switch (cmd->ps) {
@@ -513,7 +611,7 @@ static void ucma_cleanup_mc_events(struct ucma_multicast *mc)
 			continue;
 
 		list_del(&uevent->list);
-		kfree(uevent);
+		ucma_free_uevent(uevent);
 	}
 	mutex_unlock(&mc->ctx->file->mut);
 	rdma_unlock_handler(mc->ctx->cm_id);
@@ -539,7 +637,7 @@ static int ucma_cleanup_ctx_events(struct ucma_context *ctx)
 			continue;
 		}
 		list_del(&uevent->list);
-		kfree(uevent);
+		ucma_free_uevent(uevent);
 	}
 	list_del(&ctx->list);
 	events_reported = ctx->events_reported;
@@ -552,7 +650,7 @@ static int ucma_cleanup_ctx_events(struct ucma_context *ctx)
 	 */
 	list_for_each_entry_safe(uevent, tmp, &list, list) {
 		ucma_destroy_private_ctx(uevent->conn_req_ctx);
-		kfree(uevent);
+		ucma_free_uevent(uevent);
 	}
 	return events_reported;
 }
@@ -880,27 +978,33 @@ static void ucma_query_device_addr(struct rdma_cm_id *cm_id,
 		     ib_addr_get_pkey(&cm_id->route.addr.dev_addr));
 }
 
+static void ucma_fill_addr(struct rdma_cm_id *cm_id,
+			   struct rdma_ucm_query_addr_resp *resp)
+{
+	struct sockaddr *addr;
+
+	addr = (struct sockaddr *) &cm_id->route.addr.src_addr;
+	resp->src_size = rdma_addr_size(addr);
+	memcpy(&resp->src_addr, addr, resp->src_size);
+
+	addr = (struct sockaddr *) &cm_id->route.addr.dst_addr;
+	resp->dst_size = rdma_addr_size(addr);
+	memcpy(&resp->dst_addr, addr, resp->dst_size);
+
+	ucma_query_device_addr(cm_id, resp);
+}
+
 static ssize_t ucma_query_addr(struct ucma_context *ctx,
 			       void __user *response, int out_len)
 {
 	struct rdma_ucm_query_addr_resp resp;
-	struct sockaddr *addr;
 	int ret = 0;
 
 	if (out_len < offsetof(struct rdma_ucm_query_addr_resp, ibdev_index))
 		return -ENOSPC;
 
 	memset(&resp, 0, sizeof resp);
-
-	addr = (struct sockaddr *) &ctx->cm_id->route.addr.src_addr;
-	resp.src_size = rdma_addr_size(addr);
-	memcpy(&resp.src_addr, addr, resp.src_size);
-
-	addr = (struct sockaddr *) &ctx->cm_id->route.addr.dst_addr;
-	resp.dst_size = rdma_addr_size(addr);
-	memcpy(&resp.dst_addr, addr, resp.dst_size);
-
-	ucma_query_device_addr(ctx->cm_id, &resp);
+	ucma_fill_addr(ctx->cm_id, &resp);
 
 	if (copy_to_user(response, &resp, min_t(size_t, out_len, sizeof(resp))))
 		ret = -EFAULT;
@@ -908,6 +1012,22 @@ static ssize_t ucma_query_addr(struct ucma_context *ctx,
 	return ret;
 }
 
+static void ucma_pack_path(struct sa_path_rec *rec,
+			   struct ib_path_rec_data *path_data)
+{
+	path_data->flags = IB_PATH_GMP | IB_PATH_PRIMARY |
+			   IB_PATH_BIDIRECTIONAL;
+	if (rec->rec_type == SA_PATH_REC_TYPE_OPA) {
+		struct sa_path_rec ib;
+
+		sa_convert_path_opa_to_ib(&ib, rec);
+		ib_sa_pack_path(&ib, &path_data->path_rec);
+
+	} else {
+		ib_sa_pack_path(rec, &path_data->path_rec);
+	}
+}
+
 static ssize_t ucma_query_path(struct ucma_context *ctx,
 			       void __user *response, int out_len)
 {
@@ -924,21 +1044,9 @@ static ssize_t ucma_query_path(struct ucma_context *ctx,
 	resp->num_paths = ctx->cm_id->route.num_pri_alt_paths;
 	for (i = 0, out_len -= sizeof(*resp);
 	     i < resp->num_paths && out_len > sizeof(struct ib_path_rec_data);
-	     i++, out_len -= sizeof(struct ib_path_rec_data)) {
-		struct sa_path_rec *rec = &ctx->cm_id->route.path_rec[i];
-
-		resp->path_data[i].flags = IB_PATH_GMP | IB_PATH_PRIMARY |
-					   IB_PATH_BIDIRECTIONAL;
-		if (rec->rec_type == SA_PATH_REC_TYPE_OPA) {
-			struct sa_path_rec ib;
-
-			sa_convert_path_opa_to_ib(&ib, rec);
-			ib_sa_pack_path(&ib, &resp->path_data[i].path_rec);
-
-		} else {
-			ib_sa_pack_path(rec, &resp->path_data[i].path_rec);
-		}
-	}
+	     i++, out_len -= sizeof(struct ib_path_rec_data))
+		ucma_pack_path(&ctx->cm_id->route.path_rec[i],
+			       &resp->path_data[i]);
 
 	if (copy_to_user(response, resp, struct_size(resp, path_data, i)))
 		ret = -EFAULT;
@@ -947,45 +1055,49 @@ static ssize_t ucma_query_path(struct ucma_context *ctx,
 	return ret;
 }
 
-static ssize_t ucma_query_gid(struct ucma_context *ctx,
-			      void __user *response, int out_len)
+static void ucma_fill_gid(struct rdma_cm_id *cm_id,
+			  struct rdma_ucm_query_addr_resp *resp)
 {
-	struct rdma_ucm_query_addr_resp resp;
 	struct sockaddr_ib *addr;
-	int ret = 0;
 
-	if (out_len < offsetof(struct rdma_ucm_query_addr_resp, ibdev_index))
-		return -ENOSPC;
-
-	memset(&resp, 0, sizeof resp);
-
-	ucma_query_device_addr(ctx->cm_id, &resp);
+	ucma_query_device_addr(cm_id, resp);
 
-	addr = (struct sockaddr_ib *) &resp.src_addr;
-	resp.src_size = sizeof(*addr);
-	if (ctx->cm_id->route.addr.src_addr.ss_family == AF_IB) {
-		memcpy(addr, &ctx->cm_id->route.addr.src_addr, resp.src_size);
+	addr = (struct sockaddr_ib *) &resp->src_addr;
+	resp->src_size = sizeof(*addr);
+	if (cm_id->route.addr.src_addr.ss_family == AF_IB) {
+		memcpy(addr, &cm_id->route.addr.src_addr, resp->src_size);
 	} else {
 		addr->sib_family = AF_IB;
-		addr->sib_pkey = (__force __be16) resp.pkey;
-		rdma_read_gids(ctx->cm_id, (union ib_gid *)&addr->sib_addr,
-			       NULL);
-		addr->sib_sid = rdma_get_service_id(ctx->cm_id, (struct sockaddr *)
-						    &ctx->cm_id->route.addr.src_addr);
+		addr->sib_pkey = (__force __be16) resp->pkey;
+		rdma_read_gids(cm_id, (union ib_gid *)&addr->sib_addr, NULL);
+		addr->sib_sid = rdma_get_service_id(cm_id, (struct sockaddr *)
+						    &cm_id->route.addr.src_addr);
 	}
 
-	addr = (struct sockaddr_ib *) &resp.dst_addr;
-	resp.dst_size = sizeof(*addr);
-	if (ctx->cm_id->route.addr.dst_addr.ss_family == AF_IB) {
-		memcpy(addr, &ctx->cm_id->route.addr.dst_addr, resp.dst_size);
+	addr = (struct sockaddr_ib *) &resp->dst_addr;
+	resp->dst_size = sizeof(*addr);
+	if (cm_id->route.addr.dst_addr.ss_family == AF_IB) {
+		memcpy(addr, &cm_id->route.addr.dst_addr, resp->dst_size);
 	} else {
 		addr->sib_family = AF_IB;
-		addr->sib_pkey = (__force __be16) resp.pkey;
-		rdma_read_gids(ctx->cm_id, NULL,
-			       (union ib_gid *)&addr->sib_addr);
-		addr->sib_sid = rdma_get_service_id(ctx->cm_id, (struct sockaddr *)
-						    &ctx->cm_id->route.addr.dst_addr);
+		addr->sib_pkey = (__force __be16) resp->pkey;
+		rdma_read_gids(cm_id, NULL, (union ib_gid *)&addr->sib_addr);
+		addr->sib_sid = rdma_get_service_id(cm_id, (struct sockaddr *)
+						    &cm_id->route.addr.dst_addr);
 	}
+}
+
+static ssize_t ucma_query_gid(struct ucma_context *ctx,
+			      void __user *response, int out_len)
+{
+	struct rdma_ucm_query_addr_resp resp;
+	int ret = 0;
+
+	if (out_len < offsetof(struct rdma_ucm_query_addr_resp, ibdev_index))
+		return -ENOSPC;
+
+	memset(&resp, 0, sizeof resp);
+	ucma_fill_gid(ctx->cm_id, &resp);
 
 	if (copy_to_user(response, &resp, min_t(size_t, out_len, sizeof(resp))))
 		ret = -EFAULT;
@@ -993,6 +1105,30 @@ static ssize_t ucma_query_gid(struct ucma_context *ctx,
 	return ret;
 }
 
+/*
+ * Snapshot what userspace queries for every new connection, so that
+ * RDMA_USER_CM_CMD_GET_EVENTS can hand it out with the connect request.
+ */
+static struct rdma_ucm_req_info *ucma_create_req_info(struct rdma_cm_id *cm_id)
+{
+	struct rdma_ucm_req_info *info;
+	int i;
+
+	info = kzalloc(sizeof(*info), GFP_KERNEL);
+	if (!info)
+		return NULL;
+
+	ucma_fill_addr(cm_id, &info->addr);
+	ucma_fill_gid(cm_id, &info->gid);
+
+	info->num_paths = min_t(u32, cm_id->route.num_pri_alt_paths,
+				ARRAY_SIZE(info->path_data));
+	for (i = 0; i < info->num_paths; i++)
+		ucma_pack_path(&cm_id->route.path_rec[i], &info->path_data[i]);
+
+	return info;
+}
+
 static ssize_t ucma_query(struct ucma_file *file,
 			  const char __user *inbuf,
 			  int in_len, int out_len)
@@ -1709,7 +1845,8 @@ static ssize_t (*ucma_cmd_table[])(struct ucma_file *file,
 	[RDMA_USER_CM_CMD_QUERY]	 = ucma_query,
 	[RDMA_USER_CM_CMD_BIND]		 = ucma_bind,
 	[RDMA_USER_CM_CMD_RESOLVE_ADDR]	 = ucma_resolve_addr,
-	[RDMA_USER_CM_CMD_JOIN_MCAST]	 = ucma_join_multicast
+	[RDMA_USER_CM_CMD_JOIN_MCAST]	 = ucma_join_multicast,
+	[RDMA_USER_CM_CMD_GET_EVENTS]	 = ucma_get_events
 };
 
 static ssize_t ucma_write(struct file *filp, const char __user *buf,
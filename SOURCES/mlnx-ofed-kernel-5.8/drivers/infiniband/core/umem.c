@@ -41,7 +41,11 @@
 #include <linux/slab.h>
 #include <linux/pagemap.h>
 #include <linux/count_zeros.h>
+#include <linux/kthread.h>
+#include <linux/workqueue.h>
+#include <linux/sizes.h>
 #include <rdma/ib_umem_odp.h>
+#include <trace/events/rdma_core.h>
 
 #include "uverbs.h"
 
@@ -138,6 +142,225 @@ unsigned long ib_umem_find_best_pgsz(struct ib_umem *umem,
 }
 EXPORT_SYMBOL(ib_umem_find_best_pgsz);
 
+/*
+ * Pages are pinned in batches of up to UMEM_PIN_BATCH, large enough that a
+ * 1GB huge page is returned by a single pin_user_pages_fast() call.
+ * Physically contiguous pages, e.g. the pages of one huge folio, are merged
+ * into a single SG entry when they are appended.
+ */
+#define UMEM_PIN_BATCH		(SZ_2M / sizeof(struct page *))
+#define UMEM_PIN_MAX_THREADS	16
+
+static unsigned int umem_parallel_pin_mb;
+module_param_named(umem_parallel_pin_mb, umem_parallel_pin_mb, uint, 0644);
+MODULE_PARM_DESC(umem_parallel_pin_mb,
+		 "Pin memory registrations at least this large (in MB) from several threads (default: 0 - disabled)");
+
+struct ib_umem_pin_run {
+	struct page *page;
+	unsigned long npages;
+};
+
+struct ib_umem_pin_work {
+	struct work_struct work;
+	struct mm_struct *mm;
+	unsigned long start;
+	unsigned long npages;
+	unsigned int gup_flags;
+	/* physically contiguous runs of the pinned pages, in VA order */
+	struct ib_umem_pin_run *runs;
+	unsigned long nruns;
+	unsigned long max_runs;
+	int ret;
+};
+
+static int ib_umem_add_runs(struct ib_umem_pin_work *pw, struct page **pages,
+			    unsigned long npages)
+{
+	struct ib_umem_pin_run *run;
+	unsigned long i;
+
+	for (i = 0; i < npages; i++) {
+		run = pw->nruns ? &pw->runs[pw->nruns - 1] : NULL;
+		if (run && page_to_pfn(run->page) + run->npages ==
+			   page_to_pfn(pages[i])) {
+			run->npages++;
+			continue;
+		}
+
+		if (pw->nruns == pw->max_runs) {
+			unsigned long max_runs = max(pw->max_runs * 2, 64UL);
+			struct ib_umem_pin_run *runs;
+
+			runs = kvmalloc_array(max_runs, sizeof(*runs),
+					      GFP_KERNEL);
+			if (!runs)
+				return -ENOMEM;
+			if (pw->runs)
+				memcpy(runs, pw->runs,
+				       pw->nruns * sizeof(*runs));
+			kvfree(pw->runs);
+			pw->runs = runs;
+			pw->max_runs = max_runs;
+		}
+		pw->runs[pw->nruns].page = pages[i];
+		pw->runs[pw->nruns].npages = 1;
+		pw->nruns++;
+	}
+	return 0;
+}
+
+static void ib_umem_unpin_runs(struct ib_umem_pin_work *pw,
+			       unsigned long first_run, unsigned long skip)
+{
+	unsigned long i;
+
+	for (i = first_run; i < pw->nruns; i++, skip = 0)
+		unpin_user_page_range_dirty_lock(
+			nth_page(pw->runs[i].page, skip),
+			pw->runs[i].npages - skip, false);
+	pw->nruns = 0;
+}
+
+static void ib_umem_pin_worker(struct work_struct *work)
+{
+	struct ib_umem_pin_work *pw =
+		container_of(work, struct ib_umem_pin_work, work);
+	unsigned long cur_base = pw->start, npages = pw->npages;
+	ktime_t start = ktime_get();
+	struct page **page_list;
+	long pinned;
+	int ret = 0;
+
+	page_list = kvmalloc_array(min_t(unsigned long, npages,
+					 UMEM_PIN_BATCH),
+				   sizeof(*page_list), GFP_KERNEL);
+	if (!page_list) {
+		pw->ret = -ENOMEM;
+		return;
+	}
+
+	kthread_use_mm(pw->mm);
+	while (npages) {
+		cond_resched();
+		pinned = pin_user_pages_fast(cur_base,
+					     min_t(unsigned long, npages,
+						   UMEM_PIN_BATCH),
+					     pw->gup_flags, page_list);
+		if (pinned <= 0) {
+			ret = pinned ?: -EFAULT;
+			break;
+		}
+
+		ret = ib_umem_add_runs(pw, page_list, pinned);
+		if (ret) {
+			unpin_user_pages(page_list, pinned);
+			break;
+		}
+		cur_base += pinned * PAGE_SIZE;
+		npages -= pinned;
+	}
+	kthread_unuse_mm(pw->mm);
+
+	if (ret)
+		ib_umem_unpin_runs(pw, 0, 0);
+	kvfree(page_list);
+	pw->ret = ret;
+	trace_umem_pin_chunk(pw->start, pw->npages, pw->nruns,
+			     ktime_us_delta(ktime_get(), start), ret);
+}
+
+/*
+ * Pin disjoint ranges of the registration from several workers, then build
+ * the SG table from their runs in VA order.
+ */
+static int ib_umem_pin_parallel(struct ib_umem *umem, unsigned long cur_base,
+				unsigned long npages, unsigned int gup_flags,
+				unsigned int nthreads, struct page **page_list)
+{
+	unsigned long chunk, left = npages, off;
+	struct ib_umem_pin_work *pw;
+	unsigned int i, n;
+	int ret = 0;
+
+	pw = kcalloc(nthreads, sizeof(*pw), GFP_KERNEL);
+	if (!pw)
+		return -ENOMEM;
+
+	/* keep huge pages within one worker as far as possible */
+	chunk = round_up(DIV_ROUND_UP(npages, nthreads), PMD_SIZE >> PAGE_SHIFT);
+	for (n = 0; n < nthreads && left; n++) {
+		pw[n].mm = umem->owning_mm;
+		pw[n].start = cur_base;
+		pw[n].npages = min(chunk, left);
+		pw[n].gup_flags = gup_flags;
+		INIT_WORK(&pw[n].work, ib_umem_pin_worker);
+		queue_work(system_unbound_wq, &pw[n].work);
+		cur_base += pw[n].npages << PAGE_SHIFT;
+		left -= pw[n].npages;
+	}
+
+	for (i = 0; i < n; i++) {
+		flush_work(&pw[i].work);
+		if (pw[i].ret && !ret)
+			ret = pw[i].ret;
+	}
+	if (ret)
+		goto out;
+
+	left = npages;
+	for (i = 0; i < n; i++) {
+		unsigned long r;
+
+		for (r = 0; r < pw[i].nruns; r++) {
+			struct ib_umem_pin_run *run = &pw[i].runs[r];
+
+			for (off = 0; off < run->npages;) {
+				unsigned long batch, j;
+
+				batch = min_t(unsigned long,
+					      run->npages - off,
+					      UMEM_PIN_BATCH);
+				for (j = 0; j < batch; j++)
+					page_list[j] = nth_page(run->page,
+								off + j);
+				left -= batch;
+				ret = sg_alloc_append_table_from_pages(
+					&umem->sgt_append, page_list, batch, 0,
+					batch << PAGE_SHIFT,
+					ib_dma_max_seg_size(umem->ibdev),
+					left, GFP_KERNEL);
+				if (ret) {
+					/* appended pages are released with the umem */
+					ib_umem_unpin_runs(&pw[i], r, off);
+					goto out;
+				}
+				off += batch;
+			}
+			cond_resched();
+		}
+		pw[i].nruns = 0;
+	}
+
+out:
+	for (i = 0; i < n; i++) {
+		ib_umem_unpin_runs(&pw[i], 0, 0);
+		kvfree(pw[i].runs);
+	}
+	kfree(pw);
+	return ret;
+}
+
+static unsigned int ib_umem_pin_threads(unsigned long npages)
+{
+	unsigned long threshold = umem_parallel_pin_mb;
+
+	if (!threshold || npages < (threshold << (20 - PAGE_SHIFT)))
+		return 1;
+	return clamp_t(unsigned int, num_online_cpus(), 1,
+		       UMEM_PIN_MAX_THREADS);
+}
+
 /**
  * __ib_umem_get - Pin and DMA map userspace memory.
  *
@@ -159,8 +382,10 @@ static struct ib_umem *__ib_umem_get(struct ib_device *device,
 	unsigned long dma_attr = 0;
 	struct mm_struct *mm;
 	unsigned long npages;
+	unsigned int nthreads = 1;
 	int pinned, ret;
 	unsigned int gup_flags = FOLL_WRITE;
+	ktime_t start = ktime_get();
 
 	/*
 	 * If the combination of the addr and size requested for this memory
@@ -195,16 +420,17 @@ static struct ib_umem *__ib_umem_get(struct ib_device *device,
 	umem->owning_mm = mm = current->mm;
 	mmgrab(mm);
 
-	page_list = (struct page **) __get_free_page(GFP_KERNEL);
-	if (!page_list) {
-		ret = -ENOMEM;
-		goto umem_kfree;
-	}
-
 	npages = ib_umem_num_pages(umem);
 	if (npages == 0 || npages > UINT_MAX) {
 		ret = -EINVAL;
-		goto out;
+		goto umem_kfree;
+	}
+
+	page_list = kvmalloc_array(min_t(unsigned long, npages, UMEM_PIN_BATCH),
+				   sizeof(*page_list), GFP_KERNEL);
+	if (!page_list) {
+		ret = -ENOMEM;
+		goto umem_kfree;
 	}
 
 	lock_limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
@@ -221,18 +447,27 @@ static struct ib_umem *__ib_umem_get(struct ib_device *device,
 	if (!umem->writable)
 		gup_flags |= FOLL_FORCE;
 
+	nthreads = ib_umem_pin_threads(npages);
+	if (nthreads > 1) {
+		ret = ib_umem_pin_parallel(umem, cur_base, npages,
+					   gup_flags | FOLL_LONGTERM, nthreads,
+					   page_list);
+		if (ret)
+			goto umem_release;
+		npages = 0;
+	}
+
 	while (npages) {
 		cond_resched();
 		pinned = pin_user_pages_fast(cur_base,
 					  min_t(unsigned long, npages,
-						PAGE_SIZE /
-						sizeof(struct page *)),
+						UMEM_PIN_BATCH),
 					  gup_flags | FOLL_LONGTERM, page_list);
 		if (pinned < 0) {
 			ret = pinned;
 			pr_debug("%s: failed to get user pages, nr_pages=%lu, flags=%u\n", __func__,
 					min_t(unsigned long, npages,
-						PAGE_SIZE / sizeof(struct page *)),
+					      UMEM_PIN_BATCH),
 					gup_flags);
 			goto umem_release;
 		}
@@ -285,7 +520,9 @@ umem_release:
 vma:
 	atomic64_sub(ib_umem_num_pages(umem), &mm->pinned_vm);
 out:
-	free_page((unsigned long) page_list);
+	kvfree(page_list);
+	trace_umem_pin(addr, size, ret ? 0 : umem->sgt_append.sgt.orig_nents,
+		       nthreads, ktime_us_delta(ktime_get(), start), ret);
 umem_kfree:
 	if (ret) {
 		mmdrop(umem->owning_mm);
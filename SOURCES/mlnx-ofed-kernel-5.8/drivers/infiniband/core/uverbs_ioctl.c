@@ -602,6 +602,79 @@ static int ib_uverbs_cmd_verbs(struct ib_uverbs_file *ufile,
 	return ret;
 }
 
+static int ib_uverbs_check_hdr(const struct ib_uverbs_ioctl_hdr *hdr)
+{
+	if (hdr->length > PAGE_SIZE ||
+	    hdr->length != struct_size(hdr, attrs, hdr->num_attrs))
+		return -EINVAL;
+
+	if (hdr->reserved1 || hdr->reserved2)
+		return -EPROTONOSUPPORT;
+
+	return 0;
+}
+
+/*
+ * Run a packed array of commands under a single SRCU read section, so that
+ * creating many objects costs one system call.  Objects created by the
+ * commands that succeeded are kept when a later one fails.
+ */
+static long ib_uverbs_ioctl_batch(struct ib_uverbs_file *file,
+				  struct ib_uverbs_ioctl_batch __user *ubatch)
+{
+	struct ib_uverbs_ioctl_hdr __user *user_hdr;
+	struct ib_uverbs_ioctl_batch batch;
+	struct ib_uverbs_ioctl_hdr hdr;
+	u32 num_done = 0;
+	u32 offset = 0;
+	int srcu_key;
+	int err = 0;
+
+	if (copy_from_user(&batch, ubatch, sizeof(batch)))
+		return -EFAULT;
+
+	if (batch.num_done)
+		return -EINVAL;
+
+	srcu_key = srcu_read_lock(&file->device->disassociate_srcu);
+	while (offset < batch.length) {
+		if (batch.length - offset < sizeof(hdr)) {
+			err = -EINVAL;
+			break;
+		}
+
+		user_hdr = u64_to_user_ptr(batch.cmds + offset);
+		if (copy_from_user(&hdr, user_hdr, sizeof(hdr))) {
+			err = -EFAULT;
+			break;
+		}
+
+		err = ib_uverbs_check_hdr(&hdr);
+		if (!err && hdr.length > batch.length - offset)
+			err = -EINVAL;
+		if (err)
+			break;
+
+		err = ib_uverbs_cmd_verbs(file, &hdr, user_hdr->attrs);
+		if (err)
+			break;
+
+		num_done++;
+		offset += hdr.length;
+
+		if (fatal_signal_pending(current)) {
+			err = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+	srcu_read_unlock(&file->device->disassociate_srcu, srcu_key);
+
+	if (put_user(num_done, &ubatch->num_done))
+		return -EFAULT;
+	return err;
+}
+
 long ib_uverbs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct ib_uverbs_file *file = filp->private_data;
@@ -611,6 +684,10 @@ long ib_uverbs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	int srcu_key;
 	int err;
 
+	if (cmd == RDMA_VERBS_IOCTL_BATCH)
+		return ib_uverbs_ioctl_batch(
+			file, (struct ib_uverbs_ioctl_batch __user *)arg);
+
 	if (unlikely(cmd != RDMA_VERBS_IOCTL))
 		return -ENOIOCTLCMD;
 
@@ -618,12 +695,9 @@ long ib_uverbs_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 	if (err)
 		return -EFAULT;
 
-	if (hdr.length > PAGE_SIZE ||
-	    hdr.length != struct_size(&hdr, attrs, hdr.num_attrs))
-		return -EINVAL;
-
-	if (hdr.reserved1 || hdr.reserved2)
-		return -EPROTONOSUPPORT;
+	err = ib_uverbs_check_hdr(&hdr);
+	if (err)
+		return err;
 
 	srcu_key = srcu_read_lock(&file->device->disassociate_srcu);
 	err = ib_uverbs_cmd_verbs(file, &hdr, user_hdr->attrs);
@@ -77,8 +77,11 @@ enum {
 	IPOIB_MAX_QUEUE_SIZE	  = 8192,
 	IPOIB_MIN_QUEUE_SIZE	  = 2,
 	IPOIB_CM_MAX_CONN_QP	  = 4096,
+	IPOIB_MAX_SEND_RINGS	  = 16,
 
 	IPOIB_NUM_WC		  = 64,
+	IPOIB_TX_BATCH		  = 16,
+	IPOIB_RX_COPYBREAK	  = 256,
 
 	IPOIB_MAX_PATH_REC_QUEUE  = 3,
 	IPOIB_MAX_MCAST_QUEUE	  = 64,
@@ -314,6 +317,7 @@ struct ipoib_neigh_table {
 struct ipoib_qp_state_validate {
 	struct work_struct work;
 	struct ipoib_dev_priv   *priv;
+	struct ib_qp		*qp;
 };
 
 struct ipoib_arp_repath {
@@ -323,6 +327,36 @@ struct ipoib_arp_repath {
 	struct net_device	*dev;
 };
 
+/*
+ * UD send ring, one per net device TX queue in datagram mode.  Ring 0
+ * posts on the QP that also receives and shares its CQ with connected
+ * mode; every other ring owns a send only UD QP and CQ.  The TX queue's
+ * xmit lock protects the head, the ring's NAPI context the tail.
+ *
+ * While the stack has more packets for the queue, up to IPOIB_TX_BATCH
+ * send WRs are chained in tx_wr[] and posted with a single doorbell;
+ * tx_pending of them are built but not yet posted.
+ */
+struct ipoib_send_ring {
+	struct ipoib_dev_priv *priv;
+	struct napi_struct napi;
+	struct work_struct reschedule_napi_work;
+	int		     index;
+	struct ib_cq	    *cq;
+	struct ib_qp	    *qp;
+
+	struct ipoib_tx_buf *tx_ring;
+	unsigned int	     tx_head;
+	unsigned int	     tx_tail;
+	unsigned int	     tx_pending;
+	struct ib_sge	     tx_sge[IPOIB_TX_BATCH][MAX_SKB_FRAGS + 1];
+	struct ib_ud_wr      tx_wr[IPOIB_TX_BATCH];
+	struct ib_wc	     send_wc[MAX_SEND_CQE];
+
+	u64		     tx_packets;
+	u64		     tx_bytes;
+};
+
 /*
  * Device private locking: network stack tx_lock protects members used
  * in TX fast path, lock protects everything else.  lock nests inside
@@ -334,7 +368,6 @@ struct ipoib_dev_priv {
 	struct net_device *dev;
 	void (*next_priv_destructor)(struct net_device *dev);
 
-	struct napi_struct send_napi;
 	struct napi_struct recv_napi;
 
 	unsigned long flags;
@@ -361,7 +394,6 @@ struct ipoib_dev_priv {
 	struct workqueue_struct *wq;
 	struct delayed_work mcast_task;
 	struct work_struct carrier_on_task;
-	struct work_struct reschedule_napi_work;
 	struct work_struct flush_light;
 	struct work_struct flush_normal;
 	struct work_struct flush_heavy;
@@ -375,7 +407,6 @@ struct ipoib_dev_priv {
 	u16		  pkey_index;
 	struct ib_pd	 *pd;
 	struct ib_cq	 *recv_cq;
-	struct ib_cq	 *send_cq;
 	struct ib_qp	 *qp;
 	u32		  qkey;
 
@@ -388,19 +419,25 @@ struct ipoib_dev_priv {
 
 	struct ipoib_rx_buf *rx_ring;
 
-	struct ipoib_tx_buf *tx_ring;
-	/* cyclic ring variables for managing tx_ring, for UD only */
-	unsigned int	     tx_head;
-	unsigned int	     tx_tail;
-	/* cyclic ring variables for counting overall outstanding send WRs */
+	/* UD send rings, send_ring[0] posts on qp */
+	struct ipoib_send_ring *send_ring;
+	int		     num_send_rings;
+	/*
+	 * cyclic ring variables for counting outstanding send WRs on
+	 * send_ring[0] and the connected mode QPs, which share its CQ
+	 */
 	unsigned int	     global_tx_head;
 	unsigned int	     global_tx_tail;
+	/* connected mode send WR */
 	struct ib_sge	     tx_sge[MAX_SKB_FRAGS + 1];
 	struct ib_ud_wr      tx_wr;
-	struct ib_wc	     send_wc[MAX_SEND_CQE];
 
 	struct ib_recv_wr    rx_wr;
 	struct ib_sge	     rx_sge[IPOIB_UD_RX_SG];
+	/* receives reposted from NAPI, chained into one post_recv */
+	struct ib_recv_wr    rx_batch_wr[IPOIB_NUM_WC];
+	struct ib_sge	     rx_batch_sge[IPOIB_NUM_WC];
+	int		     rx_batch_cnt;
 
 	struct ib_wc ibwc[IPOIB_NUM_WC];
 
@@ -435,7 +472,8 @@ struct ipoib_ah {
 	struct ib_ah	  *ah;
 	struct list_head   list;
 	struct kref	   ref;
-	unsigned int	   last_send;
+	/* send_ring[i].tx_head after the last send through this AH */
+	unsigned int	   last_send[IPOIB_MAX_SEND_RINGS];
 	int  		   valid;
 };
 
@@ -508,6 +546,9 @@ void ipoib_intf_free(struct net_device *dev);
 int ipoib_add_pkey_attr(struct net_device *dev);
 int ipoib_add_umcast_attr(struct net_device *dev);
 
+void ipoib_send_flush(struct net_device *dev, unsigned int queue);
+void ipoib_send_ah(struct net_device *dev, struct sk_buff *skb,
+		   struct ipoib_ah *ah, u32 dqpn);
 int ipoib_send(struct net_device *dev, struct sk_buff *skb,
 	       struct ib_ah *address, u32 dqpn);
 void ipoib_reap_ah(struct work_struct *work);
@@ -554,7 +595,8 @@ void ipoib_dma_unmap_tx(struct ipoib_dev_priv *priv,
 
 struct rtnl_link_ops *ipoib_get_link_ops(void);
 
-static inline void ipoib_build_sge(struct ipoib_dev_priv *priv,
+static inline void ipoib_build_sge(struct ib_sge *tx_sge,
+				   struct ib_ud_wr *tx_wr,
 				   struct ipoib_tx_buf *tx_req)
 {
 	int i, off;
@@ -564,17 +606,17 @@ static inline void ipoib_build_sge(struct ipoib_dev_priv *priv,
 	u64 *mapping = tx_req->mapping;
 
 	if (skb_headlen(skb)) {
-		priv->tx_sge[0].addr         = mapping[0];
-		priv->tx_sge[0].length       = skb_headlen(skb);
+		tx_sge[0].addr         = mapping[0];
+		tx_sge[0].length       = skb_headlen(skb);
 		off = 1;
 	} else
 		off = 0;
 
 	for (i = 0; i < nr_frags; ++i) {
-		priv->tx_sge[i + off].addr = mapping[i + off];
-		priv->tx_sge[i + off].length = skb_frag_size(&frags[i]);
+		tx_sge[i + off].addr = mapping[i + off];
+		tx_sge[i + off].length = skb_frag_size(&frags[i]);
 	}
-	priv->tx_wr.wr.num_sge	     = nr_frags + off;
+	tx_wr->wr.num_sge	     = nr_frags + off;
 }
 
 #ifdef CONFIG_INFINIBAND_IPOIB_DEBUG
@@ -828,6 +870,7 @@ do {							\
 
 extern int ipoib_sendq_size;
 extern int ipoib_recvq_size;
+extern int ipoib_num_send_rings;
 extern u32 ipoib_inline_thold;
 
 extern struct ib_sa_client ipoib_sa_client;
@@ -699,7 +699,7 @@ static inline int post_send(struct ipoib_dev_priv *priv,
 			    unsigned int wr_id,
 			    struct ipoib_tx_buf *tx_req)
 {
-	ipoib_build_sge(priv, tx_req);
+	ipoib_build_sge(priv->tx_sge, &priv->tx_wr, tx_req);
 
 	priv->tx_wr.wr.wr_id	= wr_id | IPOIB_OP_CM;
 
@@ -776,12 +776,12 @@ void ipoib_cm_send(struct net_device *dev, struct sk_buff *skb, struct ipoib_cm_
 	skb_dst_drop(skb);
 
 	if (netif_queue_stopped(dev)) {
-		rc = ib_req_notify_cq(priv->send_cq, IB_CQ_NEXT_COMP |
+		rc = ib_req_notify_cq(priv->send_ring[0].cq, IB_CQ_NEXT_COMP |
 				      IB_CQ_REPORT_MISSED_EVENTS);
 		if (unlikely(rc < 0))
 			ipoib_warn(priv, "IPoIB/CM:request notify on send CQ failed\n");
 		else if (rc)
-			napi_schedule(&priv->send_napi);
+			napi_schedule(&priv->send_ring[0].napi);
 	}
 
 	rc = post_send(priv, tx, tx->tx_head & (priv->sendq_size - 1), tx_req);
@@ -1070,7 +1070,7 @@ static struct ib_qp *ipoib_cm_create_tx_qp(struct net_device *dev, struct ipoib_
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
 	struct ib_qp_init_attr attr = {
-		.send_cq		= priv->send_cq,
+		.send_cq		= priv->send_ring[0].cq,
 		.recv_cq		= priv->recv_cq,
 		.srq			= priv->cm.srq,
 		.cap.max_send_wr	= priv->sendq_size,
@@ -1220,7 +1220,7 @@ static void ipoib_cm_tx_destroy(struct ipoib_cm_tx *p)
 		  p->qp ? p->qp->qp_num : 0, p->tx_head, p->tx_tail);
 
 	/* arming cq*/
-	ib_req_notify_cq(priv->send_cq,
+	ib_req_notify_cq(priv->send_ring[0].cq,
 			 IB_CQ_NEXT_COMP |
 			 IB_CQ_REPORT_MISSED_EVENTS);
 
@@ -1251,7 +1251,7 @@ static void ipoib_cm_tx_destroy(struct ipoib_cm_tx *p)
 					ipoib_drain_cq(p->dev);
 
 				/* arming cq*/
-				ib_req_notify_cq(priv->send_cq,
+				ib_req_notify_cq(priv->send_ring[0].cq,
 						 IB_CQ_NEXT_COMP |
 						 IB_CQ_REPORT_MISSED_EVENTS);
 
@@ -45,6 +45,12 @@
 #include "ipoib.h"
 #include <linux/if_arp.h>      /* For ARPHRD_xxx */
 
+static unsigned int ipoib_rx_copybreak __read_mostly = IPOIB_RX_COPYBREAK;
+
+module_param_named(rx_copybreak, ipoib_rx_copybreak, uint, 0644);
+MODULE_PARM_DESC(rx_copybreak,
+		 "Datagram mode packets up to this size are copied and their receive buffer reused (default = 256)");
+
 #ifdef CONFIG_INFINIBAND_IPOIB_DEBUG_DATA
 static int data_debug_level;
 
@@ -56,15 +62,18 @@ MODULE_PARM_DESC(data_debug_level,
 struct ipoib_ah *ipoib_create_ah(struct net_device *dev,
 				 struct ib_pd *pd, struct rdma_ah_attr *attr)
 {
+	struct ipoib_dev_priv *priv = ipoib_priv(dev);
 	struct ipoib_ah *ah;
 	struct ib_ah *vah;
+	int i;
 
 	ah = kmalloc(sizeof(*ah), GFP_KERNEL);
 	if (!ah)
 		return ERR_PTR(-ENOMEM);
 
 	ah->dev       = dev;
-	ah->last_send = 0;
+	for (i = 0; i < priv->num_send_rings; i++)
+		ah->last_send[i] = READ_ONCE(priv->send_ring[i].tx_head);
 	kref_init(&ah->ref);
 
 	vah = rdma_create_ah(pd, attr, RDMA_CREATE_AH_SLEEPABLE);
@@ -73,7 +82,7 @@ struct ipoib_ah *ipoib_create_ah(struct net_device *dev,
 		ah = (struct ipoib_ah *)vah;
 	} else {
 		ah->ah = vah;
-		ipoib_dbg(ipoib_priv(dev), "Created ah %p\n", ah->ah);
+		ipoib_dbg(priv, "Created ah %p\n", ah->ah);
 	}
 
 	return ah;
@@ -91,6 +100,39 @@ void ipoib_free_ah(struct kref *kref)
 	spin_unlock_irqrestore(&priv->lock, flags);
 }
 
+/*
+ * Datagram sends through an AH must come here so that the AH is kept
+ * until the send completes.  Callers may not hold a reference on the AH
+ * and are only safe because they run in ndo_start_xmit: the reaper takes
+ * every TX queue lock, so it sees last_send updated before it can look
+ * at this AH again.
+ */
+void ipoib_send_ah(struct net_device *dev, struct sk_buff *skb,
+		   struct ipoib_ah *ah, u32 dqpn)
+{
+	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	struct rdma_netdev *rn = netdev_priv(dev);
+	unsigned int queue = skb_get_queue_mapping(skb);
+
+	rn->send(dev, skb, ah->ah, dqpn);
+	if (queue < priv->num_send_rings)
+		ah->last_send[queue] = priv->send_ring[queue].tx_head;
+}
+
+static bool ipoib_is_own_qpn(struct ipoib_dev_priv *priv, u32 qpn)
+{
+	int i;
+
+	if (qpn == priv->qp->qp_num)
+		return true;
+
+	for (i = 1; i < priv->num_send_rings; i++)
+		if (qpn == priv->send_ring[i].qp->qp_num)
+			return true;
+
+	return false;
+}
+
 static void ipoib_ud_dma_unmap_rx(struct ipoib_dev_priv *priv,
 				  u64 mapping[IPOIB_UD_RX_SG])
 {
@@ -120,6 +162,53 @@ static int ipoib_ib_post_receive(struct net_device *dev, int id)
 	return ret;
 }
 
+/*
+ * Receives reposted from the completion handler are chained and handed to
+ * the HCA in one ib_post_recv() per poll batch.
+ */
+static void ipoib_ib_flush_receives(struct ipoib_dev_priv *priv)
+{
+	const struct ib_recv_wr *bad_wr, *wr;
+	int ret, id;
+
+	if (!priv->rx_batch_cnt)
+		return;
+
+	ret = ib_post_recv(priv->qp, priv->rx_batch_wr, &bad_wr);
+	if (unlikely(ret)) {
+		ipoib_warn(priv, "receive failed for %d bufs (%d)\n",
+			   priv->rx_batch_cnt, ret);
+		for (wr = bad_wr; wr; wr = wr->next) {
+			id = wr->wr_id & ~IPOIB_OP_RECV;
+			ipoib_ud_dma_unmap_rx(priv, priv->rx_ring[id].mapping);
+			dev_kfree_skb_any(priv->rx_ring[id].skb);
+			priv->rx_ring[id].skb = NULL;
+		}
+	}
+
+	priv->rx_batch_cnt = 0;
+}
+
+static void ipoib_ib_queue_receive(struct ipoib_dev_priv *priv, int id)
+{
+	struct ib_recv_wr *wr = &priv->rx_batch_wr[priv->rx_batch_cnt];
+	struct ib_sge *sge = &priv->rx_batch_sge[priv->rx_batch_cnt];
+
+	sge->addr   = priv->rx_ring[id].mapping[0];
+	sge->length = priv->rx_sge[0].length;
+	sge->lkey   = priv->rx_sge[0].lkey;
+
+	wr->wr_id   = id | IPOIB_OP_RECV;
+	wr->sg_list = sge;
+	wr->num_sge = 1;
+	wr->next    = NULL;
+	if (priv->rx_batch_cnt)
+		wr[-1].next = wr;
+
+	if (++priv->rx_batch_cnt == IPOIB_NUM_WC)
+		ipoib_ib_flush_receives(priv);
+}
+
 static struct sk_buff *ipoib_alloc_rx_skb(struct net_device *dev, int id)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
@@ -211,6 +300,7 @@ static void ipoib_ib_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 	u64 mapping[IPOIB_UD_RX_SG];
 	union ib_gid *dgid;
 	union ib_gid *sgid;
+	bool own, copy;
 
 	ipoib_dbg_data(priv, "recv completion: id %d, status: %d\n",
 		       wr_id, wc->status);
@@ -234,24 +324,63 @@ static void ipoib_ib_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 		return;
 	}
 
-	memcpy(mapping, priv->rx_ring[wr_id].mapping,
-	       IPOIB_UD_RX_SG * sizeof(*mapping));
+	ipoib_dbg_data(priv, "received %d bytes, SLID 0x%04x\n",
+		       wc->byte_len, wc->slid);
+
+	own = wc->slid == priv->local_lid &&
+	      ipoib_is_own_qpn(priv, wc->src_qp);
+	copy = wc->byte_len <= IB_GRH_BYTES + ipoib_rx_copybreak;
+	if (own || copy)
+		ib_dma_sync_single_for_cpu(priv->ca,
+					   priv->rx_ring[wr_id].mapping[0],
+					   wc->byte_len, DMA_FROM_DEVICE);
 
 	/*
-	 * If we can't allocate a new RX buffer, dump
-	 * this packet and reuse the old buffer.
+	 * Drop packets that this interface sent, ie multicast packets
+	 * that the HCA has replicated.
 	 */
-	if (unlikely(!ipoib_alloc_rx_skb(dev, wr_id))) {
-		++dev->stats.rx_dropped;
-		goto repost;
+	if (own) {
+		sgid = &((struct ib_grh *)skb->data)->sgid;
+
+		if (!(wc->wc_flags & IB_WC_GRH) ||
+		    sgid->global.interface_id == priv->local_gid.global.interface_id)
+			goto recycle;
 	}
 
-	ipoib_dbg_data(priv, "received %d bytes, SLID 0x%04x\n",
-		       wc->byte_len, wc->slid);
+	if (copy) {
+		/*
+		 * Small packets are copied out so the receive buffer can go
+		 * straight back to the HCA without being unmapped and
+		 * replaced.
+		 */
+		skb = dev_alloc_skb(wc->byte_len + IPOIB_PSEUDO_LEN);
+		if (unlikely(!skb)) {
+			++dev->stats.rx_dropped;
+			goto recycle;
+		}
+		skb_reserve(skb, IPOIB_PSEUDO_LEN);
+		skb_put_data(skb, priv->rx_ring[wr_id].skb->data,
+			     wc->byte_len);
+		ib_dma_sync_single_for_device(priv->ca,
+					      priv->rx_ring[wr_id].mapping[0],
+					      wc->byte_len, DMA_FROM_DEVICE);
+	} else {
+		memcpy(mapping, priv->rx_ring[wr_id].mapping,
+		       IPOIB_UD_RX_SG * sizeof(*mapping));
 
-	ipoib_ud_dma_unmap_rx(priv, mapping);
+		/*
+		 * If we can't allocate a new RX buffer, dump
+		 * this packet and reuse the old buffer.
+		 */
+		if (unlikely(!ipoib_alloc_rx_skb(dev, wr_id))) {
+			++dev->stats.rx_dropped;
+			goto recycle;
+		}
 
-	skb_put(skb, wc->byte_len);
+		ipoib_ud_dma_unmap_rx(priv, mapping);
+
+		skb_put(skb, wc->byte_len);
+	}
 
 	/* First byte of dgid signals multicast when 0xff */
 	dgid = &((struct ib_grh *)skb->data)->dgid;
@@ -263,25 +392,6 @@ static void ipoib_ib_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 	else
 		skb->pkt_type = PACKET_MULTICAST;
 
-	sgid = &((struct ib_grh *)skb->data)->sgid;
-
-	/*
-	 * Drop packets that this interface sent, ie multicast packets
-	 * that the HCA has replicated.
-	 */
-	if (wc->slid == priv->local_lid && wc->src_qp == priv->qp->qp_num) {
-		int need_repost = 1;
-
-		if ((wc->wc_flags & IB_WC_GRH) &&
-		    sgid->global.interface_id != priv->local_gid.global.interface_id)
-			need_repost = 0;
-
-		if (need_repost) {
-			dev_kfree_skb_any(skb);
-			goto repost;
-		}
-	}
-
 	skb_pull(skb, IB_GRH_BYTES);
 
 	skb->protocol = ((struct ipoib_header *) skb->data)->proto;
@@ -301,11 +411,15 @@ static void ipoib_ib_handle_rx_wc(struct net_device *dev, struct ib_wc *wc)
 		skb->ip_summed = CHECKSUM_UNNECESSARY;
 
 	napi_gro_receive(&priv->recv_napi, skb);
+	goto repost;
 
+recycle:
+	if (own || copy)
+		ib_dma_sync_single_for_device(priv->ca,
+					      priv->rx_ring[wr_id].mapping[0],
+					      wc->byte_len, DMA_FROM_DEVICE);
 repost:
-	if (unlikely(ipoib_ib_post_receive(dev, wr_id)))
-		ipoib_warn(priv, "ipoib_ib_post_receive failed "
-			   "for buf %d\n", wr_id);
+	ipoib_ib_queue_receive(priv, wr_id);
 }
 
 int ipoib_dma_map_tx(struct ib_device *ca, struct ipoib_tx_buf *tx_req)
@@ -384,45 +498,49 @@ static void ipoib_qp_state_validate_work(struct work_struct *work)
 		container_of(work, struct ipoib_qp_state_validate, work);
 
 	struct ipoib_dev_priv *priv = qp_work->priv;
+	struct ib_qp *qp = qp_work->qp;
 	struct ib_qp_attr qp_attr;
 	struct ib_qp_init_attr query_init_attr;
 	int ret;
 
-	ret = ib_query_qp(priv->qp, &qp_attr, IB_QP_STATE, &query_init_attr);
+	ret = ib_query_qp(qp, &qp_attr, IB_QP_STATE, &query_init_attr);
 	if (ret) {
 		ipoib_warn(priv, "%s: Failed to query QP ret: %d\n",
 			   __func__, ret);
 		goto free_res;
 	}
 	pr_info("%s: QP: 0x%x is in state: %d\n",
-		__func__, priv->qp->qp_num, qp_attr.qp_state);
+		__func__, qp->qp_num, qp_attr.qp_state);
 
 	/* currently support only in SQE->RTS transition*/
 	if (qp_attr.qp_state == IB_QPS_SQE) {
 		qp_attr.qp_state = IB_QPS_RTS;
 
-		ret = ib_modify_qp(priv->qp, &qp_attr, IB_QP_STATE);
+		ret = ib_modify_qp(qp, &qp_attr, IB_QP_STATE);
 		if (ret) {
 			pr_warn("failed(%d) modify QP:0x%x SQE->RTS\n",
-				ret, priv->qp->qp_num);
+				ret, qp->qp_num);
 			goto free_res;
 		}
 		pr_info("%s: QP: 0x%x moved from IB_QPS_SQE to IB_QPS_RTS\n",
-			__func__, priv->qp->qp_num);
+			__func__, qp->qp_num);
 	} else {
 		pr_warn("QP (%d) will stay in state: %d\n",
-			priv->qp->qp_num, qp_attr.qp_state);
+			qp->qp_num, qp_attr.qp_state);
 	}
 
 free_res:
 	kfree(qp_work);
 }
 
-static void ipoib_ib_handle_tx_wc(struct net_device *dev, struct ib_wc *wc)
+static void ipoib_ib_handle_tx_wc(struct ipoib_send_ring *txr,
+				  struct ib_wc *wc)
 {
-	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	struct ipoib_dev_priv *priv = txr->priv;
+	struct net_device *dev = priv->dev;
 	unsigned int wr_id = wc->wr_id;
 	struct ipoib_tx_buf *tx_req;
+	bool wake;
 
 	ipoib_dbg_data(priv, "send completion: id %d, status: %d\n",
 		       wr_id, wc->status);
@@ -433,24 +551,28 @@ static void ipoib_ib_handle_tx_wc(struct net_device *dev, struct ib_wc *wc)
 		return;
 	}
 
-	tx_req = &priv->tx_ring[wr_id];
+	tx_req = &txr->tx_ring[wr_id];
 
 	if (!tx_req->is_inline)
 		ipoib_dma_unmap_tx(priv, tx_req);
 
-	++dev->stats.tx_packets;
-	dev->stats.tx_bytes += tx_req->skb->len;
+	++txr->tx_packets;
+	txr->tx_bytes += tx_req->skb->len;
 
 	dev_kfree_skb_any(tx_req->skb);
 
-	++priv->tx_tail;
-	++priv->global_tx_tail;
+	++txr->tx_tail;
+	if (!txr->index) {
+		++priv->global_tx_tail;
+		wake = (priv->global_tx_head - priv->global_tx_tail) <=
+		       priv->sendq_size >> 1;
+	} else {
+		wake = (txr->tx_head - txr->tx_tail) <= priv->sendq_size >> 1;
+	}
 
-	if (unlikely(netif_queue_stopped(dev) &&
-		     ((priv->global_tx_head - priv->global_tx_tail) <=
-		      priv->sendq_size >> 1) &&
+	if (unlikely(wake && __netif_subqueue_stopped(dev, txr->index) &&
 		     test_bit(IPOIB_FLAG_ADMIN_UP, &priv->flags)))
-		netif_wake_queue(dev);
+		netif_wake_subqueue(dev, txr->index);
 
 	if (wc->status != IB_WC_SUCCESS &&
 	    wc->status != IB_WC_WR_FLUSH_ERR) {
@@ -464,22 +586,23 @@ static void ipoib_ib_handle_tx_wc(struct net_device *dev, struct ib_wc *wc)
 
 		INIT_WORK(&qp_work->work, ipoib_qp_state_validate_work);
 		qp_work->priv = priv;
+		qp_work->qp = txr->qp;
 		queue_work(priv->wq, &qp_work->work);
 	}
 }
 
-static int poll_tx(struct ipoib_dev_priv *priv)
+static int poll_tx(struct ipoib_send_ring *txr)
 {
 	int n, i;
 	struct ib_wc *wc;
 
-	n = ib_poll_cq(priv->send_cq, MAX_SEND_CQE, priv->send_wc);
+	n = ib_poll_cq(txr->cq, MAX_SEND_CQE, txr->send_wc);
 	for (i = 0; i < n; ++i) {
-		wc = priv->send_wc + i;
+		wc = txr->send_wc + i;
 		if (wc->wr_id & IPOIB_OP_CM)
-			ipoib_cm_handle_tx_wc(priv->dev, priv->send_wc + i);
+			ipoib_cm_handle_tx_wc(txr->priv->dev, wc);
 		else
-			ipoib_ib_handle_tx_wc(priv->dev, priv->send_wc + i);
+			ipoib_ib_handle_tx_wc(txr, wc);
 	}
 	return n == MAX_SEND_CQE;
 }
@@ -515,6 +638,7 @@ poll_more:
 				pr_warn("%s: Got unexpected wqe id\n", __func__);
 			}
 		}
+		ipoib_ib_flush_receives(priv);
 
 		if (n != t)
 			break;
@@ -534,26 +658,26 @@ poll_more:
 
 int ipoib_tx_poll(struct napi_struct *napi, int budget)
 {
-	struct ipoib_dev_priv *priv = container_of(napi, struct ipoib_dev_priv,
-						   send_napi);
-	struct net_device *dev = priv->dev;
+	struct ipoib_send_ring *txr = container_of(napi, struct ipoib_send_ring,
+						   napi);
+	struct net_device *dev = txr->priv->dev;
 	int n, i;
 	struct ib_wc *wc;
 
 poll_more:
-	n = ib_poll_cq(priv->send_cq, MAX_SEND_CQE, priv->send_wc);
+	n = ib_poll_cq(txr->cq, MAX_SEND_CQE, txr->send_wc);
 
 	for (i = 0; i < n; i++) {
-		wc = priv->send_wc + i;
+		wc = txr->send_wc + i;
 		if (wc->wr_id & IPOIB_OP_CM)
 			ipoib_cm_handle_tx_wc(dev, wc);
 		else
-			ipoib_ib_handle_tx_wc(dev, wc);
+			ipoib_ib_handle_tx_wc(txr, wc);
 	}
 
 	if (n < budget) {
 		napi_complete(napi);
-		if (unlikely(ib_req_notify_cq(priv->send_cq, IB_CQ_NEXT_COMP |
+		if (unlikely(ib_req_notify_cq(txr->cq, IB_CQ_NEXT_COMP |
 					      IB_CQ_REPORT_MISSED_EVENTS)) &&
 		    napi_reschedule(napi))
 			goto poll_more;
@@ -571,70 +695,145 @@ void ipoib_ib_rx_completion(struct ib_cq *cq, void *ctx_ptr)
 /* The function will force napi_schedule */
 void ipoib_napi_schedule_work(struct work_struct *work)
 {
-	struct ipoib_dev_priv *priv =
-		container_of(work, struct ipoib_dev_priv, reschedule_napi_work);
+	struct ipoib_send_ring *txr =
+		container_of(work, struct ipoib_send_ring, reschedule_napi_work);
+	struct ipoib_dev_priv *priv = txr->priv;
 	bool ret;
 
 	do {
-		ret = napi_reschedule(&priv->send_napi);
+		ret = napi_reschedule(&txr->napi);
 		if (!ret)
 			msleep(3);
-	} while (!ret && netif_queue_stopped(priv->dev) &&
+	} while (!ret && __netif_subqueue_stopped(priv->dev, txr->index) &&
 		 test_bit(IPOIB_FLAG_INITIALIZED, &priv->flags));
 }
 
 void ipoib_ib_tx_completion(struct ib_cq *cq, void *ctx_ptr)
 {
-	struct ipoib_dev_priv *priv = ctx_ptr;
+	struct ipoib_send_ring *txr = ctx_ptr;
 	bool ret;
 
-	ret = napi_reschedule(&priv->send_napi);
+	ret = napi_reschedule(&txr->napi);
 	/*
 	 * if the queue is closed the driver must be able to schedule napi,
 	 * otherwise we can end with closed queue forever, because no new
 	 * packets to send and napi callback might not get new event after
 	 * its re-arm of the napi.
 	 */
-	if (!ret && netif_queue_stopped(priv->dev))
-		schedule_work(&priv->reschedule_napi_work);
+	if (!ret && __netif_subqueue_stopped(txr->priv->dev, txr->index))
+		schedule_work(&txr->reschedule_napi_work);
 }
 
-static inline int post_send(struct ipoib_dev_priv *priv,
-			    unsigned int wr_id,
-			    struct ib_ah *address, u32 dqpn,
-			    struct ipoib_tx_buf *tx_req,
-			    void *head, int hlen)
+/*
+ * Build the send WR for tx_req in the next batch slot and chain it to the
+ * previous one; nothing reaches the HCA until ipoib_post_pending_sends().
+ */
+static inline void queue_send(struct ipoib_send_ring *txr,
+			      unsigned int wr_id,
+			      struct ib_ah *address, u32 dqpn,
+			      struct ipoib_tx_buf *tx_req,
+			      void *head, int hlen)
 {
+	struct ib_ud_wr *wr = &txr->tx_wr[txr->tx_pending];
+	struct ib_sge *sge = txr->tx_sge[txr->tx_pending];
 	struct sk_buff *skb = tx_req->skb;
 
 	if (tx_req->is_inline) {
-		priv->tx_sge[0].addr	= (u64)skb->data;
-		priv->tx_sge[0].length	= skb->len;
-		priv->tx_wr.wr.num_sge	= 1;
+		sge[0].addr	= (u64)skb->data;
+		sge[0].length	= skb->len;
+		wr->wr.num_sge	= 1;
+		wr->wr.send_flags |= IB_SEND_INLINE;
 	} else {
-		ipoib_build_sge(priv, tx_req);
+		ipoib_build_sge(sge, wr, tx_req);
+		wr->wr.send_flags &= ~IB_SEND_INLINE;
 	}
 
-	priv->tx_wr.wr.wr_id	= wr_id;
-	priv->tx_wr.remote_qpn	= dqpn;
-	priv->tx_wr.ah		= address;
+	if (skb->ip_summed == CHECKSUM_PARTIAL)
+		wr->wr.send_flags |= IB_SEND_IP_CSUM;
+	else
+		wr->wr.send_flags &= ~IB_SEND_IP_CSUM;
+
+	wr->wr.wr_id	= wr_id;
+	wr->remote_qpn	= dqpn;
+	wr->ah		= address;
 
 	if (head) {
-		priv->tx_wr.mss		= skb_shinfo(skb)->gso_size;
-		priv->tx_wr.header	= head;
-		priv->tx_wr.hlen	= hlen;
-		priv->tx_wr.wr.opcode	= IB_WR_LSO;
+		wr->mss		= skb_shinfo(skb)->gso_size;
+		wr->header	= head;
+		wr->hlen	= hlen;
+		wr->wr.opcode	= IB_WR_LSO;
 	} else
-		priv->tx_wr.wr.opcode	= IB_WR_SEND;
+		wr->wr.opcode	= IB_WR_SEND;
 
-	return ib_post_send(priv->qp, &priv->tx_wr.wr, NULL);
+	wr->wr.next = NULL;
+	if (txr->tx_pending)
+		txr->tx_wr[txr->tx_pending - 1].wr.next = &wr->wr;
+	++txr->tx_pending;
+}
+
+/*
+ * Post the chained send WRs with one doorbell.  The ring entries of WRs
+ * the HCA refused are the newest ones, so they are freed and the head is
+ * moved back over them.
+ */
+static int ipoib_post_pending_sends(struct ipoib_send_ring *txr)
+{
+	struct ipoib_dev_priv *priv = txr->priv;
+	struct net_device *dev = priv->dev;
+	const struct ib_send_wr *bad_wr;
+	struct ipoib_tx_buf *tx_req;
+	unsigned int failed;
+	int ret;
+
+	if (!txr->tx_pending)
+		return 0;
+
+	ret = ib_post_send(txr->qp, &txr->tx_wr[0].wr, &bad_wr);
+	if (unlikely(ret)) {
+		ipoib_warn(priv, "post_send failed, error %d\n", ret);
+		failed = txr->tx_pending -
+			 (container_of(bad_wr, struct ib_ud_wr, wr) - txr->tx_wr);
+		while (failed--) {
+			--txr->tx_head;
+			if (!txr->index)
+				--priv->global_tx_head;
+			tx_req = &txr->tx_ring[txr->tx_head &
+					       (priv->sendq_size - 1)];
+			++dev->stats.tx_errors;
+			if (!tx_req->is_inline)
+				ipoib_dma_unmap_tx(priv, tx_req);
+			dev_kfree_skb_any(tx_req->skb);
+		}
+		if (__netif_subqueue_stopped(dev, txr->index))
+			netif_wake_subqueue(dev, txr->index);
+	}
+
+	txr->tx_pending = 0;
+	return ret;
+}
+
+/*
+ * Called at the end of ndo_start_xmit for skbs that did not end up in
+ * ipoib_send(), so sends deferred for the rest of the burst still get
+ * their doorbell.
+ */
+void ipoib_send_flush(struct net_device *dev, unsigned int queue)
+{
+	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+
+	if (queue < priv->num_send_rings)
+		ipoib_post_pending_sends(&priv->send_ring[queue]);
 }
 
 int ipoib_send(struct net_device *dev, struct sk_buff *skb,
 	       struct ib_ah *address, u32 dqpn)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	/* only reached from ndo_start_xmit, under this queue's xmit lock */
+	struct ipoib_send_ring *txr =
+		&priv->send_ring[skb_get_queue_mapping(skb)];
 	struct ipoib_tx_buf *tx_req;
+	unsigned int outstanding;
 	int hlen, rc;
 	void *phead;
 	unsigned int usable_sge = priv->max_send_sge - !!skb_headlen(skb);
@@ -690,13 +889,12 @@ int ipoib_send(struct net_device *dev, struct sk_buff *skb,
 	 * means we have to make sure everything is properly recorded and
 	 * our state is consistent before we call post_send().
 	 */
-	tx_req = &priv->tx_ring[priv->tx_head & (priv->sendq_size - 1)];
+	tx_req = &txr->tx_ring[txr->tx_head & (priv->sendq_size - 1)];
 	tx_req->skb = skb;
 
 	if (skb->len < ipoib_inline_thold &&
 	    !skb_shinfo(skb)->nr_frags) {
 		tx_req->is_inline = 1;
-		priv->tx_wr.wr.send_flags |= IB_SEND_INLINE;
 	} else {
 		if (unlikely(ipoib_dma_map_tx(priv->ca, tx_req))) {
 			++dev->stats.tx_errors;
@@ -704,46 +902,48 @@ int ipoib_send(struct net_device *dev, struct sk_buff *skb,
 			return -1;
 		}
 		tx_req->is_inline = 0;
-		priv->tx_wr.wr.send_flags &= ~IB_SEND_INLINE;
 	}
 
-	if (skb->ip_summed == CHECKSUM_PARTIAL)
-		priv->tx_wr.wr.send_flags |= IB_SEND_IP_CSUM;
+	/*
+	 * tx_head counts queued WRs, posted or not, and is used for queue
+	 * state.  Ring 0 shares its CQ with connected mode, so it has to
+	 * count those sends as well.
+	 */
+	if (!txr->index)
+		outstanding = priv->global_tx_head - priv->global_tx_tail;
 	else
-		priv->tx_wr.wr.send_flags &= ~IB_SEND_IP_CSUM;
-	/* increase the tx_head after send success, but use it for queue state */
-	if ((priv->global_tx_head - priv->global_tx_tail) ==
-	    priv->sendq_size - 1) {
-		ipoib_dbg(priv, "TX ring full, stopping kernel net queue\n");
-		netif_stop_queue(dev);
+		outstanding = txr->tx_head - txr->tx_tail;
+	if (outstanding == priv->sendq_size - 1) {
+		ipoib_dbg(priv, "TX ring %d full, stopping kernel net queue\n",
+			  txr->index);
+		netif_stop_subqueue(dev, txr->index);
 	}
 
 	skb_orphan(skb);
 	skb_dst_drop(skb);
 
-	if (netif_queue_stopped(dev))
-		if (ib_req_notify_cq(priv->send_cq, IB_CQ_NEXT_COMP |
+	if (__netif_subqueue_stopped(dev, txr->index))
+		if (ib_req_notify_cq(txr->cq, IB_CQ_NEXT_COMP |
 				     IB_CQ_REPORT_MISSED_EVENTS) < 0)
 			ipoib_warn(priv, "request notify on send CQ failed\n");
 
-	rc = post_send(priv, priv->tx_head & (priv->sendq_size - 1),
-		       address, dqpn, tx_req, phead, hlen);
-	if (unlikely(rc)) {
-		ipoib_warn(priv, "post_send failed, error %d\n", rc);
-		++dev->stats.tx_errors;
-		if (!tx_req->is_inline)
-			ipoib_dma_unmap_tx(priv, tx_req);
-		dev_kfree_skb_any(skb);
-		if (netif_queue_stopped(dev))
-			netif_wake_queue(dev);
-		rc = 0;
-	} else {
-		netif_trans_update(dev);
-
-		rc = priv->tx_head;
-		++priv->tx_head;
+	queue_send(txr, txr->tx_head & (priv->sendq_size - 1),
+		   address, dqpn, tx_req, phead, hlen);
+	rc = txr->tx_head;
+	++txr->tx_head;
+	if (!txr->index)
 		++priv->global_tx_head;
-	}
+	netif_trans_update(dev);
+
+	/*
+	 * A stopped queue gets no further xmit calls to ring the doorbell
+	 * for us, and its completions are what will restart it.
+	 */
+	if (!netdev_xmit_more() || txr->tx_pending == IPOIB_TX_BATCH ||
+	    __netif_subqueue_stopped(dev, txr->index))
+		if (ipoib_post_pending_sends(txr))
+			rc = 0;
+
 	return rc;
 }
 
@@ -751,16 +951,23 @@ static void ipoib_reap_dead_ahs(struct ipoib_dev_priv *priv)
 {
 	struct ipoib_ah *ah, *tah;
 	unsigned long flags;
+	int i;
 
 	netif_tx_lock_bh(priv->dev);
 	spin_lock_irqsave(&priv->lock, flags);
 
-	list_for_each_entry_safe(ah, tah, &priv->dead_ahs, list)
-		if ((int) priv->tx_tail - (int) ah->last_send >= 0) {
-			list_del(&ah->list);
-			rdma_destroy_ah(ah->ah, 0);
-			kfree(ah);
-		}
+	list_for_each_entry_safe(ah, tah, &priv->dead_ahs, list) {
+		for (i = 0; i < priv->num_send_rings; i++)
+			if ((int) priv->send_ring[i].tx_tail -
+			    (int) ah->last_send[i] < 0)
+				break;
+		if (i < priv->num_send_rings)
+			continue;
+
+		list_del(&ah->list);
+		rdma_destroy_ah(ah->ah, 0);
+		kfree(ah);
+	}
 
 	spin_unlock_irqrestore(&priv->lock, flags);
 	netif_tx_unlock_bh(priv->dev);
@@ -833,17 +1040,69 @@ static void check_qp_movement_and_print(struct ipoib_dev_priv *priv,
 static void ipoib_napi_enable(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
 
 	napi_enable(&priv->recv_napi);
-	napi_enable(&priv->send_napi);
+	for (i = 0; i < priv->num_send_rings; i++)
+		napi_enable(&priv->send_ring[i].napi);
 }
 
 static void ipoib_napi_disable(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
 
 	napi_disable(&priv->recv_napi);
-	napi_disable(&priv->send_napi);
+	for (i = 0; i < priv->num_send_rings; i++)
+		napi_disable(&priv->send_ring[i].napi);
+}
+
+static int sends_pending(struct ipoib_dev_priv *priv)
+{
+	int pending = 0;
+	int i;
+
+	for (i = 0; i < priv->num_send_rings; i++)
+		pending += priv->send_ring[i].tx_head -
+			   priv->send_ring[i].tx_tail;
+
+	return pending;
+}
+
+/*
+ * Give the HCA the send chains still waiting for their doorbell, so that
+ * moving the QPs to the error state flushes them like any other send.
+ */
+static void ipoib_post_all_pending_sends(struct ipoib_dev_priv *priv)
+{
+	struct netdev_queue *txq;
+	int i;
+
+	for (i = 0; i < priv->num_send_rings; i++) {
+		txq = netdev_get_tx_queue(priv->dev, i);
+		__netif_tx_lock_bh(txq);
+		ipoib_post_pending_sends(&priv->send_ring[i]);
+		__netif_tx_unlock_bh(txq);
+	}
+}
+
+static void ipoib_free_pending_sends(struct ipoib_send_ring *txr)
+{
+	struct ipoib_dev_priv *priv = txr->priv;
+	struct ipoib_tx_buf *tx_req;
+
+	/* the chained WRs point at the skbs freed below */
+	txr->tx_pending = 0;
+
+	while ((int)txr->tx_tail - (int)txr->tx_head < 0) {
+		tx_req = &txr->tx_ring[txr->tx_tail & (priv->sendq_size - 1)];
+		if (!tx_req->is_inline)
+			ipoib_dma_unmap_tx(priv, tx_req);
+		dev_kfree_skb_any(tx_req->skb);
+		++txr->tx_tail;
+		if (!txr->index)
+			++priv->global_tx_tail;
+	}
 }
 
 int ipoib_ib_dev_stop_default(struct net_device *dev)
@@ -851,7 +1110,6 @@ int ipoib_ib_dev_stop_default(struct net_device *dev)
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
 	struct ib_qp_attr qp_attr;
 	unsigned long begin;
-	struct ipoib_tx_buf *tx_req;
 	int i;
 
 	if (test_bit(IPOIB_FLAG_INITIALIZED, &priv->flags))
@@ -859,37 +1117,35 @@ int ipoib_ib_dev_stop_default(struct net_device *dev)
 
 	ipoib_cm_dev_stop(dev);
 
+	ipoib_post_all_pending_sends(priv);
+
 	/*
-	 * Move our QP to the error state and then reinitialize in
+	 * Move our QPs to the error state and then reinitialize in
 	 * when all work requests have completed or have been flushed.
 	 */
 	qp_attr.qp_state = IB_QPS_ERR;
 	if (ib_modify_qp(priv->qp, &qp_attr, IB_QP_STATE))
 		check_qp_movement_and_print(priv, priv->qp, IB_QPS_ERR);
+	for (i = 1; i < priv->num_send_rings; i++)
+		if (ib_modify_qp(priv->send_ring[i].qp, &qp_attr, IB_QP_STATE))
+			check_qp_movement_and_print(priv, priv->send_ring[i].qp,
+						    IB_QPS_ERR);
 
 	/* Wait for all sends and receives to complete */
 	begin = jiffies;
 
-	while (priv->tx_head != priv->tx_tail || recvs_pending(dev)) {
+	while (sends_pending(priv) || recvs_pending(dev)) {
 		if (time_after(jiffies, begin + 5 * HZ)) {
 			ipoib_warn(priv,
 				   "timing out; %d sends %d receives not completed\n",
-				   priv->tx_head - priv->tx_tail,
-				   recvs_pending(dev));
+				   sends_pending(priv), recvs_pending(dev));
 
 			/*
 			 * assume the HW is wedged and just free up
 			 * all our pending work requests.
 			 */
-			while ((int)priv->tx_tail - (int)priv->tx_head < 0) {
-				tx_req = &priv->tx_ring[priv->tx_tail &
-							(priv->sendq_size - 1)];
-				if (!tx_req->is_inline)
-					ipoib_dma_unmap_tx(priv, tx_req);
-				dev_kfree_skb_any(tx_req->skb);
-				++priv->tx_tail;
-				++priv->global_tx_tail;
-			}
+			for (i = 0; i < priv->num_send_rings; i++)
+				ipoib_free_pending_sends(&priv->send_ring[i]);
 
 			for (i = 0; i < priv->recvq_size; ++i) {
 				struct ipoib_rx_buf *rx_req;
@@ -917,6 +1173,10 @@ timeout:
 	qp_attr.qp_state = IB_QPS_RESET;
 	if (ib_modify_qp(priv->qp, &qp_attr, IB_QP_STATE))
 		check_qp_movement_and_print(priv, priv->qp, IB_QPS_RESET);
+	for (i = 1; i < priv->num_send_rings; i++)
+		if (ib_modify_qp(priv->send_ring[i].qp, &qp_attr, IB_QP_STATE))
+			check_qp_movement_and_print(priv, priv->send_ring[i].qp,
+						    IB_QPS_RESET);
 
 	ib_req_notify_cq(priv->recv_cq, IB_CQ_NEXT_COMP);
 
@@ -1078,8 +1338,9 @@ void ipoib_drain_cq(struct net_device *dev)
 		}
 	} while (n == IPOIB_NUM_WC);
 
-	while (poll_tx(priv))
-		; /* nothing */
+	for (i = 0; i < priv->num_send_rings; i++)
+		while (poll_tx(&priv->send_ring[i]))
+			; /* nothing */
 
 	local_bh_enable();
 }
@@ -1319,8 +1580,7 @@ static void __ipoib_ib_dev_flush(struct ipoib_dev_priv *priv,
 		if (ipoib_ib_dev_open(dev))
 			return;
 
-		if (netif_queue_stopped(dev))
-			netif_start_queue(dev);
+		netif_tx_start_all_queues(dev);
 	}
 
 	/*
@@ -59,12 +59,15 @@ MODULE_LICENSE("Dual BSD/GPL");
 
 int ipoib_sendq_size __read_mostly = IPOIB_TX_RING_SIZE;
 int ipoib_recvq_size __read_mostly = IPOIB_RX_RING_SIZE;
+int ipoib_num_send_rings __read_mostly = 1;
 int ipoib_enhanced_enabled = 1;
 
 module_param_named(send_queue_size, ipoib_sendq_size, int, 0444);
 MODULE_PARM_DESC(send_queue_size, "Number of descriptors in send queue");
 module_param_named(recv_queue_size, ipoib_recvq_size, int, 0444);
 MODULE_PARM_DESC(recv_queue_size, "Number of descriptors in receive queue");
+module_param_named(num_send_queues, ipoib_num_send_rings, int, 0444);
+MODULE_PARM_DESC(num_send_queues, "Number of datagram mode TX queues, each with its own UD QP (default = 1) (1-16)");
 
 #ifdef CONFIG_INFINIBAND_IPOIB_DEBUG
 int ipoib_debug_level;
@@ -179,7 +182,7 @@ int ipoib_open(struct net_device *dev)
 			ipoib_dbg(priv, "parent device %s is not up, so child device may be not functioning.\n",
 				  ppriv->dev->name);
 	}
-	netif_start_queue(dev);
+	netif_tx_start_all_queues(dev);
 
 	return 0;
 
@@ -197,7 +200,7 @@ static int ipoib_stop(struct net_device *dev)
 
 	clear_bit(IPOIB_FLAG_ADMIN_UP, &priv->flags);
 
-	netif_stop_queue(dev);
+	netif_tx_stop_all_queues(dev);
 
 	ipoib_ib_dev_down(dev);
 	ipoib_ib_dev_stop(dev);
@@ -287,11 +290,18 @@ static void ipoib_get_stats(struct net_device *dev,
 			    struct rtnl_link_stats64 *stats)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
 
-	if (priv->rn_ops->ndo_get_stats64)
+	if (priv->rn_ops->ndo_get_stats64) {
 		priv->rn_ops->ndo_get_stats64(dev, stats);
-	else
-		netdev_stats_to_stats64(stats, &dev->stats);
+		return;
+	}
+
+	netdev_stats_to_stats64(stats, &dev->stats);
+	for (i = 0; i < priv->num_send_rings; i++) {
+		stats->tx_packets += READ_ONCE(priv->send_ring[i].tx_packets);
+		stats->tx_bytes += READ_ONCE(priv->send_ring[i].tx_bytes);
+	}
 }
 
 /* Called with an RCU read lock taken */
@@ -546,6 +556,8 @@ int ipoib_set_mode(struct net_device *dev, const char *buf)
 				   "will cause multicast packet drops\n");
 			netdev_update_features(dev);
 			dev_set_mtu(dev, ipoib_cm_max_mtu(dev));
+			/* connected mode sends share send_ring[0] */
+			netif_set_real_num_tx_queues(dev, 1);
 			rtnl_unlock();
 			priv->tx_wr.wr.send_flags &= ~IB_SEND_IP_CSUM;
 			priv->tx_wr.wr.opcode = IB_WR_SEND;
@@ -563,7 +575,8 @@ int ipoib_set_mode(struct net_device *dev, const char *buf)
 		clear_bit(IPOIB_FLAG_ADMIN_CM, &priv->flags);
 		netdev_update_features(dev);
 		dev_set_mtu(dev, min(priv->mcast_mtu, dev->mtu));
-		netif_set_real_num_tx_queues(dev, dev->num_tx_queues);
+		netif_set_real_num_tx_queues(dev, priv->num_send_rings ?:
+						       dev->num_tx_queues);
 		rtnl_unlock();
 		ipoib_flush_paths(dev);
 		return (!rtnl_trylock()) ? -EBUSY : 0;
@@ -971,7 +984,6 @@ static struct ipoib_neigh *neigh_add_path(struct sk_buff *skb, u8 *daddr,
 					  struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
-	struct rdma_netdev *rn = netdev_priv(dev);
 	struct ipoib_path *path;
 	struct ipoib_neigh *neigh;
 	unsigned long flags;
@@ -1026,8 +1038,7 @@ static struct ipoib_neigh *neigh_add_path(struct sk_buff *skb, u8 *daddr,
 			}
 		} else {
 			spin_unlock_irqrestore(&priv->lock, flags);
-			path->ah->last_send = rn->send(dev, skb, path->ah->ah,
-						       IPOIB_QPN(daddr));
+			ipoib_send_ah(dev, skb, path->ah, IPOIB_QPN(daddr));
 			ipoib_neigh_put(neigh);
 			return NULL;
 		}
@@ -1130,7 +1141,6 @@ static void unicast_arp_send(struct sk_buff *skb, struct net_device *dev,
 			     struct ipoib_pseudo_header *phdr)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
-	struct rdma_netdev *rn = netdev_priv(dev);
 	struct ipoib_path *path;
 	unsigned long flags;
 
@@ -1170,8 +1180,7 @@ static void unicast_arp_send(struct sk_buff *skb, struct net_device *dev,
 	spin_unlock_irqrestore(&priv->lock, flags);
 	ipoib_dbg(priv, "Send unicast ARP to %08x\n",
 		  be32_to_cpu(sa_path_get_dlid(&path->pathrec)));
-	path->ah->last_send = rn->send(dev, skb, path->ah->ah,
-				       IPOIB_QPN(phdr->hwaddr));
+	ipoib_send_ah(dev, skb, path->ah, IPOIB_QPN(phdr->hwaddr));
 	return;
 
 drop_and_unlock:
@@ -1181,10 +1190,10 @@ unlock:
 	spin_unlock_irqrestore(&priv->lock, flags);
 }
 
-static netdev_tx_t ipoib_start_xmit(struct sk_buff *skb, struct net_device *dev)
+static netdev_tx_t __ipoib_start_xmit(struct sk_buff *skb,
+				      struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
-	struct rdma_netdev *rn = netdev_priv(dev);
 	struct ipoib_neigh *neigh;
 	struct ipoib_pseudo_header *phdr;
 	struct ipoib_header *header;
@@ -1249,8 +1258,7 @@ send_using_neigh:
 			goto unref;
 		}
 	} else if (neigh->ah && neigh->ah->valid) {
-		neigh->ah->last_send = rn->send(dev, skb, neigh->ah->ah,
-						IPOIB_QPN(phdr->hwaddr));
+		ipoib_send_ah(dev, skb, neigh->ah, IPOIB_QPN(phdr->hwaddr));
 		goto unref;
 	} else if (neigh->ah) {
 		neigh_refresh_path(neigh, phdr->hwaddr, dev);
@@ -1284,6 +1292,24 @@ unref:
 	return NETDEV_TX_OK;
 }
 
+static netdev_tx_t ipoib_start_xmit(struct sk_buff *skb, struct net_device *dev)
+{
+	unsigned int queue = skb_get_queue_mapping(skb);
+	netdev_tx_t ret;
+
+	ret = __ipoib_start_xmit(skb, dev);
+
+	/*
+	 * ipoib_send() defers the doorbell while the stack has more to
+	 * send, but this skb may have been dropped, queued or sent in
+	 * connected mode instead.
+	 */
+	if (!netdev_xmit_more() || __netif_subqueue_stopped(dev, queue))
+		ipoib_send_flush(dev, queue);
+
+	return ret;
+}
+
 static void ipoib_timeout(struct net_device *dev, unsigned int txqueue)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
@@ -1295,10 +1321,13 @@ static void ipoib_timeout(struct net_device *dev, unsigned int txqueue)
 	}
 	ipoib_warn(priv, "transmit timeout: latency %d msecs\n",
 		   jiffies_to_msecs(jiffies - dev_trans_start(dev)));
-	ipoib_warn(priv,
-		   "queue stopped %d, tx_head %u, tx_tail %u, global_tx_head %u, global_tx_tail %u\n",
-		   netif_queue_stopped(dev), priv->tx_head, priv->tx_tail,
-		   priv->global_tx_head, priv->global_tx_tail);
+	if (txqueue < priv->num_send_rings)
+		ipoib_warn(priv,
+			   "queue %u stopped %d, tx_head %u, tx_tail %u, global_tx_head %u, global_tx_tail %u\n",
+			   txqueue, __netif_subqueue_stopped(dev, txqueue),
+			   priv->send_ring[txqueue].tx_head,
+			   priv->send_ring[txqueue].tx_tail,
+			   priv->global_tx_head, priv->global_tx_tail);
 
 
 	schedule_work(&priv->tx_timeout_work);
@@ -1797,17 +1826,70 @@ static void ipoib_neigh_hash_uninit(struct net_device *dev)
 static void ipoib_napi_add(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
 
 	netif_napi_add(dev, &priv->recv_napi, ipoib_rx_poll, IPOIB_NUM_WC);
-	netif_napi_add(dev, &priv->send_napi, ipoib_tx_poll, MAX_SEND_CQE);
+	for (i = 0; i < priv->num_send_rings; i++)
+		netif_napi_add(dev, &priv->send_ring[i].napi, ipoib_tx_poll,
+			       MAX_SEND_CQE);
 }
 
 static void ipoib_napi_del(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
 
 	netif_napi_del(&priv->recv_napi);
-	netif_napi_del(&priv->send_napi);
+	for (i = 0; i < priv->num_send_rings; i++)
+		netif_napi_del(&priv->send_ring[i].napi);
+}
+
+static void ipoib_free_send_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
+
+	if (!priv->send_ring)
+		return;
+
+	/* a ring that failed to get a QP still has its tx_ring allocated */
+	for (i = 0; i < dev->num_tx_queues; i++)
+		vfree(priv->send_ring[i].tx_ring);
+
+	kvfree(priv->send_ring);
+	priv->send_ring = NULL;
+	priv->num_send_rings = 0;
+}
+
+static int ipoib_alloc_send_rings(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	struct ipoib_send_ring *txr;
+	int i;
+
+	priv->send_ring = kvcalloc(dev->num_tx_queues, sizeof(*priv->send_ring),
+				   GFP_KERNEL);
+	if (!priv->send_ring)
+		return -ENOMEM;
+	priv->num_send_rings = dev->num_tx_queues;
+
+	for (i = 0; i < priv->num_send_rings; i++) {
+		txr = &priv->send_ring[i];
+		txr->priv = priv;
+		txr->index = i;
+		INIT_WORK(&txr->reschedule_napi_work, ipoib_napi_schedule_work);
+
+		txr->tx_ring = vzalloc(array_size(priv->sendq_size,
+						  sizeof(*txr->tx_ring)));
+		if (!txr->tx_ring) {
+			pr_warn("%s: failed to allocate TX ring (%d entries)\n",
+				priv->ca->name, priv->sendq_size);
+			ipoib_free_send_rings(dev);
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
 }
 
 static void ipoib_dev_uninit_default(struct net_device *dev)
@@ -1821,10 +1903,9 @@ static void ipoib_dev_uninit_default(struct net_device *dev)
 	ipoib_cm_dev_cleanup(dev);
 
 	kfree(priv->rx_ring);
-	vfree(priv->tx_ring);
+	ipoib_free_send_rings(dev);
 
 	priv->rx_ring = NULL;
-	priv->tx_ring = NULL;
 }
 
 static int ipoib_dev_init_default(struct net_device *dev)
@@ -1832,8 +1913,6 @@ static int ipoib_dev_init_default(struct net_device *dev)
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
 	u8 addr_mod[3];
 
-	ipoib_napi_add(dev);
-
 	/* Allocate RX/TX "rings" to hold queued skbs */
 	priv->rx_ring =	kcalloc(priv->recvq_size,
 				       sizeof(*priv->rx_ring),
@@ -1841,15 +1920,10 @@ static int ipoib_dev_init_default(struct net_device *dev)
 	if (!priv->rx_ring)
 		goto out;
 
-	priv->tx_ring = vzalloc(array_size(priv->sendq_size,
-					   sizeof(*priv->tx_ring)));
-	if (!priv->tx_ring) {
-		pr_warn("%s: failed to allocate TX ring (%d entries)\n",
-			priv->ca->name, priv->sendq_size);
+	if (ipoib_alloc_send_rings(dev))
 		goto out_rx_ring_cleanup;
-	}
 
-	/* priv->tx_head, tx_tail and global_tx_tail/head are already 0 */
+	/* ring tx_head, tx_tail and global_tx_tail/head are already 0 */
 
 	if (ipoib_transport_dev_init(dev, priv->ca)) {
 		pr_warn("%s: ipoib_transport_dev_init failed\n",
@@ -1857,6 +1931,9 @@ static int ipoib_dev_init_default(struct net_device *dev)
 		goto out_tx_ring_cleanup;
 	}
 
+	/* after the send QPs are created, so only the rings in use */
+	ipoib_napi_add(dev);
+
 	/* after qp created set dev address */
 	addr_mod[0] = (priv->qp->qp_num >> 16) & 0xff;
 	addr_mod[1] = (priv->qp->qp_num >>  8) & 0xff;
@@ -1866,13 +1943,12 @@ static int ipoib_dev_init_default(struct net_device *dev)
 	return 0;
 
 out_tx_ring_cleanup:
-	vfree(priv->tx_ring);
+	ipoib_free_send_rings(dev);
 
 out_rx_ring_cleanup:
 	kfree(priv->rx_ring);
 
 out:
-	ipoib_napi_del(dev);
 	return -ENOMEM;
 }
 
@@ -2302,7 +2378,6 @@ static void ipoib_build_priv(struct net_device *dev)
 
 	INIT_DELAYED_WORK(&priv->mcast_task,   ipoib_mcast_join_task);
 	INIT_WORK(&priv->carrier_on_task, ipoib_mcast_carrier_on_task);
-	INIT_WORK(&priv->reschedule_napi_work, ipoib_napi_schedule_work);
 	INIT_WORK(&priv->flush_light,   ipoib_ib_dev_flush_light);
 	INIT_WORK(&priv->flush_normal,   ipoib_ib_dev_flush_normal);
 	INIT_WORK(&priv->flush_heavy,   ipoib_ib_dev_flush_heavy);
@@ -2323,8 +2398,9 @@ static struct net_device *ipoib_alloc_netdev(struct ib_device *hca, u32 port,
 	if (!IS_ERR(dev) || PTR_ERR(dev) != -EOPNOTSUPP)
 		return dev;
 
-	dev = alloc_netdev(sizeof(struct rdma_netdev), name, NET_NAME_UNKNOWN,
-			   ipoib_setup_common);
+	dev = alloc_netdev_mqs(sizeof(struct rdma_netdev), name,
+			       NET_NAME_UNKNOWN, ipoib_setup_common,
+			       ipoib_num_send_rings, 1);
 	if (!dev)
 		return ERR_PTR(-ENOMEM);
 	return dev;
@@ -2809,6 +2885,9 @@ static int __init ipoib_init_module(void)
 		ipoib_sendq_size = IPOIB_TX_RING_SIZE;
 	}
 
+	ipoib_num_send_rings = clamp(ipoib_num_send_rings, 1,
+				     (int)IPOIB_MAX_SEND_RINGS);
+
 #ifdef CONFIG_INFINIBAND_IPOIB_CM
 	ipoib_max_conn_qp = min(ipoib_max_conn_qp, IPOIB_CM_MAX_CONN_QP);
 	ipoib_max_conn_qp = max(ipoib_max_conn_qp, 0);
@@ -218,6 +218,7 @@ static int ipoib_mcast_join_finish(struct ipoib_mcast *mcast,
 	int ret;
 	int set_qkey = 0;
 	int mtu;
+	int i, j;
 
 	mcast->mcmember = *mcmember;
 
@@ -250,6 +251,10 @@ static int ipoib_mcast_join_finish(struct ipoib_mcast *mcast,
 		priv->qkey = be32_to_cpu(priv->broadcast->mcmember.qkey);
 		spin_unlock_irq(&priv->lock);
 		priv->tx_wr.remote_qkey = priv->qkey;
+		for (i = 0; i < priv->num_send_rings; i++)
+			for (j = 0; j < IPOIB_TX_BATCH; j++)
+				priv->send_ring[i].tx_wr[j].remote_qkey =
+					priv->qkey;
 		set_qkey = 1;
 	}
 
@@ -750,7 +755,6 @@ void ipoib_mcast_remove_list(struct list_head *remove_list)
 void ipoib_mcast_send(struct net_device *dev, u8 *daddr, struct sk_buff *skb)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
-	struct rdma_netdev *rn = netdev_priv(dev);
 	struct ipoib_mcast *mcast;
 	unsigned long flags;
 	void *mgid = daddr + 4;
@@ -817,8 +821,7 @@ void ipoib_mcast_send(struct net_device *dev, u8 *daddr, struct sk_buff *skb)
 			}
 		}
 		spin_unlock_irqrestore(&priv->lock, flags);
-		mcast->ah->last_send = rn->send(dev, skb, mcast->ah->ah,
-						IB_MULTICAST_QPN);
+		ipoib_send_ah(dev, skb, mcast->ah, IB_MULTICAST_QPN);
 		if (neigh)
 			ipoib_neigh_put(neigh);
 		return;
@@ -86,15 +86,12 @@ int ipoib_mcast_detach(struct net_device *dev, struct ib_device *hca,
 	return ret;
 }
 
-int ipoib_init_qp(struct net_device *dev)
+static int ipoib_modify_qp_to_rts(struct ipoib_dev_priv *priv,
+				  struct ib_qp *qp)
 {
-	struct ipoib_dev_priv *priv = ipoib_priv(dev);
-	int ret;
 	struct ib_qp_attr qp_attr;
 	int attr_mask;
-
-	if (!test_bit(IPOIB_PKEY_ASSIGNED, &priv->flags))
-		return -1;
+	int ret;
 
 	qp_attr.qp_state = IB_QPS_INIT;
 	qp_attr.qkey = 0;
@@ -105,29 +102,52 @@ int ipoib_init_qp(struct net_device *dev)
 	    IB_QP_PORT |
 	    IB_QP_PKEY_INDEX |
 	    IB_QP_STATE;
-	ret = ib_modify_qp(priv->qp, &qp_attr, attr_mask);
+	ret = ib_modify_qp(qp, &qp_attr, attr_mask);
 	if (ret) {
 		ipoib_warn(priv, "failed to modify QP to init, ret = %d\n", ret);
-		goto out_fail;
+		return ret;
 	}
 
 	qp_attr.qp_state = IB_QPS_RTR;
 	/* Can't set this in a INIT->RTR transition */
 	attr_mask &= ~IB_QP_PORT;
-	ret = ib_modify_qp(priv->qp, &qp_attr, attr_mask);
+	ret = ib_modify_qp(qp, &qp_attr, attr_mask);
 	if (ret) {
 		ipoib_warn(priv, "failed to modify QP to RTR, ret = %d\n", ret);
-		goto out_fail;
+		return ret;
 	}
 
 	qp_attr.qp_state = IB_QPS_RTS;
 	qp_attr.sq_psn = 0;
 	attr_mask |= IB_QP_SQ_PSN;
 	attr_mask &= ~IB_QP_PKEY_INDEX;
-	ret = ib_modify_qp(priv->qp, &qp_attr, attr_mask);
+	ret = ib_modify_qp(qp, &qp_attr, attr_mask);
 	if (ret) {
 		ipoib_warn(priv, "failed to modify QP to RTS, ret = %d\n", ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+int ipoib_init_qp(struct net_device *dev)
+{
+	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	struct ib_qp_attr qp_attr;
+	int ret;
+	int i;
+
+	if (!test_bit(IPOIB_PKEY_ASSIGNED, &priv->flags))
+		return -1;
+
+	ret = ipoib_modify_qp_to_rts(priv, priv->qp);
+	if (ret)
 		goto out_fail;
+
+	for (i = 1; i < priv->num_send_rings; i++) {
+		ret = ipoib_modify_qp_to_rts(priv, priv->send_ring[i].qp);
+		if (ret)
+			goto out_fail;
 	}
 
 	return 0;
@@ -136,10 +156,83 @@ out_fail:
 	qp_attr.qp_state = IB_QPS_RESET;
 	if (ib_modify_qp(priv->qp, &qp_attr, IB_QP_STATE))
 		ipoib_warn(priv, "Failed to modify QP to RESET state\n");
+	for (i = 1; i < priv->num_send_rings; i++)
+		if (ib_modify_qp(priv->send_ring[i].qp, &qp_attr, IB_QP_STATE))
+			ipoib_warn(priv, "Failed to modify QP to RESET state\n");
 
 	return ret;
 }
 
+static void ipoib_init_send_wr(struct ipoib_dev_priv *priv,
+			       struct ib_sge *tx_sge, struct ib_ud_wr *tx_wr)
+{
+	int i;
+
+	for (i = 0; i < MAX_SKB_FRAGS + 1; ++i)
+		tx_sge[i].lkey = priv->pd->local_dma_lkey;
+
+	tx_wr->wr.opcode	= IB_WR_SEND;
+	tx_wr->wr.sg_list	= tx_sge;
+	tx_wr->wr.send_flags	= IB_SEND_SIGNALED;
+}
+
+static void ipoib_init_send_ring_wrs(struct ipoib_dev_priv *priv,
+				     struct ipoib_send_ring *txr)
+{
+	int i;
+
+	for (i = 0; i < IPOIB_TX_BATCH; i++)
+		ipoib_init_send_wr(priv, txr->tx_sge[i], &txr->tx_wr[i]);
+}
+
+/*
+ * Rings other than 0 get a UD QP of their own that is only used for
+ * sending; it shares the receive CQ but never has receives posted.
+ */
+static int ipoib_send_ring_init(struct ipoib_dev_priv *priv,
+				struct ipoib_send_ring *txr,
+				struct ib_qp_init_attr *init_attr, int comp_vector)
+{
+	struct ib_cq_init_attr cq_attr = {
+		.cqe		= priv->sendq_size,
+		.comp_vector	= comp_vector % priv->ca->num_comp_vectors,
+	};
+	struct ib_qp_init_attr attr = *init_attr;
+
+	txr->cq = ib_create_cq(priv->ca, ipoib_ib_tx_completion, NULL,
+			       txr, &cq_attr);
+	if (IS_ERR(txr->cq))
+		return PTR_ERR(txr->cq);
+
+	attr.send_cq = txr->cq;
+	attr.cap.max_recv_wr = 1;
+	attr.cap.max_recv_sge = 1;
+	/* flow steering only has to find the QP that receives */
+	attr.create_flags &= ~IB_QP_CREATE_NETIF_QP;
+	txr->qp = ib_create_qp(priv->pd, &attr);
+	if (IS_ERR(txr->qp)) {
+		ib_destroy_cq(txr->cq);
+		return PTR_ERR(txr->qp);
+	}
+
+	if (ib_req_notify_cq(txr->cq, IB_CQ_NEXT_COMP)) {
+		ib_destroy_qp(txr->qp);
+		ib_destroy_cq(txr->cq);
+		return -EIO;
+	}
+
+	ipoib_init_send_ring_wrs(priv, txr);
+
+	return 0;
+}
+
+static void ipoib_send_ring_cleanup(struct ipoib_send_ring *txr)
+{
+	if (ib_destroy_qp(txr->qp))
+		ipoib_warn(txr->priv, "ib_qp_destroy failed\n");
+	ib_destroy_cq(txr->cq);
+}
+
 int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
@@ -156,6 +249,7 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 		.qp_type     = IB_QPT_UD
 	};
 	struct ib_cq_init_attr cq_attr = {};
+	struct ib_cq *send_cq;
 
 	int ret, size, req_vec;
 	int i;
@@ -185,20 +279,21 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 
 	cq_attr.cqe = priv->sendq_size;
 	cq_attr.comp_vector = (req_vec + 1) % priv->ca->num_comp_vectors;
-	priv->send_cq = ib_create_cq(priv->ca, ipoib_ib_tx_completion, NULL,
-				     priv, &cq_attr);
-	if (IS_ERR(priv->send_cq)) {
+	send_cq = ib_create_cq(priv->ca, ipoib_ib_tx_completion, NULL,
+			       &priv->send_ring[0], &cq_attr);
+	if (IS_ERR(send_cq)) {
 		pr_warn("%s: failed to create send CQ\n", ca->name);
 		goto out_free_recv_cq;
 	}
+	priv->send_ring[0].cq = send_cq;
 
 	if (ib_req_notify_cq(priv->recv_cq, IB_CQ_NEXT_COMP))
 		goto out_free_send_cq;
 
-	if (ib_req_notify_cq(priv->send_cq, IB_CQ_NEXT_COMP))
+	if (ib_req_notify_cq(send_cq, IB_CQ_NEXT_COMP))
 		goto out_free_send_cq;
 
-	init_attr.send_cq = priv->send_cq;
+	init_attr.send_cq = send_cq;
 	init_attr.recv_cq = priv->recv_cq;
 
 	if (priv->hca_caps & IB_DEVICE_UD_TSO)
@@ -219,15 +314,29 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 		goto out_free_send_cq;
 	}
 
-	if (ib_req_notify_cq(priv->send_cq, IB_CQ_NEXT_COMP))
+	if (ib_req_notify_cq(send_cq, IB_CQ_NEXT_COMP))
 		goto out_free_send_cq;
 
-	for (i = 0; i < MAX_SKB_FRAGS + 1; ++i)
-		priv->tx_sge[i].lkey = priv->pd->local_dma_lkey;
-
-	priv->tx_wr.wr.opcode		= IB_WR_SEND;
-	priv->tx_wr.wr.sg_list		= priv->tx_sge;
-	priv->tx_wr.wr.send_flags	= IB_SEND_SIGNALED;
+	priv->send_ring[0].qp = priv->qp;
+	ipoib_init_send_ring_wrs(priv, &priv->send_ring[0]);
+	ipoib_init_send_wr(priv, priv->tx_sge, &priv->tx_wr);
+
+	/*
+	 * Run with as many rings as we could get QPs for rather than
+	 * failing the interface.
+	 */
+	for (i = 1; i < priv->num_send_rings; i++) {
+		ret = ipoib_send_ring_init(priv, &priv->send_ring[i],
+					   &init_attr, req_vec + 1 + i);
+		if (ret) {
+			pr_warn("%s: failed to create send ring %d (%d), using %d TX queues\n",
+				ca->name, i, ret, i);
+			priv->num_send_rings = i;
+			netif_set_real_num_tx_queues(dev,
+				min_t(unsigned int, i, dev->real_num_tx_queues));
+			break;
+		}
+	}
 
 	priv->rx_sge[0].lkey = priv->pd->local_dma_lkey;
 
@@ -245,7 +354,7 @@ int ipoib_transport_dev_init(struct net_device *dev, struct ib_device *ca)
 	return 0;
 
 out_free_send_cq:
-	ib_destroy_cq(priv->send_cq);
+	ib_destroy_cq(send_cq);
 
 out_free_recv_cq:
 	ib_destroy_cq(priv->recv_cq);
@@ -259,6 +368,10 @@ out_cm_dev_cleanup:
 void ipoib_transport_dev_cleanup(struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = ipoib_priv(dev);
+	int i;
+
+	for (i = 1; i < priv->num_send_rings; i++)
+		ipoib_send_ring_cleanup(&priv->send_ring[i]);
 
 	if (priv->qp) {
 		if (ib_destroy_qp(priv->qp))
@@ -267,7 +380,7 @@ void ipoib_transport_dev_cleanup(struct net_device *dev)
 		priv->qp = NULL;
 	}
 
-	ib_destroy_cq(priv->send_cq);
+	ib_destroy_cq(priv->send_ring[0].cq);
 	ib_destroy_cq(priv->recv_cq);
 }
 
@@ -348,19 +348,39 @@ struct iser_fr_desc {
 	struct list_head                  all_list;
 };
 
+/* descriptors moved between a CPU cache and the shared pool at a time */
+#define ISER_FR_CACHE_BATCH	8
+
+/**
+ * struct iser_fr_cache - per-CPU cache of fast registration descriptors
+ *
+ * @list:                list of cached fastreg descriptors
+ * @lock:                protects the cache, only contended when another
+ *                       CPU steals from it
+ * @count:               number of descriptors in the cache
+ */
+struct iser_fr_cache {
+	struct list_head        list;
+	spinlock_t              lock;
+	int                     count;
+};
+
 /**
  * struct iser_fr_pool - connection fast registration pool
  *
- * @list:                list of fastreg descriptors
- * @lock:                protects fastreg pool
+ * @list:                shared list of fastreg descriptors
+ * @lock:                protects the shared list
  * @size:                size of the pool
  * @all_list:            first and last list members
+ * @cache:               per-CPU descriptor caches, refilled from and
+ *                       spilled to @list in ISER_FR_CACHE_BATCH chunks
  */
 struct iser_fr_pool {
 	struct list_head        list;
 	spinlock_t              lock;
 	int                     size;
 	struct list_head        all_list;
+	struct iser_fr_cache __percpu *cache;
 };
 
 /**
@@ -368,8 +388,10 @@ struct iser_fr_pool {
  *
  * @cma_id:              rdma_cm connection maneger handle
  * @qp:                  Connection Queue-pair
- * @cq:                  Connection completion queue
- * @cq_size:             The number of max outstanding completions
+ * @send_cq:             Connection send completion queue
+ * @send_cq_size:        The number of max outstanding send completions
+ * @recv_cq:             Connection receive completion queue
+ * @recv_cq_size:        The number of max outstanding receive completions
  * @device:              reference to iser device
  * @fr_pool:             connection fast registration poool
  * @pi_support:          Indicate device T10-PI support
@@ -378,8 +400,10 @@ struct iser_fr_pool {
 struct ib_conn {
 	struct rdma_cm_id           *cma_id;
 	struct ib_qp	            *qp;
-	struct ib_cq		    *cq;
-	u32			    cq_size;
+	struct ib_cq		    *send_cq;
+	u32			    send_cq_size;
+	struct ib_cq		    *recv_cq;
+	u32			    recv_cq_size;
 	struct iser_device          *device;
 	struct iser_fr_pool          fr_pool;
 	bool			     pi_support;
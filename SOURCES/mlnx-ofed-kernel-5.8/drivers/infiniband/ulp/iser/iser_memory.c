@@ -44,17 +44,97 @@ void iser_reg_comp(struct ib_cq *cq, struct ib_wc *wc)
 	iser_err_comp(wc, "memreg");
 }
 
+/*
+ * Move up to a batch of free descriptors to @batch: from the shared pool, or
+ * if it is empty from the first non-empty cache of another CPU, of which half
+ * is stolen. Only one lock is held at a time. Returns the number moved.
+ */
+static int iser_reg_desc_grab(struct iser_fr_pool *fr_pool,
+			      struct iser_fr_cache *cache,
+			      struct list_head *batch)
+{
+	struct iser_fr_cache *other;
+	int i, n = 0, cpu;
+
+	spin_lock(&fr_pool->lock);
+	for (; n < ISER_FR_CACHE_BATCH && !list_empty(&fr_pool->list); n++)
+		list_move(fr_pool->list.next, batch);
+	spin_unlock(&fr_pool->lock);
+
+	for_each_possible_cpu(cpu) {
+		if (n)
+			break;
+		other = per_cpu_ptr(fr_pool->cache, cpu);
+		if (other == cache)
+			continue;
+
+		spin_lock(&other->lock);
+		n = (other->count + 1) / 2;
+		for (i = 0; i < n; i++)
+			list_move(other->list.next, batch);
+		other->count -= n;
+		spin_unlock(&other->lock);
+	}
+
+	return n;
+}
+
+/*
+ * Refill the local cache and return one descriptor from it. Called with
+ * interrupts disabled and without the local cache lock held.
+ */
+static struct iser_fr_desc *iser_reg_desc_refill(struct iser_fr_pool *fr_pool,
+						 struct iser_fr_cache *cache)
+{
+	struct iser_fr_desc *desc;
+	LIST_HEAD(batch);
+	int n;
+
+	/*
+	 * The pool holds a descriptor per command, so one is free somewhere.
+	 * The scan can still miss it while it is in transit: put back in a
+	 * cache already scanned, or in the batch of a refill on another CPU.
+	 * Those land on a list shortly, scan again.
+	 */
+	for (;;) {
+		n = iser_reg_desc_grab(fr_pool, cache, &batch);
+		if (n)
+			break;
+		cpu_relax();
+	}
+
+	desc = list_first_entry(&batch, struct iser_fr_desc, list);
+	list_del(&desc->list);
+
+	spin_lock(&cache->lock);
+	list_splice(&batch, &cache->list);
+	cache->count += n - 1;
+	spin_unlock(&cache->lock);
+
+	return desc;
+}
+
 static struct iser_fr_desc *iser_reg_desc_get_fr(struct ib_conn *ib_conn)
 {
 	struct iser_fr_pool *fr_pool = &ib_conn->fr_pool;
+	struct iser_fr_cache *cache;
 	struct iser_fr_desc *desc;
 	unsigned long flags;
 
-	spin_lock_irqsave(&fr_pool->lock, flags);
-	desc = list_first_entry(&fr_pool->list,
-				struct iser_fr_desc, list);
-	list_del(&desc->list);
-	spin_unlock_irqrestore(&fr_pool->lock, flags);
+	local_irq_save(flags);
+	cache = this_cpu_ptr(fr_pool->cache);
+	spin_lock(&cache->lock);
+	if (likely(cache->count)) {
+		desc = list_first_entry(&cache->list,
+					struct iser_fr_desc, list);
+		list_del(&desc->list);
+		cache->count--;
+		spin_unlock(&cache->lock);
+	} else {
+		spin_unlock(&cache->lock);
+		desc = iser_reg_desc_refill(fr_pool, cache);
+	}
+	local_irq_restore(flags);
 
 	return desc;
 }
@@ -63,11 +143,31 @@ static void iser_reg_desc_put_fr(struct ib_conn *ib_conn,
 				 struct iser_fr_desc *desc)
 {
 	struct iser_fr_pool *fr_pool = &ib_conn->fr_pool;
+	struct iser_fr_cache *cache;
 	unsigned long flags;
-
-	spin_lock_irqsave(&fr_pool->lock, flags);
-	list_add(&desc->list, &fr_pool->list);
-	spin_unlock_irqrestore(&fr_pool->lock, flags);
+	LIST_HEAD(spill);
+	int i;
+
+	local_irq_save(flags);
+	cache = this_cpu_ptr(fr_pool->cache);
+	spin_lock(&cache->lock);
+	list_add(&desc->list, &cache->list);
+	if (unlikely(++cache->count > 2 * ISER_FR_CACHE_BATCH)) {
+		/* give the coldest descriptors back to the shared pool */
+		for (i = 0; i < ISER_FR_CACHE_BATCH; i++)
+			list_move(cache->list.prev, &spill);
+		cache->count -= ISER_FR_CACHE_BATCH;
+
+		/*
+		 * Under the cache lock, so that a refill never misses them in
+		 * transit. Nothing takes a cache lock with the pool lock held.
+		 */
+		spin_lock(&fr_pool->lock);
+		list_splice_tail(&spill, &fr_pool->list);
+		spin_unlock(&fr_pool->lock);
+	}
+	spin_unlock(&cache->lock);
+	local_irq_restore(flags);
 }
 
 int iser_dma_map_task_data(struct iscsi_iser_task *iser_task,
@@ -175,13 +175,26 @@ int iser_alloc_fastreg_pool(struct ib_conn *ib_conn,
 {
 	struct iser_device *device = ib_conn->device;
 	struct iser_fr_pool *fr_pool = &ib_conn->fr_pool;
+	struct iser_fr_cache *cache;
 	struct iser_fr_desc *desc;
-	int i, ret;
+	int i, ret, cpu;
 
 	INIT_LIST_HEAD(&fr_pool->list);
 	INIT_LIST_HEAD(&fr_pool->all_list);
 	spin_lock_init(&fr_pool->lock);
 	fr_pool->size = 0;
+
+	fr_pool->cache = alloc_percpu(struct iser_fr_cache);
+	if (!fr_pool->cache)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		cache = per_cpu_ptr(fr_pool->cache, cpu);
+		INIT_LIST_HEAD(&cache->list);
+		spin_lock_init(&cache->lock);
+		cache->count = 0;
+	}
+
 	for (i = 0; i < cmds_max; i++) {
 		desc = iser_create_fastreg_desc(device, device->pd,
 						ib_conn->pi_support, size);
@@ -212,6 +225,9 @@ void iser_free_fastreg_pool(struct ib_conn *ib_conn)
 	struct iser_fr_desc *desc, *tmp;
 	int i = 0;
 
+	free_percpu(fr_pool->cache);
+	fr_pool->cache = NULL;
+
 	if (list_empty(&fr_pool->all_list))
 		return;
 
@@ -240,7 +256,8 @@ static int iser_create_ib_conn_res(struct ib_conn *ib_conn)
 	struct ib_device	*ib_dev;
 	struct ib_qp_init_attr	init_attr;
 	int			ret = -ENOMEM;
-	unsigned int max_send_wr, cq_size;
+	unsigned int max_send_wr;
+	int			send_vector = -1;
 
 	BUG_ON(ib_conn->device == NULL);
 
@@ -254,20 +271,39 @@ static int iser_create_ib_conn_res(struct ib_conn *ib_conn)
 	max_send_wr = min_t(unsigned int, max_send_wr,
 			    (unsigned int)ib_dev->attrs.max_qp_wr);
 
-	cq_size = max_send_wr + ISER_QP_MAX_RECV_DTOS;
-	ib_conn->cq = ib_cq_pool_get(ib_dev, cq_size, -1, IB_POLL_SOFTIRQ);
-	if (IS_ERR(ib_conn->cq)) {
-		ret = PTR_ERR(ib_conn->cq);
+	/*
+	 * Every send is signaled, so a connection completes as many sends as
+	 * receives.  Take separate send and receive CQs from the pool and put
+	 * them on different completion vectors so that both halves of the
+	 * completion processing of a busy connection do not serialize on a
+	 * single core.  Only the send queue is drained on disconnect, its
+	 * extra entry for ib_drain_sq() is already counted in max_send_wr.
+	 */
+	ib_conn->recv_cq_size = ISER_QP_MAX_RECV_DTOS;
+	ib_conn->recv_cq = ib_cq_pool_get(ib_dev, ib_conn->recv_cq_size, -1,
+					  IB_POLL_SOFTIRQ);
+	if (IS_ERR(ib_conn->recv_cq)) {
+		ret = PTR_ERR(ib_conn->recv_cq);
 		goto cq_err;
 	}
-	ib_conn->cq_size = cq_size;
+
+	if (ib_dev->num_comp_vectors > 1)
+		send_vector = (ib_conn->recv_cq->comp_vector + 1) %
+			      ib_dev->num_comp_vectors;
+	ib_conn->send_cq_size = max_send_wr;
+	ib_conn->send_cq = ib_cq_pool_get(ib_dev, ib_conn->send_cq_size,
+					  send_vector, IB_POLL_SOFTIRQ);
+	if (IS_ERR(ib_conn->send_cq)) {
+		ret = PTR_ERR(ib_conn->send_cq);
+		goto send_cq_err;
+	}
 
 	memset(&init_attr, 0, sizeof(init_attr));
 
 	init_attr.event_handler = iser_qp_event_callback;
 	init_attr.qp_context = (void *)ib_conn;
-	init_attr.send_cq = ib_conn->cq;
-	init_attr.recv_cq = ib_conn->cq;
+	init_attr.send_cq = ib_conn->send_cq;
+	init_attr.recv_cq = ib_conn->recv_cq;
 	init_attr.cap.max_recv_wr = ISER_QP_MAX_RECV_DTOS;
 	init_attr.cap.max_send_sge = 2;
 	init_attr.cap.max_recv_sge = 1;
@@ -288,7 +324,9 @@ static int iser_create_ib_conn_res(struct ib_conn *ib_conn)
 	return ret;
 
 out_err:
-	ib_cq_pool_put(ib_conn->cq, ib_conn->cq_size);
+	ib_cq_pool_put(ib_conn->send_cq, ib_conn->send_cq_size);
+send_cq_err:
+	ib_cq_pool_put(ib_conn->recv_cq, ib_conn->recv_cq_size);
 cq_err:
 	iser_err("unable to alloc mem or create resource, err %d\n", ret);
 
@@ -404,7 +442,8 @@ static void iser_free_ib_conn_res(struct iser_conn *iser_conn, bool destroy)
 
 	if (ib_conn->qp) {
 		rdma_destroy_qp(ib_conn->cma_id);
-		ib_cq_pool_put(ib_conn->cq, ib_conn->cq_size);
+		ib_cq_pool_put(ib_conn->send_cq, ib_conn->send_cq_size);
+		ib_cq_pool_put(ib_conn->recv_cq, ib_conn->recv_cq_size);
 		ib_conn->qp = NULL;
 	}
 
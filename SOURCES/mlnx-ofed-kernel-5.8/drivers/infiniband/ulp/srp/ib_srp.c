@@ -45,6 +45,7 @@
 #include <linux/jiffies.h>
 #include <linux/lockdep.h>
 #include <linux/inet.h>
+#include <linux/blk-mq.h>
 #include <rdma/ib_cache.h>
 
 #include <linux/atomic.h>
@@ -543,7 +544,8 @@ static int srp_create_ch_ib(struct srp_rdma_ch *ch)
 
 	/* queue_size + 1 for ib_drain_rq() */
 	recv_cq = ib_alloc_cq(dev->dev, ch, target->queue_size + 1,
-				ch->comp_vector, IB_POLL_SOFTIRQ);
+				ch->comp_vector,
+				ch->polled ? IB_POLL_DIRECT : IB_POLL_SOFTIRQ);
 	if (IS_ERR(recv_cq)) {
 		ret = PTR_ERR(recv_cq);
 		goto err;
@@ -2720,6 +2722,27 @@ srp_change_queue_depth(struct scsi_device *sdev, int qdepth)
 	return scsi_change_queue_depth(sdev, qdepth);
 }
 
+static unsigned long srp_wait_tsk_mgmt(struct srp_rdma_ch *ch)
+{
+	unsigned long timeout = msecs_to_jiffies(SRP_ABORT_TIMEOUT_MS);
+	unsigned long deadline = jiffies + timeout;
+	unsigned long res;
+
+	if (!ch->polled)
+		return wait_for_completion_timeout(&ch->tsk_mgmt_done, timeout);
+
+	/*
+	 * The receive CQ of a polled channel is only reaped by the block layer
+	 * while it has requests outstanding, so poll for the response here.
+	 */
+	do {
+		ib_process_cq_direct(ch->recv_cq, -1);
+		res = wait_for_completion_timeout(&ch->tsk_mgmt_done, 1);
+	} while (!res && time_before(jiffies, deadline));
+
+	return res;
+}
+
 static int srp_send_tsk_mgmt(struct srp_rdma_ch *ch, u64 req_tag, u64 lun,
 			     u8 func, u8 *status)
 {
@@ -2775,8 +2798,7 @@ static int srp_send_tsk_mgmt(struct srp_rdma_ch *ch, u64 req_tag, u64 lun,
 
 		return -1;
 	}
-	res = wait_for_completion_timeout(&ch->tsk_mgmt_done,
-					msecs_to_jiffies(SRP_ABORT_TIMEOUT_MS));
+	res = srp_wait_tsk_mgmt(ch);
 	if (res > 0 && status)
 		*status = ch->tsk_mgmt_status;
 	mutex_unlock(&rport->mutex);
@@ -3017,6 +3039,16 @@ static ssize_t ch_count_show(struct device *dev, struct device_attribute *attr,
 
 static DEVICE_ATTR_RO(ch_count);
 
+static ssize_t poll_queues_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct srp_target_port *target = host_to_target(class_to_shost(dev));
+
+	return sysfs_emit(buf, "%u\n", target->poll_ch_count);
+}
+
+static DEVICE_ATTR_RO(poll_queues);
+
 static ssize_t comp_vector_show(struct device *dev,
 				struct device_attribute *attr, char *buf)
 {
@@ -3070,6 +3102,7 @@ static struct attribute *srp_host_attrs[] = {
 	&dev_attr_local_ib_port.attr,
 	&dev_attr_local_ib_device.attr,
 	&dev_attr_ch_count.attr,
+	&dev_attr_poll_queues.attr,
 	&dev_attr_comp_vector.attr,
 	&dev_attr_tl_retry_count.attr,
 	&dev_attr_cmd_sg_entries.attr,
@@ -3079,6 +3112,37 @@ static struct attribute *srp_host_attrs[] = {
 
 ATTRIBUTE_GROUPS(srp_host);
 
+static int srp_map_queues(struct Scsi_Host *shost)
+{
+	struct srp_target_port *target = host_to_target(shost);
+	struct blk_mq_tag_set *set = &shost->tag_set;
+	u32 nr_irq = target->ch_count - target->poll_ch_count;
+
+	set->map[HCTX_TYPE_DEFAULT].nr_queues = nr_irq;
+	set->map[HCTX_TYPE_DEFAULT].queue_offset = 0;
+	blk_mq_map_queues(&set->map[HCTX_TYPE_DEFAULT]);
+
+	if (shost->nr_maps > HCTX_TYPE_POLL) {
+		/* reads share the interrupt driven channels */
+		set->map[HCTX_TYPE_READ].nr_queues = nr_irq;
+		set->map[HCTX_TYPE_READ].queue_offset = 0;
+		blk_mq_map_queues(&set->map[HCTX_TYPE_READ]);
+
+		set->map[HCTX_TYPE_POLL].nr_queues = target->poll_ch_count;
+		set->map[HCTX_TYPE_POLL].queue_offset = nr_irq;
+		blk_mq_map_queues(&set->map[HCTX_TYPE_POLL]);
+	}
+
+	return 0;
+}
+
+static int srp_mq_poll(struct Scsi_Host *shost, unsigned int queue_num)
+{
+	struct srp_target_port *target = host_to_target(shost);
+
+	return ib_process_cq_direct(target->ch[queue_num].recv_cq, -1);
+}
+
 static struct scsi_host_template srp_template = {
 	.module				= THIS_MODULE,
 	.name				= "InfiniBand SRP initiator",
@@ -3089,6 +3153,8 @@ static struct scsi_host_template srp_template = {
 	.init_cmd_priv			= srp_init_cmd_priv,
 	.exit_cmd_priv			= srp_exit_cmd_priv,
 	.queuecommand			= srp_queuecommand,
+	.map_queues			= srp_map_queues,
+	.mq_poll			= srp_mq_poll,
 	.change_queue_depth             = srp_change_queue_depth,
 	.eh_timed_out			= srp_timed_out,
 	.eh_abort_handler		= srp_abort,
@@ -3252,6 +3318,7 @@ enum {
 	SRP_OPT_TARGET_CAN_QUEUE= 1 << 17,
 	SRP_OPT_MAX_IT_IU_SIZE  = 1 << 18,
 	SRP_OPT_CH_COUNT	= 1 << 19,
+	SRP_OPT_POLL_QUEUES	= 1 << 20,
 };
 
 static unsigned int srp_opt_mandatory[] = {
@@ -3286,6 +3353,7 @@ static const match_table_t srp_opt_tokens = {
 	{ SRP_OPT_IP_DEST,		"dest=%s"		},
 	{ SRP_OPT_MAX_IT_IU_SIZE,	"max_it_iu_size=%d"	},
 	{ SRP_OPT_CH_COUNT,		"ch_count=%u",		},
+	{ SRP_OPT_POLL_QUEUES,		"poll_queues=%u",	},
 	{ SRP_OPT_ERR,			NULL 			}
 };
 
@@ -3595,6 +3663,14 @@ static int srp_parse_options(struct net *net, const char *buf,
 			target->ch_count = token;
 			break;
 
+		case SRP_OPT_POLL_QUEUES:
+			if (match_int(args, &token) || token < 0) {
+				pr_warn("bad poll queue count %s\n", p);
+				goto out;
+			}
+			target->poll_ch_count = token;
+			break;
+
 		default:
 			pr_warn("unknown parameter or missing value '%s' in target creation request\n",
 				p);
@@ -3753,6 +3829,8 @@ static ssize_t add_target_store(struct device *dev,
 				    ibdev->num_comp_vectors),
 				num_online_cpus());
 	}
+	/* polled channels come after the interrupt driven ones */
+	target->ch_count += target->poll_ch_count;
 
 	target->ch = kcalloc(target->ch_count, sizeof(*target->ch),
 			     GFP_KERNEL);
@@ -3763,6 +3841,7 @@ static ssize_t add_target_store(struct device *dev,
 		ch = &target->ch[ch_idx];
 		ch->target = target;
 		ch->comp_vector = ch_idx % ibdev->num_comp_vectors;
+		ch->polled = ch_idx >= target->ch_count - target->poll_ch_count;
 		spin_lock_init(&ch->lock);
 		INIT_LIST_HEAD(&ch->free_tx);
 		ret = srp_new_cm_id(ch);
@@ -3791,6 +3870,9 @@ static ssize_t add_target_store(struct device *dev,
 				goto free_ch;
 			} else {
 				srp_free_ch_ib(target, ch);
+				target->poll_ch_count -=
+					min(target->poll_ch_count,
+					    target->ch_count - ch_idx);
 				target->ch_count = ch - target->ch;
 				goto connected;
 			}
@@ -3800,6 +3882,8 @@ static ssize_t add_target_store(struct device *dev,
 
 connected:
 	target->scsi_host->nr_hw_queues = target->ch_count;
+	if (target->poll_ch_count)
+		target->scsi_host->nr_maps = HCTX_MAX_TYPES;
 
 	ret = srp_add_target(host, target);
 	if (ret)
@@ -133,6 +133,8 @@ struct srp_request {
 /**
  * struct srp_rdma_ch
  * @comp_vector: Completion vector used by this RDMA channel.
+ * @polled: Whether the receive CQ of this channel is reaped from the block
+ *   layer poll callback instead of from completion interrupts.
  * @max_it_iu_len: Maximum initiator-to-target information unit length.
  * @max_ti_iu_len: Maximum target-to-initiator information unit length.
  */
@@ -180,12 +182,15 @@ struct srp_rdma_ch {
 	struct completion	tsk_mgmt_done;
 	u8			tsk_mgmt_status;
 	bool			connected;
+	bool			polled;
 };
 
 /**
  * struct srp_target_port
  * @comp_vector: Completion vector used by the first RDMA channel created for
  *   this target port.
+ * @poll_ch_count: Number of polled channels. These are the last channels of
+ *   @ch and are mapped to the HCTX_TYPE_POLL hardware queues.
  */
 struct srp_target_port {
 	/* read and written in the hot path */
@@ -221,6 +226,7 @@ struct srp_target_port {
 	int			queue_size;
 	int			comp_vector;
 	int			tl_retry_count;
+	u32			poll_ch_count;
 
 	bool			using_rdma_cm;
 
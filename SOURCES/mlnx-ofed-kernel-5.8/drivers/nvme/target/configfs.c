@@ -403,6 +403,22 @@ static ssize_t nvmet_param_offload_srq_size_store(struct config_item *item,
 
 CONFIGFS_ATTR(nvmet_, param_offload_srq_size);
 
+static ssize_t nvmet_param_srq_mem_in_use_show(struct config_item *item,
+		char *page)
+{
+	struct nvmet_port *port = to_nvmet_port(item);
+	u64 mem = 0;
+
+	down_read(&nvmet_config_sem);
+	if (port->enabled && port->tr_ops->srq_mem_in_use)
+		mem = port->tr_ops->srq_mem_in_use(port);
+	up_read(&nvmet_config_sem);
+
+	return snprintf(page, PAGE_SIZE, "%llu\n", mem);
+}
+
+CONFIGFS_ATTR_RO(nvmet_, param_srq_mem_in_use);
+
 static ssize_t nvmet_param_offload_queue_size_show(struct config_item *item,
 		char *page)
 {
@@ -801,6 +817,50 @@ nvmet_ns_offload_read_cmds_show(struct config_item *item, char *page)
 }
 CONFIGFS_ATTR_RO(nvmet_ns_, offload_read_cmds);
 
+static const char * const nvmet_lat_stage_names[NVMET_LAT_NR_STAGES] = {
+	[NVMET_LAT_RECV]	= "recv",
+	[NVMET_LAT_EXEC]	= "exec",
+	[NVMET_LAT_SEND]	= "send",
+};
+
+/*
+ * One line with the command count, then one line per stage with the
+ * NVMET_LAT_BUCKETS log2 buckets, bucket i counting latencies in
+ * [2^i, 2^(i + 1)) ns.
+ */
+static ssize_t nvmet_ns_latency_stats_show(struct config_item *item,
+		char *page)
+{
+	struct nvmet_ns *ns = to_nvmet_ns(item);
+	struct nvmet_ns_lat_stats *stats;
+	u64 cmds = 0, hist[NVMET_LAT_BUCKETS];
+	ssize_t len;
+	int cpu, i, b;
+
+	for_each_possible_cpu(cpu)
+		cmds += per_cpu_ptr(ns->lat_stats, cpu)->cmds;
+	len = scnprintf(page, PAGE_SIZE, "cmds %llu\n", cmds);
+
+	for (i = 0; i < NVMET_LAT_NR_STAGES; i++) {
+		memset(hist, 0, sizeof(hist));
+		for_each_possible_cpu(cpu) {
+			stats = per_cpu_ptr(ns->lat_stats, cpu);
+			for (b = 0; b < NVMET_LAT_BUCKETS; b++)
+				hist[b] += stats->hist[i][b];
+		}
+
+		len += scnprintf(page + len, PAGE_SIZE - len, "%s",
+				 nvmet_lat_stage_names[i]);
+		for (b = 0; b < NVMET_LAT_BUCKETS; b++)
+			len += scnprintf(page + len, PAGE_SIZE - len, " %llu",
+					 hist[b]);
+		len += scnprintf(page + len, PAGE_SIZE - len, "\n");
+	}
+
+	return len;
+}
+CONFIGFS_ATTR_RO(nvmet_ns_, latency_stats);
+
 static ssize_t
 nvmet_ns_offload_read_blocks_show(struct config_item *item, char *page)
 {
@@ -886,6 +946,7 @@ static struct configfs_attribute *nvmet_ns_attrs[] = {
 	&nvmet_ns_attr_offload_error_cmds,
 	&nvmet_ns_attr_offload_backend_error_cmds,
 	&nvmet_ns_attr_offload_cmd_tmo_us,
+	&nvmet_ns_attr_latency_stats,
 	&nvmet_ns_attr_buffered_io,
 	&nvmet_ns_attr_revalidate_size,
 #ifdef CONFIG_PCI_P2PDMA
@@ -2061,6 +2122,7 @@ static struct configfs_attribute *nvmet_port_attrs[] = {
 	&nvmet_attr_param_inline_data_size,
 	&nvmet_attr_param_offload_queues,
 	&nvmet_attr_param_offload_srq_size,
+	&nvmet_attr_param_srq_mem_in_use,
 	&nvmet_attr_param_offload_queue_size,
 	&nvmet_attr_param_offload_passthrough_sqe_rw,
 #ifdef CONFIG_BLK_DEV_INTEGRITY
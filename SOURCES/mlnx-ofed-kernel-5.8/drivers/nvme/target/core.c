@@ -12,6 +12,7 @@
 #include <linux/rculist.h>
 #include <linux/pci-p2pdma.h>
 #include <linux/scatterlist.h>
+#include <linux/debugfs.h>
 
 #define CREATE_TRACE_POINTS
 #include "trace.h"
@@ -45,6 +46,41 @@ u32 nvmet_ana_group_enabled[NVMET_MAX_ANAGRPS + 1];
 u64 nvmet_ana_chgcnt;
 DECLARE_RWSEM(nvmet_ana_sem);
 
+static struct dentry *nvmet_debugfs;
+
+DEFINE_STATIC_KEY_FALSE(nvmet_lat_stats_enabled);
+EXPORT_SYMBOL_GPL(nvmet_lat_stats_enabled);
+
+static int nvmet_lat_stats_set(const char *val, const struct kernel_param *kp)
+{
+	bool enable;
+	int ret;
+
+	ret = kstrtobool(val, &enable);
+	if (ret)
+		return ret;
+
+	if (enable)
+		static_branch_enable(&nvmet_lat_stats_enabled);
+	else
+		static_branch_disable(&nvmet_lat_stats_enabled);
+	return 0;
+}
+
+static int nvmet_lat_stats_get(char *buf, const struct kernel_param *kp)
+{
+	return sprintf(buf, "%c\n",
+		       static_key_enabled(&nvmet_lat_stats_enabled) ? 'Y' : 'N');
+}
+
+static const struct kernel_param_ops nvmet_lat_stats_ops = {
+	.set = nvmet_lat_stats_set,
+	.get = nvmet_lat_stats_get,
+};
+
+module_param_cb(latency_stats, &nvmet_lat_stats_ops, NULL, 0644);
+MODULE_PARM_DESC(latency_stats, "collect per-namespace latency histograms and per-queue command counts (default: N)");
+
 inline u16 errno_to_nvme_status(struct nvmet_req *req, int errno)
 {
 	switch (errno) {
@@ -849,6 +885,7 @@ void nvmet_ns_free(struct nvmet_ns *ns)
 	nvmet_ana_group_enabled[ns->anagrpid]--;
 	up_write(&nvmet_ana_sem);
 
+	free_percpu(ns->lat_stats);
 	kfree(ns->device_path);
 	kfree(ns);
 }
@@ -861,6 +898,12 @@ struct nvmet_ns *nvmet_ns_alloc(struct nvmet_subsys *subsys, u32 nsid)
 	if (!ns)
 		return NULL;
 
+	ns->lat_stats = alloc_percpu(struct nvmet_ns_lat_stats);
+	if (!ns->lat_stats) {
+		kfree(ns);
+		return NULL;
+	}
+
 	init_completion(&ns->disable_done);
 
 	ns->nsid = nsid;
@@ -922,9 +965,47 @@ static void nvmet_set_error(struct nvmet_req *req, u16 status)
 	req->cqe->status |= cpu_to_le16(1 << 14);
 }
 
+static inline unsigned int nvmet_lat_bucket(u64 ns)
+{
+	return ns ? min_t(unsigned int, ilog2(ns), NVMET_LAT_BUCKETS - 1) : 0;
+}
+
+static void nvmet_req_account(struct nvmet_ns *ns, struct nvmet_sq *sq,
+		u64 t_init, u64 t_exec, u64 t_done)
+{
+	u64 lat[NVMET_LAT_NR_STAGES];
+	int i;
+
+	/* requests failed before execution only have a send stage */
+	if (!t_exec)
+		t_exec = t_done;
+	lat[NVMET_LAT_RECV] = t_exec - t_init;
+	lat[NVMET_LAT_EXEC] = t_done - t_exec;
+	lat[NVMET_LAT_SEND] = ktime_get_ns() - t_done;
+
+	if (ns) {
+		this_cpu_inc(ns->lat_stats->cmds);
+		for (i = 0; i < NVMET_LAT_NR_STAGES; i++)
+			this_cpu_inc(ns->lat_stats->hist[i][nvmet_lat_bucket(lat[i])]);
+	}
+
+	if (sq->ctrl) {
+		struct nvmet_queue_stats *qs = &sq->ctrl->queue_stats[sq->qid];
+
+		atomic64_inc(&qs->cmds);
+		for (i = 0; i < NVMET_LAT_NR_STAGES; i++)
+			atomic64_add(lat[i], &qs->lat_ns[i]);
+	}
+}
+
 static void __nvmet_req_complete(struct nvmet_req *req, u16 status)
 {
 	struct nvmet_ns *ns = req->ns;
+	struct nvmet_sq *sq = req->sq;
+	u64 t_init = req->t_init, t_exec = req->t_exec, t_done = 0;
+
+	if (static_branch_unlikely(&nvmet_lat_stats_enabled) && t_init)
+		t_done = ktime_get_ns();
 
 	if (!req->sq->sqhd_disabled)
 		nvmet_update_sq_head(req);
@@ -936,7 +1017,10 @@ static void __nvmet_req_complete(struct nvmet_req *req, u16 status)
 
 	trace_nvmet_req_complete(req);
 
+	/* the transport may reuse req as soon as the response is queued */
 	req->ops->queue_response(req);
+	if (unlikely(t_done))
+		nvmet_req_account(ns, sq, t_init, t_exec, t_done);
 	if (ns)
 		nvmet_put_namespace(ns);
 }
@@ -1114,6 +1198,9 @@ bool nvmet_req_init(struct nvmet_req *req, struct nvmet_cq *cq,
 	req->ns = NULL;
 	req->error_loc = NVMET_NO_ERROR_LOC;
 	req->error_slba = 0;
+	req->t_exec = 0;
+	req->t_init = static_branch_unlikely(&nvmet_lat_stats_enabled) ?
+		ktime_get_ns() : 0;
 
 	/* no support for fused commands yet */
 	if (unlikely(flags & (NVME_CMD_FUSE_FIRST | NVME_CMD_FUSE_SECOND))) {
@@ -1596,15 +1683,21 @@ u16 nvmet_alloc_ctrl(const char *subsysnqn, const char *hostnqn,
 	if (!ctrl->sqs)
 		goto out_free_changed_ns_list;
 
-	if (subsys->cntlid_min > subsys->cntlid_max)
+	ctrl->queue_stats = kcalloc(subsys->max_qid + 1,
+			sizeof(struct nvmet_queue_stats),
+			GFP_KERNEL);
+	if (!ctrl->queue_stats)
 		goto out_free_sqs;
 
+	if (subsys->cntlid_min > subsys->cntlid_max)
+		goto out_free_queue_stats;
+
 	ret = ida_simple_get(&cntlid_ida,
 			     subsys->cntlid_min, subsys->cntlid_max,
 			     GFP_KERNEL);
 	if (ret < 0) {
 		status = NVME_SC_CONNECT_CTRL_BUSY | NVME_SC_DNR;
-		goto out_free_sqs;
+		goto out_free_queue_stats;
 	}
 	ctrl->cntlid = ret;
 
@@ -1636,6 +1729,8 @@ u16 nvmet_alloc_ctrl(const char *subsysnqn, const char *hostnqn,
 	*ctrlp = ctrl;
 	return 0;
 
+out_free_queue_stats:
+	kfree(ctrl->queue_stats);
 out_free_sqs:
 	kfree(ctrl->sqs);
 out_free_changed_ns_list:
@@ -1669,6 +1764,7 @@ static void nvmet_ctrl_free(struct kref *ref)
 	ida_simple_remove(&cntlid_ida, ctrl->cntlid);
 
 	nvmet_async_events_free(ctrl);
+	kfree(ctrl->queue_stats);
 	kfree(ctrl->sqs);
 	kfree(ctrl->changed_ns_list);
 	kfree(ctrl);
@@ -1720,6 +1816,37 @@ static struct nvmet_subsys *nvmet_find_get_subsys(struct nvmet_port *port,
 	return NULL;
 }
 
+/*
+ * One line per live queue: cntlid, qid, completed commands and the summed
+ * recv/exec/send stage latencies in ns.
+ */
+static int nvmet_queue_stats_show(struct seq_file *m, void *p)
+{
+	struct nvmet_subsys *subsys = m->private;
+	struct nvmet_queue_stats *qs;
+	struct nvmet_ctrl *ctrl;
+	u16 qid;
+
+	mutex_lock(&subsys->lock);
+	list_for_each_entry(ctrl, &subsys->ctrls, subsys_entry) {
+		for (qid = 0; qid <= subsys->max_qid; qid++) {
+			if (!READ_ONCE(ctrl->sqs[qid]))
+				continue;
+			qs = &ctrl->queue_stats[qid];
+			seq_printf(m, "%u %u %lld %lld %lld %lld\n",
+				   ctrl->cntlid, qid,
+				   atomic64_read(&qs->cmds),
+				   atomic64_read(&qs->lat_ns[NVMET_LAT_RECV]),
+				   atomic64_read(&qs->lat_ns[NVMET_LAT_EXEC]),
+				   atomic64_read(&qs->lat_ns[NVMET_LAT_SEND]));
+		}
+	}
+	mutex_unlock(&subsys->lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nvmet_queue_stats);
+
 struct nvmet_subsys *nvmet_subsys_alloc(const char *subsysnqn,
 		enum nvme_subsys_type type)
 {
@@ -1771,6 +1898,13 @@ struct nvmet_subsys *nvmet_subsys_alloc(const char *subsysnqn,
 	INIT_LIST_HEAD(&subsys->ctrls);
 	INIT_LIST_HEAD(&subsys->hosts);
 
+	if (type == NVME_NQN_NVME) {
+		subsys->debugfs_dir = debugfs_create_dir(subsys->subsysnqn,
+							 nvmet_debugfs);
+		debugfs_create_file("queue_stats", 0444, subsys->debugfs_dir,
+				    subsys, &nvmet_queue_stats_fops);
+	}
+
 	return subsys;
 
 free_mn:
@@ -1787,6 +1921,7 @@ static void nvmet_subsys_free(struct kref *ref)
 
 	WARN_ON_ONCE(!xa_empty(&subsys->namespaces));
 
+	debugfs_remove_recursive(subsys->debugfs_dir);
 	xa_destroy(&subsys->namespaces);
 	nvmet_passthru_subsys_free(subsys);
 
@@ -1827,9 +1962,11 @@ static int __init nvmet_init(void)
 		goto out_free_zbd_work_queue;
 	}
 
+	nvmet_debugfs = debugfs_create_dir("nvmet", NULL);
+
 	error = nvmet_init_discovery();
 	if (error)
-		goto out_free_work_queue;
+		goto out_remove_debugfs;
 
 	error = nvmet_init_configfs();
 	if (error)
@@ -1838,7 +1975,8 @@ static int __init nvmet_init(void)
 
 out_exit_discovery:
 	nvmet_exit_discovery();
-out_free_work_queue:
+out_remove_debugfs:
+	debugfs_remove_recursive(nvmet_debugfs);
 	destroy_workqueue(buffered_io_wq);
 out_free_zbd_work_queue:
 	destroy_workqueue(zbd_wq);
@@ -1849,6 +1987,7 @@ static void __exit nvmet_exit(void)
 {
 	nvmet_exit_configfs();
 	nvmet_exit_discovery();
+	debugfs_remove_recursive(nvmet_debugfs);
 	ida_destroy(&cntlid_ida);
 	destroy_workqueue(buffered_io_wq);
 	destroy_workqueue(zbd_wq);
@@ -18,6 +18,11 @@
 
 #define NVME_LOOP_MAX_SEGMENTS		256
 
+static bool inline_execute;
+module_param(inline_execute, bool, 0644);
+MODULE_PARM_DESC(inline_execute,
+		 "execute I/O commands in the submission context instead of from a work item, applies to controllers created afterwards (default: N)");
+
 struct nvme_loop_iod {
 	struct nvme_request	nvme_req;
 	struct nvme_command	cmd;
@@ -25,6 +30,7 @@ struct nvme_loop_iod {
 	struct nvmet_req	req;
 	struct nvme_loop_queue	*queue;
 	struct work_struct	work;
+	struct llist_node	poll_node;
 	struct sg_table		sg_table;
 	struct scatterlist	first_sgl[];
 };
@@ -40,6 +46,8 @@ struct nvme_loop_ctrl {
 	struct nvme_ctrl	ctrl;
 
 	struct nvmet_port	*port;
+	unsigned int		nr_poll_queues;
+	bool			inline_execute;
 };
 
 static inline struct nvme_loop_ctrl *to_loop_ctrl(struct nvme_ctrl *ctrl)
@@ -56,6 +64,9 @@ struct nvme_loop_queue {
 	struct nvmet_sq		nvme_sq;
 	struct nvme_loop_ctrl	*ctrl;
 	unsigned long		flags;
+	/* responses waiting to be reaped by nvme_loop_poll() */
+	struct llist_head	poll_list;
+	bool			polled;
 };
 
 static LIST_HEAD(nvme_loop_ports);
@@ -97,6 +108,14 @@ static void nvme_loop_queue_response(struct nvmet_req *req)
 		container_of(req->sq, struct nvme_loop_queue, nvme_sq);
 	struct nvme_completion *cqe = req->cqe;
 
+	if (queue->polled) {
+		struct nvme_loop_iod *iod =
+			container_of(req, struct nvme_loop_iod, req);
+
+		llist_add(&iod->poll_node, &queue->poll_list);
+		return;
+	}
+
 	/*
 	 * AEN requests are special as they don't time out and can
 	 * survive any kind of queue freeze and often don't respond to
@@ -128,7 +147,7 @@ static void nvme_loop_execute_work(struct work_struct *work)
 	struct nvme_loop_iod *iod =
 		container_of(work, struct nvme_loop_iod, work);
 
-	iod->req.execute(&iod->req);
+	nvmet_req_execute(&iod->req);
 }
 
 static blk_status_t nvme_loop_queue_rq(struct blk_mq_hw_ctx *hctx,
@@ -169,10 +188,59 @@ static blk_status_t nvme_loop_queue_rq(struct blk_mq_hw_ctx *hctx,
 		iod->req.transfer_len = blk_rq_payload_bytes(req);
 	}
 
-	schedule_work(&iod->work);
+	/* the tag set is BLK_MQ_F_BLOCKING in this mode */
+	if (queue->ctrl->inline_execute && nvme_loop_queue_idx(queue))
+		nvmet_req_execute(&iod->req);
+	else
+		schedule_work(&iod->work);
 	return BLK_STS_OK;
 }
 
+static int nvme_loop_poll(struct blk_mq_hw_ctx *hctx, struct io_comp_batch *iob)
+{
+	struct nvme_loop_queue *queue = hctx->driver_data;
+	struct nvme_loop_iod *iod, *next;
+	struct llist_node *node;
+	struct request *rq;
+	int found = 0;
+
+	node = llist_reverse_order(llist_del_all(&queue->poll_list));
+	llist_for_each_entry_safe(iod, next, node, poll_node) {
+		rq = blk_mq_rq_from_pdu(iod);
+		if (!nvme_try_complete_req(rq, iod->cqe.status,
+					   iod->cqe.result))
+			nvme_loop_complete_rq(rq);
+		found++;
+	}
+
+	return found;
+}
+
+static int nvme_loop_map_queues(struct blk_mq_tag_set *set)
+{
+	struct nvme_loop_ctrl *ctrl = set->driver_data;
+	unsigned int nr_default = ctrl->ctrl.queue_count - 1 -
+				  ctrl->nr_poll_queues;
+
+	set->map[HCTX_TYPE_DEFAULT].nr_queues = nr_default;
+	set->map[HCTX_TYPE_DEFAULT].queue_offset = 0;
+	blk_mq_map_queues(&set->map[HCTX_TYPE_DEFAULT]);
+
+	if (set->nr_maps > HCTX_TYPE_POLL) {
+		/* shared read/write queues */
+		set->map[HCTX_TYPE_READ].nr_queues = nr_default;
+		set->map[HCTX_TYPE_READ].queue_offset = 0;
+		blk_mq_map_queues(&set->map[HCTX_TYPE_READ]);
+
+		set->map[HCTX_TYPE_POLL].nr_queues = ctrl->nr_poll_queues;
+		set->map[HCTX_TYPE_POLL].queue_offset = nr_default;
+		if (ctrl->nr_poll_queues)
+			blk_mq_map_queues(&set->map[HCTX_TYPE_POLL]);
+	}
+
+	return 0;
+}
+
 static void nvme_loop_submit_async_event(struct nvme_ctrl *arg)
 {
 	struct nvme_loop_ctrl *ctrl = to_loop_ctrl(arg);
@@ -255,6 +323,8 @@ static const struct blk_mq_ops nvme_loop_mq_ops = {
 	.complete	= nvme_loop_complete_rq,
 	.init_request	= nvme_loop_init_request,
 	.init_hctx	= nvme_loop_init_hctx,
+	.map_queues	= nvme_loop_map_queues,
+	.poll		= nvme_loop_poll,
 };
 
 static const struct blk_mq_ops nvme_loop_admin_mq_ops = {
@@ -302,6 +372,8 @@ static void nvme_loop_destroy_io_queues(struct nvme_loop_ctrl *ctrl)
 	for (i = 1; i < ctrl->ctrl.queue_count; i++) {
 		clear_bit(NVME_LOOP_Q_LIVE, &ctrl->queues[i].flags);
 		nvmet_sq_destroy(&ctrl->queues[i].nvme_sq);
+		/* the requests were cancelled already, drop late responses */
+		llist_del_all(&ctrl->queues[i].poll_list);
 	}
 	ctrl->ctrl.queue_count = 1;
 }
@@ -309,18 +381,27 @@ static void nvme_loop_destroy_io_queues(struct nvme_loop_ctrl *ctrl)
 static int nvme_loop_init_io_queues(struct nvme_loop_ctrl *ctrl)
 {
 	struct nvmf_ctrl_options *opts = ctrl->ctrl.opts;
-	unsigned int nr_io_queues;
+	unsigned int nr_io_queues, nr_default;
 	int ret, i;
 
-	nr_io_queues = min(opts->nr_io_queues, num_online_cpus());
+	nr_default = min(opts->nr_io_queues, num_online_cpus());
+	nr_io_queues = nr_default + opts->nr_poll_queues;
 	ret = nvme_set_queue_count(&ctrl->ctrl, &nr_io_queues);
 	if (ret || !nr_io_queues)
 		return ret;
 
-	dev_info(ctrl->ctrl.device, "creating %d I/O queues.\n", nr_io_queues);
+	/* poll queues are the first to go if the target grants fewer */
+	ctrl->nr_poll_queues = nr_io_queues > nr_default ?
+			       nr_io_queues - nr_default : 0;
+
+	dev_info(ctrl->ctrl.device, "creating %d I/O queues (%d poll).\n",
+		 nr_io_queues, ctrl->nr_poll_queues);
 
 	for (i = 1; i <= nr_io_queues; i++) {
 		ctrl->queues[i].ctrl = ctrl;
+		ctrl->queues[i].polled =
+			i > nr_io_queues - ctrl->nr_poll_queues;
+		init_llist_head(&ctrl->queues[i].poll_list);
 		ret = nvmet_sq_init(&ctrl->queues[i].nvme_sq);
 		if (ret)
 			goto out_destroy_queues;
@@ -536,10 +617,14 @@ static int nvme_loop_create_io_queues(struct nvme_loop_ctrl *ctrl)
 	ctrl->tag_set.reserved_tags = NVMF_RESERVED_TAGS;
 	ctrl->tag_set.numa_node = ctrl->ctrl.numa_node;
 	ctrl->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+	/* backends may sleep when called from ->queue_rq() */
+	if (ctrl->inline_execute)
+		ctrl->tag_set.flags |= BLK_MQ_F_BLOCKING;
 	ctrl->tag_set.cmd_size = sizeof(struct nvme_loop_iod) +
 		NVME_INLINE_SG_CNT * sizeof(struct scatterlist);
 	ctrl->tag_set.driver_data = ctrl;
 	ctrl->tag_set.nr_hw_queues = ctrl->ctrl.queue_count - 1;
+	ctrl->tag_set.nr_maps = ctrl->nr_poll_queues ? HCTX_MAX_TYPES : 1;
 	ctrl->tag_set.timeout = NVME_IO_TIMEOUT;
 	ctrl->ctrl.tagset = &ctrl->tag_set;
 
@@ -595,6 +680,7 @@ static struct nvme_ctrl *nvme_loop_create_ctrl(struct device *dev,
 	if (!ctrl)
 		return ERR_PTR(-ENOMEM);
 	ctrl->ctrl.opts = opts;
+	ctrl->inline_execute = inline_execute;
 	INIT_LIST_HEAD(&ctrl->list);
 
 	INIT_WORK(&ctrl->ctrl.reset_work, nvme_loop_reset_ctrl_work);
@@ -615,8 +701,8 @@ static struct nvme_ctrl *nvme_loop_create_ctrl(struct device *dev,
 	ctrl->ctrl.kato = opts->kato;
 	ctrl->port = nvme_loop_find_port(&ctrl->ctrl);
 
-	ctrl->queues = kcalloc(opts->nr_io_queues + 1, sizeof(*ctrl->queues),
-			GFP_KERNEL);
+	ctrl->queues = kcalloc(opts->nr_io_queues + opts->nr_poll_queues + 1,
+			sizeof(*ctrl->queues), GFP_KERNEL);
 	if (!ctrl->queues)
 		goto out_uninit_ctrl;
 
@@ -704,7 +790,7 @@ static struct nvmf_transport_ops nvme_loop_transport = {
 	.name		= "loop",
 	.module		= THIS_MODULE,
 	.create_ctrl	= nvme_loop_create_ctrl,
-	.allowed_opts	= NVMF_OPT_TRADDR,
+	.allowed_opts	= NVMF_OPT_TRADDR | NVMF_OPT_NR_POLL_QUEUES,
 };
 
 static int __init nvme_loop_init_module(void)
@@ -22,6 +22,8 @@
 #include <linux/blkdev.h>
 #include <linux/radix-tree.h>
 #include <linux/t10-pi.h>
+#include <linux/jump_label.h>
+#include <linux/timekeeping.h>
 
 #define NVMET_DEFAULT_VS		NVME_VS(1, 3, 0)
 
@@ -57,6 +59,26 @@
 #define IPO_IATTR_CONNECT_SQE(x)	\
 	(cpu_to_le32(offsetof(struct nvmf_connect_command, x)))
 
+#define NVMET_LAT_BUCKETS	32
+
+enum nvmet_lat_stage {
+	NVMET_LAT_RECV,		/* nvmet_req_init() to backend execute */
+	NVMET_LAT_EXEC,		/* backend execute to nvmet_req_complete() */
+	NVMET_LAT_SEND,		/* handing the response to the transport */
+	NVMET_LAT_NR_STAGES,
+};
+
+/* per-CPU, bucket i counts latencies in [2^i, 2^(i + 1)) ns */
+struct nvmet_ns_lat_stats {
+	u64			cmds;
+	u64			hist[NVMET_LAT_NR_STAGES][NVMET_LAT_BUCKETS];
+};
+
+struct nvmet_queue_stats {
+	atomic64_t		cmds;
+	atomic64_t		lat_ns[NVMET_LAT_NR_STAGES];
+};
+
 struct nvmet_ns {
 	struct percpu_ref	ref;
 	struct block_device	*bdev;
@@ -89,6 +111,7 @@ struct nvmet_ns {
 	int			pi_type;
 	int			metadata_size;
 	u8			csi;
+	struct nvmet_ns_lat_stats __percpu *lat_stats;
 };
 
 static inline struct nvmet_ns *to_nvmet_ns(struct config_item *item)
@@ -179,6 +202,7 @@ static inline struct nvmet_port *ana_groups_to_port(
 struct nvmet_ctrl {
 	struct nvmet_subsys	*subsys;
 	struct nvmet_sq		**sqs;
+	struct nvmet_queue_stats *queue_stats;
 
 	bool			reset_tbkas;
 
@@ -291,6 +315,7 @@ struct nvmet_subsys {
 				       struct nvmet_ns_counters *counters);
 
 	char			*model_number;
+	struct dentry		*debugfs_dir;
 
 #ifdef CONFIG_NVME_TARGET_PASSTHRU
 	struct nvme_ctrl	*passthru_ctrl;
@@ -376,6 +401,7 @@ struct nvmet_fabrics_ops {
 	bool (*check_subsys_match_offload_port)(struct nvmet_port *port,
 						struct nvmet_subsys *subsys);
 	bool (*is_port_active)(struct nvmet_port *port);
+	u64 (*srq_mem_in_use)(struct nvmet_port *port);
 	void (*queue_response)(struct nvmet_req *req);
 	int (*add_port)(struct nvmet_port *port);
 	void (*remove_port)(struct nvmet_port *port);
@@ -440,11 +466,27 @@ struct nvmet_req {
 	struct device		*p2p_client;
 	u16			error_loc;
 	u64			error_slba;
+	/* latency stats timestamps, zero unless latency_stats is set */
+	u64			t_init;
+	u64			t_exec;
 };
 
 extern struct workqueue_struct *buffered_io_wq;
 extern struct workqueue_struct *zbd_wq;
 
+DECLARE_STATIC_KEY_FALSE(nvmet_lat_stats_enabled);
+
+/*
+ * Transports call this instead of req->execute() so that the backend stage
+ * can be told apart from the transport receive stage.
+ */
+static inline void nvmet_req_execute(struct nvmet_req *req)
+{
+	if (static_branch_unlikely(&nvmet_lat_stats_enabled))
+		req->t_exec = ktime_get_ns();
+	req->execute(req);
+}
+
 static inline void nvmet_set_result(struct nvmet_req *req, u32 result)
 {
 	req->cqe->result.u32 = cpu_to_le32(result);
@@ -42,7 +42,12 @@
 #define NVMET_RDMA_MAX_MDTS			8
 #define NVMET_RDMA_MAX_METADATA_MDTS		5
 
+/* SRQ receive buffers are added and retired in chunks of this size */
+#define NVMET_RDMA_SRQ_CHUNK			256
+#define NVMET_RDMA_SRQ_SHRINK_INTERVAL		(10 * HZ)
+
 struct nvmet_rdma_srq;
+struct nvmet_rdma_srq_chunk;
 
 struct nvmet_rdma_cmd {
 	struct ib_sge		sge[NVMET_RDMA_MAX_INLINE_SGE + 1];
@@ -52,11 +57,13 @@ struct nvmet_rdma_cmd {
 	struct nvme_command     *nvme_cmd;
 	struct nvmet_rdma_queue	*queue;
 	struct nvmet_rdma_srq   *nsrq;
+	struct nvmet_rdma_srq_chunk *chunk;
 };
 
 enum {
 	NVMET_RDMA_REQ_INLINE_DATA	= (1 << 0),
 	NVMET_RDMA_REQ_INVALIDATE_RKEY	= (1 << 1),
+	NVMET_RDMA_REQ_RETIRED_CMD	= (1 << 2),
 };
 
 struct nvmet_rdma_rsp {
@@ -133,10 +140,42 @@ struct nvmet_rdma_port {
 	struct delayed_work	repair_work;
 };
 
+struct nvmet_rdma_srq_chunk {
+	struct list_head	entry;
+	struct nvmet_rdma_cmd	*cmds;
+	int			nr_cmds;
+	/* commands of a retired chunk that are still owned by the SRQ */
+	atomic_t		nr_posted;
+	bool			retired;
+};
+
+enum {
+	NVMET_RDMA_SRQ_LIMIT_REACHED,
+	NVMET_RDMA_SRQ_STOPPING,
+};
+
 struct nvmet_rdma_srq {
 	struct ib_srq            *srq;
-	struct nvmet_rdma_cmd    *cmds;
 	struct nvmet_rdma_device *ndev;
+
+	/*
+	 * Adaptive sizing: the SRQ is created srq_size deep, but only
+	 * min_cmds receive buffers are posted at first. The SRQ limit is
+	 * armed at a low watermark to grow by a chunk, and at a high
+	 * watermark to find out if the newest chunk went unused for a whole
+	 * shrink interval.
+	 */
+	struct mutex		 lock;
+	struct list_head	 chunks;
+	int			 nr_cmds;
+	int			 nr_alloc;
+	int			 min_cmds;
+	bool			 adaptive;
+	bool			 armed_hi;
+	bool			 busy;
+	unsigned long		 flags;
+	struct work_struct	 resize_work;
+	struct delayed_work	 shrink_work;
 };
 
 struct nvmet_rdma_device {
@@ -166,6 +205,10 @@ static int nvmet_rdma_srq_size = 1024;
 module_param_cb(srq_size, &srq_size_ops, &nvmet_rdma_srq_size, 0644);
 MODULE_PARM_DESC(srq_size, "set Shared Receive Queue (SRQ) size, should >= 256 (default: 1024)");
 
+static int nvmet_rdma_srq_min_size = 256;
+module_param_cb(srq_min_size, &srq_size_ops, &nvmet_rdma_srq_min_size, 0644);
+MODULE_PARM_DESC(srq_min_size, "set number of receive buffers initially posted to a Shared Receive Queue (SRQ). The SRQ grows towards srq_size on demand and shrinks back when idle. Set to srq_size to disable resizing, should >= 256 (default: 256)");
+
 static unsigned long long nvmet_rdma_offload_mem_start = 0;
 module_param_named(offload_mem_start, nvmet_rdma_offload_mem_start, ullong, 0444);
 MODULE_PARM_DESC(offload_mem_start,
@@ -217,6 +260,7 @@ static void nvmet_rdma_free_rsp(struct nvmet_rdma_device *ndev,
 				struct nvmet_rdma_rsp *r);
 static int nvmet_rdma_alloc_rsp(struct nvmet_rdma_device *ndev,
 				struct nvmet_rdma_rsp *r);
+static void nvmet_rdma_srq_put_retired(struct nvmet_rdma_cmd *cmd);
 
 static const struct nvmet_fabrics_ops nvmet_rdma_ops;
 
@@ -735,6 +779,9 @@ static void nvmet_rdma_release_rsp(struct nvmet_rdma_rsp *rsp)
 	if (rsp->req.sg != rsp->cmd->inline_sg)
 		nvmet_req_free_sgls(&rsp->req);
 
+	if (unlikely(rsp->flags & NVMET_RDMA_REQ_RETIRED_CMD))
+		nvmet_rdma_srq_put_retired(rsp->cmd);
+
 	if (unlikely(!list_empty_careful(&queue->rsp_wr_wait_list)))
 		nvmet_rdma_process_wr_wait_list(queue);
 
@@ -796,7 +843,10 @@ static void nvmet_rdma_queue_response(struct nvmet_req *req)
 		first_wr = &rsp->send_wr;
 	}
 
-	nvmet_rdma_post_recv(rsp->queue->dev, rsp->cmd);
+	if (unlikely(rsp->cmd->chunk && READ_ONCE(rsp->cmd->chunk->retired)))
+		rsp->flags |= NVMET_RDMA_REQ_RETIRED_CMD;
+	else
+		nvmet_rdma_post_recv(rsp->queue->dev, rsp->cmd);
 
 	ib_dma_sync_single_for_device(rsp->queue->dev->device,
 		rsp->send_sge.addr, rsp->send_sge.length,
@@ -838,7 +888,7 @@ static void nvmet_rdma_read_data_done(struct ib_cq *cq, struct ib_wc *wc)
 	if (unlikely(status))
 		nvmet_req_complete(&rsp->req, status);
 	else
-		rsp->req.execute(&rsp->req);
+		nvmet_req_execute(&rsp->req);
 }
 
 static void nvmet_rdma_write_data_done(struct ib_cq *cq, struct ib_wc *wc)
@@ -1025,7 +1075,7 @@ static bool nvmet_rdma_execute_command(struct nvmet_rdma_rsp *rsp)
 				queue->cm_id->port_num, &rsp->read_cqe, NULL))
 			nvmet_req_complete(&rsp->req, NVME_SC_DATA_XFER_ERROR);
 	} else {
-		rsp->req.execute(&rsp->req);
+		nvmet_req_execute(&rsp->req);
 	}
 
 	return true;
@@ -1119,11 +1169,178 @@ static void nvmet_rdma_recv_done(struct ib_cq *cq, struct ib_wc *wc)
 	nvmet_rdma_handle_command(queue, rsp);
 }
 
+static void nvmet_rdma_srq_put_retired(struct nvmet_rdma_cmd *cmd)
+{
+	if (atomic_dec_and_test(&cmd->chunk->nr_posted))
+		schedule_work(&cmd->nsrq->resize_work);
+}
+
+static int nvmet_rdma_srq_arm(struct nvmet_rdma_srq *nsrq, bool hi)
+{
+	struct ib_srq_attr attr = { };
+
+	attr.srq_limit = nsrq->nr_cmds / 4;
+	if (hi)
+		attr.srq_limit += NVMET_RDMA_SRQ_CHUNK;
+	nsrq->armed_hi = hi;
+
+	return ib_modify_srq(nsrq->srq, &attr, IB_SRQ_LIMIT);
+}
+
+static int nvmet_rdma_srq_add_chunk(struct nvmet_rdma_srq *nsrq, int nr_cmds)
+{
+	struct nvmet_rdma_device *ndev = nsrq->ndev;
+	struct nvmet_rdma_srq_chunk *chunk;
+	int ret, i;
+
+	chunk = kzalloc(sizeof(*chunk), GFP_KERNEL);
+	if (!chunk)
+		return -ENOMEM;
+
+	chunk->cmds = nvmet_rdma_alloc_cmds(ndev, nr_cmds, false);
+	if (IS_ERR(chunk->cmds)) {
+		ret = PTR_ERR(chunk->cmds);
+		kfree(chunk);
+		return ret;
+	}
+
+	chunk->nr_cmds = nr_cmds;
+	atomic_set(&chunk->nr_posted, nr_cmds);
+	list_add_tail(&chunk->entry, &nsrq->chunks);
+	nsrq->nr_cmds += nr_cmds;
+	WRITE_ONCE(nsrq->nr_alloc, nsrq->nr_alloc + nr_cmds);
+
+	for (i = 0; i < nr_cmds; i++) {
+		chunk->cmds[i].nsrq = nsrq;
+		chunk->cmds[i].chunk = chunk;
+		ret = nvmet_rdma_post_recv(ndev, &chunk->cmds[i]);
+		if (ret) {
+			atomic_sub(nr_cmds - i, &chunk->nr_posted);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
+static void nvmet_rdma_srq_free_chunk(struct nvmet_rdma_srq *nsrq,
+				      struct nvmet_rdma_srq_chunk *chunk)
+{
+	list_del(&chunk->entry);
+	WRITE_ONCE(nsrq->nr_alloc, nsrq->nr_alloc - chunk->nr_cmds);
+	nvmet_rdma_free_cmds(nsrq->ndev, chunk->cmds, chunk->nr_cmds, false);
+	kfree(chunk);
+}
+
+static void nvmet_rdma_srq_resize_work(struct work_struct *w)
+{
+	struct nvmet_rdma_srq *nsrq =
+		container_of(w, struct nvmet_rdma_srq, resize_work);
+	struct nvmet_rdma_srq_chunk *chunk, *tmp;
+	int max_cmds = nsrq->ndev->srq_size;
+	int nr, nr_posted;
+
+	if (test_bit(NVMET_RDMA_SRQ_STOPPING, &nsrq->flags))
+		return;
+
+	mutex_lock(&nsrq->lock);
+	/*
+	 * Retired chunks keep their receive buffers posted until the SRQ
+	 * consumes them, so they still count against max_wr.
+	 */
+	nr_posted = nsrq->nr_cmds;
+	list_for_each_entry_safe(chunk, tmp, &nsrq->chunks, entry) {
+		if (!chunk->retired)
+			continue;
+		if (!atomic_read(&chunk->nr_posted))
+			nvmet_rdma_srq_free_chunk(nsrq, chunk);
+		else
+			nr_posted += atomic_read(&chunk->nr_posted);
+	}
+
+	if (test_and_clear_bit(NVMET_RDMA_SRQ_LIMIT_REACHED, &nsrq->flags)) {
+		nsrq->busy = true;
+		nr = min(NVMET_RDMA_SRQ_CHUNK, max_cmds - nsrq->nr_cmds);
+		/* a high watermark event only means "do not shrink" */
+		if (!nsrq->armed_hi && nr > max_cmds - nr_posted) {
+			/*
+			 * Grow once the retired buffers drain, the last one
+			 * put schedules this work again.
+			 */
+			set_bit(NVMET_RDMA_SRQ_LIMIT_REACHED, &nsrq->flags);
+			nr = max_cmds - nr_posted;
+		}
+		if (!nsrq->armed_hi && nr > 0 &&
+		    nvmet_rdma_srq_add_chunk(nsrq, nr))
+			pr_warn_ratelimited("failed to grow SRQ to %d receive buffers\n",
+					    nsrq->nr_cmds + nr);
+		/* at full size the shrink work re-arms the limit */
+		if (nsrq->nr_cmds < max_cmds)
+			nvmet_rdma_srq_arm(nsrq, false);
+	}
+	mutex_unlock(&nsrq->lock);
+}
+
+static void nvmet_rdma_srq_shrink_work(struct work_struct *w)
+{
+	struct nvmet_rdma_srq *nsrq = container_of(to_delayed_work(w),
+			struct nvmet_rdma_srq, shrink_work);
+	struct nvmet_rdma_srq_chunk *chunk;
+
+	mutex_lock(&nsrq->lock);
+	if (!nsrq->busy && nsrq->armed_hi) {
+		/*
+		 * The SRQ never drained into the newest chunk during the last
+		 * interval, retire it. The first chunk holds min_cmds and is
+		 * never retired.
+		 */
+		list_for_each_entry_reverse(chunk, &nsrq->chunks, entry) {
+			if (chunk->retired)
+				continue;
+			if (list_is_first(&chunk->entry, &nsrq->chunks))
+				break;
+			WRITE_ONCE(chunk->retired, true);
+			nsrq->nr_cmds -= chunk->nr_cmds;
+			break;
+		}
+	}
+	nsrq->busy = false;
+	nvmet_rdma_srq_arm(nsrq, nsrq->nr_cmds > nsrq->min_cmds);
+	mutex_unlock(&nsrq->lock);
+
+	if (!test_bit(NVMET_RDMA_SRQ_STOPPING, &nsrq->flags))
+		schedule_delayed_work(&nsrq->shrink_work,
+				      NVMET_RDMA_SRQ_SHRINK_INTERVAL);
+}
+
+static void nvmet_rdma_srq_event(struct ib_event *event, void *priv)
+{
+	struct nvmet_rdma_srq *nsrq = priv;
+
+	if (event->event != IB_EVENT_SRQ_LIMIT_REACHED) {
+		pr_err("received IB SRQ event: %s (%d)\n",
+		       ib_event_msg(event->event), event->event);
+		return;
+	}
+
+	set_bit(NVMET_RDMA_SRQ_LIMIT_REACHED, &nsrq->flags);
+	if (!test_bit(NVMET_RDMA_SRQ_STOPPING, &nsrq->flags))
+		schedule_work(&nsrq->resize_work);
+}
+
 static void nvmet_rdma_destroy_srq(struct nvmet_rdma_srq *nsrq)
 {
-	nvmet_rdma_free_cmds(nsrq->ndev, nsrq->cmds, nsrq->ndev->srq_size,
-			     false);
+	struct nvmet_rdma_srq_chunk *chunk, *tmp;
+
+	set_bit(NVMET_RDMA_SRQ_STOPPING, &nsrq->flags);
+	cancel_delayed_work_sync(&nsrq->shrink_work);
+	cancel_work_sync(&nsrq->resize_work);
 	ib_destroy_srq(nsrq->srq);
+	/* a limit event may have raced with the cancel above */
+	cancel_work_sync(&nsrq->resize_work);
+
+	list_for_each_entry_safe(chunk, tmp, &nsrq->chunks, entry)
+		nvmet_rdma_srq_free_chunk(nsrq, chunk);
 
 	kfree(nsrq);
 }
@@ -1146,14 +1363,24 @@ nvmet_rdma_init_srq(struct nvmet_rdma_device *ndev)
 {
 	struct ib_srq_init_attr srq_attr = { NULL, };
 	size_t srq_size = ndev->srq_size;
+	struct nvmet_rdma_srq_chunk *chunk, *tmp;
 	struct nvmet_rdma_srq *nsrq;
 	struct ib_srq *srq;
-	int ret, i;
+	int ret;
 
 	nsrq = kzalloc(sizeof(*nsrq), GFP_KERNEL);
 	if (!nsrq)
 		return ERR_PTR(-ENOMEM);
 
+	mutex_init(&nsrq->lock);
+	INIT_LIST_HEAD(&nsrq->chunks);
+	INIT_WORK(&nsrq->resize_work, nvmet_rdma_srq_resize_work);
+	INIT_DELAYED_WORK(&nsrq->shrink_work, nvmet_rdma_srq_shrink_work);
+	nsrq->min_cmds = min_t(size_t, nvmet_rdma_srq_min_size, srq_size);
+	nsrq->adaptive = nsrq->min_cmds < srq_size;
+
+	srq_attr.event_handler = nvmet_rdma_srq_event;
+	srq_attr.srq_context = nsrq;
 	srq_attr.attr.max_wr = srq_size;
 	srq_attr.attr.max_sge = 1 + ndev->inline_page_count;
 	srq_attr.attr.srq_limit = 0;
@@ -1164,27 +1391,31 @@ nvmet_rdma_init_srq(struct nvmet_rdma_device *ndev)
 		goto out_free;
 	}
 
-	nsrq->cmds = nvmet_rdma_alloc_cmds(ndev, srq_size, false);
-	if (IS_ERR(nsrq->cmds)) {
-		ret = PTR_ERR(nsrq->cmds);
-		goto out_destroy_srq;
-	}
-
 	nsrq->srq = srq;
 	nsrq->ndev = ndev;
 
-	for (i = 0; i < srq_size; i++) {
-		nsrq->cmds[i].nsrq = nsrq;
-		ret = nvmet_rdma_post_recv(ndev, &nsrq->cmds[i]);
+	ret = nvmet_rdma_srq_add_chunk(nsrq, nsrq->min_cmds);
+	if (ret)
+		goto out_free_cmds;
+
+	if (nsrq->adaptive && nvmet_rdma_srq_arm(nsrq, false)) {
+		pr_info("SRQ limit not supported by %s, using a fixed SRQ size.\n",
+			dev_name(&ndev->device->dev));
+		nsrq->adaptive = false;
+		ret = nvmet_rdma_srq_add_chunk(nsrq, srq_size - nsrq->min_cmds);
 		if (ret)
 			goto out_free_cmds;
 	}
 
+	if (nsrq->adaptive)
+		schedule_delayed_work(&nsrq->shrink_work,
+				      NVMET_RDMA_SRQ_SHRINK_INTERVAL);
+
 	return nsrq;
 
 out_free_cmds:
-	nvmet_rdma_free_cmds(ndev, nsrq->cmds, srq_size, false);
-out_destroy_srq:
+	list_for_each_entry_safe(chunk, tmp, &nsrq->chunks, entry)
+		nvmet_rdma_srq_free_chunk(nsrq, chunk);
 	ib_destroy_srq(srq);
 out_free:
 	kfree(nsrq);
@@ -2108,6 +2339,34 @@ static bool nvmet_rdma_is_port_active(struct nvmet_port *nport)
 	return port->cm_id ? true : false;
 }
 
+/*
+ * Memory held by the SRQ receive buffers of the device behind @nport. The
+ * SRQs are per device, so all ports on the same device report the same
+ * value.
+ */
+static u64 nvmet_rdma_srq_mem_in_use(struct nvmet_port *nport)
+{
+	struct nvmet_rdma_port *port = nport->priv;
+	struct nvmet_rdma_device *ndev;
+	u64 cmd_size, mem = 0;
+	int i;
+
+	mutex_lock(&device_list_mutex);
+	list_for_each_entry(ndev, &device_list, entry) {
+		if (ndev->device->node_guid != port->node_guid || !ndev->srqs)
+			continue;
+
+		cmd_size = sizeof(struct nvmet_rdma_cmd) +
+			   sizeof(struct nvme_command) +
+			   ndev->inline_page_count * PAGE_SIZE;
+		for (i = 0; i < ndev->srq_count; i++)
+			mem += READ_ONCE(ndev->srqs[i]->nr_alloc) * cmd_size;
+	}
+	mutex_unlock(&device_list_mutex);
+
+	return mem;
+}
+
 static const struct nvmet_fabrics_ops nvmet_rdma_ops = {
 	.owner			= THIS_MODULE,
 	.type			= NVMF_TRTYPE_RDMA,
@@ -2115,6 +2374,7 @@ static const struct nvmet_fabrics_ops nvmet_rdma_ops = {
 	.flags			= NVMF_KEYED_SGLS | NVMF_METADATA_SUPPORTED,
 	.add_port		= nvmet_rdma_add_port,
 	.is_port_active         = nvmet_rdma_is_port_active,
+	.srq_mem_in_use		= nvmet_rdma_srq_mem_in_use,
 	.remove_port		= nvmet_rdma_remove_port,
 	.peer_to_peer_capable	= nvmet_rdma_peer_to_peer_capable,
 	.install_queue		= nvmet_rdma_install_offload_queue,
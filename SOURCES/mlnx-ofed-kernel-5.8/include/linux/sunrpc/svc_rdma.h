@@ -65,6 +65,7 @@ extern unsigned int svcrdma_ord;
 extern unsigned int svcrdma_max_requests;
 extern unsigned int svcrdma_max_bc_requests;
 extern unsigned int svcrdma_max_req_size;
+extern unsigned int svcrdma_recv_batch;
 
 extern struct percpu_counter svcrdma_stat_read;
 extern struct percpu_counter svcrdma_stat_recv;
@@ -122,6 +123,7 @@ enum {
 	RPCRDMA_LISTEN_BACKLOG	= 10,
 	RPCRDMA_MAX_REQUESTS	= 64,
 	RPCRDMA_MAX_BC_REQUESTS	= 2,
+	RPCRDMA_DEF_RECV_BATCH	= 7,
 };
 
 #define RPCSVC_MAXPAYLOAD_RDMA	RPCSVC_MAXPAYLOAD
@@ -57,6 +57,8 @@
 #define RPCRDMA_DEF_INLINE  (4096)	/* default inline thresh */
 #define RPCRDMA_MAX_INLINE  (65536)	/* max inline thresh */
 
+#define RPCRDMA_DEF_PULLUP  (1024)	/* default pull-up thresh */
+
 /* Memory registration strategies, by number.
  * This is part of a kernel / user space API. Do not remove. */
 enum rpcrdma_memreg {
@@ -389,6 +389,77 @@ TRACE_EVENT(mr_dereg,
 	TP_printk("mr.id=%u", __entry->id)
 );
 
+/**
+ ** User memory events
+ **/
+
+TRACE_EVENT(umem_pin,
+	TP_PROTO(
+		unsigned long addr,
+		size_t size,
+		unsigned int nents,
+		unsigned int nthreads,
+		s64 usecs,
+		int rc
+	),
+
+	TP_ARGS(addr, size, nents, nthreads, usecs, rc),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, addr)
+		__field(size_t, size)
+		__field(unsigned int, nents)
+		__field(unsigned int, nthreads)
+		__field(s64, usecs)
+		__field(int, rc)
+	),
+
+	TP_fast_assign(
+		__entry->addr = addr;
+		__entry->size = size;
+		__entry->nents = nents;
+		__entry->nthreads = nthreads;
+		__entry->usecs = usecs;
+		__entry->rc = rc;
+	),
+
+	TP_printk("addr=0x%lx size=%zu nents=%u threads=%u usecs=%lld rc=%d",
+		__entry->addr, __entry->size, __entry->nents,
+		__entry->nthreads, __entry->usecs, __entry->rc)
+);
+
+TRACE_EVENT(umem_pin_chunk,
+	TP_PROTO(
+		unsigned long start,
+		unsigned long npages,
+		unsigned long nruns,
+		s64 usecs,
+		int rc
+	),
+
+	TP_ARGS(start, npages, nruns, usecs, rc),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, start)
+		__field(unsigned long, npages)
+		__field(unsigned long, nruns)
+		__field(s64, usecs)
+		__field(int, rc)
+	),
+
+	TP_fast_assign(
+		__entry->start = start;
+		__entry->npages = npages;
+		__entry->nruns = nruns;
+		__entry->usecs = usecs;
+		__entry->rc = rc;
+	),
+
+	TP_printk("start=0x%lx npages=%lu runs=%lu usecs=%lld rc=%d",
+		__entry->start, __entry->npages, __entry->nruns,
+		__entry->usecs, __entry->rc)
+);
+
 #endif /* _TRACE_RDMA_CORE_H */
 
 #include <trace/define_trace.h>
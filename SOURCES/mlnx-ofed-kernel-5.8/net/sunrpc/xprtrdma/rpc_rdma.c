@@ -149,6 +149,20 @@ static bool rpcrdma_args_inline(struct rpcrdma_xprt *r_xprt,
 	return true;
 }
 
+/* An inline Call can be sent either by copying the page list and
+ * tail into the head buffer, or by DMA mapping each of them as a
+ * separate Send SGE. The copy is cheaper only for small payloads;
+ * rpcrdma_args_inline() has already checked that the mapped form
+ * fits within the device's max_send_sge.
+ */
+static bool rpcrdma_args_pullup(struct rpcrdma_req *req, struct xdr_buf *xdr)
+{
+	if (xdr->len >= rdmab_length(req->rl_sendbuf))
+		return false;
+	return xdr->page_len + xdr->tail[0].iov_len <=
+		READ_ONCE(xprt_rdma_pullup_thresh);
+}
+
 /* The client can't know how large the actual reply will be. Thus it
  * plans for the largest possible reply for that particular ULP
  * operation. If the maximum combined reply message size exceeds that
@@ -742,6 +756,7 @@ static bool rpcrdma_prepare_noch_mapped(struct rpcrdma_xprt *r_xprt,
 
 	if (req->rl_sendctx->sc_unmap_count)
 		kref_get(&req->rl_kref);
+	r_xprt->rx_stats.mapped_send_count += xdr->page_len + tail->iov_len;
 	return true;
 }
 
@@ -926,7 +941,7 @@ rpcrdma_marshal_req(struct rpcrdma_xprt *r_xprt, struct rpc_rqst *rqst)
 	 */
 	if (rpcrdma_args_inline(r_xprt, rqst)) {
 		*p++ = rdma_msg;
-		rtype = buf->len < rdmab_length(req->rl_sendbuf) ?
+		rtype = rpcrdma_args_pullup(req, buf) ?
 			rpcrdma_noch_pullup : rpcrdma_noch_mapped;
 	} else if (ddp_allowed && buf->flags & XDRBUF_WRITE) {
 		*p++ = rdma_msg;
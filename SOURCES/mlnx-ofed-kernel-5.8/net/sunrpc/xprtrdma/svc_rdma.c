@@ -62,6 +62,9 @@ static unsigned int max_max_requests = 16384;
 unsigned int svcrdma_max_req_size = RPCRDMA_DEF_INLINE_THRESH;
 static unsigned int min_max_inline = RPCRDMA_DEF_INLINE_THRESH;
 static unsigned int max_max_inline = RPCRDMA_MAX_INLINE_THRESH;
+unsigned int svcrdma_recv_batch = RPCRDMA_DEF_RECV_BATCH;
+static unsigned int min_recv_batch = 1;
+static unsigned int max_recv_batch = 128;
 static unsigned int svcrdma_stat_unused;
 static unsigned int zero;
 
@@ -135,6 +138,15 @@ static struct ctl_table svcrdma_parm_table[] = {
 		.extra1		= &min_ord,
 		.extra2		= &max_ord,
 	},
+	{
+		.procname	= "recv_batch",
+		.data		= &svcrdma_recv_batch,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= &min_recv_batch,
+		.extra2		= &max_recv_batch,
+	},
 
 	{
 		.procname	= "rdma_stat_read",
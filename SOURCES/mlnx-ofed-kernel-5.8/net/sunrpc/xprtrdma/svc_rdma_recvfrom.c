@@ -324,6 +324,7 @@ static void svc_rdma_wc_receive(struct ib_cq *cq, struct ib_wc *wc)
 	struct svcxprt_rdma *rdma = cq->cq_context;
 	struct ib_cqe *cqe = wc->wr_cqe;
 	struct svc_rdma_recv_ctxt *ctxt;
+	bool was_empty;
 
 	rdma->sc_pending_recvs--;
 
@@ -351,11 +352,18 @@ static void svc_rdma_wc_receive(struct ib_cq *cq, struct ib_wc *wc)
 	ctxt->rc_byte_len = wc->byte_len;
 
 	spin_lock(&rdma->sc_rq_dto_lock);
+	was_empty = list_empty(&rdma->sc_rq_dto_q);
 	list_add_tail(&ctxt->rc_list, &rdma->sc_rq_dto_q);
 	/* Note the unlock pairs with the smp_rmb in svc_xprt_ready: */
 	set_bit(XPT_DATA, &rdma->sc_xprt.xpt_flags);
 	spin_unlock(&rdma->sc_rq_dto_lock);
-	if (!test_bit(RDMAXPRT_CONN_PENDING, &rdma->sc_flags))
+
+	/* If Calls were already waiting, the transport has been enqueued
+	 * for them and the thread that dequeues the next one re-enqueues
+	 * it via svc_xprt_received() while XPT_DATA stays set. A burst of
+	 * Receives therefore costs one wakeup instead of one per Call.
+	 */
+	if (was_empty && !test_bit(RDMAXPRT_CONN_PENDING, &rdma->sc_flags))
 		svc_xprt_enqueue(&rdma->sc_xprt);
 	return;
 
@@ -391,6 +391,7 @@ struct rpcrdma_stats {
 	unsigned long		write_chunk_count;
 	unsigned long		reply_chunk_count;
 	unsigned long long	total_rdma_request;
+	unsigned long long	mapped_send_count;
 
 	/* rarely accessed error counters */
 	unsigned long long	pullup_copy_count;
@@ -576,6 +577,7 @@ static inline void rpcrdma_set_xdrlen(struct xdr_buf *xdr, size_t len)
  */
 extern unsigned int xprt_rdma_max_inline_read;
 extern unsigned int xprt_rdma_max_inline_write;
+extern unsigned int xprt_rdma_pullup_thresh;
 void xprt_rdma_format_addresses(struct rpc_xprt *xprt, struct sockaddr *sap);
 void xprt_rdma_free_addresses(struct rpc_xprt *xprt);
 void xprt_rdma_close(struct rpc_xprt *xprt);
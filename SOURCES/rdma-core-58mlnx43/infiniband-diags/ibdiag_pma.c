@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <infiniband/umad.h>
+
+#include "ibdiag_common.h"
+#include "ibdiag_pma.h"
+
+static void queue_query(struct pma_engine *engine, struct pma_query *q)
+{
+	q->qnext = NULL;
+	if (!engine->queue_head) {
+		engine->queue_head = q;
+		engine->queue_tail = q;
+	} else {
+		engine->queue_tail->qnext = q;
+		engine->queue_tail = q;
+	}
+}
+
+static struct pma_query *get_query(struct pma_engine *engine)
+{
+	struct pma_query *head = engine->queue_head;
+
+	if (head) {
+		if (engine->queue_tail == head)
+			engine->queue_tail = NULL;
+		engine->queue_head = head->qnext;
+	}
+	return head;
+}
+
+static int send_query(struct pma_engine *engine, struct pma_query *q)
+{
+	uint8_t umad[1024];
+	uint8_t data[IB_PC_DATA_SZ] = { 0 };
+	int rc;
+
+	memset(umad, 0, umad_size() + IB_MAD_SIZE);
+
+	mad_set_field(data, 0, IB_PC_PORT_SELECT_F, q->port);
+
+	if ((rc = mad_build_pkt(umad, &q->rpc, &q->portid, NULL, data)) < 0) {
+		IBWARN("mad_build_pkt failed; %d", rc);
+		return rc;
+	}
+
+	if ((rc = umad_send(engine->umad_fd, engine->agent, umad, IB_MAD_SIZE,
+			    engine->timeout, engine->retries)) < 0) {
+		IBWARN("send failed; %d", rc);
+		return rc;
+	}
+
+	return 0;
+}
+
+static void process_queue(struct pma_engine *engine)
+{
+	struct pma_query *q;
+
+	/* queries issued from a completion callback are picked up by the
+	 * loop that is already running */
+	if (engine->in_process)
+		return;
+	engine->in_process = 1;
+
+	while (cl_qmap_count(&engine->on_wire) < engine->max_outstanding) {
+		q = get_query(engine);
+		if (!q)
+			break;
+
+		if (send_query(engine, q)) {
+			engine->total_failed++;
+			q->cb(engine, q, NULL, q->cb_data);
+			free(q);
+			continue;
+		}
+		cl_qmap_insert(&engine->on_wire, (uint32_t) q->rpc.trid,
+			       &q->on_wire);
+		engine->total_sent++;
+	}
+
+	engine->in_process = 0;
+}
+
+int pma_issue_query(struct pma_engine *engine, ib_portid_t *portid, int port,
+		    unsigned attr_id, pma_comp_cb_t cb, void *cb_data)
+{
+	struct pma_query *q;
+
+	if (portid->lid <= 0) {
+		IBWARN("only lid routed is supported");
+		return -EINVAL;
+	}
+
+	q = calloc(1, sizeof(*q));
+	if (!q) {
+		IBWARN("OOM");
+		return -ENOMEM;
+	}
+
+	q->cb = cb;
+	q->cb_data = cb_data;
+	q->port = port;
+	q->portid = *portid;
+	if (!q->portid.qp)
+		q->portid.qp = 1;
+	if (!q->portid.qkey)
+		q->portid.qkey = IB_DEFAULT_QP1_QKEY;
+
+	q->rpc.mgtclass = IB_PERFORMANCE_CLASS;
+	q->rpc.method = IB_MAD_METHOD_GET;
+	q->rpc.attr.id = attr_id;
+	q->rpc.attr.mod = 0;
+	q->rpc.timeout = engine->timeout;
+	q->rpc.datasz = IB_PC_DATA_SZ;
+	q->rpc.dataoffs = IB_PC_DATA_OFFS;
+	q->rpc.trid = mad_trid();
+
+	queue_query(engine, q);
+	process_queue(engine);
+	return 0;
+}
+
+static int process_one_recv(struct pma_engine *engine)
+{
+	uint8_t umad[sizeof(struct ib_user_mad) + IB_MAD_SIZE];
+	int length = umad_size() + IB_MAD_SIZE;
+	struct pma_query *q;
+	uint8_t *mad;
+	uint32_t trid;
+	int status;
+	int rc;
+
+	memset(umad, 0, sizeof(umad));
+
+	if ((rc = umad_recv(engine->umad_fd, umad, &length, -1)) < 0) {
+		IBWARN("umad_recv failed: %d", rc);
+		return -1;
+	}
+
+	mad = umad_get_mad(umad);
+	trid = (uint32_t) mad_get_field64(mad, 0, IB_MAD_TRID_F);
+
+	q = (struct pma_query *)cl_qmap_remove(&engine->on_wire, trid);
+	if (&q->on_wire == cl_qmap_end(&engine->on_wire)) {
+		IBWARN("Failed to find matching query for trid (%x)", trid);
+		return -1;
+	}
+
+	/* keep the window full before handing the response over */
+	process_queue(engine);
+
+	if ((status = umad_status(umad))) {
+		DEBUG("umad (%s Attr 0x%x port %d) bad status %d; %s",
+		      portid2str(&q->portid), q->rpc.attr.id, q->port,
+		      status, strerror(status));
+		engine->total_failed++;
+		q->cb(engine, q, NULL, q->cb_data);
+	} else if ((status = mad_get_field(mad, 0, IB_MAD_STATUS_F))) {
+		DEBUG("mad (%s Attr 0x%x port %d) bad status 0x%x",
+		      portid2str(&q->portid), q->rpc.attr.id, q->port,
+		      status);
+		engine->total_failed++;
+		q->cb(engine, q, NULL, q->cb_data);
+	} else
+		q->cb(engine, q, mad + IB_PC_DATA_OFFS, q->cb_data);
+
+	free(q);
+	return 0;
+}
+
+int pma_engine_init(struct pma_engine *engine, char *ca_name, int ca_port,
+		    unsigned max_outstanding, unsigned timeout)
+{
+	memset(engine, 0, sizeof(*engine));
+
+	engine->umad_fd = umad_open_port(ca_name, ca_port);
+	if (engine->umad_fd < 0) {
+		IBWARN("can't open UMAD port (%s:%d)", ca_name, ca_port);
+		return -EIO;
+	}
+
+	if ((engine->agent = umad_register(engine->umad_fd,
+					   IB_PERFORMANCE_CLASS, 1, 0,
+					   NULL)) < 0) {
+		IBWARN("Failed to register PerfMgt agent on (%s:%d)",
+		       ca_name, ca_port);
+		umad_close_port(engine->umad_fd);
+		return -EIO;
+	}
+
+	cl_qmap_init(&engine->on_wire);
+	engine->max_outstanding = max_outstanding ? max_outstanding : 1;
+	engine->timeout = timeout ? timeout : MAD_DEF_TIMEOUT_MS;
+	engine->retries = MAD_DEF_RETRIES;
+	return 0;
+}
+
+void pma_engine_destroy(struct pma_engine *engine)
+{
+	cl_map_item_t *item;
+	struct pma_query *q;
+
+	q = get_query(engine);
+	if (q)
+		IBWARN("outstanding PMA queries");
+	for (; q; q = get_query(engine))
+		free(q);
+
+	item = cl_qmap_head(&engine->on_wire);
+	if (item != cl_qmap_end(&engine->on_wire))
+		IBWARN("outstanding PMA queries on wire");
+	for (; item != cl_qmap_end(&engine->on_wire);
+	     item = cl_qmap_head(&engine->on_wire)) {
+		cl_qmap_remove_item(&engine->on_wire, item);
+		free(item);
+	}
+
+	umad_unregister(engine->umad_fd, engine->agent);
+	umad_close_port(engine->umad_fd);
+}
+
+int pma_process_mads(struct pma_engine *engine)
+{
+	int rc;
+
+	while (!cl_is_qmap_empty(&engine->on_wire))
+		if ((rc = process_one_recv(engine)) != 0)
+			return rc;
+	return 0;
+}
+
+/* PortCounters and PortCountersExtended field for each snapshot counter */
+static const struct {
+	enum MAD_FIELDS pc;
+	enum MAD_FIELDS ext;
+} snap_fields[PMA_SNAP_NUM_CTRS] = {
+	[PMA_SNAP_SYM_ERR] = { IB_PC_ERR_SYM_F, IB_PC_EXT_ERR_SYM_F },
+	[PMA_SNAP_LINK_RECOVERS] = { IB_PC_LINK_RECOVERS_F,
+				     IB_PC_EXT_LINK_RECOVERS_F },
+	[PMA_SNAP_LINK_DOWNED] = { IB_PC_LINK_DOWNED_F,
+				   IB_PC_EXT_LINK_DOWNED_F },
+	[PMA_SNAP_RCV_ERR] = { IB_PC_ERR_RCV_F, IB_PC_EXT_ERR_RCV_F },
+	[PMA_SNAP_PHYSRCV_ERR] = { IB_PC_ERR_PHYSRCV_F,
+				   IB_PC_EXT_ERR_PHYSRCV_F },
+	[PMA_SNAP_SWITCH_REL_ERR] = { IB_PC_ERR_SWITCH_REL_F,
+				      IB_PC_EXT_ERR_SWITCH_REL_F },
+	[PMA_SNAP_XMT_DISCARDS] = { IB_PC_XMT_DISCARDS_F,
+				    IB_PC_EXT_XMT_DISCARDS_F },
+	[PMA_SNAP_XMTCONSTR_ERR] = { IB_PC_ERR_XMTCONSTR_F,
+				     IB_PC_EXT_ERR_XMTCONSTR_F },
+	[PMA_SNAP_RCVCONSTR_ERR] = { IB_PC_ERR_RCVCONSTR_F,
+				     IB_PC_EXT_ERR_RCVCONSTR_F },
+	[PMA_SNAP_LOCALINTEG_ERR] = { IB_PC_ERR_LOCALINTEG_F,
+				      IB_PC_EXT_ERR_LOCALINTEG_F },
+	[PMA_SNAP_EXCESS_OVR_ERR] = { IB_PC_ERR_EXCESS_OVR_F,
+				      IB_PC_EXT_ERR_EXCESS_OVR_F },
+	[PMA_SNAP_VL15_DROPPED] = { IB_PC_VL15_DROPPED_F,
+				    IB_PC_EXT_VL15_DROPPED_F },
+	[PMA_SNAP_XMT_WAIT] = { IB_PC_XMT_WAIT_F, IB_PC_EXT_XMT_WAIT_F },
+	[PMA_SNAP_XMT_BYTES] = { IB_PC_XMT_BYTES_F, IB_PC_EXT_XMT_BYTES_F },
+	[PMA_SNAP_RCV_BYTES] = { IB_PC_RCV_BYTES_F, IB_PC_EXT_RCV_BYTES_F },
+	[PMA_SNAP_XMT_PKTS] = { IB_PC_XMT_PKTS_F, IB_PC_EXT_XMT_PKTS_F },
+	[PMA_SNAP_RCV_PKTS] = { IB_PC_RCV_PKTS_F, IB_PC_EXT_RCV_PKTS_F },
+};
+
+#define PMA_SNAP_MAGIC		"IBPMASNP"
+#define PMA_SNAP_VERSION	1
+
+struct pma_snap_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_ctrs;
+	uint32_t rec_size;
+	uint32_t num_recs;
+	uint64_t timestamp;
+};
+
+enum MAD_FIELDS pma_snap_field(enum pma_snap_ctr ctr, int ext)
+{
+	return ext ? snap_fields[ctr].ext : snap_fields[ctr].pc;
+}
+
+struct pma_snap_rec *pma_snap_add(struct pma_snap *snap, uint64_t guid,
+				  uint8_t port)
+{
+	struct pma_snap_rec *rec;
+
+	if (snap->num_recs == snap->max_recs) {
+		uint32_t max = snap->max_recs ? snap->max_recs * 2 : 1024;
+
+		rec = realloc(snap->recs, max * sizeof(*rec));
+		if (!rec)
+			return NULL;
+		snap->recs = rec;
+		snap->max_recs = max;
+	}
+
+	rec = &snap->recs[snap->num_recs++];
+	memset(rec, 0, sizeof(*rec));
+	rec->guid = guid;
+	rec->port = port;
+	return rec;
+}
+
+void pma_snap_fill(struct pma_snap_rec *rec, uint8_t *pc, uint8_t *pce,
+		   int ext_err)
+{
+	int i;
+
+	if (pce)
+		rec->flags |= PMA_SNAP_F_EXT;
+	if (pce && ext_err)
+		rec->flags |= PMA_SNAP_F_EXT_ERR;
+
+	for (i = 0; i <= PMA_SNAP_LAST_ERR; i++) {
+		if (rec->flags & PMA_SNAP_F_EXT_ERR)
+			rec->ctr[i] = mad_get_field64(pce, 0,
+						      snap_fields[i].ext);
+		else
+			rec->ctr[i] = mad_get_field(pc, 0, snap_fields[i].pc);
+	}
+
+	for (; i < PMA_SNAP_NUM_CTRS; i++) {
+		if (pce)
+			rec->ctr[i] = mad_get_field64(pce, 0,
+						      snap_fields[i].ext);
+		else
+			rec->ctr[i] = mad_get_field(pc, 0, snap_fields[i].pc);
+	}
+}
+
+static int rec_cmp(const struct pma_snap_rec *a, const struct pma_snap_rec *b)
+{
+	if (a->guid != b->guid)
+		return a->guid < b->guid ? -1 : 1;
+	return (int)a->port - (int)b->port;
+}
+
+static int rec_qsort_cmp(const void *a, const void *b)
+{
+	return rec_cmp(a, b);
+}
+
+void pma_snap_sort(struct pma_snap *snap)
+{
+	qsort(snap->recs, snap->num_recs, sizeof(*snap->recs), rec_qsort_cmp);
+}
+
+int pma_snap_write(struct pma_snap *snap, const char *file)
+{
+	struct pma_snap_hdr hdr = {};
+	FILE *f;
+	int rc = 0;
+
+	memcpy(hdr.magic, PMA_SNAP_MAGIC, sizeof(hdr.magic));
+	hdr.version = PMA_SNAP_VERSION;
+	hdr.num_ctrs = PMA_SNAP_NUM_CTRS;
+	hdr.rec_size = sizeof(struct pma_snap_rec);
+	hdr.num_recs = snap->num_recs;
+	hdr.timestamp = snap->timestamp;
+
+	f = fopen(file, "w");
+	if (!f)
+		return -errno;
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    (snap->num_recs &&
+	     fwrite(snap->recs, sizeof(*snap->recs), snap->num_recs, f) !=
+	     snap->num_recs))
+		rc = -EIO;
+
+	if (fclose(f) && !rc)
+		rc = -errno;
+	return rc;
+}
+
+int pma_snap_read(struct pma_snap *snap, const char *file)
+{
+	struct pma_snap_hdr hdr;
+	FILE *f;
+	int rc = 0;
+
+	memset(snap, 0, sizeof(*snap));
+
+	f = fopen(file, "r");
+	if (!f)
+		return -errno;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    memcmp(hdr.magic, PMA_SNAP_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != PMA_SNAP_VERSION ||
+	    hdr.num_ctrs != PMA_SNAP_NUM_CTRS ||
+	    hdr.rec_size != sizeof(struct pma_snap_rec)) {
+		rc = -EINVAL;
+		goto out;
+	}
+
+	if (hdr.num_recs) {
+		snap->recs = calloc(hdr.num_recs, sizeof(*snap->recs));
+		if (!snap->recs) {
+			rc = -ENOMEM;
+			goto out;
+		}
+		if (fread(snap->recs, sizeof(*snap->recs), hdr.num_recs, f) !=
+		    hdr.num_recs) {
+			pma_snap_free(snap);
+			rc = -EINVAL;
+			goto out;
+		}
+	}
+	snap->num_recs = snap->max_recs = hdr.num_recs;
+	snap->timestamp = hdr.timestamp;
+
+out:
+	fclose(f);
+	return rc;
+}
+
+void pma_snap_free(struct pma_snap *snap)
+{
+	free(snap->recs);
+	memset(snap, 0, sizeof(*snap));
+}
+
+void pma_snap_delta(const struct pma_snap *prev, const struct pma_snap *cur,
+		    pma_snap_delta_cb_t cb, void *cb_data)
+{
+	uint64_t delta[PMA_SNAP_NUM_CTRS];
+	uint32_t p = 0, c = 0;
+	int cmp, i;
+
+	while (p < prev->num_recs && c < cur->num_recs) {
+		const struct pma_snap_rec *pr = &prev->recs[p];
+		const struct pma_snap_rec *cr = &cur->recs[c];
+
+		cmp = rec_cmp(pr, cr);
+		if (cmp < 0) {
+			p++;
+			continue;
+		}
+		if (cmp > 0) {
+			c++;
+			continue;
+		}
+
+		/* A counter going backwards has been cleared (or the
+		 * counter width changed) since the previous snapshot. */
+		for (i = 0; i < PMA_SNAP_NUM_CTRS; i++)
+			delta[i] = cr->ctr[i] >= pr->ctr[i] ?
+				   cr->ctr[i] - pr->ctr[i] : cr->ctr[i];
+
+		cb(cr, delta, cb_data);
+		p++;
+		c++;
+	}
+}
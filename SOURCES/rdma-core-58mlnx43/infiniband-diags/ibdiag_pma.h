@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef _IBDIAG_PMA_H_
+#define _IBDIAG_PMA_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <infiniband/mad.h>
+#include <util/cl_qmap.h>
+
+/* Pipelined PMA query engine
+ * Queries are queued and kept on the wire up to a bounded window, the same
+ * way libibnetdisc drives SMPs during discovery.  Completions are delivered
+ * through a callback; "data" points at the attribute data of the response
+ * (IB_PC_DATA_OFFS into the MAD) or is NULL if the query failed, including
+ * when it could not be sent.  pma_issue_query only fails if the query could
+ * not be queued, its callback is not called then.  Queries still queued or
+ * on the wire when pma_process_mads fails never complete.
+ */
+struct pma_engine;
+struct pma_query;
+
+typedef void (*pma_comp_cb_t) (struct pma_engine *engine,
+			       struct pma_query *query, uint8_t *data,
+			       void *cb_data);
+
+struct pma_query {
+	cl_map_item_t on_wire;
+	struct pma_query *qnext;
+	pma_comp_cb_t cb;
+	void *cb_data;
+	ib_portid_t portid;
+	ib_rpc_t rpc;
+	int port;
+};
+
+struct pma_engine {
+	int umad_fd;
+	int agent;
+	struct pma_query *queue_head;
+	struct pma_query *queue_tail;
+	cl_qmap_t on_wire;
+	unsigned max_outstanding;
+	unsigned timeout;
+	unsigned retries;
+	unsigned total_sent;
+	unsigned total_failed;
+	int in_process;
+};
+
+/* NOTE: umad_init must be called prior to pma_engine_init */
+int pma_engine_init(struct pma_engine *engine, char *ca_name, int ca_port,
+		    unsigned max_outstanding, unsigned timeout);
+int pma_issue_query(struct pma_engine *engine, ib_portid_t *portid, int port,
+		    unsigned attr_id, pma_comp_cb_t cb, void *cb_data);
+int pma_process_mads(struct pma_engine *engine);
+void pma_engine_destroy(struct pma_engine *engine);
+
+/* Binary counter snapshots
+ * One fixed size record per port holding the error and data counters in
+ * host byte order, widened to 64 bits.  Records are kept sorted by
+ * (guid, port) so that two snapshots can be compared in a single merge pass.
+ */
+enum pma_snap_ctr {
+	PMA_SNAP_SYM_ERR,
+	PMA_SNAP_LINK_RECOVERS,
+	PMA_SNAP_LINK_DOWNED,
+	PMA_SNAP_RCV_ERR,
+	PMA_SNAP_PHYSRCV_ERR,
+	PMA_SNAP_SWITCH_REL_ERR,
+	PMA_SNAP_XMT_DISCARDS,
+	PMA_SNAP_XMTCONSTR_ERR,
+	PMA_SNAP_RCVCONSTR_ERR,
+	PMA_SNAP_LOCALINTEG_ERR,
+	PMA_SNAP_EXCESS_OVR_ERR,
+	PMA_SNAP_VL15_DROPPED,
+	PMA_SNAP_XMT_WAIT,
+	PMA_SNAP_LAST_ERR = PMA_SNAP_XMT_WAIT,
+	PMA_SNAP_XMT_BYTES,
+	PMA_SNAP_RCV_BYTES,
+	PMA_SNAP_XMT_PKTS,
+	PMA_SNAP_RCV_PKTS,
+	PMA_SNAP_NUM_CTRS
+};
+
+#define PMA_SNAP_F_EXT		0x1	/* counters read from PortCountersExtended */
+#define PMA_SNAP_F_EXT_ERR	0x2	/* error counters are 64 bit as well */
+
+struct pma_snap_rec {
+	uint64_t guid;
+	uint8_t port;
+	uint8_t flags;
+	uint8_t reserved[6];
+	uint64_t ctr[PMA_SNAP_NUM_CTRS];
+};
+
+struct pma_snap {
+	uint64_t timestamp;
+	uint32_t num_recs;
+	uint32_t max_recs;
+	struct pma_snap_rec *recs;
+};
+
+enum MAD_FIELDS pma_snap_field(enum pma_snap_ctr ctr, int ext);
+struct pma_snap_rec *pma_snap_add(struct pma_snap *snap, uint64_t guid,
+				  uint8_t port);
+void pma_snap_fill(struct pma_snap_rec *rec, uint8_t *pc, uint8_t *pce,
+		   int ext_err);
+void pma_snap_sort(struct pma_snap *snap);
+int pma_snap_write(struct pma_snap *snap, const char *file);
+int pma_snap_read(struct pma_snap *snap, const char *file);
+void pma_snap_free(struct pma_snap *snap);
+
+typedef void (*pma_snap_delta_cb_t) (const struct pma_snap_rec *cur,
+				     const uint64_t *delta, void *cb_data);
+/* Both snapshots must be sorted; cb is called for every port present in
+ * both of them. */
+void pma_snap_delta(const struct pma_snap *prev, const struct pma_snap *cur,
+		    pma_snap_delta_cb_t cb, void *cb_data);
+
+#endif /* _IBDIAG_PMA_H_ */
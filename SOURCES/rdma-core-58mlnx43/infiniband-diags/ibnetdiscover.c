@@ -38,6 +38,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
 #include <time.h>
 #include <string.h>
 #include <inttypes.h>
@@ -75,6 +76,11 @@ static unsigned diffcheck_flags = DIFF_FLAG_DEFAULT;
 static int report_max_hops = 0;
 static int full_info;
 
+static ibnd_src_port_t *src_ports;
+static int num_src_ports;
+static int all_src_ports;
+static int report_timing;
+
 /**
  * Define our own conversion functions to maintain compatibility with the old
  * ibnetdiscover which did not use the ibmad conversion functions.
@@ -986,6 +992,97 @@ static int diff(ibnd_fabric_t *orig_fabric, ibnd_fabric_t *new_fabric)
 	return 0;
 }
 
+static void add_src_port(const char *ca_name, int ca_port)
+{
+	ibnd_src_port_t *p;
+	int i;
+
+	for (i = 0; i < num_src_ports; i++)
+		if (src_ports[i].ca_port == ca_port &&
+		    !strcmp(src_ports[i].ca_name, ca_name))
+			return;
+
+	p = realloc(src_ports, (num_src_ports + 1) * sizeof(*src_ports));
+	if (!p)
+		IBEXIT("out of memory, realloc for source ports failed");
+	src_ports = p;
+	src_ports[num_src_ports].ca_name = strdup(ca_name);
+	if (!src_ports[num_src_ports].ca_name)
+		IBEXIT("out of memory, strdup for source port failed");
+	src_ports[num_src_ports].ca_port = ca_port;
+	num_src_ports++;
+}
+
+/* <ca>[:<port>][,<ca>[:<port>]...] */
+static int parse_src_ports(char *arg)
+{
+	char *p, *port;
+
+	for (p = strtok(arg, ","); p; p = strtok(NULL, ",")) {
+		port = strchr(p, ':');
+		if (port)
+			*port++ = '\0';
+		if (!*p)
+			return -1;
+		add_src_port(p, port ? strtol(port, NULL, 0) : 0);
+	}
+	return num_src_ports ? 0 : -1;
+}
+
+static void add_active_src_ports(void)
+{
+	struct umad_device_node *device_list, *node;
+	umad_ca_t ca;
+	int i;
+
+	if (umad_init() < 0)
+		IBEXIT("can't init UMAD library");
+
+	device_list = umad_get_ca_device_list();
+	if (!device_list && errno)
+		IBEXIT("can't list IB device names");
+
+	for (node = device_list; node; node = node->next) {
+		if (umad_get_ca(node->ca_name, &ca) < 0)
+			continue;
+		for (i = 0; i < UMAD_CA_MAX_PORTS; i++) {
+			umad_port_t *port = ca.ports[i];
+
+			/* 4 == Active */
+			if (!port || port->state != 4 ||
+			    strcmp(port->link_layer, "InfiniBand"))
+				continue;
+			add_src_port(ca.ca_name, port->portnum);
+		}
+		umad_release_ca(&ca);
+	}
+	umad_free_ca_device_list(device_list);
+
+	if (!num_src_ports)
+		IBEXIT("no active InfiniBand ports found");
+}
+
+static void count_node(ibnd_node_t *node, void *user_data)
+{
+	(*(unsigned *)user_data)++;
+}
+
+static void dump_timing(ibnd_fabric_t *fabric, struct timespec *start,
+			struct timespec *end)
+{
+	unsigned nodes = 0;
+	double ms;
+
+	ms = (end->tv_sec - start->tv_sec) * 1e3 +
+	     (end->tv_nsec - start->tv_nsec) / 1e6;
+	ibnd_iter_nodes(fabric, count_node, &nodes);
+
+	fprintf(stderr, "# Discovery: %s, %d source port(s), %u nodes, "
+		"%u MADs, %.3f ms\n", num_src_ports ? "parallel" : "single",
+		num_src_ports ? num_src_ports : 1, nodes,
+		fabric->total_mads_used, ms);
+}
+
 static int list, group, ports_report;
 
 static int process_opt(void *context, int ch)
@@ -1032,6 +1129,18 @@ static int process_opt(void *context, int ch)
 			p = strtok(NULL, ",");
 		}
 		break;
+	case 6:
+		all_src_ports = 1;
+		break;
+	case 7:
+		if (parse_src_ports(optarg)) {
+			fprintf(stderr, "invalid source port list\n");
+			return -1;
+		}
+		break;
+	case 8:
+		report_timing = 1;
+		break;
 	case 's':
 		cfg->show_progress = 1;
 		break;
@@ -1074,6 +1183,8 @@ int main(int argc, char **argv)
 	struct ibnd_config config = { 0 };
 	ibnd_fabric_t *fabric = NULL;
 	ibnd_fabric_t *diff_fabric = NULL;
+	struct timespec start, end;
+	int i;
 
 	const struct ibdiag_opt opts[] = {
 		{"full", 'f', 0, NULL, "show full information (ports' speed and width, vlcap)"},
@@ -1098,6 +1209,12 @@ int main(int argc, char **argv)
 		{"outstanding_smps", 'o', 1, NULL,
 		 "specify the number of outstanding SMP's which should be "
 		 "issued during the scan"},
+		{"all-ports", 6, 0, NULL,
+		 "discover from all active local ports in parallel"},
+		{"src-ports", 7, 1, "<ca[:port],...>",
+		 "discover from the listed local ports in parallel"},
+		{"timing", 8, 0, NULL,
+		 "report discovery time and MADs used on stderr"},
 		{}
 	};
 	char usage_args[] = "[topology-file]";
@@ -1130,9 +1247,23 @@ int main(int argc, char **argv)
 		if ((fabric = ibnd_load_fabric(load_cache_file, 0)) == NULL)
 			IBEXIT("loading cached fabric failed\n");
 	} else {
-		if ((fabric =
-		     ibnd_discover_fabric(ibd_ca, ibd_ca_port, NULL, &config)) == NULL)
+		if (all_src_ports && !num_src_ports)
+			add_active_src_ports();
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		if (num_src_ports)
+			fabric = ibnd_discover_fabric_multi(src_ports,
+							    num_src_ports,
+							    &config);
+		else
+			fabric = ibnd_discover_fabric(ibd_ca, ibd_ca_port,
+						      NULL, &config);
+		if (!fabric)
 			IBEXIT("discover failed\n");
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		if (report_timing)
+			dump_timing(fabric, &start, &end);
 	}
 
 	if (ports_report)
@@ -1152,5 +1283,8 @@ int main(int argc, char **argv)
 	if (diff_fabric)
 		ibnd_destroy_fabric(diff_fabric);
 	close_node_name_map(node_name_map);
+	for (i = 0; i < num_src_ports; i++)
+		free(src_ports[i].ca_name);
+	free(src_ports);
 	exit(0);
 }
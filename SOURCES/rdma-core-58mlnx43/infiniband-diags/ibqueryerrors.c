@@ -53,6 +53,7 @@
 
 #include "ibdiag_common.h"
 #include "ibdiag_sa.h"
+#include "ibdiag_pma.h"
 
 static struct ibmad_port *ibmad_port;
 static char *node_name_map_file = NULL;
@@ -79,6 +80,7 @@ static unsigned clear_errors, clear_counts, details;
 #define PRINT_ALL 0xFF		/* all nodes default flag */
 
 #define DEFAULT_HALF_WORLD_PR_TIMEOUT (3000)
+#define DEFAULT_PMA_WINDOW (64)
 
 static struct {
 	int nodes_checked;
@@ -423,6 +425,21 @@ static int check_threshold(uint8_t *pc, uint8_t *pce, uint32_t cap_mask2,
 	return is_exceeds;
 }
 
+static void print_errors_header(ibnd_node_t *node, char *node_name,
+				int *header_printed)
+{
+	if (*header_printed)
+		return;
+
+	if (node->type == IB_NODE_SWITCH)
+		printf("Errors for 0x%" PRIx64 " \"%s\"\n",
+		       node->ports[0]->guid, node_name);
+	else
+		printf("Errors for \"%s\"\n", node_name);
+	*header_printed = 1;
+	summary.bad_nodes++;
+}
+
 static int print_results(ib_portid_t * portid, char *node_name,
 			 ibnd_node_t * node, uint8_t * pc, int portnum,
 			 int *header_printed, uint8_t *pce, __be16 cap_mask,
@@ -509,15 +526,7 @@ static int print_results(ib_portid_t * portid, char *node_name,
 			}
 		}
 
-		if (!*header_printed) {
-			if (node->type == IB_NODE_SWITCH)
-				printf("Errors for 0x%" PRIx64 " \"%s\"\n",
-					node->ports[0]->guid, node_name);
-			else
-				printf("Errors for \"%s\"\n", node_name);
-			*header_printed = 1;
-			summary.bad_nodes++;
-		}
+		print_errors_header(node, node_name, header_printed);
 
 		if (portnum == 0xFF) {
 			if (node->type == IB_NODE_SWITCH)
@@ -561,42 +570,20 @@ static int query_cap_mask(ib_portid_t * portid, char *node_name, int portnum,
 	return 0;
 }
 
-static int print_data_cnts(ib_portid_t * portid, __be16 cap_mask,
-			   char *node_name, ibnd_node_t * node, int portnum,
-			   int *header_printed)
+static void report_data_cnts(uint8_t *pc, __be16 cap_mask, char *node_name,
+			     ibnd_node_t * node, int portnum,
+			     int *header_printed)
 {
-	uint8_t pc[1024];
 	int i;
 	int start_field = IB_PC_XMT_BYTES_F;
 	int end_field = IB_PC_RCV_PKTS_F;
 
-	memset(pc, 0, 1024);
-
-	portid->sl = lid2sl_table[portid->lid];
-
 	if (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP)) {
-		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-				   IB_GSI_PORT_COUNTERS_EXT, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			summary.pma_query_failures++;
-			return (1);
-		}
 		start_field = IB_PC_EXT_XMT_BYTES_F;
 		if (cap_mask & IB_PM_EXT_WIDTH_SUPPORTED)
 			end_field = IB_PC_EXT_RCV_MPKTS_F;
 		else
 			end_field = IB_PC_EXT_RCV_PKTS_F;
-	} else {
-		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
-				   IB_GSI_PORT_COUNTERS, ibmad_port)) {
-			IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
-			       node_name, portid2str(portid), portnum);
-			summary.pma_query_failures++;
-			return (1);
-		}
-		start_field = IB_PC_XMT_BYTES_F;
-		end_field = IB_PC_RCV_PKTS_F;
 	}
 
 	if (!*header_printed) {
@@ -628,10 +615,55 @@ static int print_data_cnts(ib_portid_t * portid, __be16 cap_mask,
 
 	if (portnum != 0xFF && port_config)
 		print_port_config(node, portnum);
+}
 
+static int print_data_cnts(ib_portid_t * portid, __be16 cap_mask,
+			   char *node_name, ibnd_node_t * node, int portnum,
+			   int *header_printed)
+{
+	uint8_t pc[1024];
+
+	memset(pc, 0, 1024);
+
+	portid->sl = lid2sl_table[portid->lid];
+
+	if (cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED | IB_PM_EXT_WIDTH_NOIETF_SUP)) {
+		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
+				   IB_GSI_PORT_COUNTERS_EXT, ibmad_port)) {
+			IBWARN("IB_GSI_PORT_COUNTERS_EXT query failed on %s, %s port %d",
+			       node_name, portid2str(portid), portnum);
+			summary.pma_query_failures++;
+			return (1);
+		}
+	} else {
+		if (!pma_query_via(pc, portid, portnum, ibd_timeout,
+				   IB_GSI_PORT_COUNTERS, ibmad_port)) {
+			IBWARN("IB_GSI_PORT_COUNTERS query failed on %s, %s port %d",
+			       node_name, portid2str(portid), portnum);
+			summary.pma_query_failures++;
+			return (1);
+		}
+	}
+
+	report_data_cnts(pc, cap_mask, node_name, node, portnum,
+			 header_printed);
 	return (0);
 }
 
+static int report_errors(ib_portid_t * portid, __be16 cap_mask,
+			 uint32_t cap_mask2, char *node_name,
+			 ibnd_node_t * node, int portnum, int *header_printed,
+			 uint8_t *pc, uint8_t *pc_ext)
+{
+	if (!(cap_mask & IB_PM_PC_XMIT_WAIT_SUP)) {
+		/* if PortCounters:PortXmitWait not supported clear this counter */
+		uint32_t foo = 0;
+		mad_encode_field(pc, IB_PC_XMT_WAIT_F, &foo);
+	}
+	return (print_results(portid, node_name, node, pc, portnum,
+			      header_printed, pc_ext, cap_mask, cap_mask2));
+}
+
 static int print_errors(ib_portid_t * portid, __be16 cap_mask, uint32_t cap_mask2,
 			char *node_name, ibnd_node_t * node, int portnum,
 			int *header_printed)
@@ -664,13 +696,8 @@ static int print_errors(ib_portid_t * portid, __be16 cap_mask, uint32_t cap_mask
 		pc_ext = pce;
 	}
 
-	if (!(cap_mask & IB_PM_PC_XMIT_WAIT_SUP)) {
-		/* if PortCounters:PortXmitWait not supported clear this counter */
-		uint32_t foo = 0;
-		mad_encode_field(pc, IB_PC_XMT_WAIT_F, &foo);
-	}
-	return (print_results(portid, node_name, node, pc, portnum,
-			      header_printed, pc_ext, cap_mask, cap_mask2));
+	return (report_errors(portid, cap_mask, cap_mask2, node_name, node,
+			      portnum, header_printed, pc, pc_ext));
 }
 
 static uint8_t *reset_pc_ext(void *rcvbuf, ib_portid_t *dest, int port,
@@ -869,6 +896,491 @@ clear:
 	free(node_name);
 }
 
+/* Parallel collection
+ * Instead of walking the fabric one PMA round-trip at a time, queue the
+ * ClassPortInfo, PortCounters and PortCountersExtended queries of every port
+ * on a pma_engine and keep up to pma_window of them on the wire.  Reports are
+ * printed in node order once all responses have been gathered.  Like
+ * print_node, a node supporting AllPortSelect is checked as a whole first and
+ * its ports are only queried if that shows errors, unless counters of every
+ * port are needed for a snapshot.
+ */
+struct pma_node_res;
+
+struct pma_port_res {
+	struct pma_node_res *nr;
+	int portnum;
+	int pending;
+	int failed;
+	uint8_t pc[IB_PC_DATA_SZ];
+	uint8_t pce[IB_PC_DATA_SZ];
+};
+
+struct pma_node_res {
+	ibnd_node_t *node;
+	ib_portid_t portid;
+	int cpi_port;
+	int startport;
+	__be16 cap_mask;
+	uint32_t cap_mask2;
+	int failed;
+	int all_port_sup;
+	int ports_clean;
+	struct pma_port_res all;
+	struct pma_port_res *ports;
+};
+
+static unsigned pma_window;
+static char *snapshot_file;
+static char *delta_file;
+static struct pma_node_res *pma_nodes;
+static unsigned num_pma_nodes;
+static unsigned max_pma_nodes;
+
+static int pma_ext_width(__be16 cap_mask)
+{
+	return !!(cap_mask & (IB_PM_EXT_WIDTH_SUPPORTED |
+			      IB_PM_EXT_WIDTH_NOIETF_SUP));
+}
+
+/* The error check of print_results, without printing or querying details */
+static int pma_has_errors(uint8_t *pc, uint8_t *pce, __be16 cap_mask,
+			  uint32_t cap_mask2)
+{
+	char buf[2048];
+	uint32_t zero = 0;
+	int i, ext_i, n = 0;
+
+	if (!(cap_mask & IB_PM_PC_XMIT_WAIT_SUP))
+		mad_encode_field(pc, IB_PC_XMT_WAIT_F, &zero);
+
+	for (i = IB_PC_ERR_SYM_F, ext_i = IB_PC_EXT_ERR_SYM_F;
+	     i <= IB_PC_VL15_DROPPED_F; i++, ext_i++) {
+		if (suppress(i))
+			continue;
+		if (i == IB_PC_COUNTER_SELECT2_F) {
+			ext_i--;
+			continue;
+		}
+		check_threshold(pc, pce, cap_mask2, i, ext_i, &n, buf,
+				sizeof(buf));
+	}
+
+	if (!suppress(IB_PC_XMT_WAIT_F))
+		check_threshold(pc, pce, cap_mask2, IB_PC_XMT_WAIT_F,
+				IB_PC_EXT_XMT_WAIT_F, &n, buf, sizeof(buf));
+
+	return n != 0;
+}
+
+static void pma_issue_port(struct pma_engine *engine, struct pma_node_res *nr,
+			   int p);
+
+static void pma_all_ports_done(struct pma_engine *engine,
+			       struct pma_node_res *nr)
+{
+	int p;
+
+	/* a failed AllPortSelect query falls back to the ports */
+	if (!nr->all.failed &&
+	    !pma_has_errors(nr->all.pc,
+			    pma_ext_width(nr->cap_mask) ? nr->all.pce : NULL,
+			    nr->cap_mask, nr->cap_mask2)) {
+		nr->ports_clean = 1;
+		return;
+	}
+
+	for (p = nr->startport; p <= nr->node->numports; p++)
+		if (nr->node->ports[p])
+			pma_issue_port(engine, nr, p);
+}
+
+static void pma_port_ctrs_cb(struct pma_engine *engine,
+			     struct pma_query *query, uint8_t *data,
+			     void *cb_data)
+{
+	struct pma_port_res *pr = cb_data;
+
+	pr->pending--;
+	if (!data) {
+		IBWARN("%s query failed on 0x%" PRIx64 ", %s port %d",
+		       query->rpc.attr.id == IB_GSI_PORT_COUNTERS_EXT ?
+		       "IB_GSI_PORT_COUNTERS_EXT" : "IB_GSI_PORT_COUNTERS",
+		       pr->nr->node->guid, portid2str(&query->portid),
+		       pr->portnum);
+		if (!pr->failed)
+			summary.pma_query_failures++;
+		pr->failed = 1;
+	} else if (query->rpc.attr.id == IB_GSI_PORT_COUNTERS_EXT)
+		memcpy(pr->pce, data, IB_PC_DATA_SZ);
+	else
+		memcpy(pr->pc, data, IB_PC_DATA_SZ);
+
+	if (pr == &pr->nr->all && !pr->pending)
+		pma_all_ports_done(engine, pr->nr);
+}
+
+static int pma_issue_ctrs(struct pma_engine *engine, ib_portid_t *portid,
+			  struct pma_port_res *pr, unsigned attr_id)
+{
+	/* a query failing to send completes before pma_issue_query returns */
+	pr->pending++;
+	if (!pma_issue_query(engine, portid, pr->portnum, attr_id,
+			     pma_port_ctrs_cb, pr))
+		return 0;
+
+	pr->pending--;
+	if (!pr->failed)
+		summary.pma_query_failures++;
+	pr->failed = 1;
+	return -1;
+}
+
+static void pma_issue_port(struct pma_engine *engine, struct pma_node_res *nr,
+			   int p)
+{
+	struct pma_port_res *pr = &nr->ports[p];
+	ib_portid_t portid = nr->portid;
+
+	if (nr->node->type != IB_NODE_SWITCH)
+		ib_portid_set(&portid, nr->node->ports[p]->base_lid, 0, 0);
+	portid.sl = lid2sl_table[portid.lid];
+
+	pr->nr = nr;
+	pr->portnum = p;
+
+	if (!pma_issue_ctrs(engine, &portid, pr, IB_GSI_PORT_COUNTERS) &&
+	    pma_ext_width(nr->cap_mask))
+		pma_issue_ctrs(engine, &portid, pr, IB_GSI_PORT_COUNTERS_EXT);
+}
+
+static void pma_issue_all_ports(struct pma_engine *engine,
+				struct pma_node_res *nr)
+{
+	struct pma_port_res *pr = &nr->all;
+	ib_portid_t portid = nr->portid;
+
+	portid.sl = lid2sl_table[portid.lid];
+	pr->nr = nr;
+	pr->portnum = 0xFF;
+
+	/* complete only once both queries have been issued */
+	pr->pending++;
+	if (!pma_issue_ctrs(engine, &portid, pr, IB_GSI_PORT_COUNTERS) &&
+	    pma_ext_width(nr->cap_mask))
+		pma_issue_ctrs(engine, &portid, pr, IB_GSI_PORT_COUNTERS_EXT);
+	if (!--pr->pending)
+		pma_all_ports_done(engine, nr);
+}
+
+static void pma_class_port_info_cb(struct pma_engine *engine,
+				   struct pma_query *query, uint8_t *data,
+				   void *cb_data)
+{
+	struct pma_node_res *nr = cb_data;
+	__be32 cap_mask2;
+	int p;
+
+	if (!data) {
+		IBWARN("classportinfo query failed on 0x%" PRIx64 ", %s port %d",
+		       nr->node->guid, portid2str(&nr->portid), nr->cpi_port);
+		summary.pma_query_failures++;
+		nr->failed = 1;
+		return;
+	}
+
+	memcpy(&nr->cap_mask, data + 2, sizeof(nr->cap_mask));
+	memcpy(&cap_mask2, data + 4, sizeof(cap_mask2));
+	nr->cap_mask2 = ntohl(cap_mask2) >> 5;
+	nr->all_port_sup = !!(nr->cap_mask & IB_PM_ALL_PORT_SELECT);
+
+	if (nr->all_port_sup && !data_counters_only && !snapshot_file &&
+	    !delta_file) {
+		pma_issue_all_ports(engine, nr);
+		return;
+	}
+
+	for (p = nr->startport; p <= nr->node->numports; p++)
+		if (nr->node->ports[p])
+			pma_issue_port(engine, nr, p);
+}
+
+static void add_pma_node(ibnd_node_t *node, void *user_data)
+{
+	struct pma_node_res *nr;
+	int type = 0;
+	int p;
+
+	switch (node->type) {
+	case IB_NODE_SWITCH:
+		type = PRINT_SWITCH;
+		break;
+	case IB_NODE_CA:
+		type = PRINT_CA;
+		break;
+	case IB_NODE_ROUTER:
+		type = PRINT_ROUTER;
+		break;
+	}
+
+	if ((type & node_type_to_print) == 0)
+		return;
+
+	if (num_pma_nodes == max_pma_nodes) {
+		max_pma_nodes = max_pma_nodes ? max_pma_nodes * 2 : 256;
+		pma_nodes = realloc(pma_nodes,
+				    max_pma_nodes * sizeof(*pma_nodes));
+		if (!pma_nodes)
+			IBEXIT("out of memory");
+	}
+
+	nr = &pma_nodes[num_pma_nodes++];
+	memset(nr, 0, sizeof(*nr));
+	nr->node = node;
+	nr->startport = 1;
+	if (node->type == IB_NODE_SWITCH && node->smaenhsp0)
+		nr->startport = 0;
+
+	nr->ports = calloc(node->numports + 1, sizeof(*nr->ports));
+	if (!nr->ports)
+		IBEXIT("out of memory");
+
+	if (node->type == IB_NODE_SWITCH) {
+		ib_portid_set(&nr->portid, node->smalid, 0, 0);
+	} else {
+		for (p = 1; p <= node->numports; p++) {
+			if (node->ports[p]) {
+				ib_portid_set(&nr->portid,
+					      node->ports[p]->base_lid, 0, 0);
+				nr->cpi_port = p;
+				break;
+			}
+		}
+	}
+}
+
+struct delta_report {
+	ibnd_fabric_t *fabric;
+	uint64_t guid;
+	int header_printed;
+};
+
+static void print_delta(const struct pma_snap_rec *rec, const uint64_t *delta,
+			void *cb_data)
+{
+	struct delta_report *dr = cb_data;
+	ibnd_node_t *node;
+	char buf[2048];
+	char *node_name;
+	int i, n = 0;
+
+	for (i = 0; i <= PMA_SNAP_LAST_ERR; i++) {
+		if (!delta[i] || suppress(pma_snap_field(i, 0)))
+			continue;
+		n += snprintf(buf + n, sizeof(buf) - n, " [%s == +%" PRIu64 "]",
+			      mad_field_name(pma_snap_field(i,
+					rec->flags & PMA_SNAP_F_EXT_ERR)),
+			      delta[i]);
+	}
+
+	if (!n)
+		return;
+
+	if (data_counters) {
+		for (; i < PMA_SNAP_NUM_CTRS; i++) {
+			float val = 0;
+			const char *unit;
+
+			unit = conv_cnt_human_readable(delta[i], &val,
+					i == PMA_SNAP_XMT_BYTES ||
+					i == PMA_SNAP_RCV_BYTES);
+			n += snprintf(buf + n, sizeof(buf) - n,
+				      " [%s == +%" PRIu64 " (%5.3f%s)]",
+				      mad_field_name(pma_snap_field(i,
+					rec->flags & PMA_SNAP_F_EXT)),
+				      delta[i], val, unit);
+		}
+	}
+
+	/* records of the current snapshot always come from this fabric */
+	node = ibnd_find_node_guid(dr->fabric, rec->guid);
+	if (!node || !node->ports[rec->port])
+		return;
+
+	/* records are sorted, the ports of a node follow each other */
+	if (dr->guid != rec->guid) {
+		dr->guid = rec->guid;
+		dr->header_printed = 0;
+	}
+
+	node_name = remap_node_name(node_name_map, rec->guid, node->nodedesc);
+	print_errors_header(node, node_name, &dr->header_printed);
+	printf("   GUID 0x%" PRIx64 " port %d:%s\n",
+	       node->ports[rec->port]->guid, rec->port, buf);
+	if (port_config)
+		print_port_config(node, rec->port);
+	summary.bad_ports++;
+	free(node_name);
+}
+
+static void report_deltas(ibnd_fabric_t *fabric, struct pma_snap *cur)
+{
+	struct delta_report dr = { .fabric = fabric };
+	struct pma_snap prev;
+	int rc;
+
+	rc = pma_snap_read(&prev, delta_file);
+	if (rc) {
+		fprintf(stderr, "Failed to read snapshot %s: %s\n", delta_file,
+			strerror(-rc));
+		return;
+	}
+
+	printf("## Counter deltas over %" PRIu64 " seconds\n",
+	       cur->timestamp - prev.timestamp);
+	pma_snap_delta(&prev, cur, print_delta, &dr);
+	pma_snap_free(&prev);
+}
+
+static void collect_parallel(ibnd_fabric_t *fabric)
+{
+	struct pma_engine engine;
+	struct pma_snap snap = { 0 };
+	struct pma_snap_rec *rec;
+	unsigned unanswered = 0;
+	unsigned i;
+	int p;
+
+	if (pma_engine_init(&engine, ibd_ca, ibd_ca_port, pma_window,
+			    ibd_timeout))
+		IBEXIT("Failed to open PMA engine on %s:%d", ibd_ca,
+		       ibd_ca_port);
+
+	ibnd_iter_nodes(fabric, add_pma_node, NULL);
+
+	for (i = 0; i < num_pma_nodes; i++) {
+		struct pma_node_res *nr = &pma_nodes[i];
+
+		nr->portid.sl = lid2sl_table[nr->portid.lid];
+		/* PerfMgt ClassPortInfo is a required attribute */
+		if (pma_issue_query(&engine, &nr->portid, nr->cpi_port,
+				    CLASS_PORT_INFO, pma_class_port_info_cb,
+				    nr))
+			pma_class_port_info_cb(&engine, NULL, NULL, nr);
+	}
+
+	if (pma_process_mads(&engine))
+		IBWARN("PMA collection aborted; results are partial");
+
+	snap.timestamp = time(NULL);
+
+	for (i = 0; i < num_pma_nodes; i++) {
+		struct pma_node_res *nr = &pma_nodes[i];
+		ibnd_node_t *node = nr->node;
+		int header_printed = 0;
+		char *node_name;
+
+		node_name = remap_node_name(node_name_map, node->guid,
+					    node->nodedesc);
+
+		/* ClassPortInfo failed, the node was not queried further */
+		if (nr->failed)
+			goto next;
+
+		if (nr->all.nr && !nr->all.failed && !nr->all.pending) {
+			ib_portid_t portid = nr->portid;
+
+			portid.sl = lid2sl_table[portid.lid];
+			report_errors(&portid, nr->cap_mask, nr->cap_mask2,
+				      node_name, node, 0xFF, &header_printed,
+				      nr->all.pc,
+				      pma_ext_width(nr->cap_mask) ?
+				      nr->all.pce : NULL);
+			if (nr->ports_clean) {
+				summary.ports_checked += node->numports;
+				goto clear;
+			}
+		}
+
+		for (p = nr->startport; p <= node->numports; p++) {
+			struct pma_port_res *pr = &nr->ports[p];
+			ib_portid_t portid = nr->portid;
+
+			if (!node->ports[p])
+				continue;
+			/* left without a response when the collection aborted */
+			if (!pr->failed && (!pr->nr || pr->pending)) {
+				summary.pma_query_failures++;
+				pr->failed = 1;
+				unanswered++;
+			}
+			if (pr->failed)
+				continue;
+
+			if (node->type != IB_NODE_SWITCH)
+				ib_portid_set(&portid, node->ports[p]->base_lid,
+					      0, 0);
+			portid.sl = lid2sl_table[portid.lid];
+
+			if (snapshot_file || delta_file) {
+				rec = pma_snap_add(&snap, node->guid, p);
+				if (!rec)
+					IBEXIT("out of memory");
+				pma_snap_fill(rec, pr->pc,
+					      pma_ext_width(nr->cap_mask) ?
+					      pr->pce : NULL,
+					      !!(htonl(nr->cap_mask2) &
+						 IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP));
+			}
+
+			if (data_counters_only)
+				report_data_cnts(pma_ext_width(nr->cap_mask) ?
+						 pr->pce : pr->pc,
+						 nr->cap_mask, node_name, node,
+						 p, &header_printed);
+			else if (!delta_file)
+				report_errors(&portid, nr->cap_mask,
+					      nr->cap_mask2, node_name, node, p,
+					      &header_printed, pr->pc,
+					      pma_ext_width(nr->cap_mask) ?
+					      pr->pce : NULL);
+			summary.ports_checked++;
+			if (!nr->all_port_sup)
+				clear_port(&portid, nr->cap_mask,
+					   nr->cap_mask2, node_name, p);
+		}
+
+clear:
+		if (nr->all_port_sup) {
+			ib_portid_t portid = nr->portid;
+
+			portid.sl = lid2sl_table[portid.lid];
+			clear_port(&portid, nr->cap_mask, nr->cap_mask2,
+				   node_name, 0xFF);
+		}
+next:
+		summary.nodes_checked++;
+		free(node_name);
+		free(nr->ports);
+	}
+
+	if (unanswered)
+		IBWARN("%u ports were not answered, they are left out", unanswered);
+
+	pma_engine_destroy(&engine);
+	free(pma_nodes);
+	pma_nodes = NULL;
+	num_pma_nodes = max_pma_nodes = 0;
+
+	pma_snap_sort(&snap);
+	if (delta_file)
+		report_deltas(fabric, &snap);
+	if (snapshot_file && pma_snap_write(&snap, snapshot_file))
+		fprintf(stderr, "Failed to write snapshot %s\n",
+			snapshot_file);
+	pma_snap_free(&snap);
+}
+
 static void add_suppressed(enum MAD_FIELDS field)
 {
 	if (sup_total >= SUP_MAX) {
@@ -939,6 +1451,17 @@ static int process_opt(void *context, int ch)
 	case 10:
 		obtain_sl = 0;
 		break;
+	case 11:
+		pma_window = strtoul(optarg, NULL, 0);
+		if (!pma_window)
+			IBEXIT("parallel window must be greater than 0");
+		break;
+	case 12:
+		snapshot_file = strdup(optarg);
+		break;
+	case 13:
+		delta_file = strdup(optarg);
+		break;
 	case 'G':
 	case 'S':
 		port_guid_str = optarg;
@@ -1017,6 +1540,15 @@ int main(int argc, char **argv)
 		{"outstanding_smps", 'o', 1, NULL,
 		 "specify the number of outstanding SMP's which should be "
 		 "issued during the scan"},
+		{"parallel", 11, 1, "<window>",
+		 "query all ports in parallel with up to <window> PMA "
+		 "queries outstanding"},
+		{"snapshot", 12, 1, "<file>",
+		 "save the collected counters to a binary snapshot file "
+		 "(implies --parallel)"},
+		{"delta", 13, 1, "<file>",
+		 "report counter increases since the snapshot in <file> "
+		 "(implies --parallel)"},
 		{}
 	};
 	char usage_args[] = "";
@@ -1031,6 +1563,9 @@ int main(int argc, char **argv)
 	if (!node_type_to_print)
 		node_type_to_print = PRINT_ALL;
 
+	if ((snapshot_file || delta_file) && !pma_window)
+		pma_window = DEFAULT_PMA_WINDOW;
+
 	ibmad_port = mad_rpc_open_port(ibd_ca, ibd_ca_port, mgmt_classes, 4);
 	if (!ibmad_port)
 		IBEXIT("Failed to open port; %s:%d\n", ibd_ca, ibd_ca_port);
@@ -1153,7 +1688,10 @@ int main(int argc, char **argv)
 			if(path_record_query(self_gid,0))
 				goto close_port;
 
-		ibnd_iter_nodes(fabric, print_node, NULL);
+		if (pma_window)
+			collect_parallel(fabric);
+		else
+			ibnd_iter_nodes(fabric, print_node, NULL);
 	}
 
 	rc = print_summary();
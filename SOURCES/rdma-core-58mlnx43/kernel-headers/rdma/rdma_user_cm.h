@@ -67,7 +67,8 @@ enum {
 	RDMA_USER_CM_CMD_QUERY,
 	RDMA_USER_CM_CMD_BIND,
 	RDMA_USER_CM_CMD_RESOLVE_ADDR,
-	RDMA_USER_CM_CMD_JOIN_MCAST
+	RDMA_USER_CM_CMD_JOIN_MCAST,
+	RDMA_USER_CM_CMD_GET_EVENTS
 };
 
 /* See IBTA Annex A11, servies ID bytes 4 & 5 */
@@ -338,4 +339,39 @@ struct rdma_ucm_migrate_resp {
 	__u32 events_reported;
 };
 
+struct rdma_ucm_get_events {
+	__aligned_u64 response;		/* rdma_ucm_get_events_resp */
+	__u32 max_events;
+	__u32 reserved;
+};
+
+enum {
+	RDMA_UCM_EVENT_F_REQ_INFO = 1 << 0,
+};
+
+/*
+ * What RDMA_USER_CM_QUERY_ADDR, RDMA_USER_CM_QUERY_GID and
+ * RDMA_USER_CM_QUERY_PATH report for the id of a connect request.
+ */
+struct rdma_ucm_req_info {
+	struct rdma_ucm_query_addr_resp addr;
+	struct rdma_ucm_query_addr_resp gid;
+	__u32 num_paths;
+	__u32 reserved;
+	struct ib_path_rec_data path_data[2];
+};
+
+struct rdma_ucm_event_ex {
+	struct rdma_ucm_event_resp event;
+	__u32 flags;
+	__u32 reserved;
+	struct rdma_ucm_req_info req_info;	/* RDMA_UCM_EVENT_F_REQ_INFO */
+};
+
+struct rdma_ucm_get_events_resp {
+	__u32 num_events;
+	__u32 reserved;
+	struct rdma_ucm_event_ex events[];
+};
+
 #endif /* RDMA_USER_CM_H */
@@ -40,6 +40,8 @@
 #define RDMA_IOCTL_MAGIC	0x1b
 #define RDMA_VERBS_IOCTL \
 	_IOWR(RDMA_IOCTL_MAGIC, 1, struct ib_uverbs_ioctl_hdr)
+#define RDMA_VERBS_IOCTL_BATCH \
+	_IOWR(RDMA_IOCTL_MAGIC, 2, struct ib_uverbs_ioctl_batch)
 
 enum {
 	/* User input */
@@ -84,4 +86,15 @@ struct ib_uverbs_ioctl_hdr {
 	struct ib_uverbs_attr  attrs[];
 };
 
+/*
+ * RDMA_VERBS_IOCTL_BATCH executes a packed array of ib_uverbs_ioctl_hdr,
+ * each followed by its attributes, in order.  Execution stops at the first
+ * command that fails and num_done returns the number that succeeded.
+ */
+struct ib_uverbs_ioctl_batch {
+	__aligned_u64 cmds;
+	__u32 length;
+	__u32 num_done;
+};
+
 #endif
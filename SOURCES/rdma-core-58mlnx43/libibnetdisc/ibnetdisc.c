@@ -228,7 +228,7 @@ static int is_mlnx_ext_port_info_supported(ibnd_port_t * port)
 int mlnx_ext_port_info_err(smp_engine_t * engine, ibnd_smp_t * smp,
 			   uint8_t * mad, void *cb_data)
 {
-	f_internal_t *f_int = ((ibnd_scan_t *) engine->user_data)->f_int;
+	ibnd_scan_t *scan = engine->user_data;
 	ibnd_node_t *node = cb_data;
 	ibnd_port_t *port;
 	uint8_t port_num, local_port;
@@ -247,12 +247,12 @@ int mlnx_ext_port_info_err(smp_engine_t * engine, ibnd_smp_t * smp,
 	if (port_num && mad_get_field(port->info, 0, IB_PORT_PHYS_STATE_F)
 	    == IB_PORT_PHYS_STATE_LINKUP
 	    && ((node->type == IB_NODE_SWITCH && port_num != local_port) ||
-		(node == f_int->fabric.from_node && port_num == f_int->fabric.from_portnum))) {
+		(node == scan->from_node && port_num == scan->from_portnum))) {
 		int rc = 0;
 		ib_portid_t path = smp->path;
 
 		if (node->type != IB_NODE_SWITCH &&
-		    node == f_int->fabric.from_node &&
+		    node == scan->from_node &&
 		    path.drpath.cnt > 1)
 			rc = retract_dpath(engine, &path);
 		else {
@@ -275,7 +275,7 @@ int mlnx_ext_port_info_err(smp_engine_t * engine, ibnd_smp_t * smp,
 static int recv_mlnx_ext_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 				   uint8_t * mad, void *cb_data)
 {
-	f_internal_t *f_int = ((ibnd_scan_t *) engine->user_data)->f_int;
+	ibnd_scan_t *scan = engine->user_data;
 	ibnd_node_t *node = cb_data;
 	ibnd_port_t *port;
 	uint8_t *ext_port_info = mad + IB_SMP_DATA_OFFS;
@@ -296,12 +296,12 @@ static int recv_mlnx_ext_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 	if (port_num && mad_get_field(port->info, 0, IB_PORT_PHYS_STATE_F)
 	    == IB_PORT_PHYS_STATE_LINKUP
 	    && ((node->type == IB_NODE_SWITCH && port_num != local_port) ||
-		(node == f_int->fabric.from_node && port_num == f_int->fabric.from_portnum))) {
+		(node == scan->from_node && port_num == scan->from_portnum))) {
 		int rc = 0;
 		ib_portid_t path = smp->path;
 
 		if (node->type != IB_NODE_SWITCH &&
-		    node == f_int->fabric.from_node &&
+		    node == scan->from_node &&
 		    path.drpath.cnt > 1)
 			rc = retract_dpath(engine, &path);
 		else {
@@ -410,13 +410,13 @@ static int recv_port_info(smp_engine_t * engine, ibnd_smp_t * smp,
 	if (port_num && mad_get_field(port->info, 0, IB_PORT_PHYS_STATE_F)
 	    == IB_PORT_PHYS_STATE_LINKUP
 	    && ((node->type == IB_NODE_SWITCH && port_num != local_port) ||
-		(node == f_int->fabric.from_node && port_num == f_int->fabric.from_portnum))) {
+		(node == scan->from_node && port_num == scan->from_portnum))) {
 
 		int rc = 0;
 		ib_portid_t path = smp->path;
 
 		if (node->type != IB_NODE_SWITCH &&
-		    node == f_int->fabric.from_node &&
+		    node == scan->from_node &&
 		    path.drpath.cnt > 1)
 			rc = retract_dpath(engine, &path);
 		else {
@@ -575,8 +575,12 @@ static int recv_node_info(smp_engine_t * engine, ibnd_smp_t * smp,
 			     node, port);
 
 	if (rem_node == NULL) {	/* this is the start node */
-		f_int->fabric.from_node = node;
-		f_int->fabric.from_portnum = port_num;
+		scan->from_node = node;
+		scan->from_portnum = port_num;
+		if (scan->primary) {
+			f_int->fabric.from_node = node;
+			f_int->fabric.from_portnum = port_num;
+		}
 	} else {
 		/* link ports... */
 		if (!rem_node->ports[rem_port_num]) {
@@ -764,6 +768,67 @@ f_internal_t *allocate_fabric_internal(void)
 	return (f);
 }
 
+static int scan_init(ibnd_scan_t *scan, f_internal_t *f_int,
+		     struct ibnd_config *config, char *ca_name, int ca_port,
+		     ib_portid_t *from)
+{
+	struct ibmad_port *ibmad_port;
+	int nc = 2;
+	int mc[2] = { IB_SMI_CLASS, IB_SMI_DIRECT_CLASS };
+
+	memset(scan, 0, sizeof(*scan));
+	scan->f_int = f_int;
+	scan->cfg = config;
+	scan->from = *from;
+	scan->initial_hops = from->drpath.cnt;
+
+	ibmad_port = mad_rpc_open_port(ca_name, ca_port, mc, nc);
+	if (!ibmad_port) {
+		IBND_ERROR("can't open MAD port (%s:%d)\n", ca_name, ca_port);
+		return -1;
+	}
+	mad_rpc_set_timeout(ibmad_port, config->timeout_ms);
+	mad_rpc_set_retries(ibmad_port, config->retries);
+	smp_mkey_set(ibmad_port, config->mkey);
+
+	if (ib_resolve_self_via(&scan->selfportid,
+				NULL, NULL, ibmad_port) < 0) {
+		IBND_ERROR("Failed to resolve self\n");
+		mad_rpc_close_port(ibmad_port);
+		return -1;
+	}
+	mad_rpc_close_port(ibmad_port);
+
+	return smp_engine_init(&scan->engine, ca_name, ca_port, scan, config);
+}
+
+static int scan_run(ibnd_scan_t *scan)
+{
+	smp_engine_t *engine = &scan->engine;
+	int rc;
+
+	/* the first query goes through the callbacks' lock like the rest */
+	if (engine->fabric_lock)
+		pthread_mutex_lock(engine->fabric_lock);
+	IBND_DEBUG("from %s\n", portid2str(&scan->from));
+	rc = query_node_info(engine, &scan->from, NULL);
+	if (engine->fabric_lock)
+		pthread_mutex_unlock(engine->fabric_lock);
+
+	if (rc)
+		return 0;
+
+	return process_mads(engine);
+}
+
+static void *scan_thread(void *arg)
+{
+	ibnd_scan_t *scan = arg;
+
+	scan->status = scan_run(scan);
+	return NULL;
+}
+
 ibnd_fabric_t *ibnd_discover_fabric(char * ca_name, int ca_port,
 				    ib_portid_t * from,
 				    struct ibnd_config *cfg)
@@ -771,11 +836,7 @@ ibnd_fabric_t *ibnd_discover_fabric(char * ca_name, int ca_port,
 	struct ibnd_config config = { 0 };
 	f_internal_t *f_int = NULL;
 	ib_portid_t my_portid = { 0 };
-	smp_engine_t engine;
 	ibnd_scan_t scan;
-	struct ibmad_port *ibmad_port;
-	int nc = 2;
-	int mc[2] = { IB_SMI_CLASS, IB_SMI_DIRECT_CLASS };
 
 	/* If not specified start from "my" port */
 	if (!from)
@@ -792,51 +853,113 @@ ibnd_fabric_t *ibnd_discover_fabric(char * ca_name, int ca_port,
 		return NULL;
 	}
 
-	memset(&scan.selfportid, 0, sizeof(scan.selfportid));
-	scan.f_int = f_int;
-	scan.cfg = &config;
-	scan.initial_hops = from->drpath.cnt;
+	if (scan_init(&scan, f_int, &config, ca_name, ca_port, from)) {
+		free(f_int);
+		return NULL;
+	}
+	scan.primary = 1;
 
-	ibmad_port = mad_rpc_open_port(ca_name, ca_port, mc, nc);
-	if (!ibmad_port) {
-		IBND_ERROR("can't open MAD port (%s:%d)\n", ca_name, ca_port);
-		goto error_int;
+	if (scan_run(&scan) != 0)
+		goto error;
+
+	f_int->fabric.total_mads_used = scan.engine.total_smps;
+	f_int->fabric.maxhops_discovered += scan.initial_hops;
+
+	if (group_nodes(&f_int->fabric))
+		goto error;
+
+	smp_engine_destroy(&scan.engine);
+	return (ibnd_fabric_t *)f_int;
+error:
+	smp_engine_destroy(&scan.engine);
+	ibnd_destroy_fabric(&f_int->fabric);
+	return NULL;
+}
+
+ibnd_fabric_t *ibnd_discover_fabric_multi(ibnd_src_port_t *ports,
+					  int num_ports,
+					  struct ibnd_config *cfg)
+{
+	pthread_mutex_t fabric_lock = PTHREAD_MUTEX_INITIALIZER;
+	struct ibnd_config config = { 0 };
+	ib_portid_t my_portid = { 0 };
+	f_internal_t *f_int = NULL;
+	ibnd_scan_t *scans;
+	int i, n_init = 0, n_started = 0;
+	int rc = 0;
+
+	if (!ports || num_ports <= 0) {
+		IBND_ERROR("No source ports given\n");
+		return NULL;
 	}
-	mad_rpc_set_timeout(ibmad_port, cfg->timeout_ms);
-	mad_rpc_set_retries(ibmad_port, cfg->retries);
-	smp_mkey_set(ibmad_port, cfg->mkey);
 
-	if (ib_resolve_self_via(&scan.selfportid,
-				NULL, NULL, ibmad_port) < 0) {
-		IBND_ERROR("Failed to resolve self\n");
-		mad_rpc_close_port(ibmad_port);
-		goto error_int;
+	if (num_ports == 1)
+		return ibnd_discover_fabric(ports[0].ca_name, ports[0].ca_port,
+					    NULL, cfg);
+
+	if (set_config(&config, cfg)) {
+		IBND_ERROR("Invalid ibnd_config\n");
+		return NULL;
 	}
-	mad_rpc_close_port(ibmad_port);
 
-	if (smp_engine_init(&engine, ca_name, ca_port, &scan, &config)) {
-		goto error_int;
+	f_int = allocate_fabric_internal();
+	if (!f_int) {
+		IBND_ERROR("OOM: failed to calloc ibnd_fabric_t\n");
+		return NULL;
 	}
 
-	IBND_DEBUG("from %s\n", portid2str(from));
+	scans = calloc(num_ports, sizeof(*scans));
+	if (!scans) {
+		IBND_ERROR("OOM: failed to allocate scans\n");
+		free(f_int);
+		return NULL;
+	}
+
+	for (n_init = 0; n_init < num_ports; n_init++) {
+		ibnd_scan_t *scan = &scans[n_init];
 
-	if (!query_node_info(&engine, from, NULL))
-		if (process_mads(&engine) != 0)
+		if (scan_init(scan, f_int, &config, ports[n_init].ca_name,
+			      ports[n_init].ca_port, &my_portid)) {
+			rc = -1;
 			goto error;
+		}
+		/* the first port provides from_node and the DR paths of
+		 * anything it reaches first */
+		scan->primary = (n_init == 0);
+		scan->engine.fabric_lock = &fabric_lock;
+	}
 
-	f_int->fabric.total_mads_used = engine.total_smps;
-	f_int->fabric.maxhops_discovered += scan.initial_hops;
+	/* Each scan walks its own plane; a node already found through
+	 * another port is linked but not explored again. */
+	for (n_started = 0; n_started < num_ports; n_started++)
+		if (pthread_create(&scans[n_started].thread, NULL, scan_thread,
+				   &scans[n_started])) {
+			IBND_ERROR("Failed to start discovery thread\n");
+			rc = -1;
+			break;
+		}
 
-	if (group_nodes(&f_int->fabric))
+	for (i = 0; i < n_started; i++) {
+		pthread_join(scans[i].thread, NULL);
+		if (scans[i].status)
+			rc = scans[i].status;
+		f_int->fabric.total_mads_used += scans[i].engine.total_smps;
+	}
+
+	if (rc || group_nodes(&f_int->fabric))
 		goto error;
 
-	smp_engine_destroy(&engine);
+	for (i = 0; i < n_init; i++)
+		smp_engine_destroy(&scans[i].engine);
+	free(scans);
+	pthread_mutex_destroy(&fabric_lock);
 	return (ibnd_fabric_t *)f_int;
 error:
-	smp_engine_destroy(&engine);
+	for (i = 0; i < n_init; i++)
+		smp_engine_destroy(&scans[i].engine);
+	free(scans);
+	pthread_mutex_destroy(&fabric_lock);
 	ibnd_destroy_fabric(&f_int->fabric);
-error_int:
-	free(f_int);
 	return NULL;
 }
 
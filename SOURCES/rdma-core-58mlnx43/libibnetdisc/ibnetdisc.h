@@ -56,7 +56,10 @@ typedef struct ibnd_node {
 
 	ib_portid_t path_portid;	/* path from "from_node" */
 					/* NOTE: this is not valid on a fabric
-					 * read from a cache file */
+					 * read from a cache file.  With
+					 * ibnd_discover_fabric_multi it is
+					 * relative to the source port which
+					 * reached the node first */
 	uint16_t smalid;
 	uint8_t smalmc;
 
@@ -195,6 +198,22 @@ ibnd_fabric_t *ibnd_discover_fabric(char *ca_name, int ca_port,
 	 *       If NULL start from the CA/CA port specified
 	 * config: (optional) additional config options for the scan
 	 */
+
+typedef struct ibnd_src_port {
+	char *ca_name;
+	int ca_port;
+} ibnd_src_port_t;
+
+ibnd_fabric_t *ibnd_discover_fabric_multi(ibnd_src_port_t *ports,
+					  int num_ports,
+					  struct ibnd_config *config);
+	/**
+	 * ports: local CA ports to discover from, one thread per port.
+	 *        Nodes reachable from several ports are merged by GUID.
+	 *        The first port is reported as from_node/from_portnum.
+	 * num_ports: number of entries in ports
+	 * config: (optional) additional config options for the scan
+	 */
 void ibnd_destroy_fabric(ibnd_fabric_t *fabric);
 
 ibnd_fabric_t *ibnd_load_fabric(const char *file, unsigned int flags);
@@ -38,6 +38,7 @@
 #ifndef _INTERNAL_H_
 #define _INTERNAL_H_
 
+#include <pthread.h>
 #include <infiniband/ibnetdisc.h>
 #include <util/cl_qmap.h>
 
@@ -66,13 +67,6 @@ void create_lid2guid(f_internal_t *f_int);
 void destroy_lid2guid(f_internal_t *f_int);
 void add_to_portlid_hash(ibnd_port_t * port, f_internal_t *f_int);
 
-typedef struct ibnd_scan {
-	ib_portid_t selfportid;
-	f_internal_t *f_int;
-	struct ibnd_config *cfg;
-	unsigned initial_hops;
-} ibnd_scan_t;
-
 typedef struct ibnd_smp ibnd_smp_t;
 typedef struct smp_engine smp_engine_t;
 typedef int (*smp_comp_cb_t) (smp_engine_t * engine, ibnd_smp_t * smp,
@@ -96,8 +90,26 @@ struct smp_engine {
 	cl_qmap_t smps_on_wire;
 	struct ibnd_config *cfg;
 	unsigned total_smps;
+	/* serializes completions of engines sharing one fabric */
+	pthread_mutex_t *fabric_lock;
 };
 
+/* One scan per local port the fabric is discovered from */
+typedef struct ibnd_scan {
+	ib_portid_t selfportid;
+	f_internal_t *f_int;
+	struct ibnd_config *cfg;
+	unsigned initial_hops;
+	/* node and port the scan started from */
+	ibnd_node_t *from_node;
+	int from_portnum;
+	int primary;
+	smp_engine_t engine;
+	ib_portid_t from;
+	pthread_t thread;
+	int status;
+} ibnd_scan_t;
+
 int smp_engine_init(smp_engine_t * engine, char * ca_name, int ca_port,
 		    void *user_data, ibnd_config_t *cfg);
 int issue_smp(smp_engine_t * engine, ib_portid_t * portid,
@@ -182,6 +182,9 @@ static int process_one_recv(smp_engine_t * engine)
 	if (rc)
 		goto error;
 
+	if (engine->fabric_lock)
+		pthread_mutex_lock(engine->fabric_lock);
+
 	if ((status = umad_status(umad))) {
 		IBND_ERROR("umad (%s Attr 0x%x:%u) bad status %d; %s\n",
 			   portid2str(&smp->path), smp->rpc.attr.id,
@@ -199,6 +202,9 @@ static int process_one_recv(smp_engine_t * engine)
 	} else
 		rc = smp->cb(engine, smp, mad, smp->cb_data);
 
+	if (engine->fabric_lock)
+		pthread_mutex_unlock(engine->fabric_lock);
+
 error:
 	free(smp);
 	return rc;
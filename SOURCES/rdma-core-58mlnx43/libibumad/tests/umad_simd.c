@@ -0,0 +1,1232 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/*
+ * Fabric simulator for the libibumad UMAD_SIM_SOCKET backend.
+ *
+ * Loads a topology in ibnetdiscover output format and answers the SMP
+ * (NodeInfo, NodeDescription, SwitchInfo, PortInfo), PMA (ClassPortInfo,
+ * PortCounters, PortCountersExtended) and SA (ClassPortInfo, NodeRecord,
+ * PathRecord) queries sent by clients attached to one of its CAs.
+ *
+ *	umad_simd -t fabric.topo -s /tmp/umad.sock &
+ *	UMAD_SIM_SOCKET=/tmp/umad.sock ibnetdiscover
+ */
+
+#include <config.h>
+
+#include <stdio.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <infiniband/umad.h>
+#include <infiniband/mad.h>
+#include <util/iba_types.h>
+
+#include "../umad_sim.h"
+
+#define SIM_MAX_LID		0xbfff
+#define SIM_MAX_CLIENTS		256
+#define SIM_GID_PREFIX		0xfe80000000000000ULL
+#define SIM_FRAME_SIZE		(sizeof(struct ib_user_mad) + IB_MAD_SIZE)
+
+struct sim_node;
+
+struct sim_port {
+	struct sim_node *node;
+	struct sim_port *remote;
+	uint64_t guid;
+	uint64_t remote_node_guid;
+	uint8_t remote_portnum;
+	uint8_t portnum;
+	uint16_t lid;
+	uint8_t lmc;
+	uint8_t width;
+	uint8_t speed;
+	uint8_t espeed;
+	uint8_t err_inject;
+	uint64_t err_reset_ms;
+	uint64_t data_reset_ms;
+};
+
+struct sim_node {
+	int type;
+	int numports;
+	int enhanced0;
+	uint64_t guid;
+	uint64_t sysguid;
+	uint32_t vendid;
+	uint32_t devid;
+	uint16_t lid;
+	uint8_t lmc;
+	int pma_timeout;
+	char desc[IB_SMP_DATA_SIZE + 1];
+	struct sim_port *ports;		/* [0 .. numports] */
+};
+
+static struct sim_node **nodes;
+static unsigned num_nodes;
+static struct sim_port *lids[SIM_MAX_LID + 1];
+static uint16_t max_lid;
+static struct sim_port *attach;
+static unsigned sm_lid;
+static unsigned err_percent;
+static unsigned pma_timeout_percent;
+static unsigned pma_limit;
+static unsigned pma_answered;
+static uint64_t start_ms;
+static int verbose;
+
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000 - start_ms;
+}
+
+/*************************************
+ * Topology
+ */
+static struct sim_node *add_node(int type, int numports, uint64_t guid)
+{
+	struct sim_node *node;
+	int i;
+
+	if (!(num_nodes & (num_nodes + 1)) || !nodes) {
+		nodes = realloc(nodes, (num_nodes + 1) * 2 * sizeof(*nodes));
+		if (!nodes)
+			return NULL;
+	}
+
+	node = calloc(1, sizeof(*node));
+	if (!node)
+		return NULL;
+	node->ports = calloc(numports + 1, sizeof(*node->ports));
+	if (!node->ports) {
+		free(node);
+		return NULL;
+	}
+
+	node->type = type;
+	node->numports = numports;
+	node->guid = guid;
+	for (i = 0; i <= numports; i++) {
+		node->ports[i].node = node;
+		node->ports[i].portnum = i;
+	}
+	nodes[num_nodes++] = node;
+	return node;
+}
+
+/* "S-0002c90300001234" style node id */
+static uint64_t parse_node_id(const char *p)
+{
+	p = strchr(p, '-');
+	return p ? strtoull(p + 1, NULL, 16) : 0;
+}
+
+static void parse_link(struct sim_port *port, const char *p)
+{
+	static const struct {
+		const char *name;
+		uint8_t speed;
+		uint8_t espeed;
+	} speeds[] = {
+		{ "SDR", 1, 0 }, { "DDR", 2, 0 }, { "QDR", 4, 0 },
+		{ "FDR10", 4, 0 }, { "FDR", 4, 1 }, { "EDR", 4, 2 },
+		{ "HDR", 4, 4 }, { "NDR", 4, 8 },
+	};
+	unsigned width;
+	char *end;
+	int i;
+
+	width = strtoul(p, &end, 10);
+	if (end == p || (*end != 'x' && *end != 'X'))
+		return;
+
+	switch (width) {
+	case 1:
+		port->width = 1;
+		break;
+	case 4:
+		port->width = 2;
+		break;
+	case 8:
+		port->width = 4;
+		break;
+	case 12:
+		port->width = 8;
+		break;
+	case 2:
+		port->width = 16;
+		break;
+	}
+
+	for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+		if (!strncmp(end + 1, speeds[i].name, strlen(speeds[i].name)) &&
+		    !isalnum(end[1 + strlen(speeds[i].name)])) {
+			port->speed = speeds[i].speed;
+			port->espeed = speeds[i].espeed;
+		}
+	}
+}
+
+/*
+ * Node lines:
+ *	Switch	36 "S-<guid>"		# "<desc>" enhanced port 0 lid 1 lmc 0
+ *	Ca	2 "H-<guid>"		# "<desc>"
+ */
+static struct sim_node *parse_node(char *p, int type, uint64_t sysguid,
+				   uint32_t vendid, uint32_t devid,
+				   uint64_t port0_guid)
+{
+	struct sim_node *node;
+	char *q, *desc;
+	int numports;
+
+	while (*p && !isspace(*p))
+		p++;
+	numports = strtoul(p, &p, 10);
+	if (numports <= 0 || numports > 254)
+		return NULL;
+
+	q = strchr(p, '"');
+	if (!q)
+		return NULL;
+
+	node = add_node(type, numports, parse_node_id(q));
+	if (!node)
+		return NULL;
+	node->sysguid = sysguid;
+	node->vendid = vendid;
+	node->devid = devid;
+
+	p = strchr(q + 1, '#');
+	if (p && (desc = strchr(p, '"')) && (q = strchr(desc + 1, '"'))) {
+		*q = '\0';
+		strncpy(node->desc, desc + 1, IB_SMP_DATA_SIZE);
+		p = q + 1;
+	}
+
+	if (type == IB_NODE_SWITCH) {
+		node->ports[0].guid = port0_guid ? port0_guid : node->guid;
+		if (p && (q = strstr(p, "port 0 lid ")))
+			node->lid = strtoul(q + 11, &q, 10);
+		if (p && (q = strstr(p, "lmc ")))
+			node->lmc = strtoul(q + 4, NULL, 10);
+		node->enhanced0 = p && strstr(p, "enhanced") != NULL;
+		node->ports[0].lid = node->lid;
+		node->ports[0].lmc = node->lmc;
+	}
+
+	return node;
+}
+
+/*
+ * Port lines:
+ *	[1]	"H-<guid>"[1](<portguid>)	# "<desc>" lid 2 4xQDR
+ *	[1](<portguid>)	"S-<guid>"[3]		# lid 2 lmc 0 "<desc>" lid 1 4xQDR
+ */
+static void parse_port(struct sim_node *node, char *p)
+{
+	struct sim_port *port;
+	unsigned portnum;
+	char *q;
+
+	portnum = strtoul(p + 1, &p, 10);
+	if (portnum < 1 || portnum > node->numports)
+		return;
+	port = &node->ports[portnum];
+
+	p = strchr(p, ']');
+	if (!p)
+		return;
+	p++;
+	if (!strncmp(p, "[ext", 4) && (q = strchr(p, ']')))
+		p = q + 1;
+	if (*p == '(')
+		port->guid = strtoull(p + 1, &p, 16);
+	if (node->type == IB_NODE_SWITCH)
+		port->guid = node->ports[0].guid;
+
+	q = strchr(p, '"');
+	if (!q)
+		return;
+	port->remote_node_guid = parse_node_id(q);
+	q = strchr(q + 1, '"');
+	if (!q || q[1] != '[')
+		return;
+	port->remote_portnum = strtoul(q + 2, &p, 10);
+
+	p = strchr(p, '#');
+	if (!p)
+		return;
+
+	if (node->type != IB_NODE_SWITCH &&
+	    (q = strstr(p, "# lid ")) == p) {
+		port->lid = strtoul(p + 6, &q, 10);
+		if ((q = strstr(q, "lmc ")))
+			port->lmc = strtoul(q + 4, NULL, 10);
+	}
+
+	/* the link width and speed follow the last "lid <n>" */
+	for (q = p; (p = strstr(q, "lid ")); q = p + 4)
+		;
+	strtoul(q, &p, 10);
+	while (isspace(*p))
+		p++;
+	parse_link(port, p);
+}
+
+static int cmp_node_guid(const void *a, const void *b)
+{
+	const struct sim_node *na = *(struct sim_node * const *)a;
+	const struct sim_node *nb = *(struct sim_node * const *)b;
+
+	if (na->guid == nb->guid)
+		return 0;
+	return na->guid < nb->guid ? -1 : 1;
+}
+
+static struct sim_node *find_node(uint64_t guid)
+{
+	struct sim_node key = { .guid = guid };
+	struct sim_node *pkey = &key;
+	struct sim_node **n;
+
+	n = bsearch(&pkey, nodes, num_nodes, sizeof(*nodes), cmp_node_guid);
+	return n ? *n : NULL;
+}
+
+static void add_lid(struct sim_port *port)
+{
+	unsigned l;
+
+	if (!port->lid)
+		return;
+	for (l = port->lid; l < port->lid + (1U << port->lmc) &&
+	     l <= SIM_MAX_LID; l++) {
+		lids[l] = port;
+		if (l > max_lid)
+			max_lid = l;
+	}
+}
+
+static int load_topology(const char *file, uint64_t attach_guid)
+{
+	uint64_t sysguid = 0, port0_guid = 0;
+	uint32_t vendid = 0, devid = 0;
+	struct sim_node *node = NULL;
+	char line[1024];
+	unsigned i;
+	int p;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f) {
+		fprintf(stderr, "can't open %s: %m\n", file);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *s = line;
+
+		while (isspace(*s))
+			s++;
+		if (!*s || *s == '#')
+			continue;
+
+		if (!strncmp(s, "vendid=", 7))
+			vendid = strtoul(s + 7, NULL, 0);
+		else if (!strncmp(s, "devid=", 6))
+			devid = strtoul(s + 6, NULL, 0);
+		else if (!strncmp(s, "sysimgguid=", 11))
+			sysguid = strtoull(s + 11, NULL, 0);
+		else if (!strncmp(s, "switchguid=", 11)) {
+			char *q = strchr(s, '(');
+
+			port0_guid = q ? strtoull(q + 1, NULL, 16) : 0;
+		} else if (!strncmp(s, "Switch", 6))
+			node = parse_node(s, IB_NODE_SWITCH, sysguid, vendid,
+					  devid, port0_guid);
+		else if (!strncmp(s, "Ca", 2))
+			node = parse_node(s, IB_NODE_CA, sysguid, vendid,
+					  devid, 0);
+		else if (!strncmp(s, "Rt", 2))
+			node = parse_node(s, IB_NODE_ROUTER, sysguid, vendid,
+					  devid, 0);
+		else if (*s == '[' && node)
+			parse_port(node, s);
+	}
+	fclose(f);
+
+	if (!num_nodes) {
+		fprintf(stderr, "no nodes found in %s\n", file);
+		return -1;
+	}
+
+	qsort(nodes, num_nodes, sizeof(*nodes), cmp_node_guid);
+
+	for (i = 0; i < num_nodes; i++) {
+		node = nodes[i];
+
+		if (node->type == IB_NODE_SWITCH)
+			add_lid(&node->ports[0]);
+		node->pma_timeout = (node->guid * 2654435761ULL) % 100 <
+				    pma_timeout_percent;
+
+		for (p = 1; p <= node->numports; p++) {
+			struct sim_port *port = &node->ports[p];
+			struct sim_node *rnode;
+
+			if (port->remote_node_guid &&
+			    (rnode = find_node(port->remote_node_guid)) &&
+			    port->remote_portnum >= 1 &&
+			    port->remote_portnum <= rnode->numports)
+				port->remote = &rnode->ports[port->remote_portnum];
+
+			if (!port->guid)
+				port->guid = node->guid + p;
+			if (!port->width)
+				port->width = 2;
+			if (!port->speed)
+				port->speed = 4;
+			if (node->type != IB_NODE_SWITCH)
+				add_lid(port);
+			/* deterministic error injection */
+			port->err_inject = port->remote &&
+				((port->guid * 2654435761ULL + p) % 100) <
+				err_percent;
+		}
+
+		if (!attach && node->type == IB_NODE_CA &&
+		    (!attach_guid || attach_guid == node->guid))
+			for (p = 1; p <= node->numports && !attach; p++)
+				if (node->ports[p].remote)
+					attach = &node->ports[p];
+	}
+
+	if (!attach) {
+		fprintf(stderr, "no connected CA port to attach to\n");
+		return -1;
+	}
+
+	if (!sm_lid)
+		sm_lid = attach->lid;
+
+	printf("loaded %u nodes, max lid %u, attached to 0x%016" PRIx64
+	       " port %u lid %u\n", num_nodes, max_lid, attach->node->guid,
+	       attach->portnum, attach->lid);
+	return 0;
+}
+
+/*************************************
+ * Port attributes
+ */
+static int port_active(struct sim_port *port)
+{
+	return port->portnum == 0 || port->remote;
+}
+
+static unsigned port_rate(struct sim_port *port)
+{
+	static const unsigned lanes[] = { [1] = 1, [2] = 4, [4] = 8, [8] = 12,
+					  [16] = 2 };
+	unsigned gbps;
+
+	switch (port->espeed) {
+	case 1:
+		gbps = 14;
+		break;
+	case 2:
+		gbps = 25;
+		break;
+	case 4:
+		gbps = 50;
+		break;
+	case 8:
+		gbps = 100;
+		break;
+	default:
+		gbps = port->speed == 1 ? 2 : port->speed == 2 ? 5 : 10;
+	}
+	return gbps * (port->width <= 16 ? lanes[port->width] : 4);
+}
+
+static uint16_t port_lid(struct sim_port *port)
+{
+	return port->node->type == IB_NODE_SWITCH ? port->node->lid :
+						    port->lid;
+}
+
+static void fill_node_info(uint8_t *data, struct sim_node *node,
+			   struct sim_port *entry)
+{
+	uint32_t val;
+
+	val = 1;
+	mad_set_field(data, 0, IB_NODE_BASE_VERS_F, val);
+	mad_set_field(data, 0, IB_NODE_CLASS_VERS_F, val);
+	mad_set_field(data, 0, IB_NODE_TYPE_F, node->type);
+	mad_set_field(data, 0, IB_NODE_NPORTS_F, node->numports);
+	mad_set_field64(data, 0, IB_NODE_SYSTEM_GUID_F,
+			node->sysguid ? node->sysguid : node->guid);
+	mad_set_field64(data, 0, IB_NODE_GUID_F, node->guid);
+	mad_set_field64(data, 0, IB_NODE_PORT_GUID_F, entry->guid);
+	mad_set_field(data, 0, IB_NODE_PARTITION_CAP_F, 128);
+	mad_set_field(data, 0, IB_NODE_DEVID_F, node->devid);
+	mad_set_field(data, 0, IB_NODE_LOCAL_PORT_F, entry->portnum);
+	mad_set_field(data, 0, IB_NODE_VENDORID_F, node->vendid);
+}
+
+static void fill_switch_info(uint8_t *data, struct sim_node *node)
+{
+	mad_set_field(data, 0, IB_SW_LINEAR_FDB_CAP_F, SIM_MAX_LID + 1);
+	mad_set_field(data, 0, IB_SW_LINEAR_FDB_TOP_F, max_lid);
+	mad_set_field(data, 0, IB_SW_LIFE_TIME_F, 18);
+	mad_set_field(data, 0, IB_SW_ENHANCED_PORT0_F, node->enhanced0);
+}
+
+static int fill_port_info(uint8_t *data, struct sim_node *node,
+			  struct sim_port *entry, unsigned portnum)
+{
+	struct sim_port *port;
+	uint32_t capmask = 0;
+	int espeeds = 0;
+	int p;
+
+	if (node->type != IB_NODE_SWITCH && portnum == 0)
+		portnum = entry->portnum;
+	if (portnum > node->numports ||
+	    (node->type != IB_NODE_SWITCH && portnum == 0))
+		return IB_MAD_STS_INV_ATTR_VALUE;
+	port = &node->ports[portnum];
+
+	for (p = 1; p <= node->numports; p++)
+		if (node->ports[p].espeed)
+			espeeds = 1;
+
+	if (espeeds)
+		capmask |= be32toh(IB_PORT_CAP_HAS_EXT_SPEEDS);
+	if (node->type == IB_NODE_CA && port_lid(port) == sm_lid)
+		capmask |= be32toh(IB_PORT_CAP_IS_SM);
+
+	mad_set_field64(data, 0, IB_PORT_GID_PREFIX_F, SIM_GID_PREFIX);
+	mad_set_field(data, 0, IB_PORT_LID_F, port_lid(port));
+	mad_set_field(data, 0, IB_PORT_SMLID_F, sm_lid);
+	mad_set_field(data, 0, IB_PORT_CAPMASK_F, capmask);
+	mad_set_field(data, 0, IB_PORT_LOCAL_PORT_F, entry->portnum);
+	mad_set_field(data, 0, IB_PORT_LMC_F, port->lmc);
+	mad_set_field(data, 0, IB_PORT_MTU_CAP_F, 5);
+	mad_set_field(data, 0, IB_PORT_VL_CAP_F, 4);
+	mad_set_field(data, 0, IB_PORT_OPER_VLS_F, 4);
+
+	if (portnum == 0) {
+		mad_set_field(data, 0, IB_PORT_STATE_F, IB_LINK_ACTIVE);
+		mad_set_field(data, 0, IB_PORT_PHYS_STATE_F, IB_PORT_PHYS_STATE_LINKUP);
+		return 0;
+	}
+
+	mad_set_field(data, 0, IB_PORT_LINK_WIDTH_ENABLED_F, port->width);
+	mad_set_field(data, 0, IB_PORT_LINK_WIDTH_SUPPORTED_F, port->width);
+	mad_set_field(data, 0, IB_PORT_LINK_WIDTH_ACTIVE_F, port->width);
+	mad_set_field(data, 0, IB_PORT_LINK_SPEED_SUPPORTED_F, port->speed);
+	mad_set_field(data, 0, IB_PORT_LINK_SPEED_ENABLED_F, port->speed);
+	mad_set_field(data, 0, IB_PORT_LINK_SPEED_ACTIVE_F, port->speed);
+	mad_set_field(data, 0, IB_PORT_LINK_SPEED_EXT_SUPPORTED_F, port->espeed);
+	mad_set_field(data, 0, IB_PORT_LINK_SPEED_EXT_ENABLED_F, port->espeed);
+	mad_set_field(data, 0, IB_PORT_LINK_SPEED_EXT_ACTIVE_F, port->espeed);
+	mad_set_field(data, 0, IB_PORT_NEIGHBOR_MTU_F, 5);
+
+	if (port_active(port)) {
+		mad_set_field(data, 0, IB_PORT_STATE_F, IB_LINK_ACTIVE);
+		mad_set_field(data, 0, IB_PORT_PHYS_STATE_F,
+			      IB_PORT_PHYS_STATE_LINKUP);
+	} else {
+		mad_set_field(data, 0, IB_PORT_STATE_F, IB_LINK_DOWN);
+		mad_set_field(data, 0, IB_PORT_PHYS_STATE_F,
+			      IB_PORT_PHYS_STATE_POLLING);
+	}
+	return 0;
+}
+
+/*************************************
+ * SMP
+ */
+
+/* Follow the initial path of a directed route SMP */
+static struct sim_port *dr_route(uint8_t *mad, uint16_t dlid)
+{
+	uint8_t *path = mad + 128;
+	unsigned hops = mad_get_field(mad, 0, IB_DRSMP_HOPCNT_F);
+	struct sim_port *cur = attach;
+	unsigned i;
+
+	if (mad_get_field(mad, 0, IB_DRSMP_DRSLID_F) != 0xffff) {
+		if (dlid > SIM_MAX_LID || !(cur = lids[dlid]))
+			return NULL;
+	}
+
+	for (i = 1; i <= hops; i++) {
+		struct sim_node *node = cur->node;
+		struct sim_port *out;
+
+		if (!path[i] || path[i] > node->numports)
+			return NULL;
+		/* only switches forward, a CA may only leave by its own port */
+		if (node->type != IB_NODE_SWITCH &&
+		    (i > 1 || path[i] != cur->portnum))
+			return NULL;
+		out = &node->ports[path[i]];
+		if (!out->remote)
+			return NULL;
+		cur = out->remote;
+	}
+	return cur;
+}
+
+static int process_smp(uint8_t *mad, uint16_t dlid)
+{
+	uint8_t *data = mad + IB_SMP_DATA_OFFS;
+	unsigned attr = mad_get_field(mad, 0, IB_MAD_ATTRID_F);
+	unsigned mod = mad_get_field(mad, 0, IB_MAD_ATTRMOD_F);
+	struct sim_port *entry;
+	int status = 0;
+
+	if (mad_get_field(mad, 0, IB_MAD_MGMTCLASS_F) == IB_SMI_DIRECT_CLASS)
+		entry = dr_route(mad, dlid);
+	else
+		entry = dlid <= SIM_MAX_LID ? lids[dlid] : NULL;
+	if (!entry)
+		return -ETIMEDOUT;
+
+	memset(data, 0, IB_SMP_DATA_SIZE);
+
+	switch (attr) {
+	case IB_ATTR_NODE_DESC:
+		memcpy(data, entry->node->desc, IB_SMP_DATA_SIZE);
+		break;
+	case IB_ATTR_NODE_INFO:
+		fill_node_info(data, entry->node, entry);
+		break;
+	case IB_ATTR_SWITCH_INFO:
+		if (entry->node->type != IB_NODE_SWITCH)
+			status = IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		else
+			fill_switch_info(data, entry->node);
+		break;
+	case IB_ATTR_PORT_INFO:
+		status = fill_port_info(data, entry->node, entry, mod);
+		break;
+	default:
+		status = IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		break;
+	}
+
+	if (mad_get_field(mad, 0, IB_MAD_MGMTCLASS_F) == IB_SMI_DIRECT_CLASS) {
+		mad_set_field(mad, 0, IB_DRSMP_DIRECTION_F, 1);
+		mad_set_field(mad, 0, IB_DRSMP_STATUS_F, status);
+	} else
+		mad_set_field(mad, 0, IB_MAD_STATUS_F, status);
+	mad_set_field(mad, 0, IB_MAD_METHOD_F, IB_MAD_METHOD_GET_RESPONSE);
+	return IB_MAD_SIZE;
+}
+
+/*************************************
+ * PMA
+ */
+static uint64_t sat(uint64_t val, unsigned bits)
+{
+	uint64_t max = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+
+	return val > max ? max : val;
+}
+
+/* Counters are a function of the time since they were last cleared: data
+ * grows at a per port rate and error injected ports gain one symbol error
+ * per second and one receive error every five seconds. */
+static void port_counters(struct sim_port *port, uint64_t *data,
+			  uint64_t *pkts, uint64_t *sym, uint64_t *rcv_err)
+{
+	uint64_t now = now_ms();
+	uint64_t rate;
+
+	*data = *pkts = *sym = *rcv_err = 0;
+	if (!port->remote)
+		return;
+
+	rate = (port->guid + port->portnum) % 1000 + 1;
+	*data = (now - port->data_reset_ms) * rate;
+	*pkts = *data / 64;
+	if (port->err_inject) {
+		*sym = (now - port->err_reset_ms) / 1000;
+		*rcv_err = (now - port->err_reset_ms) / 5000;
+	}
+}
+
+static void reset_counters(struct sim_port *port, unsigned attr,
+			   uint8_t *data)
+{
+	unsigned select = mad_get_field(data, 0, IB_PC_COUNTER_SELECT_F);
+
+	if (attr == IB_GSI_PORT_COUNTERS) {
+		if (select & 0xfff)
+			port->err_reset_ms = now_ms();
+		if (select & 0xf000)
+			port->data_reset_ms = now_ms();
+	} else {
+		if (select & 0xff)
+			port->data_reset_ms = now_ms();
+		if (mad_get_field(data, 0, IB_PC_EXT_COUNTER_SELECT2_F))
+			port->err_reset_ms = now_ms();
+	}
+}
+
+static int process_pma(uint8_t *mad, uint16_t dlid)
+{
+	uint8_t *data = mad + IB_PC_DATA_OFFS;
+	unsigned attr = mad_get_field(mad, 0, IB_MAD_ATTRID_F);
+	unsigned method = mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	uint64_t xdata = 0, pkts = 0, sym = 0, rcv_err = 0;
+	uint64_t p_xdata, p_pkts, p_sym, p_rcv_err;
+	struct sim_port *target, *port;
+	unsigned portnum, first, last, p;
+	int status = 0;
+
+	target = dlid <= SIM_MAX_LID ? lids[dlid] : NULL;
+	if (!target || target->node->pma_timeout)
+		return -ETIMEDOUT;
+
+	switch (attr) {
+	case CLASS_PORT_INFO: {
+		__be16 cap_mask = IB_PM_EXT_WIDTH_SUPPORTED |
+				  IB_PM_PC_XMIT_WAIT_SUP;
+		__be32 cap_mask2 = htobe32(be32toh(
+				IB_PM_IS_ADDL_PORT_CTRS_EXT_SUP) << 5);
+
+		if (target->node->type == IB_NODE_SWITCH)
+			cap_mask |= IB_PM_ALL_PORT_SELECT;
+
+		memset(data, 0, IB_PC_DATA_SZ);
+		data[0] = 1;	/* BaseVersion */
+		data[1] = 1;	/* ClassVersion */
+		memcpy(data + 2, &cap_mask, sizeof(cap_mask));
+		memcpy(data + 4, &cap_mask2, sizeof(cap_mask2));
+		break;
+	}
+	case IB_GSI_PORT_COUNTERS:
+	case IB_GSI_PORT_COUNTERS_EXT:
+		portnum = mad_get_field(data, 0, IB_PC_PORT_SELECT_F);
+		/* AllPortSelect sums up the counters of every switch port */
+		if (portnum == 0xFF && target->node->type == IB_NODE_SWITCH) {
+			first = 0;
+			last = target->node->numports;
+		} else if ((target->node->type != IB_NODE_SWITCH &&
+			    portnum != target->portnum) ||
+			   portnum > target->node->numports) {
+			status = IB_MAD_STS_INV_ATTR_VALUE;
+			break;
+		} else
+			first = last = portnum;
+
+		for (p = first; p <= last; p++) {
+			port = &target->node->ports[p];
+			if (method == IB_MAD_METHOD_SET)
+				reset_counters(port, attr, data);
+			port_counters(port, &p_xdata, &p_pkts, &p_sym,
+				      &p_rcv_err);
+			xdata += p_xdata;
+			pkts += p_pkts;
+			sym += p_sym;
+			rcv_err += p_rcv_err;
+		}
+		memset(data, 0, IB_PC_DATA_SZ);
+		mad_set_field(data, 0, IB_PC_PORT_SELECT_F, portnum);
+
+		if (attr == IB_GSI_PORT_COUNTERS) {
+			mad_set_field(data, 0, IB_PC_ERR_SYM_F, sat(sym, 16));
+			mad_set_field(data, 0, IB_PC_ERR_RCV_F,
+				      sat(rcv_err, 16));
+			mad_set_field(data, 0, IB_PC_XMT_BYTES_F,
+				      sat(xdata, 32));
+			mad_set_field(data, 0, IB_PC_RCV_BYTES_F,
+				      sat(xdata, 32));
+			mad_set_field(data, 0, IB_PC_XMT_PKTS_F, sat(pkts, 32));
+			mad_set_field(data, 0, IB_PC_RCV_PKTS_F, sat(pkts, 32));
+		} else {
+			mad_set_field64(data, 0, IB_PC_EXT_XMT_BYTES_F, xdata);
+			mad_set_field64(data, 0, IB_PC_EXT_RCV_BYTES_F, xdata);
+			mad_set_field64(data, 0, IB_PC_EXT_XMT_PKTS_F, pkts);
+			mad_set_field64(data, 0, IB_PC_EXT_RCV_PKTS_F, pkts);
+			mad_set_field64(data, 0, IB_PC_EXT_XMT_UPKTS_F, pkts);
+			mad_set_field64(data, 0, IB_PC_EXT_RCV_UPKTS_F, pkts);
+			mad_set_field64(data, 0, IB_PC_EXT_ERR_SYM_F, sym);
+			mad_set_field64(data, 0, IB_PC_EXT_ERR_RCV_F, rcv_err);
+		}
+		break;
+	default:
+		status = IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		break;
+	}
+
+	mad_set_field(mad, 0, IB_MAD_STATUS_F, status);
+	mad_set_field(mad, 0, IB_MAD_METHOD_F, IB_MAD_METHOD_GET_RESPONSE);
+	return IB_MAD_SIZE;
+}
+
+/*************************************
+ * SA
+ */
+static struct sim_port *find_port_guid(uint64_t guid)
+{
+	unsigned l;
+
+	/* endports are reachable by LID, which is good enough here */
+	for (l = 1; l <= max_lid; l++)
+		if (lids[l] && lids[l]->guid == guid)
+			return lids[l];
+	return NULL;
+}
+
+static void fill_path_rec(ib_path_rec_t *pr, struct sim_port *src,
+			  struct sim_port *dst)
+{
+	unsigned rate = port_rate(dst);
+
+	memset(pr, 0, sizeof(*pr));
+	pr->dgid.unicast.prefix = htobe64(SIM_GID_PREFIX);
+	pr->dgid.unicast.interface_id = htobe64(dst->guid);
+	pr->sgid.unicast.prefix = htobe64(SIM_GID_PREFIX);
+	pr->sgid.unicast.interface_id = htobe64(src->guid);
+	pr->dlid = htobe16(port_lid(dst));
+	pr->slid = htobe16(port_lid(src));
+	pr->num_path = 0x80 | 1;
+	pr->pkey = htobe16(0xffff);
+	pr->mtu = IB_PATH_SELECTOR_EXACTLY << 6 | IB_MTU_LEN_2048;
+	pr->rate = IB_PATH_SELECTOR_EXACTLY << 6 |
+		   (rate >= 100 ? IB_PATH_RECORD_RATE_100_GBS :
+		    rate >= 40 ? IB_PATH_RECORD_RATE_40_GBS :
+		    rate >= 20 ? IB_PATH_RECORD_RATE_20_GBS :
+		    IB_PATH_RECORD_RATE_10_GBS);
+	pr->pkt_life = IB_PATH_SELECTOR_EXACTLY << 6 | 0x12;
+}
+
+static int process_sa(uint8_t **pmad, uint16_t dlid)
+{
+	uint8_t *mad = *pmad;
+	unsigned attr = mad_get_field(mad, 0, IB_MAD_ATTRID_F);
+	unsigned method = mad_get_field(mad, 0, IB_MAD_METHOD_F);
+	__be64 comp_mask = htobe64(mad_get_field64(mad, 0, IB_SA_COMPMASK_F));
+	size_t rec_size = 0, len = IB_MAD_SIZE;
+	unsigned n = 0, l;
+	uint16_t status = 0;
+	uint8_t *resp;
+
+	if (dlid != sm_lid)
+		return -ETIMEDOUT;
+
+	/* worst case: one record per LID */
+	resp = calloc(1, IB_SA_DATA_OFFS +
+		      (size_t)(max_lid + 1) * sizeof(ib_node_record_t));
+	if (!resp)
+		return -ENOMEM;
+	memcpy(resp, mad, IB_MAD_SIZE);
+	memset(resp + IB_SA_DATA_OFFS, 0, IB_MAD_SIZE - IB_SA_DATA_OFFS);
+
+	switch (attr) {
+	case CLASS_PORT_INFO:
+		resp[IB_SA_DATA_OFFS] = 1;
+		resp[IB_SA_DATA_OFFS + 1] = 2;
+		n = 1;
+		break;
+	case IB_SA_ATTR_NODERECORD: {
+		ib_node_record_t *rec = (void *)(resp + IB_SA_DATA_OFFS);
+		uint8_t ni[IB_SMP_DATA_SIZE];
+
+		rec_size = sizeof(*rec);
+		for (l = 1; l <= max_lid; l++) {
+			struct sim_port *port = lids[l];
+
+			/* one record per port, at its base LID */
+			if (!port || port_lid(port) != l)
+				continue;
+			memset(ni, 0, sizeof(ni));
+			fill_node_info(ni, port->node, port);
+			rec->lid = htobe16(l);
+			memcpy(&rec->node_info, ni, sizeof(rec->node_info));
+			memcpy(rec->node_desc.description, port->node->desc,
+			       sizeof(rec->node_desc.description));
+			rec++;
+			n++;
+		}
+		break;
+	}
+	case IB_SA_ATTR_PATHRECORD: {
+		ib_path_rec_t req, *rec = (void *)(resp + IB_SA_DATA_OFFS);
+		struct sim_port *src = attach, *dst;
+
+		rec_size = sizeof(*rec);
+		memcpy(&req, mad + IB_SA_DATA_OFFS, sizeof(req));
+		if (comp_mask & IB_PR_COMPMASK_SGID)
+			src = find_port_guid(be64toh(req.sgid.unicast.interface_id));
+		else if ((comp_mask & IB_PR_COMPMASK_SLID) &&
+			 be16toh(req.slid) <= SIM_MAX_LID)
+			src = lids[be16toh(req.slid)];
+		if (!src)
+			break;
+
+		if (comp_mask & (IB_PR_COMPMASK_DGID | IB_PR_COMPMASK_DLID)) {
+			if (comp_mask & IB_PR_COMPMASK_DGID)
+				dst = find_port_guid(be64toh(req.dgid.unicast.interface_id));
+			else
+				dst = be16toh(req.dlid) <= SIM_MAX_LID ?
+				      lids[be16toh(req.dlid)] : NULL;
+			if (dst) {
+				fill_path_rec(rec, src, dst);
+				n = 1;
+			}
+			break;
+		}
+
+		for (l = 1; l <= max_lid; l++) {
+			dst = lids[l];
+			if (!dst || port_lid(dst) != l)
+				continue;
+			fill_path_rec(rec++, src, dst);
+			n++;
+		}
+		break;
+	}
+	default:
+		status = IB_MAD_STS_METHOD_ATTR_NOT_SUPPORTED;
+		break;
+	}
+
+	if (!status && !n)
+		status = be16toh(IB_SA_MAD_STATUS_NO_RECORDS);
+
+	if (method == IB_MAD_METHOD_GET_TABLE) {
+		mad_set_field(resp, 0, IB_MAD_METHOD_F,
+			      IB_MAD_METHOD_GETTABLE_RESP);
+		mad_set_field(resp, 0, IB_SA_ATTROFFS_F, rec_size / 8);
+		mad_set_field(resp, 0, IB_SA_RMPP_VERS_F, 1);
+		mad_set_field(resp, 0, IB_SA_RMPP_TYPE_F, IB_RMPP_TYPE_DATA);
+		mad_set_field(resp, 0, IB_SA_RMPP_FLAGS_F,
+			      IB_RMPP_FLAG_ACTIVE | IB_RMPP_FLAG_FIRST |
+			      IB_RMPP_FLAG_LAST);
+		mad_set_field(resp, 0, IB_SA_RMPP_D1_F, 1);
+		mad_set_field(resp, 0, IB_SA_RMPP_D2_F,
+			      IB_SA_DATA_OFFS - 36 + n * rec_size);
+		if (IB_SA_DATA_OFFS + n * rec_size > len)
+			len = IB_SA_DATA_OFFS + n * rec_size;
+	} else
+		mad_set_field(resp, 0, IB_MAD_METHOD_F,
+			      IB_MAD_METHOD_GET_RESPONSE);
+	mad_set_field(resp, 0, IB_MAD_STATUS_F, status);
+
+	*pmad = resp;
+	return len;
+}
+
+/*************************************
+ * Clients
+ */
+static void reply_ca(int fd, const struct umad_sim_req *req)
+{
+	struct umad_sim_ca ca = {};
+	struct sim_node *node = attach->node;
+	int p;
+
+	if (req->magic != UMAD_SIM_MAGIC ||
+	    (req->ca_name[0] &&
+	     strncmp(req->ca_name, UMAD_SIM_CA_NAME, UMAD_CA_NAME_LEN))) {
+		ca.status = -ENODEV;
+		goto out;
+	}
+	if (req->op == UMAD_SIM_OPEN_PORT && req->portnum &&
+	    req->portnum != attach->portnum) {
+		ca.status = -ENODEV;
+		goto out;
+	}
+
+	strcpy(ca.ca_name, UMAD_SIM_CA_NAME);
+	ca.node_type = node->type;
+	ca.numports = node->numports < UMAD_CA_MAX_PORTS ?
+		      node->numports : UMAD_CA_MAX_PORTS - 1;
+	ca.node_guid = htobe64(node->guid);
+	ca.system_guid = htobe64(node->sysguid ? node->sysguid : node->guid);
+
+	for (p = 1; p <= ca.numports; p++) {
+		struct sim_port *port = &node->ports[p];
+		struct umad_sim_port *sp = &ca.ports[p];
+
+		sp->base_lid = port_lid(port);
+		sp->lmc = port->lmc;
+		sp->sm_lid = sm_lid;
+		sp->state = port_active(port) ? IB_LINK_ACTIVE : IB_LINK_DOWN;
+		sp->phys_state = port_active(port) ?
+				 IB_PORT_PHYS_STATE_LINKUP :
+				 IB_PORT_PHYS_STATE_POLLING;
+		sp->rate = port_rate(port);
+		sp->capmask = port_lid(port) == sm_lid ? IB_PORT_CAP_IS_SM : 0;
+		sp->gid_prefix = htobe64(SIM_GID_PREFIX);
+		sp->port_guid = htobe64(port->guid);
+	}
+
+out:
+	if (write(fd, &ca, sizeof(ca)) != sizeof(ca))
+		fprintf(stderr, "failed to reply to client: %m\n");
+}
+
+/* returns 0 to keep the client connected */
+static int process_frame(int fd)
+{
+	uint8_t buf[SIM_FRAME_SIZE];
+	struct ib_user_mad *umad = (void *)buf;
+	uint8_t *mad = umad->data, *resp;
+	uint16_t dlid;
+	ssize_t n;
+	int len;
+
+	n = read(fd, buf, sizeof(buf));
+	if (n <= 0)
+		return -1;
+	if (n < sizeof(*umad) + IB_MAD_SIZE / 4)
+		return 0;
+
+	dlid = be16toh(umad->addr.lid);
+	resp = mad;
+
+	switch (mad_get_field(mad, 0, IB_MAD_MGMTCLASS_F)) {
+	case IB_SMI_CLASS:
+	case IB_SMI_DIRECT_CLASS:
+		len = process_smp(mad, dlid);
+		break;
+	case IB_PERFORMANCE_CLASS:
+		/* a client losing its port in the middle of a collection */
+		if (pma_limit && pma_answered++ >= pma_limit)
+			return -1;
+		len = process_pma(mad, dlid);
+		break;
+	case IB_SA_CLASS:
+		len = process_sa(&resp, dlid);
+		break;
+	default:
+		len = -ETIMEDOUT;
+		break;
+	}
+
+	if (verbose)
+		printf("fd %d class 0x%x attr 0x%x dlid %u: %d\n", fd,
+		       mad_get_field(mad, 0, IB_MAD_MGMTCLASS_F),
+		       mad_get_field(mad, 0, IB_MAD_ATTRID_F), dlid, len);
+
+	if (len < 0) {
+		/* like the kernel, return the request with a failed status */
+		umad->status = -len;
+		n = write(fd, buf, n);
+		return 0;
+	}
+
+	umad->status = 0;
+	umad->length = sizeof(*umad) + len;
+	/* responses come from the port that was queried */
+	umad->addr.lid = htobe16(dlid);
+
+	if (resp == mad) {
+		n = write(fd, buf, sizeof(*umad) + len);
+	} else {
+		struct iovec iov[2] = {
+			{ .iov_base = umad, .iov_len = sizeof(*umad) },
+			{ .iov_base = resp, .iov_len = len },
+		};
+		struct msghdr msg = { .msg_iov = iov, .msg_iovlen = 2 };
+
+		n = sendmsg(fd, &msg, 0);
+		free(resp);
+	}
+	return 0;
+}
+
+static int serve(const char *path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct pollfd fds[SIM_MAX_CLIENTS + 1];
+	unsigned nfds = 1, i;
+	int lfd;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	unlink(path);
+
+	lfd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(lfd, 64)) {
+		fprintf(stderr, "can't listen on %s: %m\n", path);
+		return -1;
+	}
+
+	fds[0].fd = lfd;
+	fds[0].events = POLLIN;
+
+	for (;;) {
+		if (poll(fds, nfds, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (i = 1; i < nfds; i++) {
+			if (!fds[i].revents)
+				continue;
+			if (process_frame(fds[i].fd)) {
+				close(fds[i].fd);
+				fds[i--] = fds[--nfds];
+			}
+		}
+
+		if (fds[0].revents & POLLIN) {
+			struct umad_sim_req req;
+			int fd = accept(lfd, NULL, NULL);
+
+			if (fd < 0)
+				continue;
+			if (read(fd, &req, sizeof(req)) != sizeof(req)) {
+				close(fd);
+				continue;
+			}
+			reply_ca(fd, &req);
+			if (req.op != UMAD_SIM_OPEN_PORT ||
+			    nfds == SIM_MAX_CLIENTS + 1) {
+				close(fd);
+				continue;
+			}
+			fds[nfds].fd = fd;
+			fds[nfds].events = POLLIN;
+			fds[nfds].revents = 0;
+			nfds++;
+		}
+	}
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s -t <topology> -s <socket> [options]\n",
+		prog);
+	fprintf(stderr, "	-t, --topology <file>	ibnetdiscover output to simulate\n");
+	fprintf(stderr, "	-s, --socket <path>	unix socket to listen on\n");
+	fprintf(stderr, "	-n, --node <guid>	node GUID of the CA clients attach to\n");
+	fprintf(stderr, "	-S, --sm-lid <lid>	LID reported as SM/SA (default: attached port)\n");
+	fprintf(stderr, "	-e, --errors <percent>	inject errors on this share of the ports\n");
+	fprintf(stderr, "	-T, --pma-timeouts <percent>	PMA queries to this share of the nodes time out\n");
+	fprintf(stderr, "	-l, --pma-limit <n>	disconnect the client sending PMA query n + 1\n");
+	fprintf(stderr, "	-v, --verbose		log every MAD\n");
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_opts[] = {
+		{ "topology", 1, NULL, 't' },
+		{ "socket", 1, NULL, 's' },
+		{ "node", 1, NULL, 'n' },
+		{ "sm-lid", 1, NULL, 'S' },
+		{ "errors", 1, NULL, 'e' },
+		{ "pma-timeouts", 1, NULL, 'T' },
+		{ "pma-limit", 1, NULL, 'l' },
+		{ "verbose", 0, NULL, 'v' },
+		{ "help", 0, NULL, 'h' },
+		{}
+	};
+	const char *topo = NULL, *path = NULL;
+	uint64_t attach_guid = 0;
+	int c;
+
+	while ((c = getopt_long(argc, argv, "t:s:n:S:e:T:l:vh", long_opts,
+				NULL)) != -1) {
+		switch (c) {
+		case 't':
+			topo = optarg;
+			break;
+		case 's':
+			path = optarg;
+			break;
+		case 'n':
+			attach_guid = strtoull(optarg, NULL, 0);
+			break;
+		case 'S':
+			sm_lid = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			err_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'T':
+			pma_timeout_percent = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			pma_limit = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+
+	if (!topo || !path) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	start_ms = now_ms();
+	if (load_topology(topo, attach_guid))
+		return 1;
+	fflush(stdout);
+
+	return serve(path) ? 1 : 0;
+}
@@ -54,6 +54,7 @@
 
 #include <valgrind/memcheck.h>
 #include "sysfs.h"
+#include "umad_sim.h"
 
 typedef struct ib_user_mad_reg_req {
 	uint32_t id;
@@ -596,6 +597,13 @@ int umad_get_cas_names(char cas[][UMAD_CA_NAME_LEN], int max)
 
 	TRACE("max %d", max);
 
+	if (umad_sim_enabled()) {
+		if (max < 1)
+			return 0;
+		strcpy(cas[0], UMAD_SIM_CA_NAME);
+		return 1;
+	}
+
 	n = scandir(SYS_INFINIBAND, &namelist, NULL, alphasort);
 	if (n > 0) {
 		for (i = 0; i < n; i++) {
@@ -689,11 +697,17 @@ int umad_open_port(const char *ca_name, int portnum)
 {
 	char dev_file[UMAD_DEV_FILE_SZ];
 	int umad_id, fd, result;
-	unsigned int abi_version = get_abi_version();
+	unsigned int abi_version;
 	char *found_ca_name = NULL;
 
 	TRACE("ca %s port %d", ca_name, portnum);
 
+	if (umad_sim_enabled()) {
+		new_user_mad_api = 1;
+		return umad_sim_open_port(ca_name, portnum);
+	}
+
+	abi_version = get_abi_version();
 	if (!abi_version) {
 		result = -EOPNOTSUPP;
 		goto exit;
@@ -741,6 +755,9 @@ int umad_get_ca(const char *ca_name, umad_ca_t *ca)
 	char *found_ca_name;
 
 	TRACE("ca_name %s", ca_name);
+	if (umad_sim_enabled())
+		return umad_sim_get_ca(ca_name, ca);
+
 	if (resolve_ca_name(ca_name, NULL, &found_ca_name) < 0) {
 		r = -ENODEV;
 		goto exit;
@@ -788,6 +805,11 @@ int umad_get_port(const char *ca_name, int portnum, umad_port_t *port)
 		goto exit;
 	}
 
+	if (umad_sim_enabled()) {
+		result = umad_sim_get_port(found_ca_name, portnum, port);
+		goto exit;
+	}
+
 	snprintf(dir_name, sizeof(dir_name), "%s/%s/%s",
 		 SYS_INFINIBAND, found_ca_name, SYS_CA_PORTS_DIR);
 
@@ -915,7 +937,10 @@ int umad_send(int fd, int agentid, void *umad, int length,
 	if (umaddebug > 1)
 		umad_dump(mad);
 
-	n = write(fd, mad, length + umad_size());
+	if (umad_sim_enabled())
+		n = umad_sim_write(fd, mad, length + umad_size());
+	else
+		n = write(fd, mad, length + umad_size());
 	if (n == length + umad_size())
 		return 0;
 
@@ -962,7 +987,10 @@ int umad_recv(int fd, void *umad, int *length, int timeout_ms)
 		return n;
 	}
 
-	n = read(fd, umad, umad_size() + *length);
+	if (umad_sim_enabled())
+		n = umad_sim_read(fd, umad, umad_size() + *length);
+	else
+		n = read(fd, umad, umad_size() + *length);
 
 	VALGRIND_MAKE_MEM_DEFINED(umad, umad_size() + *length);
 
@@ -1016,6 +1044,9 @@ int umad_register_oui(int fd, int mgmt_class, uint8_t rmpp_version,
 		return -EINVAL;
 	}
 
+	if (umad_sim_enabled())
+		return umad_sim_register(fd);
+
 	req.qpn = 1;
 	req.mgmt_class = mgmt_class;
 	req.mgmt_class_version = 1;
@@ -1052,6 +1083,9 @@ int umad_register(int fd, int mgmt_class, int mgmt_version,
 	    ("fd %d mgmt_class %u mgmt_version %u rmpp_version %d method_mask %p",
 	     fd, mgmt_class, mgmt_version, rmpp_version, method_mask);
 
+	if (umad_sim_enabled())
+		return umad_sim_register(fd);
+
 	req.qpn = qp = (mgmt_class == 0x1 || mgmt_class == 0x81) ? 0 : 1;
 	req.mgmt_class = mgmt_class;
 	req.mgmt_class_version = mgmt_version;
@@ -1098,6 +1132,11 @@ int umad_register2(int port_fd, struct umad_reg_attr *attr, uint32_t *agent_id)
 		return EINVAL;
 	}
 
+	if (umad_sim_enabled()) {
+		*agent_id = umad_sim_register(port_fd);
+		return 0;
+	}
+
 	memset(&req, 0, sizeof(req));
 
 	req.mgmt_class = attr->mgmt_class;
@@ -1162,6 +1201,8 @@ int umad_register2(int port_fd, struct umad_reg_attr *attr, uint32_t *agent_id)
 int umad_unregister(int fd, int agentid)
 {
 	TRACE("fd %d unregistering agent %d", fd, agentid);
+	if (umad_sim_enabled())
+		return 0;
 	return ioctl(fd, IB_USER_MAD_UNREGISTER_AGENT, &agentid);
 }
 
@@ -1274,6 +1315,19 @@ struct umad_device_node *umad_get_ca_device_list(void)
 	size_t d_name_size;
 	int errsv = 0;
 
+	if (umad_sim_enabled()) {
+		d_name_size = sizeof(UMAD_SIM_CA_NAME);
+		head = calloc(1, sizeof(*head) + d_name_size);
+		if (!head) {
+			errno = ENOMEM;
+			return NULL;
+		}
+		ca_name = (char *)(head + 1);
+		memcpy(ca_name, UMAD_SIM_CA_NAME, d_name_size);
+		head->ca_name = ca_name;
+		return head;
+	}
+
 	dir = opendir(SYS_INFINIBAND);
 	if (!dir) {
 		if (errno == ENOENT)
@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "umad_sim.h"
+
+static const char *sim_socket;
+static int sim_checked;
+static uint32_t sim_next_agent;
+
+int umad_sim_enabled(void)
+{
+	if (!sim_checked) {
+		sim_socket = secure_getenv(UMAD_SIM_ENV);
+		if (sim_socket && !*sim_socket)
+			sim_socket = NULL;
+		sim_checked = 1;
+	}
+	return sim_socket != NULL;
+}
+
+static int sim_connect(const struct umad_sim_req *req,
+		       struct umad_sim_ca *reply)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	ssize_t n;
+	int fd;
+
+	if (strlen(sim_socket) >= sizeof(addr.sun_path))
+		return -ENAMETOOLONG;
+	strcpy(addr.sun_path, sim_socket);
+
+	fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+		goto err;
+
+	if (write(fd, req, sizeof(*req)) != sizeof(*req))
+		goto err;
+
+	n = read(fd, reply, sizeof(*reply));
+	if (n != sizeof(*reply)) {
+		errno = EPROTO;
+		goto err;
+	}
+
+	if (reply->status < 0) {
+		errno = -reply->status;
+		goto err;
+	}
+
+	return fd;
+
+err:
+	n = errno ? -errno : -EIO;
+	close(fd);
+	return n;
+}
+
+int umad_sim_get_ca(const char *ca_name, umad_ca_t *ca)
+{
+	struct umad_sim_req req = {
+		.magic = UMAD_SIM_MAGIC,
+		.op = UMAD_SIM_GET_CA,
+	};
+	struct umad_sim_ca reply;
+	int fd, i;
+
+	if (ca_name)
+		strncpy(req.ca_name, ca_name, sizeof(req.ca_name) - 1);
+
+	fd = sim_connect(&req, &reply);
+	if (fd < 0)
+		return fd;
+	close(fd);
+
+	memset(ca, 0, sizeof(*ca));
+	memcpy(ca->ca_name, reply.ca_name, sizeof(ca->ca_name) - 1);
+	strcpy(ca->ca_type, "simulated");
+	ca->node_type = reply.node_type;
+	ca->node_guid = reply.node_guid;
+	ca->system_guid = reply.system_guid;
+	ca->numports = reply.numports < UMAD_CA_MAX_PORTS ?
+		       reply.numports : UMAD_CA_MAX_PORTS - 1;
+
+	for (i = 0; i <= ca->numports; i++) {
+		struct umad_sim_port *sp = &reply.ports[i];
+		umad_port_t *port;
+
+		/* ports[0] only exists for switches */
+		if (!sp->port_guid)
+			continue;
+
+		port = calloc(1, sizeof(*port));
+		if (!port)
+			goto err;
+		ca->ports[i] = port;
+
+		port->pkeys = calloc(1, sizeof(*port->pkeys));
+		if (!port->pkeys)
+			goto err;
+		port->pkeys[0] = 0xffff;
+		port->pkeys_size = 1;
+
+		memcpy(port->ca_name, ca->ca_name, sizeof(port->ca_name));
+		port->portnum = i;
+		port->base_lid = sp->base_lid;
+		port->lmc = sp->lmc;
+		port->sm_lid = sp->sm_lid;
+		port->sm_sl = sp->sm_sl;
+		port->state = sp->state;
+		port->phys_state = sp->phys_state;
+		port->rate = sp->rate;
+		port->capmask = sp->capmask;
+		port->gid_prefix = sp->gid_prefix;
+		port->port_guid = sp->port_guid;
+		strcpy(port->link_layer, "InfiniBand");
+	}
+	return 0;
+
+err:
+	umad_release_ca(ca);
+	return -ENOMEM;
+}
+
+int umad_sim_get_port(const char *ca_name, int portnum, umad_port_t *port)
+{
+	umad_ca_t ca;
+	int r;
+
+	r = umad_sim_get_ca(ca_name, &ca);
+	if (r < 0)
+		return r;
+
+	if (portnum < 0 || portnum > ca.numports || !ca.ports[portnum]) {
+		umad_release_ca(&ca);
+		return -ENODEV;
+	}
+
+	/* hand the port, including its pkey table, over to the caller */
+	*port = *ca.ports[portnum];
+	free(ca.ports[portnum]);
+	ca.ports[portnum] = NULL;
+	umad_release_ca(&ca);
+	return 0;
+}
+
+int umad_sim_open_port(const char *ca_name, int portnum)
+{
+	struct umad_sim_req req = {
+		.magic = UMAD_SIM_MAGIC,
+		.op = UMAD_SIM_OPEN_PORT,
+		.portnum = portnum,
+	};
+	struct umad_sim_ca reply;
+	int fd;
+
+	if (ca_name)
+		strncpy(req.ca_name, ca_name, sizeof(req.ca_name) - 1);
+
+	fd = sim_connect(&req, &reply);
+	if (fd < 0)
+		return -EIO;
+
+	/* match the O_NONBLOCK semantics of the umad device */
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+		close(fd);
+		return -EIO;
+	}
+	return fd;
+}
+
+int umad_sim_register(int fd)
+{
+	return __atomic_fetch_add(&sim_next_agent, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Behave like read() on the umad device: a frame which does not fit the
+ * buffer stays queued, only its header is returned and the call fails with
+ * ENOSPC so the caller can retry with a larger buffer.
+ */
+int umad_sim_read(int fd, void *umad, size_t len)
+{
+	struct ib_user_mad *mad = umad;
+	ssize_t n;
+
+	n = recv(fd, umad, len, MSG_PEEK | MSG_TRUNC);
+	if (n < 0)
+		return -1;
+	if (n == 0) {
+		/* the simulator went away */
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	if (n > len) {
+		mad->length = n;
+		errno = ENOSPC;
+		return -1;
+	}
+
+	return recv(fd, umad, len, 0);
+}
+
+/* A simulator that went away must fail the send, not raise SIGPIPE */
+int umad_sim_write(int fd, const void *umad, size_t len)
+{
+	return send(fd, umad, len, MSG_NOSIGNAL);
+}
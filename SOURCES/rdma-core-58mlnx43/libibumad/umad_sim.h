@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2022, NVIDIA CORPORATION & AFFILIATES. All rights reserved.
+ *
+ * This software is available to you under a choice of one of two
+ * licenses.  You may choose to be licensed under the terms of the GNU
+ * General Public License (GPL) Version 2, available from the file
+ * COPYING in the main directory of this source tree, or the
+ * OpenIB.org BSD license below:
+ *
+ *     Redistribution and use in source and binary forms, with or
+ *     without modification, are permitted provided that the following
+ *     conditions are met:
+ *
+ *      - Redistributions of source code must retain the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer.
+ *
+ *      - Redistributions in binary form must reproduce the above
+ *        copyright notice, this list of conditions and the following
+ *        disclaimer in the documentation and/or other materials
+ *        provided with the distribution.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+#ifndef _UMAD_SIM_H
+#define _UMAD_SIM_H
+
+#include <stdint.h>
+#include <linux/types.h>
+#include <infiniband/umad.h>
+
+/*
+ * Simulated fabric backend
+ *
+ * When UMAD_SIM_ENV names a unix socket, umad ports are not opened on
+ * /dev/infiniband/umadN but on a SOCK_SEQPACKET connection to a fabric
+ * simulator listening on that socket.  Each connection starts with a
+ * struct umad_sim_req from the client, answered by a struct umad_sim_ca.
+ * For UMAD_SIM_OPEN_PORT the connection then carries the same
+ * struct ib_user_mad frames that are read from and written to the umad
+ * character device, one frame per packet, in both directions.
+ *
+ * Agent registration is kept local to the client: the simulator only
+ * answers requests and echoes the agent_id of the request in its response.
+ */
+#define UMAD_SIM_ENV		"UMAD_SIM_SOCKET"
+#define UMAD_SIM_MAGIC		0x756d5331	/* "umS1" */
+#define UMAD_SIM_CA_NAME	"sim0"
+
+enum umad_sim_op {
+	UMAD_SIM_GET_CA = 1,
+	UMAD_SIM_OPEN_PORT = 2,
+};
+
+struct umad_sim_req {
+	uint32_t magic;
+	uint32_t op;
+	char ca_name[UMAD_CA_NAME_LEN];
+	uint32_t portnum;
+};
+
+struct umad_sim_port {
+	uint32_t base_lid;
+	uint32_t lmc;
+	uint32_t sm_lid;
+	uint32_t sm_sl;
+	uint32_t state;
+	uint32_t phys_state;
+	uint32_t rate;
+	__be32 capmask;
+	__be64 gid_prefix;
+	__be64 port_guid;
+};
+
+struct umad_sim_ca {
+	int32_t status;		/* 0 or negative errno */
+	char ca_name[UMAD_CA_NAME_LEN];
+	uint32_t node_type;
+	uint32_t numports;
+	__be64 node_guid;
+	__be64 system_guid;
+	struct umad_sim_port ports[UMAD_CA_MAX_PORTS];
+};
+
+int umad_sim_enabled(void);
+int umad_sim_get_ca(const char *ca_name, umad_ca_t *ca);
+int umad_sim_get_port(const char *ca_name, int portnum, umad_port_t *port);
+int umad_sim_open_port(const char *ca_name, int portnum);
+int umad_sim_register(int fd);
+int umad_sim_read(int fd, void *umad, size_t len);
+int umad_sim_write(int fd, const void *umad, size_t len);
+
+#endif /* _UMAD_SIM_H */
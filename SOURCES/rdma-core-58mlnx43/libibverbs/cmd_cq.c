@@ -33,6 +33,21 @@
 #include <infiniband/cmd_write.h>
 #include "ibverbs.h"
 
+static uint32_t create_cq_flags(const struct ibv_cq_init_attr_ex *cq_attr)
+{
+	uint32_t flags = 0;
+
+	if (cq_attr->wc_flags & IBV_WC_EX_WITH_COMPLETION_TIMESTAMP ||
+	    cq_attr->wc_flags & IBV_WC_EX_WITH_COMPLETION_TIMESTAMP_WALLCLOCK)
+		flags |= IB_UVERBS_CQ_FLAGS_TIMESTAMP_COMPLETION;
+
+	if ((cq_attr->comp_mask & IBV_CQ_INIT_ATTR_MASK_FLAGS) &&
+	    cq_attr->flags & IBV_CREATE_CQ_ATTR_IGNORE_OVERRUN)
+		flags |= IB_UVERBS_CQ_FLAGS_IGNORE_OVERRUN;
+
+	return flags;
+}
+
 static int ibv_icmd_create_cq(struct ibv_context *context, int cqe,
 			      struct ibv_comp_channel *channel, int comp_vector,
 			      uint32_t flags, struct ibv_cq *cq,
@@ -153,26 +168,109 @@ int ibv_cmd_create_cq_ex(struct ibv_context *context,
 	DECLARE_CMD_BUFFER_COMPAT(cmdb, UVERBS_OBJECT_CQ,
 				  UVERBS_METHOD_CQ_CREATE, cmd, cmd_size, resp,
 				  resp_size);
-	uint32_t flags = 0;
 
 	if (!check_comp_mask(cq_attr->comp_mask,
 			     IBV_CQ_INIT_ATTR_MASK_FLAGS |
 			     IBV_CQ_INIT_ATTR_MASK_PD))
 		return EOPNOTSUPP;
 
-	if (cq_attr->wc_flags & IBV_WC_EX_WITH_COMPLETION_TIMESTAMP ||
-	    cq_attr->wc_flags & IBV_WC_EX_WITH_COMPLETION_TIMESTAMP_WALLCLOCK)
-		flags |= IB_UVERBS_CQ_FLAGS_TIMESTAMP_COMPLETION;
-
-	if ((cq_attr->comp_mask & IBV_CQ_INIT_ATTR_MASK_FLAGS) &&
-	    cq_attr->flags & IBV_CREATE_CQ_ATTR_IGNORE_OVERRUN)
-		flags |= IB_UVERBS_CQ_FLAGS_IGNORE_OVERRUN;
-
 	return ibv_icmd_create_cq(context, cq_attr->cqe, cq_attr->channel,
-				  cq_attr->comp_vector, flags,
+				  cq_attr->comp_vector,
+				  create_cq_flags(cq_attr),
 				  &cq->cq, cmdb, cmd_flags);
 }
 
+enum { CREATE_CQ_BATCH_ATTRS = 10 };
+
+static struct ib_uverbs_attr *
+fill_create_cq_batch(struct ibv_command_buffer *cmdb,
+		     struct ibv_context *context,
+		     const struct ibv_cq_init_attr_ex *cq_attr,
+		     struct ibv_cq *cq)
+{
+	struct ib_uverbs_attr *handle;
+	uint32_t flags;
+
+	if (!check_comp_mask(cq_attr->comp_mask,
+			     IBV_CQ_INIT_ATTR_MASK_FLAGS |
+			     IBV_CQ_INIT_ATTR_MASK_PD)) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	cq->context = context;
+
+	handle = fill_attr_out_obj(cmdb, UVERBS_ATTR_CREATE_CQ_HANDLE);
+	fill_attr_out(cmdb, UVERBS_ATTR_CREATE_CQ_RESP_CQE, &cq->cqe,
+		      sizeof(cq->cqe));
+
+	fill_attr_in_uint32(cmdb, UVERBS_ATTR_CREATE_CQ_CQE, cq_attr->cqe);
+	fill_attr_in_uint64(cmdb, UVERBS_ATTR_CREATE_CQ_USER_HANDLE,
+			    (uintptr_t)cq);
+	if (cq_attr->channel)
+		fill_attr_in_fd(cmdb, UVERBS_ATTR_CREATE_CQ_COMP_CHANNEL,
+				cq_attr->channel->fd);
+	fill_attr_in_uint32(cmdb, UVERBS_ATTR_CREATE_CQ_COMP_VECTOR,
+			    cq_attr->comp_vector);
+	fill_attr_in_fd(cmdb, UVERBS_ATTR_CREATE_CQ_EVENT_FD,
+			context->async_fd);
+
+	flags = create_cq_flags(cq_attr);
+	if (flags)
+		fill_attr_in_uint32(cmdb, UVERBS_ATTR_CREATE_CQ_FLAGS, flags);
+
+	return handle;
+}
+
+/*
+ * Create num CQs with as few system calls as possible. udata optionally
+ * points to num driver request/response buffers. Either all CQs are created
+ * or none is.
+ */
+int ibv_cmd_create_cq_batch(struct ibv_context *context,
+			    const struct ibv_cq_init_attr_ex *cq_attrs,
+			    struct verbs_cq **cqs,
+			    const struct ibv_batch_udata *udata,
+			    unsigned int num)
+{
+	struct ibv_command_buffer *cmds, *cmdb;
+	unsigned int i, num_done = 0;
+	int ret;
+
+	if (VERBS_WRITE_ONLY)
+		return EOPNOTSUPP;
+
+	cmds = alloc_command_buffers(UVERBS_OBJECT_CQ, UVERBS_METHOD_CQ_CREATE,
+				     CREATE_CQ_BATCH_ATTRS, num);
+	if (!cmds)
+		return ENOMEM;
+
+	for (i = 0; i != num; i++) {
+		cmdb = command_buffer_at(cmds, CREATE_CQ_BATCH_ATTRS, i);
+		if (!fill_create_cq_batch(cmdb, context, &cq_attrs[i],
+					  &cqs[i]->cq)) {
+			ret = errno;
+			goto out;
+		}
+		if (udata)
+			fill_batch_udata(cmdb, &udata[i]);
+	}
+
+	ret = execute_ioctl_batch(context, cmds, CREATE_CQ_BATCH_ATTRS, num,
+				  &num_done);
+	for (i = 0; i != num_done; i++) {
+		cmdb = command_buffer_at(cmds, CREATE_CQ_BATCH_ATTRS, i);
+		cqs[i]->cq.handle = read_attr_obj(UVERBS_ATTR_CREATE_CQ_HANDLE,
+						  &cmdb->hdr.attrs[0]);
+		if (ret)
+			ibv_cmd_destroy_cq(&cqs[i]->cq);
+	}
+
+out:
+	free(cmds);
+	return ret;
+}
+
 int ibv_cmd_destroy_cq(struct ibv_cq *cq)
 {
 	DECLARE_FBCMD_BUFFER(cmdb, UVERBS_OBJECT_CQ, UVERBS_METHOD_CQ_DESTROY, 2,
@@ -125,10 +125,21 @@ static void finalize_attrs(struct ibv_command_buffer *cmd)
 	}
 }
 
-int execute_ioctl(struct ibv_context *context, struct ibv_command_buffer *cmd)
+static void prepare_hdr(struct ibv_context *context,
+			struct ibv_command_buffer *cmd)
 {
 	struct verbs_context *vctx = verbs_get_ctx(context);
 
+	prepare_attrs(cmd);
+	cmd->hdr.length = sizeof(cmd->hdr) +
+		sizeof(cmd->hdr.attrs[0]) * cmd->hdr.num_attrs;
+	cmd->hdr.reserved1 = 0;
+	cmd->hdr.reserved2 = 0;
+	cmd->hdr.driver_id = vctx->priv->driver_id;
+}
+
+int execute_ioctl(struct ibv_context *context, struct ibv_command_buffer *cmd)
+{
 	/*
 	 * One of the fill functions was given input that cannot be marshaled
 	 */
@@ -137,12 +148,7 @@ int execute_ioctl(struct ibv_context *context, struct ibv_command_buffer *cmd)
 		return errno;
 	}
 
-	prepare_attrs(cmd);
-	cmd->hdr.length = sizeof(cmd->hdr) +
-		sizeof(cmd->hdr.attrs[0]) * cmd->hdr.num_attrs;
-	cmd->hdr.reserved1 = 0;
-	cmd->hdr.reserved2 = 0;
-	cmd->hdr.driver_id = vctx->priv->driver_id;
+	prepare_hdr(context, cmd);
 
 	if (ioctl(context->cmd_fd, RDMA_VERBS_IOCTL, &cmd->hdr))
 		return errno;
@@ -152,6 +158,105 @@ int execute_ioctl(struct ibv_context *context, struct ibv_command_buffer *cmd)
 	return 0;
 }
 
+/* Commands are packed into chunks of this size, each is one system call */
+#define IOCTL_BATCH_LEN (256 * 1024)
+
+/*
+ * Execute an array of command buffers built by alloc_command_buffers(), in
+ * order, stopping at the first failure. *num_done returns the number of
+ * commands that succeeded. Kernels without RDMA_VERBS_IOCTL_BATCH get one
+ * ioctl per command.
+ */
+int execute_ioctl_batch(struct ibv_context *context,
+			struct ibv_command_buffer *cmds, size_t num_attrs,
+			unsigned int num_cmds, unsigned int *num_done)
+{
+	struct ib_uverbs_ioctl_batch batch;
+	struct ibv_command_buffer *cmd;
+	unsigned int first, last, i;
+	uint8_t *buf, *pos;
+	int ret = 0;
+
+	*num_done = 0;
+	for (i = 0; i != num_cmds; i++) {
+		cmd = command_buffer_at(cmds, num_attrs, i);
+		if (unlikely(cmd->buffer_error)) {
+			errno = EINVAL;
+			return errno;
+		}
+		prepare_hdr(context, cmd);
+	}
+
+	buf = malloc(IOCTL_BATCH_LEN);
+	if (!buf) {
+		errno = ENOMEM;
+		return errno;
+	}
+
+	for (first = 0; first != num_cmds && !ret; first = last) {
+		/* hdr.length is 16 bits so every chunk holds one command */
+		pos = buf;
+		for (last = first; last != num_cmds; last++) {
+			cmd = command_buffer_at(cmds, num_attrs, last);
+			if (pos + cmd->hdr.length > buf + IOCTL_BATCH_LEN)
+				break;
+			memcpy(pos, &cmd->hdr, cmd->hdr.length);
+			pos += cmd->hdr.length;
+		}
+
+		batch = (struct ib_uverbs_ioctl_batch){
+			.cmds = ioctl_ptr_to_u64(buf),
+			.length = pos - buf,
+		};
+		if (ioctl(context->cmd_fd, RDMA_VERBS_IOCTL_BATCH, &batch))
+			ret = errno;
+
+		if (ret == ENOTTY) {
+			ret = 0;
+			for (i = first; i != num_cmds && !ret; i++) {
+				cmd = command_buffer_at(cmds, num_attrs, i);
+				if (ioctl(context->cmd_fd, RDMA_VERBS_IOCTL,
+					  &cmd->hdr)) {
+					ret = errno;
+					break;
+				}
+				finalize_attrs(cmd);
+				(*num_done)++;
+			}
+			break;
+		}
+
+		/* The kernel wrote the outputs into the packed copy */
+		pos = buf;
+		for (i = first; i != first + batch.num_done; i++) {
+			cmd = command_buffer_at(cmds, num_attrs, i);
+			memcpy(&cmd->hdr, pos, cmd->hdr.length);
+			pos += cmd->hdr.length;
+			finalize_attrs(cmd);
+		}
+		*num_done += batch.num_done;
+	}
+
+	free(buf);
+
+	/* The kernel supports the ioctl but not this method */
+	if (ret == EPROTONOSUPPORT && !*num_done)
+		ret = EOPNOTSUPP;
+	return ret;
+}
+
+/* Attach the driver specific request and response to a batched command */
+void fill_batch_udata(struct ibv_command_buffer *cmd,
+		      const struct ibv_batch_udata *udata)
+{
+	if (udata->req_size)
+		fill_attr_in(cmd, UVERBS_ATTR_UHW_IN, udata->req,
+			     udata->req_size);
+	if (udata->resp_size)
+		fill_attr_out(cmd, UVERBS_ATTR_UHW_OUT, udata->resp,
+			      udata->resp_size);
+}
+
 /*
  * The compat scheme for UHW IN requires a pointer in .data, however the
  * kernel protocol requires pointers < 8 to be inlined into .data. We defer
@@ -36,6 +36,7 @@
 #include <config.h>
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <rdma/rdma_user_ioctl_cmds.h>
 #include <infiniband/verbs.h>
@@ -189,6 +190,42 @@ static inline int _ioctl_init_cmdb(struct ibv_command_buffer *cmd,
 				    NULL)
 
 int execute_ioctl(struct ibv_context *context, struct ibv_command_buffer *cmd);
+int execute_ioctl_batch(struct ibv_context *context,
+			struct ibv_command_buffer *cmds, size_t num_attrs,
+			unsigned int num_cmds, unsigned int *num_done);
+
+/*
+ * Allocate an array of num_cmds command buffers with room for _num_attrs
+ * elements each, for building commands that are run by execute_ioctl_batch()
+ */
+static inline struct ibv_command_buffer *
+alloc_command_buffers(uint16_t object_id, uint16_t method_id,
+		      size_t num_attrs, unsigned int num_cmds)
+{
+	struct ibv_command_buffer *cmds;
+	unsigned int i;
+
+	cmds = calloc((size_t)num_cmds * _IOCTL_NUM_CMDB(num_attrs),
+		      sizeof(*cmds));
+	if (!cmds)
+		return NULL;
+
+	for (i = 0; i != num_cmds; i++)
+		_ioctl_init_cmdb(cmds + i * _IOCTL_NUM_CMDB(num_attrs),
+				 object_id, method_id, num_attrs, NULL);
+	return cmds;
+}
+
+struct ibv_batch_udata;
+void fill_batch_udata(struct ibv_command_buffer *cmd,
+		      const struct ibv_batch_udata *udata);
+
+static inline struct ibv_command_buffer *
+command_buffer_at(struct ibv_command_buffer *cmds, size_t num_attrs,
+		  unsigned int i)
+{
+	return cmds + i * _IOCTL_NUM_CMDB(num_attrs);
+}
 
 static inline struct ib_uverbs_attr *
 _ioctl_next_attr(struct ibv_command_buffer *cmd, uint16_t attr_id)
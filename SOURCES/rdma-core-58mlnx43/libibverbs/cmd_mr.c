@@ -154,3 +154,87 @@ int ibv_cmd_reg_dmabuf_mr(struct ibv_pd *pd, uint64_t offset, size_t length,
 	vmr->mr_type = IBV_MR_TYPE_DMABUF_MR;
 	return 0;
 }
+
+enum { REG_MR_BATCH_ATTRS = 10 };
+
+static struct ib_uverbs_attr *
+fill_reg_mr_batch(struct ibv_command_buffer *cmdb, struct ibv_pd *pd,
+		  const struct ibv_mr_batch_attr *attr, struct ibv_mr *mr)
+{
+	struct ib_uverbs_attr *handle;
+	uint64_t length = attr->length;
+
+	/* See ibv_cmd_reg_mr() for implicit ODP */
+	if (attr->access & IBV_ACCESS_ON_DEMAND && attr->length == SIZE_MAX) {
+		if (attr->addr) {
+			errno = EINVAL;
+			return NULL;
+		}
+		length = UINT64_MAX;
+	}
+
+	handle = fill_attr_out_obj(cmdb, UVERBS_ATTR_REG_MR_HANDLE);
+	fill_attr_out_ptr(cmdb, UVERBS_ATTR_REG_MR_RESP_LKEY, &mr->lkey);
+	fill_attr_out_ptr(cmdb, UVERBS_ATTR_REG_MR_RESP_RKEY, &mr->rkey);
+
+	fill_attr_in_obj(cmdb, UVERBS_ATTR_REG_MR_PD_HANDLE, pd->handle);
+	fill_attr_in_uint64(cmdb, UVERBS_ATTR_REG_MR_ADDR,
+			    (uintptr_t)attr->addr);
+	fill_attr_in_uint64(cmdb, UVERBS_ATTR_REG_MR_LENGTH, length);
+	fill_attr_in_uint64(cmdb, UVERBS_ATTR_REG_MR_IOVA, attr->iova);
+	fill_attr_in_uint32(cmdb, UVERBS_ATTR_REG_MR_ACCESS_FLAGS,
+			    attr->access);
+
+	return handle;
+}
+
+/*
+ * Register num MRs with as few system calls as possible. udata optionally
+ * points to num driver request/response buffers. Either all MRs are
+ * registered or none is.
+ */
+int ibv_cmd_reg_mr_batch(struct ibv_pd *pd,
+			 const struct ibv_mr_batch_attr *attrs,
+			 struct verbs_mr **vmrs,
+			 const struct ibv_batch_udata *udata,
+			 unsigned int num)
+{
+	struct ibv_command_buffer *cmds, *cmdb;
+	unsigned int i, num_done = 0;
+	int ret;
+
+	if (VERBS_WRITE_ONLY)
+		return EOPNOTSUPP;
+
+	cmds = alloc_command_buffers(UVERBS_OBJECT_MR, UVERBS_METHOD_REG_MR,
+				     REG_MR_BATCH_ATTRS, num);
+	if (!cmds)
+		return ENOMEM;
+
+	for (i = 0; i != num; i++) {
+		cmdb = command_buffer_at(cmds, REG_MR_BATCH_ATTRS, i);
+		if (!fill_reg_mr_batch(cmdb, pd, &attrs[i], &vmrs[i]->ibv_mr)) {
+			ret = errno;
+			goto out;
+		}
+		if (udata)
+			fill_batch_udata(cmdb, &udata[i]);
+	}
+
+	ret = execute_ioctl_batch(pd->context, cmds, REG_MR_BATCH_ATTRS, num,
+				  &num_done);
+	for (i = 0; i != num_done; i++) {
+		cmdb = command_buffer_at(cmds, REG_MR_BATCH_ATTRS, i);
+		vmrs[i]->ibv_mr.handle = read_attr_obj(UVERBS_ATTR_REG_MR_HANDLE,
+						       &cmdb->hdr.attrs[0]);
+		vmrs[i]->ibv_mr.context = pd->context;
+		vmrs[i]->mr_type = IBV_MR_TYPE_MR;
+		vmrs[i]->access = attrs[i].access;
+		if (ret)
+			ibv_cmd_dereg_mr(vmrs[i]);
+	}
+
+out:
+	free(cmds);
+	return ret;
+}
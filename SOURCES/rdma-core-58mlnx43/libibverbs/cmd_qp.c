@@ -446,6 +446,144 @@ int ibv_cmd_create_qp_ex2(struct ibv_context *context,
 	return ibv_icmd_create_qp(context, qp, NULL, attr_ex, cmdb);
 }
 
+enum { CREATE_QP_BATCH_ATTRS = 15 };
+
+/*
+ * Only the QP types that take a PD and CQs are batched, the callers create
+ * XRC receive and RSS QPs one by one.
+ */
+static struct ib_uverbs_attr *
+fill_create_qp_batch(struct ibv_command_buffer *cmdb,
+		     struct ibv_context *context,
+		     struct ibv_qp_init_attr_ex *attr_ex, struct ibv_qp *qp)
+{
+	struct ib_uverbs_attr *handle;
+	uint32_t create_flags = 0;
+
+	switch (attr_ex->qp_type) {
+	case IBV_QPT_RC:
+	case IBV_QPT_UD:
+	case IBV_QPT_UC:
+	case IBV_QPT_RAW_PACKET:
+	case IBV_QPT_DRIVER:
+		break;
+	default:
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	if (!check_comp_mask(attr_ex->comp_mask,
+			     IBV_QP_INIT_ATTR_PD |
+			     IBV_QP_INIT_ATTR_CREATE_FLAGS |
+			     IBV_QP_INIT_ATTR_SEND_OPS_FLAGS)) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	if (!(attr_ex->comp_mask & IBV_QP_INIT_ATTR_PD)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	qp->context = context;
+
+	handle = fill_attr_out_obj(cmdb, UVERBS_ATTR_CREATE_QP_HANDLE);
+	fill_attr_in_obj(cmdb, UVERBS_ATTR_CREATE_QP_PD_HANDLE,
+			 attr_ex->pd->handle);
+	fill_attr_in_obj(cmdb, UVERBS_ATTR_CREATE_QP_SEND_CQ_HANDLE,
+			 attr_ex->send_cq->handle);
+	fill_attr_in_obj(cmdb, UVERBS_ATTR_CREATE_QP_RECV_CQ_HANDLE,
+			 attr_ex->recv_cq->handle);
+	fill_attr_const_in(cmdb, UVERBS_ATTR_CREATE_QP_TYPE, attr_ex->qp_type);
+	fill_attr_in_uint64(cmdb, UVERBS_ATTR_CREATE_QP_USER_HANDLE,
+			    (uintptr_t)qp);
+	fill_attr_in_ptr(cmdb, UVERBS_ATTR_CREATE_QP_CAP, &attr_ex->cap);
+	fill_attr_in_fd(cmdb, UVERBS_ATTR_CREATE_QP_EVENT_FD,
+			context->async_fd);
+
+	if (attr_ex->sq_sig_all)
+		create_flags |= IB_UVERBS_QP_CREATE_SQ_SIG_ALL;
+
+	if (attr_ex->comp_mask & IBV_QP_INIT_ATTR_CREATE_FLAGS) {
+		if (attr_ex->create_flags & ~CREATE_QP_EX_SUP_CREATE_FLAGS) {
+			errno = EINVAL;
+			return NULL;
+		}
+
+		create_flags |= attr_ex->create_flags;
+		if (attr_ex->create_flags & IBV_QP_CREATE_SOURCE_QPN) {
+			fill_attr_in_uint32(cmdb,
+					    UVERBS_ATTR_CREATE_QP_SOURCE_QPN,
+					    attr_ex->source_qpn);
+			create_flags &= ~IBV_QP_CREATE_SOURCE_QPN;
+		}
+	}
+
+	if (create_flags)
+		fill_attr_in_uint32(cmdb, UVERBS_ATTR_CREATE_QP_FLAGS,
+				    create_flags);
+
+	if (attr_ex->srq)
+		fill_attr_in_obj(cmdb, UVERBS_ATTR_CREATE_QP_SRQ_HANDLE,
+				 attr_ex->srq->handle);
+
+	fill_attr_out_ptr(cmdb, UVERBS_ATTR_CREATE_QP_RESP_CAP, &attr_ex->cap);
+	fill_attr_out_ptr(cmdb, UVERBS_ATTR_CREATE_QP_RESP_QP_NUM,
+			  &qp->qp_num);
+
+	return handle;
+}
+
+/*
+ * Create num QPs with as few system calls as possible. udata optionally
+ * points to num driver request/response buffers. Either all QPs are created
+ * or none is.
+ */
+int ibv_cmd_create_qp_batch(struct ibv_context *context,
+			    struct ibv_qp_init_attr_ex *attrs_ex,
+			    struct verbs_qp **qps,
+			    const struct ibv_batch_udata *udata,
+			    unsigned int num)
+{
+	struct ibv_command_buffer *cmds, *cmdb;
+	unsigned int i, num_done = 0;
+	int ret;
+
+	if (VERBS_WRITE_ONLY)
+		return EOPNOTSUPP;
+
+	cmds = alloc_command_buffers(UVERBS_OBJECT_QP, UVERBS_METHOD_QP_CREATE,
+				     CREATE_QP_BATCH_ATTRS, num);
+	if (!cmds)
+		return ENOMEM;
+
+	for (i = 0; i != num; i++) {
+		cmdb = command_buffer_at(cmds, CREATE_QP_BATCH_ATTRS, i);
+		if (!fill_create_qp_batch(cmdb, context, &attrs_ex[i],
+					  &qps[i]->qp)) {
+			ret = errno;
+			goto out;
+		}
+		if (udata)
+			fill_batch_udata(cmdb, &udata[i]);
+	}
+
+	ret = execute_ioctl_batch(context, cmds, CREATE_QP_BATCH_ATTRS, num,
+				  &num_done);
+	for (i = 0; i != num_done; i++) {
+		cmdb = command_buffer_at(cmds, CREATE_QP_BATCH_ATTRS, i);
+		qps[i]->qp.handle = read_attr_obj(UVERBS_ATTR_CREATE_QP_HANDLE,
+						  &cmdb->hdr.attrs[0]);
+		set_qp(qps[i], NULL, &attrs_ex[i], NULL);
+		if (ret)
+			ibv_cmd_destroy_qp(&qps[i]->qp);
+	}
+
+out:
+	free(cmds);
+	return ret;
+}
+
 int ibv_cmd_destroy_qp(struct ibv_qp *qp)
 {
 	DECLARE_FBCMD_BUFFER(cmdb, UVERBS_OBJECT_QP, UVERBS_METHOD_QP_DESTROY, 2,
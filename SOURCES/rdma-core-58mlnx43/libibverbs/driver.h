@@ -341,6 +341,9 @@ struct verbs_context_ops {
 	struct ibv_cq *(*create_cq)(struct ibv_context *context, int cqe,
 				    struct ibv_comp_channel *channel,
 				    int comp_vector);
+	int (*create_cq_batch)(struct ibv_context *context,
+			       struct ibv_cq_init_attr_ex *cq_attrs,
+			       struct ibv_cq_ex **cqs, unsigned int num);
 	struct ibv_cq_ex *(*create_cq_ex)(
 		struct ibv_context *context,
 		struct ibv_cq_init_attr_ex *init_attr);
@@ -350,6 +353,9 @@ struct verbs_context_ops {
 							  struct ibv_flow_action_esp_attr *attr);
 	struct ibv_qp *(*create_qp)(struct ibv_pd *pd,
 				    struct ibv_qp_init_attr *attr);
+	int (*create_qp_batch)(struct ibv_context *context,
+			       struct ibv_qp_init_attr_ex *qp_attrs,
+			       struct ibv_qp **qps, unsigned int num);
 	struct ibv_qp *(*create_qp_ex)(
 		struct ibv_context *context,
 		struct ibv_qp_init_attr_ex *qp_init_attr_ex);
@@ -437,6 +443,9 @@ struct verbs_context_ops {
 					int fd, int access);
 	struct ibv_mr *(*reg_mr)(struct ibv_pd *pd, void *addr, size_t length,
 				 uint64_t hca_va, int access);
+	int (*reg_mr_batch)(struct ibv_pd *pd,
+			    const struct ibv_mr_batch_attr *attrs,
+			    struct ibv_mr **mrs, unsigned int num);
 	int (*req_notify_cq)(struct ibv_cq *cq, int solicited_only);
 	int (*rereg_mr)(struct verbs_mr *vmr, int flags, struct ibv_pd *pd,
 			void *addr, size_t length, int access);
@@ -557,6 +566,20 @@ int ibv_cmd_advise_mr(struct ibv_pd *pd,
 int ibv_cmd_reg_dmabuf_mr(struct ibv_pd *pd, uint64_t offset, size_t length,
 			  uint64_t iova, int fd, int access,
 			  struct verbs_mr *vmr);
+
+/* Driver request and response of one object created by a batch command */
+struct ibv_batch_udata {
+	const void *req;
+	size_t req_size;
+	void *resp;
+	size_t resp_size;
+};
+
+int ibv_cmd_reg_mr_batch(struct ibv_pd *pd,
+			 const struct ibv_mr_batch_attr *attrs,
+			 struct verbs_mr **vmrs,
+			 const struct ibv_batch_udata *udata,
+			 unsigned int num);
 int ibv_cmd_alloc_mw(struct ibv_pd *pd, enum ibv_mw_type type,
 		     struct ibv_mw *mw, struct ibv_alloc_mw *cmd,
 		     size_t cmd_size,
@@ -575,6 +598,11 @@ int ibv_cmd_create_cq_ex(struct ibv_context *context,
 			 struct ib_uverbs_ex_create_cq_resp *resp,
 			 size_t resp_size,
 			 uint32_t cmd_flags);
+int ibv_cmd_create_cq_batch(struct ibv_context *context,
+			    const struct ibv_cq_init_attr_ex *cq_attrs,
+			    struct verbs_cq **cqs,
+			    const struct ibv_batch_udata *udata,
+			    unsigned int num);
 int ibv_cmd_poll_cq(struct ibv_cq *cq, int ne, struct ibv_wc *wc);
 int ibv_cmd_req_notify_cq(struct ibv_cq *cq, int solicited_only);
 int ibv_cmd_resize_cq(struct ibv_cq *cq, int cqe,
@@ -620,6 +648,11 @@ int ibv_cmd_create_qp_ex2(struct ibv_context *context,
 			  size_t cmd_size,
 			  struct ib_uverbs_ex_create_qp_resp *resp,
 			  size_t resp_size);
+int ibv_cmd_create_qp_batch(struct ibv_context *context,
+			    struct ibv_qp_init_attr_ex *qp_attrs,
+			    struct verbs_qp **qps,
+			    const struct ibv_batch_udata *udata,
+			    unsigned int num);
 int ibv_cmd_open_qp(struct ibv_context *context,
 		    struct verbs_qp *qp,  int vqp_sz,
 		    struct ibv_qp_open_attr *attr,
@@ -137,6 +137,13 @@ static struct ibv_cq *create_cq(struct ibv_context *context, int cqe,
 	return NULL;
 }
 
+static int create_cq_batch(struct ibv_context *context,
+			   struct ibv_cq_init_attr_ex *cq_attrs,
+			   struct ibv_cq_ex **cqs, unsigned int num)
+{
+	return EOPNOTSUPP;
+}
+
 static struct ibv_cq_ex *create_cq_ex(struct ibv_context *context,
 				      struct ibv_cq_init_attr_ex *init_attr)
 {
@@ -165,6 +172,13 @@ static struct ibv_qp *create_qp(struct ibv_pd *pd,
 	return NULL;
 }
 
+static int create_qp_batch(struct ibv_context *context,
+			   struct ibv_qp_init_attr_ex *qp_attrs,
+			   struct ibv_qp **qps, unsigned int num)
+{
+	return EOPNOTSUPP;
+}
+
 static struct ibv_qp *create_qp_ex(struct ibv_context *context,
 				   struct ibv_qp_init_attr_ex *qp_init_attr_ex)
 {
@@ -449,6 +463,13 @@ static struct ibv_mr *reg_mr(struct ibv_pd *pd, void *addr, size_t length,
 	return NULL;
 }
 
+static int reg_mr_batch(struct ibv_pd *pd,
+			const struct ibv_mr_batch_attr *attrs,
+			struct ibv_mr **mrs, unsigned int num)
+{
+	return EOPNOTSUPP;
+}
+
 static struct ibv_mr *reg_dmabuf_mr(struct ibv_pd *pd, uint64_t offset,
 				    size_t length, uint64_t iova,
 				    int fd, int access)
@@ -519,10 +540,12 @@ const struct verbs_context_ops verbs_dummy_ops = {
 	create_ah,
 	create_counters,
 	create_cq,
+	create_cq_batch,
 	create_cq_ex,
 	create_flow,
 	create_flow_action_esp,
 	create_qp,
+	create_qp_batch,
 	create_qp_ex,
 	create_rwq_ind_table,
 	create_srq,
@@ -572,6 +595,7 @@ const struct verbs_context_ops verbs_dummy_ops = {
 	reg_dm_mr,
 	reg_dmabuf_mr,
 	reg_mr,
+	reg_mr_batch,
 	req_notify_cq,
 	rereg_mr,
 	resize_cq,
@@ -644,10 +668,12 @@ void verbs_set_ops(struct verbs_context *vctx,
 	SET_PRIV_OP(ctx, cq_event);
 	SET_PRIV_OP(ctx, create_ah);
 	SET_PRIV_OP(ctx, create_cq);
+	SET_PRIV_OP_IC(vctx, create_cq_batch);
 	SET_PRIV_OP_IC(vctx, create_cq_ex);
 	SET_OP2(vctx, ibv_create_flow, create_flow);
 	SET_OP(vctx, create_flow_action_esp);
 	SET_PRIV_OP(ctx, create_qp);
+	SET_PRIV_OP_IC(vctx, create_qp_batch);
 	SET_OP(vctx, create_qp_ex);
 	SET_OP(vctx, create_rwq_ind_table);
 	SET_PRIV_OP(ctx, create_srq);
@@ -697,6 +723,7 @@ void verbs_set_ops(struct verbs_context *vctx,
 	SET_OP(vctx, reg_dm_mr);
 	SET_PRIV_OP_IC(vctx, reg_dmabuf_mr);
 	SET_PRIV_OP(ctx, reg_mr);
+	SET_PRIV_OP_IC(vctx, reg_mr_batch);
 	SET_OP(ctx, req_notify_cq);
 	SET_PRIV_OP(ctx, rereg_mr);
 	SET_PRIV_OP(ctx, resize_cq);
@@ -0,0 +1,319 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+/*
+ * Compare creating CQs, QPs and MRs one by one with the batch verbs, as an
+ * application does at startup, e.g. on an rxe device:
+ *
+ *   ibv_batch_create_bench -d rxe0 -n 10000
+ */
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <util/compiler.h>
+#include <infiniband/verbs.h>
+
+#define ACCESS (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | \
+		IBV_ACCESS_REMOTE_WRITE)
+
+struct objs {
+	struct ibv_cq_ex **cqs;
+	struct ibv_qp **qps;
+	struct ibv_mr **mrs;
+};
+
+struct times {
+	double cq;
+	double qp;
+	double mr;
+};
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s            compare single and batched object creation\n", argv0);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -d, --ib-dev=<dev>     use IB device <dev> (default first device found)\n");
+	printf("  -n, --num=<num>        number of CQs, QPs and MRs (default 10000)\n");
+	printf("  -h, --help             print a help text and exit\n");
+}
+
+static void destroy_objs(struct objs *objs, unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i != num; i++) {
+		ibv_dereg_mr(objs->mrs[i]);
+		ibv_destroy_qp(objs->qps[i]);
+		ibv_destroy_cq(ibv_cq_ex_to_cq(objs->cqs[i]));
+	}
+}
+
+static int create_single(struct ibv_context *context,
+			 struct ibv_cq_init_attr_ex *cq_attrs,
+			 struct ibv_qp_init_attr_ex *qp_attrs,
+			 struct ibv_mr_batch_attr *mr_attrs,
+			 struct objs *objs, unsigned int num,
+			 struct times *t)
+{
+	unsigned int i;
+	double start;
+
+	start = now_ns();
+	for (i = 0; i != num; i++) {
+		objs->cqs[i] = ibv_create_cq_ex(context, &cq_attrs[i]);
+		if (!objs->cqs[i]) {
+			perror("ibv_create_cq_ex");
+			return 1;
+		}
+	}
+	t->cq = now_ns() - start;
+
+	for (i = 0; i != num; i++) {
+		qp_attrs[i].send_cq = ibv_cq_ex_to_cq(objs->cqs[i]);
+		qp_attrs[i].recv_cq = ibv_cq_ex_to_cq(objs->cqs[i]);
+	}
+
+	start = now_ns();
+	for (i = 0; i != num; i++) {
+		objs->qps[i] = ibv_create_qp_ex(context, &qp_attrs[i]);
+		if (!objs->qps[i]) {
+			perror("ibv_create_qp_ex");
+			return 1;
+		}
+	}
+	t->qp = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i != num; i++) {
+		objs->mrs[i] = ibv_reg_mr_iova2(qp_attrs[0].pd,
+						mr_attrs[i].addr,
+						mr_attrs[i].length,
+						mr_attrs[i].iova,
+						mr_attrs[i].access);
+		if (!objs->mrs[i]) {
+			perror("ibv_reg_mr");
+			return 1;
+		}
+	}
+	t->mr = now_ns() - start;
+
+	return 0;
+}
+
+static int create_batch(struct ibv_context *context,
+			struct ibv_cq_init_attr_ex *cq_attrs,
+			struct ibv_qp_init_attr_ex *qp_attrs,
+			struct ibv_mr_batch_attr *mr_attrs,
+			struct objs *objs, unsigned int num,
+			struct times *t)
+{
+	unsigned int i;
+	double start;
+	int ret;
+
+	start = now_ns();
+	ret = ibv_create_cq_batch(context, cq_attrs, objs->cqs, num);
+	if (ret) {
+		fprintf(stderr, "ibv_create_cq_batch: %s\n", strerror(ret));
+		return 1;
+	}
+	t->cq = now_ns() - start;
+
+	for (i = 0; i != num; i++) {
+		qp_attrs[i].send_cq = ibv_cq_ex_to_cq(objs->cqs[i]);
+		qp_attrs[i].recv_cq = ibv_cq_ex_to_cq(objs->cqs[i]);
+	}
+
+	start = now_ns();
+	ret = ibv_create_qp_batch(context, qp_attrs, objs->qps, num);
+	if (ret) {
+		fprintf(stderr, "ibv_create_qp_batch: %s\n", strerror(ret));
+		return 1;
+	}
+	t->qp = now_ns() - start;
+
+	start = now_ns();
+	ret = ibv_reg_mr_batch(qp_attrs[0].pd, mr_attrs, objs->mrs, num);
+	if (ret) {
+		fprintf(stderr, "ibv_reg_mr_batch: %s\n", strerror(ret));
+		return 1;
+	}
+	t->mr = now_ns() - start;
+
+	return 0;
+}
+
+static void print_times(const char *name, struct times *t, unsigned int num)
+{
+	printf("  %-8s CQ %8.2f us  QP %8.2f us  MR %8.2f us  total %8.1f ms\n",
+	       name, t->cq / num / 1e3, t->qp / num / 1e3, t->mr / num / 1e3,
+	       (t->cq + t->qp + t->mr) / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ibv_qp_init_attr_ex *qp_attrs;
+	struct ibv_cq_init_attr_ex *cq_attrs;
+	struct ibv_mr_batch_attr *mr_attrs;
+	struct times single, batch;
+	struct ibv_device **dev_list;
+	struct ibv_context *context;
+	char *ib_devname = NULL;
+	unsigned int num = 10000;
+	struct objs objs;
+	struct ibv_pd *pd;
+	unsigned int n;
+	size_t page;
+	char *buf;
+	int i = 0;
+
+	while (1) {
+		int ret = 1;
+		int c;
+		static struct option long_options[] = {
+			{ .name = "ib-dev", .has_arg = 1, .val = 'd' },
+			{ .name = "num",    .has_arg = 1, .val = 'n' },
+			{ .name = "help",   .has_arg = 0, .val = 'h' },
+			{}
+		};
+
+		c = getopt_long(argc, argv, "d:n:h", long_options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'd':
+			ib_devname = strdupa(optarg);
+			break;
+		case 'n':
+			num = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			ret = 0;
+			SWITCH_FALLTHROUGH;
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+	if (!num) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	dev_list = ibv_get_device_list(NULL);
+	if (!dev_list) {
+		perror("Failed to get IB devices list");
+		return 1;
+	}
+	if (ib_devname) {
+		for (; dev_list[i]; ++i) {
+			if (!strcmp(ibv_get_device_name(dev_list[i]), ib_devname))
+				break;
+		}
+	}
+	if (!dev_list[i]) {
+		fprintf(stderr, "IB device %s not found\n",
+			ib_devname ? ib_devname : "");
+		return 1;
+	}
+
+	context = ibv_open_device(dev_list[i]);
+	if (!context) {
+		fprintf(stderr, "Couldn't get context for %s\n",
+			ibv_get_device_name(dev_list[i]));
+		return 1;
+	}
+	pd = ibv_alloc_pd(context);
+	if (!pd) {
+		fprintf(stderr, "Couldn't allocate PD\n");
+		return 1;
+	}
+
+	/* One page per MR */
+	page = sysconf(_SC_PAGESIZE);
+	buf = mmap(NULL, page * num, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	cq_attrs = calloc(num, sizeof(*cq_attrs));
+	qp_attrs = calloc(num, sizeof(*qp_attrs));
+	mr_attrs = calloc(num, sizeof(*mr_attrs));
+	objs.cqs = calloc(num, sizeof(*objs.cqs));
+	objs.qps = calloc(num, sizeof(*objs.qps));
+	objs.mrs = calloc(num, sizeof(*objs.mrs));
+	if (!cq_attrs || !qp_attrs || !mr_attrs || !objs.cqs || !objs.qps ||
+	    !objs.mrs) {
+		fprintf(stderr, "Couldn't allocate attributes\n");
+		return 1;
+	}
+
+	for (n = 0; n != num; n++) {
+		cq_attrs[n] = (struct ibv_cq_init_attr_ex){
+			.cqe = 32,
+			.wc_flags = IBV_WC_STANDARD_FLAGS,
+		};
+		qp_attrs[n] = (struct ibv_qp_init_attr_ex){
+			.qp_type = IBV_QPT_RC,
+			.cap = {
+				.max_send_wr = 16,
+				.max_recv_wr = 16,
+				.max_send_sge = 1,
+				.max_recv_sge = 1,
+			},
+			.comp_mask = IBV_QP_INIT_ATTR_PD,
+			.pd = pd,
+		};
+		mr_attrs[n] = (struct ibv_mr_batch_attr){
+			.addr = buf + n * page,
+			.length = page,
+			.iova = (uintptr_t)(buf + n * page),
+			.access = ACCESS,
+		};
+	}
+
+	if (create_single(context, cq_attrs, qp_attrs, mr_attrs, &objs, num,
+			  &single))
+		return 1;
+	destroy_objs(&objs, num);
+
+	if (create_batch(context, cq_attrs, qp_attrs, mr_attrs, &objs, num,
+			 &batch))
+		return 1;
+	destroy_objs(&objs, num);
+
+	printf("%s: %u CQs, QPs and MRs, time per object\n",
+	       ibv_get_device_name(dev_list[i]), num);
+	print_times("single:", &single, num);
+	print_times("batch:", &batch, num);
+
+	free(objs.mrs);
+	free(objs.qps);
+	free(objs.cqs);
+	free(mr_attrs);
+	free(qp_attrs);
+	free(cq_attrs);
+	munmap(buf, page * num);
+	ibv_dealloc_pd(pd);
+	ibv_close_device(context);
+	ibv_free_device_list(dev_list);
+	return 0;
+}
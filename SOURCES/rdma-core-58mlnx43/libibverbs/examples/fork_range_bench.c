@@ -0,0 +1,135 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+/*
+ * Time the fork protection that ibv_reg_mr()/ibv_dereg_mr() apply to every
+ * registered range, for many small buffers.  No device is needed.  Set
+ * RDMAV_HUGEPAGES_SAFE=1 to include the page size lookup.
+ */
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <util/compiler.h>
+#include <infiniband/driver.h>
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s            time ibv_dontfork_range()/ibv_dofork_range()\n", argv0);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -n, --buffers=<num>    number of buffers (default 100000)\n");
+	printf("  -s, --size=<size>      size of each buffer (default 256)\n");
+	printf("  -m, --mappings=<num>   extra mappings to create first (default 0)\n");
+	printf("  -h, --help             print a help text and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nbufs = 100000, nmaps = 0;
+	size_t size = 256, page, stride;
+	double start, dontfork, dofork;
+	unsigned int n;
+	char *buf;
+	int ret;
+
+	while (1) {
+		int c;
+		static struct option long_options[] = {
+			{ .name = "buffers",  .has_arg = 1, .val = 'n' },
+			{ .name = "size",     .has_arg = 1, .val = 's' },
+			{ .name = "mappings", .has_arg = 1, .val = 'm' },
+			{ .name = "help",     .has_arg = 0, .val = 'h' },
+			{}
+		};
+
+		ret = 1;
+		c = getopt_long(argc, argv, "n:s:m:h", long_options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'n':
+			nbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			nmaps = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			ret = 0;
+			SWITCH_FALLTHROUGH;
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+	if (!nbufs || !size) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = ibv_fork_init();
+	if (ret) {
+		fprintf(stderr, "ibv_fork_init failed: %s\n", strerror(ret));
+		return 1;
+	}
+
+	/* Inflate the address space the way a large application would */
+	page = sysconf(_SC_PAGESIZE);
+	for (n = 0; n < nmaps; n++) {
+		void *p = mmap(NULL, page, n & 1 ? PROT_READ : PROT_NONE,
+			       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+		if (p == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+	}
+
+	/* One buffer per page so that ranges are never merged */
+	stride = (size + page - 1) & ~(page - 1);
+	buf = mmap(NULL, stride * nbufs, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	start = now_ns();
+	for (n = 0; n < nbufs; n++) {
+		if (ibv_dontfork_range(buf + n * stride, size)) {
+			perror("ibv_dontfork_range");
+			return 1;
+		}
+	}
+	dontfork = (now_ns() - start) / nbufs;
+
+	start = now_ns();
+	for (n = 0; n < nbufs; n++)
+		ibv_dofork_range(buf + n * stride, size);
+	dofork = (now_ns() - start) / nbufs;
+
+	printf("%u x %zu byte buffers, huge page check %s\n", nbufs, size,
+	       getenv("RDMAV_HUGEPAGES_SAFE") ? "on" : "off");
+	printf("  dontfork: %10.0f ns/range\n", dontfork);
+	printf("  dofork:   %10.0f ns/range\n", dofork);
+
+	munmap(buf, stride * nbufs);
+	return 0;
+}
@@ -0,0 +1,202 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+/*
+ * Compare ibv_reg_mr()/ibv_dereg_mr() with the libibverbs registration
+ * cache for a workload that keeps re-registering buffers out of a fixed
+ * working set, e.g. on an rxe device:
+ *
+ *   ibv_mr_cache_bench -d rxe0 -s 65536 -b 64 -n 100000 -m 2097152
+ */
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+
+#include <util/compiler.h>
+#include <infiniband/verbs.h>
+
+#define ACCESS (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_READ | \
+		IBV_ACCESS_REMOTE_WRITE)
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s            compare plain and cached MR registration\n", argv0);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -d, --ib-dev=<dev>     use IB device <dev> (default first device found)\n");
+	printf("  -s, --size=<size>      size of each buffer (default 65536)\n");
+	printf("  -b, --buffers=<num>    number of buffers in the working set (default 64)\n");
+	printf("  -n, --iters=<num>      number of registrations (default 10000)\n");
+	printf("  -m, --max-size=<size>  cache size limit in bytes, 0 for none (default 0)\n");
+	printf("  -h, --help             print a help text and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct ibv_mr_cache_init_attr attr = {};
+	struct ibv_mr_cache_stats stats;
+	struct ibv_device **dev_list;
+	struct ibv_context *context;
+	struct ibv_mr_cache *cache;
+	char *ib_devname = NULL;
+	unsigned int iters = 10000;
+	unsigned int nbufs = 64;
+	size_t size = 65536;
+	size_t page, stride;
+	struct ibv_pd *pd;
+	struct ibv_mr *mr;
+	double start, plain, cached;
+	unsigned int n;
+	char *buf;
+	int i = 0;
+
+	while (1) {
+		int ret = 1;
+		int c;
+		static struct option long_options[] = {
+			{ .name = "ib-dev",   .has_arg = 1, .val = 'd' },
+			{ .name = "size",     .has_arg = 1, .val = 's' },
+			{ .name = "buffers",  .has_arg = 1, .val = 'b' },
+			{ .name = "iters",    .has_arg = 1, .val = 'n' },
+			{ .name = "max-size", .has_arg = 1, .val = 'm' },
+			{ .name = "help",     .has_arg = 0, .val = 'h' },
+			{}
+		};
+
+		c = getopt_long(argc, argv, "d:s:b:n:m:h", long_options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'd':
+			ib_devname = strdupa(optarg);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			nbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			attr.max_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			ret = 0;
+			SWITCH_FALLTHROUGH;
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+	if (!size || !nbufs || !iters) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	dev_list = ibv_get_device_list(NULL);
+	if (!dev_list) {
+		perror("Failed to get IB devices list");
+		return 1;
+	}
+	if (ib_devname) {
+		for (; dev_list[i]; ++i) {
+			if (!strcmp(ibv_get_device_name(dev_list[i]), ib_devname))
+				break;
+		}
+	}
+	if (!dev_list[i]) {
+		fprintf(stderr, "IB device %s not found\n",
+			ib_devname ? ib_devname : "");
+		return 1;
+	}
+
+	context = ibv_open_device(dev_list[i]);
+	if (!context) {
+		fprintf(stderr, "Couldn't get context for %s\n",
+			ibv_get_device_name(dev_list[i]));
+		return 1;
+	}
+	pd = ibv_alloc_pd(context);
+	if (!pd) {
+		fprintf(stderr, "Couldn't allocate PD\n");
+		return 1;
+	}
+
+	/* Buffers are page aligned and a page apart so they never merge */
+	page = sysconf(_SC_PAGESIZE);
+	size = (size + page - 1) & ~(page - 1);
+	stride = size + page;
+	buf = mmap(NULL, stride * nbufs, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (buf == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	srand(1);
+	start = now_ns();
+	for (n = 0; n < iters; n++) {
+		mr = ibv_reg_mr(pd, buf + (rand() % nbufs) * stride,
+				size, ACCESS);
+		if (!mr) {
+			perror("ibv_reg_mr");
+			return 1;
+		}
+		ibv_dereg_mr(mr);
+	}
+	plain = (now_ns() - start) / iters;
+
+	cache = ibv_mr_cache_create(pd, &attr);
+	if (!cache) {
+		perror("ibv_mr_cache_create");
+		return 1;
+	}
+
+	srand(1);
+	start = now_ns();
+	for (n = 0; n < iters; n++) {
+		mr = ibv_mr_cache_get(cache,
+				      buf + (rand() % nbufs) * stride,
+				      size, ACCESS);
+		if (!mr) {
+			perror("ibv_mr_cache_get");
+			return 1;
+		}
+		ibv_mr_cache_put(cache, mr);
+	}
+	cached = (now_ns() - start) / iters;
+
+	ibv_mr_cache_query_stats(cache, &stats);
+	printf("%s: %u x %zu byte buffers, %u registrations\n",
+	       ibv_get_device_name(dev_list[i]), nbufs, size, iters);
+	printf("  reg/dereg:     %10.0f ns/op\n", plain);
+	printf("  cache get/put: %10.0f ns/op\n", cached);
+	printf("  hits %" PRIu64 " misses %" PRIu64 " evictions %" PRIu64
+	       " cached %" PRIu64 " bytes in %u MRs\n",
+	       stats.hits, stats.misses, stats.evictions, stats.cached_bytes,
+	       stats.num_entries);
+
+	ibv_mr_cache_destroy(cache);
+	munmap(buf, stride * nbufs);
+	ibv_dealloc_pd(pd);
+	ibv_close_device(context);
+	ibv_free_device_list(dev_list);
+	return 0;
+}
@@ -64,61 +64,125 @@ static int page_size;
 static int huge_page_enabled;
 static int too_late;
 
-static unsigned long smaps_page_size(FILE *file)
+/*
+ * Snapshot of the page size backing each mapping of the process, taken from
+ * /proc/self/smaps.  Reading smaps walks the page tables of every mapping,
+ * so it is only read again when a range is not covered by a single mapping
+ * of the snapshot or when madvise() fails with the page size the snapshot
+ * gave.
+ */
+struct ibv_vma {
+	uintptr_t		start, end;
+	unsigned long		page_size;
+};
+
+static struct ibv_vma *vma_index;
+static size_t vma_count;
+static unsigned int vma_gen;
+static pthread_rwlock_t vma_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void vma_index_refresh(void)
 {
-	int n;
-	unsigned long size = page_size;
+	struct ibv_vma *vmas = NULL, *tmp;
+	size_t count = 0, max = 0;
+	uintptr_t range_start, range_end;
+	unsigned long size;
 	char buf[1024];
+	FILE *file;
 
-	while (fgets(buf, sizeof(buf), file) != NULL) {
-		if (!strstr(buf, "KernelPageSize:"))
-			continue;
+	file = fopen("/proc/self/smaps", "r" STREAM_CLOEXEC);
+	if (!file)
+		goto out;
 
-		n = sscanf(buf, "%*s %lu", &size);
-		if (n < 1)
+	while (fgets(buf, sizeof(buf), file) != NULL) {
+		if (sscanf(buf, "%" SCNxPTR "-%" SCNxPTR,
+			   &range_start, &range_end) == 2) {
+			if (count == max) {
+				max = max ? max * 2 : 256;
+				tmp = realloc(vmas, max * sizeof(*vmas));
+				if (!tmp)
+					break;
+				vmas = tmp;
+			}
+			vmas[count].start = range_start;
+			vmas[count].end = range_end;
+			vmas[count].page_size = page_size;
+			count++;
 			continue;
+		}
 
 		/* page size is printed in Kb */
-		size = size * 1024;
-
-		break;
+		if (count && strstr(buf, "KernelPageSize:") &&
+		    sscanf(buf, "%*s %lu", &size) == 1)
+			vmas[count - 1].page_size = size * 1024;
 	}
 
-	return size;
+	fclose(file);
+out:
+	free(vma_index);
+	vma_index = vmas;
+	vma_count = count;
+	vma_gen++;
 }
 
-static unsigned long get_page_size(void *base)
+static const struct ibv_vma *vma_lookup(uintptr_t addr)
 {
-	unsigned long ret = page_size;
-	pid_t pid;
-	FILE *file;
-	char buf[1024];
-
-	pid = getpid();
-	snprintf(buf, sizeof(buf), "/proc/%d/smaps", pid);
-
-	file = fopen(buf, "r" STREAM_CLOEXEC);
-	if (!file)
-		goto out;
+	size_t lo = 0, hi = vma_count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (addr < vma_index[mid].start)
+			hi = mid;
+		else if (addr >= vma_index[mid].end)
+			lo = mid + 1;
+		else
+			return &vma_index[mid];
+	}
+	return NULL;
+}
 
-	while (fgets(buf, sizeof(buf), file) != NULL) {
-		int n;
-		uintptr_t range_start, range_end;
+/* Whether [addr, addr + size) aligned to the page size lies within @vma */
+static bool vma_covers(const struct ibv_vma *vma, uintptr_t addr, size_t size)
+{
+	uintptr_t mask = vma->page_size - 1;
 
-		n = sscanf(buf, "%" SCNxPTR "-%" SCNxPTR, &range_start, &range_end);
+	return (addr & ~mask) >= vma->start &&
+	       ((addr + size + mask) & ~mask) <= vma->end;
+}
 
-		if (n < 2)
-			continue;
+static unsigned long get_page_size(void *base, size_t size, bool refresh)
+{
+	uintptr_t addr = (uintptr_t) base;
+	const struct ibv_vma *vma;
+	unsigned long ret = page_size;
+	unsigned int gen;
+	bool found = false;
 
-		if ((uintptr_t) base >= range_start && (uintptr_t) base < range_end) {
-			ret = smaps_page_size(file);
-			break;
-		}
+	pthread_rwlock_rdlock(&vma_lock);
+	/*
+	 * A range reaching past the mapping it starts in may have been
+	 * remapped since the snapshot, so the snapshot is only trusted when
+	 * it covers the whole range.
+	 */
+	vma = refresh ? NULL : vma_lookup(addr);
+	if (vma && vma_covers(vma, addr, size)) {
+		ret = vma->page_size;
+		found = true;
 	}
+	gen = vma_gen;
+	pthread_rwlock_unlock(&vma_lock);
+	if (found)
+		return ret;
 
-	fclose(file);
+	pthread_rwlock_wrlock(&vma_lock);
+	/* Another thread may have re-read smaps meanwhile */
+	if (gen == vma_gen)
+		vma_index_refresh();
+	vma = vma_lookup(addr);
+	if (vma)
+		ret = vma->page_size;
+	pthread_rwlock_unlock(&vma_lock);
 
-out:
 	return ret;
 }
 
@@ -145,7 +209,7 @@ int ibv_fork_init(void)
 		return ENOMEM;
 
 	if (huge_page_enabled) {
-		size = get_page_size(tmp);
+		size = get_page_size(tmp, page_size, false);
 		tmp_aligned = (void *) ((uintptr_t) tmp & ~(size - 1));
 	} else {
 		size = page_size;
@@ -618,22 +682,14 @@ static int do_madvise(void *addr, size_t length, int advice,
 	return 0;
 }
 
-static int ibv_madvise_range(void *base, size_t size, int advice)
+static int madvise_range(void *base, size_t size, int advice,
+			 unsigned long range_page_size)
 {
 	uintptr_t start, end;
 	struct ibv_mem_node *node, *tmp;
 	int inc;
 	int rolling_back = 0;
 	int ret = 0;
-	unsigned long range_page_size;
-
-	if (!size || !base)
-		return 0;
-
-	if (huge_page_enabled)
-		range_page_size = get_page_size(base);
-	else
-		range_page_size = page_size;
 
 	start = (uintptr_t) base & ~(range_page_size - 1);
 	end   = ((uintptr_t) (base + size + range_page_size - 1) &
@@ -712,6 +768,30 @@ out:
 	return ret;
 }
 
+static int ibv_madvise_range(void *base, size_t size, int advice)
+{
+	unsigned long range_page_size, fresh_page_size;
+	int ret;
+
+	if (!size || !base)
+		return 0;
+
+	if (!huge_page_enabled)
+		return madvise_range(base, size, advice, page_size);
+
+	range_page_size = get_page_size(base, size, false);
+	ret = madvise_range(base, size, advice, range_page_size);
+	if (!ret)
+		return 0;
+
+	/* The range may have been remapped since smaps was last read */
+	fresh_page_size = get_page_size(base, size, true);
+	if (fresh_page_size != range_page_size)
+		ret = madvise_range(base, size, advice, fresh_page_size);
+
+	return ret;
+}
+
 int ibv_dontfork_range(void *base, size_t size)
 {
 	if (mm_root)
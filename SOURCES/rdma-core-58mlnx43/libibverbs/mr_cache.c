@@ -0,0 +1,334 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+
+#include <config.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ccan/list.h>
+#include <ccan/minmax.h>
+#include <util/cl_qmap.h>
+#include <util/util.h>
+
+#include "ibverbs.h"
+
+/*
+ * Registration cache
+ *
+ * Cached MRs are kept in a map keyed by their start address and never
+ * overlap, so the only entry that may cover an address is the one with the
+ * greatest start at or below it.  A miss that overlaps cached entries
+ * registers their union and retires them, which keeps the map disjoint.
+ *
+ * Entries whose refcount dropped to zero sit on an LRU list and are
+ * deregistered when the registered size exceeds max_size.  Retired entries
+ * leave the range map but stay in the MR map until they are released.
+ */
+
+#define MR_CACHE_ACCESS (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE | \
+			 IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC | \
+			 IBV_ACCESS_RELAXED_ORDERING)
+
+struct mr_cache_entry {
+	cl_map_item_t range_item;
+	cl_map_item_t mr_item;
+	/* cache->lru while unused, or a local free list */
+	struct list_node entry;
+	struct ibv_mr *mr;
+	uintptr_t start;
+	uintptr_t end;
+	unsigned int access;
+	unsigned int refcnt;
+	bool cached;
+};
+
+struct ibv_mr_cache {
+	struct ibv_pd *pd;
+	pthread_mutex_t lock;
+	cl_qmap_t ranges;
+	cl_qmap_t mrs;
+	struct list_head lru;
+	size_t max_size;
+	size_t page_size;
+	struct ibv_mr_cache_stats stats;
+};
+
+static struct mr_cache_entry *range_entry(cl_map_item_t *item)
+{
+	return container_of(item, struct mr_cache_entry, range_item);
+}
+
+/* First cached entry that may overlap [start, end) */
+static cl_map_item_t *first_overlap(struct ibv_mr_cache *cache,
+				    uintptr_t start)
+{
+	cl_map_item_t *item = cl_qmap_get_next(&cache->ranges, start);
+	cl_map_item_t *prev = cl_qmap_prev(item);
+
+	if (prev != cl_qmap_end(&cache->ranges) &&
+	    range_entry(prev)->end > start)
+		return prev;
+	return item;
+}
+
+/* Remove an entry from the range map.  Unused ones go on @free_list. */
+static void retire_entry(struct ibv_mr_cache *cache,
+			 struct mr_cache_entry *ent,
+			 struct list_head *free_list)
+{
+	cl_qmap_remove_item(&cache->ranges, &ent->range_item);
+	ent->cached = false;
+	cache->stats.cached_bytes -= ent->end - ent->start;
+	cache->stats.num_entries--;
+
+	if (ent->refcnt)
+		return;
+	list_del(&ent->entry);
+	cl_qmap_remove_item(&cache->mrs, &ent->mr_item);
+	list_add_tail(free_list, &ent->entry);
+}
+
+static void evict_entries(struct ibv_mr_cache *cache,
+			  struct list_head *free_list)
+{
+	struct mr_cache_entry *ent;
+
+	if (!cache->max_size)
+		return;
+
+	while (cache->stats.cached_bytes > cache->max_size) {
+		ent = list_top(&cache->lru, struct mr_cache_entry, entry);
+		if (!ent)
+			break;
+		retire_entry(cache, ent, free_list);
+		cache->stats.evictions++;
+	}
+}
+
+static int free_entries(struct list_head *free_list)
+{
+	struct mr_cache_entry *ent, *tmp;
+	int ret = 0;
+	int err;
+
+	list_for_each_safe(free_list, ent, tmp, entry) {
+		list_del(&ent->entry);
+		err = ibv_dereg_mr(ent->mr);
+		if (err && !ret)
+			ret = err;
+		free(ent);
+	}
+	return ret;
+}
+
+struct ibv_mr_cache *ibv_mr_cache_create(struct ibv_pd *pd,
+					 struct ibv_mr_cache_init_attr *attr)
+{
+	struct ibv_mr_cache *cache;
+
+	if (attr->comp_mask) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	cache = calloc(1, sizeof(*cache));
+	if (!cache) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	cache->pd = pd;
+	cache->max_size = attr->max_size;
+	cache->page_size = sysconf(_SC_PAGESIZE);
+	pthread_mutex_init(&cache->lock, NULL);
+	cl_qmap_init(&cache->ranges);
+	cl_qmap_init(&cache->mrs);
+	list_head_init(&cache->lru);
+	return cache;
+}
+
+int ibv_mr_cache_destroy(struct ibv_mr_cache *cache)
+{
+	LIST_HEAD(free_list);
+	cl_map_item_t *item;
+
+	pthread_mutex_lock(&cache->lock);
+	for (item = cl_qmap_head(&cache->mrs);
+	     item != cl_qmap_end(&cache->mrs); item = cl_qmap_next(item)) {
+		if (container_of(item, struct mr_cache_entry,
+				 mr_item)->refcnt) {
+			pthread_mutex_unlock(&cache->lock);
+			return EBUSY;
+		}
+	}
+
+	while ((item = cl_qmap_head(&cache->ranges)) !=
+	       cl_qmap_end(&cache->ranges))
+		retire_entry(cache, range_entry(item), &free_list);
+	pthread_mutex_unlock(&cache->lock);
+
+	free_entries(&free_list);
+	pthread_mutex_destroy(&cache->lock);
+	free(cache);
+	return 0;
+}
+
+static struct mr_cache_entry *reg_entry(struct ibv_mr_cache *cache,
+					uintptr_t start, uintptr_t end,
+					unsigned int access)
+{
+	struct mr_cache_entry *ent;
+
+	ent = calloc(1, sizeof(*ent));
+	if (!ent) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ent->mr = ibv_reg_mr_iova2(cache->pd, (void *)start, end - start,
+				   start, access);
+	if (!ent->mr) {
+		free(ent);
+		return NULL;
+	}
+	ent->start = start;
+	ent->end = end;
+	ent->access = access;
+	ent->refcnt = 1;
+	cl_qmap_insert(&cache->mrs, (uintptr_t)ent->mr, &ent->mr_item);
+	return ent;
+}
+
+struct ibv_mr *ibv_mr_cache_get(struct ibv_mr_cache *cache, void *addr,
+				size_t length, unsigned int access)
+{
+	uintptr_t start, end, reg_start, reg_end;
+	unsigned int reg_access = access;
+	struct mr_cache_entry *ent;
+	cl_map_item_t *item, *next;
+	LIST_HEAD(free_list);
+
+	if (!length || access & ~MR_CACHE_ACCESS) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	start = align_down((uintptr_t)addr, cache->page_size);
+	end = align((uintptr_t)addr + length, cache->page_size);
+
+	pthread_mutex_lock(&cache->lock);
+	item = first_overlap(cache, start);
+	if (item != cl_qmap_end(&cache->ranges)) {
+		ent = range_entry(item);
+		if (ent->start <= start && ent->end >= end &&
+		    (ent->access & access) == access) {
+			if (!ent->refcnt++)
+				list_del(&ent->entry);
+			cache->stats.hits++;
+			pthread_mutex_unlock(&cache->lock);
+			return ent->mr;
+		}
+	}
+	cache->stats.misses++;
+
+	reg_start = start;
+	reg_end = end;
+	for (next = item; next != cl_qmap_end(&cache->ranges) &&
+	     range_entry(next)->start < end; next = cl_qmap_next(next)) {
+		ent = range_entry(next);
+		reg_start = min(reg_start, ent->start);
+		reg_end = max(reg_end, ent->end);
+		reg_access |= ent->access;
+	}
+
+	ent = reg_entry(cache, reg_start, reg_end, reg_access);
+	if (!ent) {
+		/*
+		 * Part of the merged range may no longer be mapped, hand out
+		 * an MR for just this range and do not cache it.
+		 */
+		if (reg_start != start || reg_end != end ||
+		    reg_access != access)
+			ent = reg_entry(cache, start, end, access);
+		pthread_mutex_unlock(&cache->lock);
+		return ent ? ent->mr : NULL;
+	}
+
+	while (item != cl_qmap_end(&cache->ranges) &&
+	       range_entry(item)->start < end) {
+		next = cl_qmap_next(item);
+		retire_entry(cache, range_entry(item), &free_list);
+		item = next;
+	}
+
+	ent->cached = true;
+	cl_qmap_insert(&cache->ranges, reg_start, &ent->range_item);
+	cache->stats.cached_bytes += reg_end - reg_start;
+	cache->stats.num_entries++;
+	evict_entries(cache, &free_list);
+	pthread_mutex_unlock(&cache->lock);
+
+	free_entries(&free_list);
+	return ent->mr;
+}
+
+int ibv_mr_cache_put(struct ibv_mr_cache *cache, struct ibv_mr *mr)
+{
+	struct mr_cache_entry *ent;
+	cl_map_item_t *item;
+	LIST_HEAD(free_list);
+
+	pthread_mutex_lock(&cache->lock);
+	item = cl_qmap_get(&cache->mrs, (uintptr_t)mr);
+	if (item == cl_qmap_end(&cache->mrs)) {
+		pthread_mutex_unlock(&cache->lock);
+		return EINVAL;
+	}
+
+	ent = container_of(item, struct mr_cache_entry, mr_item);
+	if (!--ent->refcnt) {
+		if (ent->cached) {
+			list_add_tail(&cache->lru, &ent->entry);
+			evict_entries(cache, &free_list);
+		} else {
+			cl_qmap_remove_item(&cache->mrs, &ent->mr_item);
+			list_add_tail(&free_list, &ent->entry);
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	return free_entries(&free_list);
+}
+
+void ibv_mr_cache_invalidate(struct ibv_mr_cache *cache, void *addr,
+			     size_t length)
+{
+	uintptr_t start = (uintptr_t)addr;
+	uintptr_t end = start + length;
+	cl_map_item_t *item, *next;
+	LIST_HEAD(free_list);
+
+	pthread_mutex_lock(&cache->lock);
+	item = first_overlap(cache, start);
+	while (item != cl_qmap_end(&cache->ranges) &&
+	       range_entry(item)->start < end) {
+		next = cl_qmap_next(item);
+		retire_entry(cache, range_entry(item), &free_list);
+		cache->stats.invalidations++;
+		item = next;
+	}
+	pthread_mutex_unlock(&cache->lock);
+
+	free_entries(&free_list);
+}
+
+int ibv_mr_cache_query_stats(struct ibv_mr_cache *cache,
+			     struct ibv_mr_cache_stats *stats)
+{
+	pthread_mutex_lock(&cache->lock);
+	*stats = cache->stats;
+	pthread_mutex_unlock(&cache->lock);
+	return 0;
+}
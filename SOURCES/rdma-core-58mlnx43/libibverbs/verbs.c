@@ -350,6 +350,61 @@ struct ibv_mr *ibv_reg_mr_iova(struct ibv_pd *pd, void *addr, size_t length,
 	return ibv_reg_mr_iova2(pd, addr, length, iova, access);
 }
 
+static void dofork_mr_batch(const struct ibv_mr_batch_attr *attrs,
+			    unsigned int num)
+{
+	unsigned int i;
+
+	for (i = 0; i != num; i++) {
+		if (!(attrs[i].access & IBV_ACCESS_ON_DEMAND))
+			ibv_dofork_range(attrs[i].addr, attrs[i].length);
+	}
+}
+
+int ibv_reg_mr_batch(struct ibv_pd *pd, const struct ibv_mr_batch_attr *attrs,
+		     struct ibv_mr **mrs, unsigned int num)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i != num; i++) {
+		if (!(attrs[i].access & IBV_ACCESS_ON_DEMAND) &&
+		    ibv_dontfork_range(attrs[i].addr, attrs[i].length)) {
+			ret = errno;
+			dofork_mr_batch(attrs, i);
+			return ret;
+		}
+	}
+
+	ret = get_ops(pd->context)->reg_mr_batch(pd, attrs, mrs, num);
+	if (!ret) {
+		for (i = 0; i != num; i++) {
+			mrs[i]->context = pd->context;
+			mrs[i]->pd = pd;
+			mrs[i]->addr = attrs[i].addr;
+			mrs[i]->length = attrs[i].length;
+		}
+		return 0;
+	}
+
+	dofork_mr_batch(attrs, num);
+	if (ret != EOPNOTSUPP)
+		return ret;
+
+	for (i = 0; i != num; i++) {
+		mrs[i] = ibv_reg_mr_iova2(pd, attrs[i].addr, attrs[i].length,
+					  attrs[i].iova, attrs[i].access);
+		if (!mrs[i]) {
+			ret = errno;
+			while (i--)
+				ibv_dereg_mr(mrs[i]);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 struct ibv_pd *ibv_import_pd(struct ibv_context *context,
 			     uint32_t pd_handle)
 {
@@ -557,6 +612,41 @@ LATEST_SYMVER_FUNC(ibv_create_cq, 1_1, "IBVERBS_1.1",
 	return cq;
 }
 
+int ibv_create_cq_batch(struct ibv_context *context,
+			struct ibv_cq_init_attr_ex *cq_attrs,
+			struct ibv_cq_ex **cqs, unsigned int num)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i != num; i++) {
+		if (cq_attrs[i].wc_flags & ~IBV_CREATE_CQ_SUP_WC_FLAGS)
+			return EOPNOTSUPP;
+	}
+
+	ret = get_ops(context)->create_cq_batch(context, cq_attrs, cqs, num);
+	if (ret != EOPNOTSUPP) {
+		for (i = 0; !ret && i != num; i++)
+			verbs_init_cq(ibv_cq_ex_to_cq(cqs[i]), context,
+				      cq_attrs[i].channel,
+				      cq_attrs[i].cq_context);
+		return ret;
+	}
+
+	/* The provider or the kernel cannot batch, create them one by one */
+	for (i = 0; i != num; i++) {
+		cqs[i] = ibv_create_cq_ex(context, &cq_attrs[i]);
+		if (!cqs[i]) {
+			ret = errno;
+			while (i--)
+				ibv_destroy_cq(ibv_cq_ex_to_cq(cqs[i]));
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 LATEST_SYMVER_FUNC(ibv_resize_cq, 1_1, "IBVERBS_1.1",
 		   int,
 		   struct ibv_cq *cq, int cqe)
@@ -665,6 +755,30 @@ LATEST_SYMVER_FUNC(ibv_create_qp, 1_1, "IBVERBS_1.1",
 	return qp;
 }
 
+int ibv_create_qp_batch(struct ibv_context *context,
+			struct ibv_qp_init_attr_ex *qp_attrs,
+			struct ibv_qp **qps, unsigned int num)
+{
+	unsigned int i;
+	int ret;
+
+	ret = get_ops(context)->create_qp_batch(context, qp_attrs, qps, num);
+	if (ret != EOPNOTSUPP)
+		return ret;
+
+	for (i = 0; i != num; i++) {
+		qps[i] = ibv_create_qp_ex(context, &qp_attrs[i]);
+		if (!qps[i]) {
+			ret = errno;
+			while (i--)
+				ibv_destroy_qp(qps[i]);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 struct ibv_qp_ex *ibv_qp_to_qp_ex(struct ibv_qp *qp)
 {
 	struct verbs_qp *vqp = (struct verbs_qp *)qp;
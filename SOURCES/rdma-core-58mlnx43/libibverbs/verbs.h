@@ -2595,6 +2595,78 @@ int ibv_rereg_mr(struct ibv_mr *mr, int flags,
  */
 int ibv_dereg_mr(struct ibv_mr *mr);
 
+struct ibv_mr_cache;
+
+struct ibv_mr_cache_init_attr {
+	uint32_t comp_mask;
+	/* Registered bytes above which unused MRs are evicted, 0 for no limit */
+	size_t max_size;
+};
+
+struct ibv_mr_cache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t invalidations;
+	uint64_t cached_bytes;
+	uint32_t num_entries;
+};
+
+/**
+ * ibv_mr_cache_create - Create a registration cache on a protection domain
+ */
+struct ibv_mr_cache *ibv_mr_cache_create(struct ibv_pd *pd,
+					 struct ibv_mr_cache_init_attr *attr);
+
+/**
+ * ibv_mr_cache_destroy - Deregister all cached MRs and free the cache
+ */
+int ibv_mr_cache_destroy(struct ibv_mr_cache *cache);
+
+/**
+ * ibv_mr_cache_get - Return an MR covering [addr, addr + length)
+ *
+ * The MR is reused from the cache when possible, otherwise a new one is
+ * registered.  Its addr and length may cover more than was requested.
+ */
+struct ibv_mr *ibv_mr_cache_get(struct ibv_mr_cache *cache, void *addr,
+				size_t length, unsigned int access);
+
+/**
+ * ibv_mr_cache_put - Release an MR returned by ibv_mr_cache_get()
+ */
+int ibv_mr_cache_put(struct ibv_mr_cache *cache, struct ibv_mr *mr);
+
+/**
+ * ibv_mr_cache_invalidate - Drop cached MRs overlapping a range
+ *
+ * Must be called before the range is unmapped or remapped.  MRs still
+ * in use are deregistered when they are released.
+ */
+void ibv_mr_cache_invalidate(struct ibv_mr_cache *cache, void *addr,
+			     size_t length);
+
+/**
+ * ibv_mr_cache_query_stats - Read the cache counters
+ */
+int ibv_mr_cache_query_stats(struct ibv_mr_cache *cache,
+			     struct ibv_mr_cache_stats *stats);
+
+struct ibv_mr_batch_attr {
+	void *addr;
+	size_t length;
+	uint64_t iova;
+	unsigned int access;
+};
+
+/**
+ * ibv_reg_mr_batch - Register an array of memory regions
+ *
+ * Either all MRs are registered or none is.  Returns 0 or an errno value.
+ */
+int ibv_reg_mr_batch(struct ibv_pd *pd, const struct ibv_mr_batch_attr *attrs,
+		     struct ibv_mr **mrs, unsigned int num);
+
 /**
  * ibv_alloc_mw - Allocate a memory window
  */
@@ -2814,6 +2886,18 @@ struct ibv_cq_ex *ibv_create_cq_ex(struct ibv_context *context,
 	return vctx->create_cq_ex(context, cq_attr);
 }
 
+/**
+ * ibv_create_cq_batch - Create an array of completion queues
+ * @context - Context the CQs will be attached to
+ * @cq_attrs - Array of num attributes, one per CQ
+ * @cqs - Array of num CQs returned on success
+ *
+ * Either all CQs are created or none is.  Returns 0 or an errno value.
+ */
+int ibv_create_cq_batch(struct ibv_context *context,
+			struct ibv_cq_init_attr_ex *cq_attrs,
+			struct ibv_cq_ex **cqs, unsigned int num);
+
 /**
  * ibv_resize_cq - Modifies the capacity of the CQ.
  * @cq: The CQ to resize.
@@ -3024,6 +3108,18 @@ ibv_create_qp_ex(struct ibv_context *context, struct ibv_qp_init_attr_ex *qp_ini
 	return vctx->create_qp_ex(context, qp_init_attr_ex);
 }
 
+/**
+ * ibv_create_qp_batch - Create an array of queue pairs
+ * @context - Context the QPs will be attached to
+ * @qp_attrs - Array of num attributes, one per QP
+ * @qps - Array of num QPs returned on success
+ *
+ * Either all QPs are created or none is.  Returns 0 or an errno value.
+ */
+int ibv_create_qp_batch(struct ibv_context *context,
+			struct ibv_qp_init_attr_ex *qp_attrs,
+			struct ibv_qp **qps, unsigned int num);
+
 /**
  * ibv_alloc_td - Allocate a thread domain
  */
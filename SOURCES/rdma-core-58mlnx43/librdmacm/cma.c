@@ -60,6 +60,8 @@
 #include <util/util.h>
 #include <util/rdma_nl.h>
 #include <ccan/list.h>
+#include <ccan/array_size.h>
+#include <ccan/minmax.h>
 
 #define CMA_INIT_CMD(req, req_size, op)		\
 do {						\
@@ -77,6 +79,9 @@ do {						\
 
 #define UCMA_INVALID_IB_INDEX -1
 
+/* Keeps the rdma_get_cm_events() response within the 16 bit out size */
+#define UCMA_MAX_GET_EVENTS 32
+
 struct cma_port {
 	uint8_t			link_layer;
 };
@@ -145,6 +150,7 @@ static int abi_ver = -1;
 static char dev_name[64] = "rdma_cm";
 static dev_t dev_cdev;
 int af_ib_support;
+static int get_events_support = 1;
 static struct index_map ucma_idm;
 static fastlock_t idm_lock;
 
@@ -857,6 +863,28 @@ int ucma_addrlen(struct sockaddr *addr)
 	}
 }
 
+static int ucma_copy_addr(struct rdma_cm_id *id,
+			  struct ucma_abi_query_addr_resp *resp)
+{
+	struct cma_id_private *id_priv;
+	int ret;
+
+	id_priv = container_of(id, struct cma_id_private, id);
+	memcpy(&id->route.addr.src_addr, &resp->src_addr, resp->src_size);
+	memcpy(&id->route.addr.dst_addr, &resp->dst_addr, resp->dst_size);
+
+	if (!id_priv->cma_dev && resp->node_guid) {
+		ret = ucma_get_device(id_priv, resp->node_guid,
+				      resp->ibdev_index);
+		if (ret)
+			return ret;
+		id->port_num = resp->port_num;
+		id->route.addr.addr.ibaddr.pkey = resp->pkey;
+	}
+
+	return 0;
+}
+
 static int ucma_query_addr(struct rdma_cm_id *id)
 {
 	struct ucma_abi_query_addr_resp resp;
@@ -881,19 +909,21 @@ static int ucma_query_addr(struct rdma_cm_id *id)
 
 	VALGRIND_MAKE_MEM_DEFINED(&resp, sizeof resp);
 
-	memcpy(&id->route.addr.src_addr, &resp.src_addr, resp.src_size);
-	memcpy(&id->route.addr.dst_addr, &resp.dst_addr, resp.dst_size);
+	return ucma_copy_addr(id, &resp);
+}
 
-	if (!id_priv->cma_dev && resp.node_guid) {
-		ret = ucma_get_device(id_priv, resp.node_guid,
-				      resp.ibdev_index);
-		if (ret)
-			return ret;
-		id->port_num = resp.port_num;
-		id->route.addr.addr.ibaddr.pkey = resp.pkey;
-	}
+static void ucma_copy_gid(struct rdma_cm_id *id,
+			  struct ucma_abi_query_addr_resp *resp)
+{
+	struct sockaddr_ib *sib;
 
-	return 0;
+	sib = (struct sockaddr_ib *) &resp->src_addr;
+	memcpy(id->route.addr.addr.ibaddr.sgid.raw, sib->sib_addr.sib_raw,
+	       sizeof id->route.addr.addr.ibaddr.sgid);
+
+	sib = (struct sockaddr_ib *) &resp->dst_addr;
+	memcpy(id->route.addr.addr.ibaddr.dgid.raw, sib->sib_addr.sib_raw,
+	       sizeof id->route.addr.addr.ibaddr.dgid);
 }
 
 static int ucma_query_gid(struct rdma_cm_id *id)
@@ -901,7 +931,6 @@ static int ucma_query_gid(struct rdma_cm_id *id)
 	struct ucma_abi_query_addr_resp resp;
 	struct ucma_abi_query cmd;
 	struct cma_id_private *id_priv;
-	struct sockaddr_ib *sib;
 	int ret;
 
 	CMA_INIT_CMD_RESP(&cmd, sizeof cmd, QUERY, &resp, sizeof resp);
@@ -915,14 +944,7 @@ static int ucma_query_gid(struct rdma_cm_id *id)
 
 	VALGRIND_MAKE_MEM_DEFINED(&resp, sizeof resp);
 
-	sib = (struct sockaddr_ib *) &resp.src_addr;
-	memcpy(id->route.addr.addr.ibaddr.sgid.raw, sib->sib_addr.sib_raw,
-	       sizeof id->route.addr.addr.ibaddr.sgid);
-
-	sib = (struct sockaddr_ib *) &resp.dst_addr;
-	memcpy(id->route.addr.addr.ibaddr.dgid.raw, sib->sib_addr.sib_raw,
-	       sizeof id->route.addr.addr.ibaddr.dgid);
-
+	ucma_copy_gid(id, &resp);
 	return 0;
 }
 
@@ -956,12 +978,31 @@ static void ucma_convert_path(struct ibv_path_data *path_data,
 	sa_path->preference = (uint8_t) path_data->flags;
 }
 
+static int ucma_copy_paths(struct rdma_cm_id *id,
+			   struct ibv_path_data *path_data, int num_paths)
+{
+	int i;
+
+	if (!num_paths)
+		return 0;
+
+	id->route.path_rec = malloc(sizeof(*id->route.path_rec) * num_paths);
+	if (!id->route.path_rec)
+		return ERR(ENOMEM);
+
+	id->route.num_paths = num_paths;
+	for (i = 0; i < num_paths; i++)
+		ucma_convert_path(&path_data[i], &id->route.path_rec[i]);
+
+	return 0;
+}
+
 static int ucma_query_path(struct rdma_cm_id *id)
 {
 	struct ucma_abi_query_path_resp *resp;
 	struct ucma_abi_query cmd;
 	struct cma_id_private *id_priv;
-	int ret, i, size;
+	int ret, size;
 
 	size = sizeof(*resp) + sizeof(struct ibv_path_data) * 6;
 	resp = alloca(size);
@@ -976,18 +1017,7 @@ static int ucma_query_path(struct rdma_cm_id *id)
 
 	VALGRIND_MAKE_MEM_DEFINED(resp, size);
 
-	if (resp->num_paths) {
-		id->route.path_rec = malloc(sizeof(*id->route.path_rec) *
-					    resp->num_paths);
-		if (!id->route.path_rec)
-			return ERR(ENOMEM);
-
-		id->route.num_paths = resp->num_paths;
-		for (i = 0; i < resp->num_paths; i++)
-			ucma_convert_path(&resp->path_data[i], &id->route.path_rec[i]);
-	}
-
-	return 0;
+	return ucma_copy_paths(id, resp->path_data, resp->num_paths);
 }
 
 static int ucma_query_route(struct rdma_cm_id *id)
@@ -2273,10 +2303,23 @@ static void ucma_process_route_resolved(struct cma_event *evt)
 		evt->event.event = RDMA_CM_EVENT_ROUTE_ERROR;
 }
 
-static int ucma_query_req_info(struct rdma_cm_id *id)
+static int ucma_query_req_info(struct rdma_cm_id *id,
+			       struct ucma_abi_req_info *req_info)
 {
 	int ret;
 
+	/* Reported by the kernel along with the connect request */
+	if (req_info) {
+		ret = ucma_copy_addr(id, &req_info->addr);
+		if (ret)
+			return ret;
+
+		ucma_copy_gid(id, &req_info->gid);
+		return ucma_copy_paths(id, req_info->path_data,
+				       min_t(uint32_t, req_info->num_paths,
+					     ARRAY_SIZE(req_info->path_data)));
+	}
+
 	if (!af_ib_support)
 		return ucma_query_route(id);
 
@@ -2296,7 +2339,8 @@ static int ucma_query_req_info(struct rdma_cm_id *id)
 }
 
 static int ucma_process_conn_req(struct cma_event *evt, uint32_t handle,
-				 struct ucma_abi_ece *ece)
+				 struct ucma_abi_ece *ece,
+				 struct ucma_abi_req_info *req_info)
 {
 	struct cma_id_private *id_priv;
 	int ret;
@@ -2325,7 +2369,7 @@ static int ucma_process_conn_req(struct cma_event *evt, uint32_t handle,
 			goto err2;
 	}
 
-	ret = ucma_query_req_info(&id_priv->id);
+	ret = ucma_query_req_info(&id_priv->id, req_info);
 	if (ret)
 		goto err2;
 
@@ -2476,37 +2520,18 @@ int rdma_establish(struct rdma_cm_id *id)
 						   id));
 }
 
-int rdma_get_cm_event(struct rdma_event_channel *channel,
-		      struct rdma_cm_event **event)
+/*
+ * Fill in evt from a kernel event.  Returns false if the event is consumed
+ * internally and must not be reported to the user.
+ */
+static bool ucma_process_event(struct cma_event *evt,
+			       struct ucma_abi_event_resp *resp,
+			       struct ucma_abi_req_info *req_info)
 {
-	struct ucma_abi_event_resp resp = {};
-	struct ucma_abi_get_event cmd;
-	struct cma_event *evt;
 	int ret;
 
-	ret = ucma_init();
-	if (ret)
-		return ret;
-
-	if (!event)
-		return ERR(EINVAL);
-
-	evt = malloc(sizeof(*evt));
-	if (!evt)
-		return ERR(ENOMEM);
-
-retry:
 	memset(evt, 0, sizeof(*evt));
-	CMA_INIT_CMD_RESP(&cmd, sizeof cmd, GET_EVENT, &resp, sizeof resp);
-	ret = write(channel->fd, &cmd, sizeof cmd);
-	if (ret != sizeof cmd) {
-		free(evt);
-		return (ret >= 0) ? ERR(ENODATA) : -1;
-	}
-
-	VALGRIND_MAKE_MEM_DEFINED(&resp, sizeof resp);
-
-	evt->event.event = resp.event;
+	evt->event.event = resp->event;
 	/*
 	 * We should have a non-zero uid, except for connection requests.
 	 * But a bug in older kernels can report a uid 0.  Work-around this
@@ -2515,24 +2540,24 @@ retry:
 	 * In all other cases, if the uid is 0, we discard the event, like
 	 * the kernel should have done.
 	 */
-	if (resp.uid) {
-		evt->id_priv = (void *) (uintptr_t) resp.uid;
+	if (resp->uid) {
+		evt->id_priv = (void *) (uintptr_t) resp->uid;
 	} else {
-		evt->id_priv = ucma_lookup_id(resp.id);
+		evt->id_priv = ucma_lookup_id(resp->id);
 		if (!evt->id_priv) {
 			syslog(LOG_WARNING, PFX "Warning: discarding unmatched "
 				"event - rdma_destroy_id may hang.\n");
-			goto retry;
+			return false;
 		}
-		if (resp.event != RDMA_CM_EVENT_ESTABLISHED) {
+		if (resp->event != RDMA_CM_EVENT_ESTABLISHED) {
 			ucma_complete_event(evt->id_priv);
-			goto retry;
+			return false;
 		}
 	}
 	evt->event.id = &evt->id_priv->id;
-	evt->event.status = resp.status;
+	evt->event.status = resp->status;
 
-	switch (resp.event) {
+	switch (resp->event) {
 	case RDMA_CM_EVENT_ADDR_RESOLVED:
 		ucma_process_addr_resolved(evt);
 		break;
@@ -2540,25 +2565,25 @@ retry:
 		ucma_process_route_resolved(evt);
 		break;
 	case RDMA_CM_EVENT_CONNECT_REQUEST:
-		evt->id_priv = (void *) (uintptr_t) resp.uid;
+		evt->id_priv = (void *) (uintptr_t) resp->uid;
 		if (ucma_is_ud_qp(evt->id_priv->id.qp_type))
-			ucma_copy_ud_event(evt, &resp.param.ud);
+			ucma_copy_ud_event(evt, &resp->param.ud);
 		else
-			ucma_copy_conn_event(evt, &resp.param.conn);
+			ucma_copy_conn_event(evt, &resp->param.conn);
 
-		ret = ucma_process_conn_req(evt, resp.id, &resp.ece);
+		ret = ucma_process_conn_req(evt, resp->id, &resp->ece, req_info);
 		if (ret)
-			goto retry;
+			return false;
 		break;
 	case RDMA_CM_EVENT_CONNECT_RESPONSE:
-		ucma_copy_conn_event(evt, &resp.param.conn);
+		ucma_copy_conn_event(evt, &resp->param.conn);
 		if (!evt->id_priv->id.qp) {
 			evt->event.event = RDMA_CM_EVENT_CONNECT_RESPONSE;
-			evt->id_priv->remote_ece.vendor_id = resp.ece.vendor_id;
-			evt->id_priv->remote_ece.options = resp.ece.attr_mod;
+			evt->id_priv->remote_ece.vendor_id = resp->ece.vendor_id;
+			evt->id_priv->remote_ece.options = resp->ece.attr_mod;
 		} else {
 			evt->event.status = ucma_process_conn_resp_ece(
-				evt->id_priv, &resp.ece);
+				evt->id_priv, &resp->ece);
 			if (!evt->event.status)
 				evt->event.event = RDMA_CM_EVENT_ESTABLISHED;
 			else {
@@ -2569,58 +2594,170 @@ retry:
 		break;
 	case RDMA_CM_EVENT_ESTABLISHED:
 		if (ucma_is_ud_qp(evt->id_priv->id.qp_type)) {
-			ucma_copy_ud_event(evt, &resp.param.ud);
+			ucma_copy_ud_event(evt, &resp->param.ud);
 			break;
 		}
 
-		ucma_copy_conn_event(evt, &resp.param.conn);
+		ucma_copy_conn_event(evt, &resp->param.conn);
 		break;
 	case RDMA_CM_EVENT_REJECTED:
 		if (evt->id_priv->connect_error) {
 			ucma_complete_event(evt->id_priv);
-			goto retry;
+			return false;
 		}
-		ucma_copy_conn_event(evt, &resp.param.conn);
+		ucma_copy_conn_event(evt, &resp->param.conn);
 		ucma_modify_qp_err(evt->event.id);
 		break;
 	case RDMA_CM_EVENT_DISCONNECTED:
 		if (evt->id_priv->connect_error) {
 			ucma_complete_event(evt->id_priv);
-			goto retry;
+			return false;
 		}
-		ucma_copy_conn_event(evt, &resp.param.conn);
+		ucma_copy_conn_event(evt, &resp->param.conn);
 		break;
 	case RDMA_CM_EVENT_MULTICAST_JOIN:
-		evt->mc = (void *) (uintptr_t) resp.uid;
+		evt->mc = (void *) (uintptr_t) resp->uid;
 		evt->id_priv = evt->mc->id_priv;
 		evt->event.id = &evt->id_priv->id;
-		ucma_copy_ud_event(evt, &resp.param.ud);
+		ucma_copy_ud_event(evt, &resp->param.ud);
 		evt->event.param.ud.private_data = evt->mc->context;
 		evt->event.status = ucma_process_join(evt);
 		if (evt->event.status)
 			evt->event.event = RDMA_CM_EVENT_MULTICAST_ERROR;
 		break;
 	case RDMA_CM_EVENT_MULTICAST_ERROR:
-		evt->mc = (void *) (uintptr_t) resp.uid;
+		evt->mc = (void *) (uintptr_t) resp->uid;
 		evt->id_priv = evt->mc->id_priv;
 		evt->event.id = &evt->id_priv->id;
 		evt->event.param.ud.private_data = evt->mc->context;
 		break;
 	default:
-		evt->id_priv = (void *) (uintptr_t) resp.uid;
+		evt->id_priv = (void *) (uintptr_t) resp->uid;
 		evt->event.id = &evt->id_priv->id;
-		evt->event.status = resp.status;
+		evt->event.status = resp->status;
 		if (ucma_is_ud_qp(evt->id_priv->id.qp_type))
-			ucma_copy_ud_event(evt, &resp.param.ud);
+			ucma_copy_ud_event(evt, &resp->param.ud);
 		else
-			ucma_copy_conn_event(evt, &resp.param.conn);
+			ucma_copy_conn_event(evt, &resp->param.conn);
 		break;
 	}
 
+	return true;
+}
+
+int rdma_get_cm_event(struct rdma_event_channel *channel,
+		      struct rdma_cm_event **event)
+{
+	struct ucma_abi_event_resp resp = {};
+	struct ucma_abi_get_event cmd;
+	struct cma_event *evt;
+	int ret;
+
+	ret = ucma_init();
+	if (ret)
+		return ret;
+
+	if (!event)
+		return ERR(EINVAL);
+
+	evt = malloc(sizeof(*evt));
+	if (!evt)
+		return ERR(ENOMEM);
+
+	do {
+		CMA_INIT_CMD_RESP(&cmd, sizeof cmd, GET_EVENT, &resp,
+				  sizeof resp);
+		ret = write(channel->fd, &cmd, sizeof cmd);
+		if (ret != sizeof cmd) {
+			free(evt);
+			return (ret >= 0) ? ERR(ENODATA) : -1;
+		}
+
+		VALGRIND_MAKE_MEM_DEFINED(&resp, sizeof resp);
+	} while (!ucma_process_event(evt, &resp, NULL));
+
 	*event = &evt->event;
 	return 0;
 }
 
+int rdma_get_cm_events(struct rdma_event_channel *channel,
+		       struct rdma_cm_event **events, int max_events)
+{
+	struct ucma_abi_get_events_resp *resp;
+	struct ucma_abi_get_events cmd;
+	struct ucma_abi_event_ex *kevt;
+	struct cma_event *evt[UCMA_MAX_GET_EVENTS];
+	int ret, i, n = 0;
+	size_t size;
+
+	ret = ucma_init();
+	if (ret)
+		return ret;
+
+	if (!events || max_events <= 0)
+		return ERR(EINVAL);
+
+	if (!get_events_support) {
+fallback:
+		ret = rdma_get_cm_event(channel, &events[0]);
+		return ret ? ret : 1;
+	}
+
+	max_events = min(max_events, UCMA_MAX_GET_EVENTS);
+	size = sizeof(*resp) + sizeof(resp->events[0]) * max_events;
+	resp = malloc(size);
+	if (!resp)
+		return ERR(ENOMEM);
+
+	/* Events are gone from the kernel once read, allocate them up front */
+	for (i = 0; i < max_events; i++) {
+		evt[i] = malloc(sizeof(*evt[i]));
+		if (!evt[i]) {
+			max_events = i;
+			break;
+		}
+	}
+	if (!max_events) {
+		free(resp);
+		return ERR(ENOMEM);
+	}
+
+	while (!n) {
+		CMA_INIT_CMD_RESP(&cmd, sizeof cmd, GET_EVENTS, resp, size);
+		cmd.max_events = max_events;
+		ret = write(channel->fd, &cmd, sizeof cmd);
+		if (ret != sizeof cmd) {
+			if (ret < 0 && (errno == EINVAL || errno == ENOSYS)) {
+				/* The kernel does not know the command */
+				get_events_support = 0;
+				for (i = 0; i < max_events; i++)
+					free(evt[i]);
+				free(resp);
+				goto fallback;
+			}
+			n = (ret >= 0) ? ERR(ENODATA) : -1;
+			break;
+		}
+
+		VALGRIND_MAKE_MEM_DEFINED(resp, size);
+
+		for (i = 0; i < resp->num_events; i++) {
+			kevt = &resp->events[i];
+			if (!ucma_process_event(evt[n], &kevt->event,
+						kevt->flags & UCMA_EVENT_F_REQ_INFO ?
+						&kevt->req_info : NULL))
+				continue;
+			events[n] = &evt[n]->event;
+			n++;
+		}
+	}
+
+	for (i = max(n, 0); i < max_events; i++)
+		free(evt[i]);
+	free(resp);
+	return n;
+}
+
 const char *rdma_event_str(enum rdma_cm_event_type event)
 {
 	switch (event) {
@@ -0,0 +1,185 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rdma/rdma_cma.h>
+#include "cma.h"
+
+/*
+ * Bulk connection establishment
+ *
+ * Every connection walks resolve address -> resolve route -> create QP and
+ * connect -> established, driven by events read from a private channel.
+ * Up to max_pending connections are in flight at any time, so address
+ * resolution of later connections overlaps the connect handshakes of
+ * earlier ones, and all events that are pending are read with one call.
+ * Established ids are moved to the caller's channel.
+ */
+
+#define BULK_EVENTS 64
+#define BULK_DEF_TIMEOUT_MS 2000
+
+struct bulk_ctx {
+	struct rdma_event_channel *channel;
+	struct rdma_event_channel *user_channel;
+	struct rdma_connect_bulk_attr *attr;
+	int timeout_ms;
+	int established;
+};
+
+static void bulk_fail(struct rdma_bulk_conn *conn,
+		      enum rdma_cm_event_type event, int status)
+{
+	conn->event = event;
+	conn->status = status;
+	if (conn->id->qp)
+		rdma_destroy_qp(conn->id);
+	rdma_destroy_id(conn->id);
+	conn->id = NULL;
+}
+
+/* Returns 0 if the connection is in flight */
+static int bulk_start(struct bulk_ctx *ctx, struct rdma_bulk_conn *conn)
+{
+	int ret;
+
+	conn->id = NULL;
+	conn->status = -EINPROGRESS;
+	ret = rdma_create_id(ctx->channel, &conn->id, conn, ctx->attr->ps);
+	if (ret) {
+		conn->event = RDMA_CM_EVENT_ADDR_ERROR;
+		conn->status = -errno;
+		return ret;
+	}
+
+	ret = rdma_resolve_addr(conn->id, conn->src_addr, conn->dst_addr,
+				ctx->timeout_ms);
+	if (ret)
+		bulk_fail(conn, RDMA_CM_EVENT_ADDR_ERROR, -errno);
+	return ret;
+}
+
+static int bulk_connect(struct bulk_ctx *ctx, struct rdma_bulk_conn *conn)
+{
+	struct ibv_qp_init_attr qp_attr;
+
+	/* rdma_create_qp() writes the CQs it creates back into the attr */
+	qp_attr = *ctx->attr->qp_init_attr;
+	if (rdma_create_qp(conn->id, ctx->attr->pd, &qp_attr))
+		return -1;
+
+	return rdma_connect(conn->id, ctx->attr->conn_param);
+}
+
+static int bulk_established(struct bulk_ctx *ctx, struct rdma_bulk_conn *conn)
+{
+	if (rdma_migrate_id(conn->id, ctx->user_channel))
+		return -1;
+
+	conn->id->context = conn->context;
+	conn->event = RDMA_CM_EVENT_ESTABLISHED;
+	conn->status = 0;
+	ctx->established++;
+	return 0;
+}
+
+/* Returns 1 once the connection is done, successfully or not */
+static int bulk_process(struct bulk_ctx *ctx, struct rdma_cm_event *event)
+{
+	struct rdma_bulk_conn *conn = event->id->context;
+	enum rdma_cm_event_type type = event->event;
+	int status = event->status;
+
+	/* The event must be acked before the id can be migrated or destroyed */
+	rdma_ack_cm_event(event);
+
+	switch (type) {
+	case RDMA_CM_EVENT_ADDR_RESOLVED:
+		if (!rdma_resolve_route(conn->id, ctx->timeout_ms))
+			return 0;
+		type = RDMA_CM_EVENT_ROUTE_ERROR;
+		break;
+	case RDMA_CM_EVENT_ROUTE_RESOLVED:
+		if (!bulk_connect(ctx, conn))
+			return 0;
+		type = RDMA_CM_EVENT_CONNECT_ERROR;
+		break;
+	case RDMA_CM_EVENT_ESTABLISHED:
+		if (!bulk_established(ctx, conn))
+			return 1;
+		type = RDMA_CM_EVENT_CONNECT_ERROR;
+		break;
+	default:
+		if (!status)
+			status = -ECONNABORTED;
+		bulk_fail(conn, type, status);
+		return 1;
+	}
+
+	bulk_fail(conn, type, -errno);
+	return 1;
+}
+
+int rdma_connect_bulk(struct rdma_event_channel *channel,
+		      struct rdma_bulk_conn *conns, int num_conns,
+		      struct rdma_connect_bulk_attr *attr)
+{
+	struct rdma_cm_event *events[BULK_EVENTS];
+	struct bulk_ctx ctx = {};
+	int next = 0, pending = 0;
+	int max_pending;
+	int i, n;
+
+	if (attr->comp_mask)
+		return ERR(EOPNOTSUPP);
+
+	if (!channel || num_conns < 0 || (num_conns && !conns) ||
+	    !attr->qp_init_attr)
+		return ERR(EINVAL);
+
+	ctx.channel = rdma_create_event_channel();
+	if (!ctx.channel)
+		return -1;
+
+	ctx.user_channel = channel;
+	ctx.attr = attr;
+	ctx.timeout_ms = attr->timeout_ms ? attr->timeout_ms :
+			 BULK_DEF_TIMEOUT_MS;
+	max_pending = attr->max_pending > 0 ? attr->max_pending : num_conns;
+
+	while (next < num_conns || pending) {
+		while (next < num_conns && pending < max_pending) {
+			if (!bulk_start(&ctx, &conns[next]))
+				pending++;
+			next++;
+		}
+		if (!pending)
+			break;
+
+		n = rdma_get_cm_events(ctx.channel, events, BULK_EVENTS);
+		if (n < 0) {
+			n = -errno;
+			for (i = 0; i < next; i++) {
+				if (conns[i].status == -EINPROGRESS)
+					bulk_fail(&conns[i],
+						  RDMA_CM_EVENT_CONNECT_ERROR, n);
+			}
+			for (; i < num_conns; i++) {
+				conns[i].id = NULL;
+				conns[i].event = RDMA_CM_EVENT_CONNECT_ERROR;
+				conns[i].status = n;
+			}
+			break;
+		}
+
+		for (i = 0; i < n; i++)
+			pending -= bulk_process(&ctx, events[i]);
+	}
+
+	rdma_destroy_event_channel(ctx.channel);
+	return ctx.established;
+}
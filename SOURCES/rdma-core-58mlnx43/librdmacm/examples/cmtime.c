@@ -52,6 +52,9 @@ static char *dst_addr;
 static char *src_addr;
 static int timeout = 2000;
 static int retries = 2;
+static int addr_only;
+static int batch = 1;
+static int bulk = -1;
 
 enum step {
 	STEP_CREATE_ID,
@@ -183,11 +186,22 @@ static void show_perf(void)
 	for (i = 0; i < STEP_CNT; i++) {
 		if (i == STEP_BIND && !src_addr)
 			continue;
+		if (zero_time(&times[i][0]))
+			continue;
 
 		us = diff_us(&times[i][1], &times[i][0]);
 		printf("%-13s: %11.2f%11.2f%11.2f%11.2f\n", step_str[i], us / 1000.,
 			max[i] / 1000., min[i], us / connections);
 	}
+	for (i = 0; i < STEP_CNT; i++) {
+		if (i != STEP_RESOLVE_ADDR && i != STEP_CONNECT)
+			continue;
+
+		us = diff_us(&times[i][1], &times[i][0]);
+		if (completed[i] && us > 0)
+			printf("%-13s: %11.0f ops/sec\n", step_str[i],
+			       completed[i] * 1000000. / us);
+	}
 }
 
 static void addr_handler(struct node *n)
@@ -214,7 +228,7 @@ static void disc_handler(struct node *n)
 	completed[STEP_DISCONNECT]++;
 }
 
-static void __req_handler(struct rdma_cm_id *id)
+static int __req_handler(struct rdma_cm_id *id)
 {
 	int ret;
 
@@ -229,26 +243,37 @@ static void __req_handler(struct rdma_cm_id *id)
 		perror("failure accepting");
 		goto err2;
 	}
-	return;
+	return 0;
 err2:
 	rdma_destroy_qp(id);
 err1:
 	printf("failing connection request\n");
 	rdma_reject(id, NULL, 0);
 	rdma_destroy_id(id);
-	return;
+	return ret;
 }
 
 static void *req_handler_thread(void *arg)
 {
+	struct timeval start, end;
 	struct list_head *work;
+	int accepted = 0;
+
 	do {
 		pthread_mutex_lock(&req_work.lock);
 		if (__list_empty(&req_work))
 			pthread_cond_wait(&req_work.cond, &req_work.lock);
 		work = __list_remove_head(&req_work);
 		pthread_mutex_unlock(&req_work.lock);
-		__req_handler(work->id);
+		if (!accepted)
+			gettimeofday(&start, NULL);
+		if (!__req_handler(work->id) && ++accepted == connections) {
+			gettimeofday(&end, NULL);
+			printf("accepted %d connections: %.0f accepts/sec\n",
+			       accepted,
+			       accepted * 1000000. / diff_us(&end, &start));
+			accepted = 0;
+		}
 		free(work);
 	} while (1);
 	return NULL;
@@ -359,6 +384,10 @@ static int alloc_nodes(void)
 	if (!nodes)
 		return -ENOMEM;
 
+	/* rdma_connect_bulk() creates the ids */
+	if (bulk >= 0)
+		return 0;
+
 	printf("creating id\n");
 	start_time(STEP_CREATE_ID);
 	for (i = 0; i < connections; i++) {
@@ -398,18 +427,27 @@ static void cleanup_nodes(void)
 
 static void *process_events(void *arg)
 {
-	struct rdma_cm_event *event;
-	int ret = 0;
+	struct rdma_cm_event **events;
+	int i, ret;
 
-	while (!ret) {
-		ret = rdma_get_cm_event(channel, &event);
-		if (!ret) {
-			cma_handler(event->id, event);
-		} else {
-			perror("failure in rdma_get_cm_event in process_server_events");
-			ret = errno;
-		}
+	events = calloc(batch, sizeof *events);
+	if (!events) {
+		perror("out of memory allocating events");
+		return NULL;
 	}
+
+	do {
+		if (batch > 1)
+			ret = rdma_get_cm_events(channel, events, batch);
+		else
+			ret = rdma_get_cm_event(channel, events) ? -1 : 1;
+
+		for (i = 0; i < ret; i++)
+			cma_handler(events[i]->id, events[i]);
+	} while (ret > 0);
+
+	perror("failure in rdma_get_cm_event in process_server_events");
+	free(events);
 	return NULL;
 }
 
@@ -487,6 +525,78 @@ static int run_server(void)
 	return ret;
 }
 
+static void disconnect_nodes(void)
+{
+	int i;
+
+	printf("disconnecting\n");
+	start_time(STEP_DISCONNECT);
+	for (i = 0; i < connections; i++) {
+		if (nodes[i].error)
+			continue;
+		start_perf(&nodes[i], STEP_DISCONNECT);
+		rdma_disconnect(nodes[i].id);
+		rdma_destroy_qp(nodes[i].id);
+		started[STEP_DISCONNECT]++;
+	}
+	while (started[STEP_DISCONNECT] != completed[STEP_DISCONNECT]) sched_yield();
+	end_time(STEP_DISCONNECT);
+}
+
+static int run_client_bulk(void)
+{
+	struct rdma_connect_bulk_attr attr = {};
+	struct rdma_bulk_conn *conns;
+	pthread_t event_thread;
+	int i, ret;
+
+	conns = calloc(connections, sizeof *conns);
+	if (!conns)
+		return -ENOMEM;
+
+	for (i = 0; i < connections; i++) {
+		conns[i].src_addr = rai->ai_src_addr;
+		conns[i].dst_addr = rai->ai_dst_addr;
+		conns[i].context = &nodes[i];
+	}
+	attr.ps = hints.ai_port_space;
+	attr.qp_init_attr = &init_qp_attr;
+	attr.conn_param = &conn_param;
+	attr.timeout_ms = timeout;
+	attr.max_pending = bulk;
+
+	printf("connecting in bulk\n");
+	start_time(STEP_CONNECT);
+	ret = rdma_connect_bulk(channel, conns, connections, &attr);
+	end_time(STEP_CONNECT);
+	if (ret < 0) {
+		perror("failure in rdma_connect_bulk");
+		free(conns);
+		return ret;
+	}
+
+	for (i = 0; i < connections; i++) {
+		nodes[i].id = conns[i].id;
+		if (conns[i].status) {
+			printf("event: %s, error: %d\n",
+			       rdma_event_str(conns[i].event), conns[i].status);
+			nodes[i].error = 1;
+			continue;
+		}
+		completed[STEP_CONNECT]++;
+	}
+	free(conns);
+
+	ret = pthread_create(&event_thread, NULL, process_events, NULL);
+	if (ret) {
+		perror("failure creating event thread");
+		return ret;
+	}
+
+	disconnect_nodes();
+	return 0;
+}
+
 static int run_client(void)
 {
 	pthread_t event_thread;
@@ -504,6 +614,9 @@ static int run_client(void)
 	conn_param.private_data = rai->ai_connect;
 	conn_param.private_data_len = rai->ai_connect_len;
 
+	if (bulk >= 0)
+		return run_client_bulk();
+
 	ret = pthread_create(&event_thread, NULL, process_events, NULL);
 	if (ret) {
 		perror("failure creating event thread");
@@ -545,6 +658,9 @@ static int run_client(void)
 	while (started[STEP_RESOLVE_ADDR] != completed[STEP_RESOLVE_ADDR]) sched_yield();
 	end_time(STEP_RESOLVE_ADDR);
 
+	if (addr_only)
+		return 0;
+
 	printf("resolving route\n");
 	start_time(STEP_RESOLVE_ROUTE);
 	for (i = 0; i < connections; i++) {
@@ -596,19 +712,7 @@ static int run_client(void)
 	while (started[STEP_CONNECT] != completed[STEP_CONNECT]) sched_yield();
 	end_time(STEP_CONNECT);
 
-	printf("disconnecting\n");
-	start_time(STEP_DISCONNECT);
-	for (i = 0; i < connections; i++) {
-		if (nodes[i].error)
-			continue;
-		start_perf(&nodes[i], STEP_DISCONNECT);
-		rdma_disconnect(nodes[i].id);
-		rdma_destroy_qp(nodes[i].id);
-		started[STEP_DISCONNECT]++;
-	}
-	while (started[STEP_DISCONNECT] != completed[STEP_DISCONNECT]) sched_yield();
-	end_time(STEP_DISCONNECT);
-
+	disconnect_nodes();
 	return ret;
 }
 
@@ -618,7 +722,7 @@ int main(int argc, char **argv)
 
 	hints.ai_port_space = RDMA_PS_TCP;
 	hints.ai_qp_type = IBV_QPT_RC;
-	while ((op = getopt(argc, argv, "s:b:c:p:r:t:")) != -1) {
+	while ((op = getopt(argc, argv, "s:b:c:p:r:t:ae:B:")) != -1) {
 		switch (op) {
 		case 's':
 			dst_addr = optarg;
@@ -638,6 +742,19 @@ int main(int argc, char **argv)
 		case 't':
 			timeout = atoi(optarg);
 			break;
+		case 'a':
+			addr_only = 1;
+			break;
+		case 'e':
+			batch = atoi(optarg);
+			if (batch < 1)
+				batch = 1;
+			break;
+		case 'B':
+			bulk = atoi(optarg);
+			if (bulk < 0)
+				bulk = 0;
+			break;
 		default:
 			printf("usage: %s\n", argv[0]);
 			printf("\t[-s server_address]\n");
@@ -646,6 +763,9 @@ int main(int argc, char **argv)
 			printf("\t[-p port_number]\n");
 			printf("\t[-r retries]\n");
 			printf("\t[-t timeout_ms]\n");
+			printf("\t[-a] only resolve addresses, no server needed\n");
+			printf("\t[-e events] events to retrieve per call\n");
+			printf("\t[-B max_pending] connect with rdma_connect_bulk\n");
 			exit(1);
 		}
 	}
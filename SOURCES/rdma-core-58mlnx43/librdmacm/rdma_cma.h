@@ -646,6 +646,26 @@ int rdma_join_multicast_ex(struct rdma_cm_id *id,
 int rdma_get_cm_event(struct rdma_event_channel *channel,
 		      struct rdma_cm_event **event);
 
+/**
+ * rdma_get_cm_events - Retrieves pending communication events.
+ * @channel: Event channel to check for events.
+ * @events: Array that receives the allocated events.
+ * @max_events: Maximum number of events to return.
+ * Description:
+ *   Like rdma_get_cm_event, but returns all pending events up to max_events
+ *   with a single call into the kernel.  Connection requests are reported
+ *   together with their address and route information, which saves the
+ *   queries rdma_get_cm_event makes for each of them.  Blocks like
+ *   rdma_get_cm_event until at least one event is available and returns the
+ *   number of events stored in the array.
+ * Notes:
+ *   Every returned event must be acknowledged by calling rdma_ack_cm_event.
+ * See also:
+ *   rdma_get_cm_event, rdma_ack_cm_event
+ */
+int rdma_get_cm_events(struct rdma_event_channel *channel,
+		       struct rdma_cm_event **events, int max_events);
+
 /**
  * rdma_ack_cm_event - Free a communication event.
  * @event: Event to be released.
@@ -777,6 +797,42 @@ int rdma_set_local_ece(struct rdma_cm_id *id, struct ibv_ece *ece);
  * @ece: ECE parameters
  */
 int rdma_get_remote_ece(struct rdma_cm_id *id, struct ibv_ece *ece);
+
+struct rdma_bulk_conn {
+	struct sockaddr *src_addr;
+	struct sockaddr *dst_addr;
+	void *context;
+	/* Output */
+	struct rdma_cm_id *id;
+	enum rdma_cm_event_type event;
+	int status;
+};
+
+struct rdma_connect_bulk_attr {
+	uint32_t comp_mask;
+	enum rdma_port_space ps;
+	struct ibv_pd *pd;
+	struct ibv_qp_init_attr *qp_init_attr;
+	struct rdma_conn_param *conn_param;
+	int timeout_ms;
+	int max_pending;
+};
+
+/**
+ * rdma_connect_bulk - Establish many connections at once.
+ * @channel: Event channel that receives the established ids.
+ * @conns: Source and destination address of each connection.
+ * @num_conns: Number of entries in conns.
+ * @attr: Settings shared by all connections.
+ * Description:
+ *   Resolves, creates a QP for and connects every entry of conns, keeping
+ *   up to max_pending connections in flight.  Returns the number of
+ *   established connections once all have completed.  Each entry reports
+ *   the connected id or the event and status that failed it.
+ */
+int rdma_connect_bulk(struct rdma_event_channel *channel,
+		      struct rdma_bulk_conn *conns, int num_conns,
+		      struct rdma_connect_bulk_attr *attr);
 #ifdef __cplusplus
 }
 #endif
@@ -70,7 +70,8 @@ enum {
 	UCMA_CMD_QUERY,
 	UCMA_CMD_BIND,
 	UCMA_CMD_RESOLVE_ADDR,
-	UCMA_CMD_JOIN_MCAST
+	UCMA_CMD_JOIN_MCAST,
+	UCMA_CMD_GET_EVENTS
 };
 
 struct ucma_abi_cmd_hdr {
@@ -361,4 +362,38 @@ struct ucma_abi_migrate_resp {
 	__u32 events_reported;
 };
 
+struct ucma_abi_get_events {
+	__u32 cmd;
+	__u16 in;
+	__u16 out;
+	__u64 response;		/* ucma_abi_get_events_resp */
+	__u32 max_events;
+	__u32 reserved;
+};
+
+enum {
+	UCMA_EVENT_F_REQ_INFO = 1 << 0,
+};
+
+struct ucma_abi_req_info {
+	struct ucma_abi_query_addr_resp addr;
+	struct ucma_abi_query_addr_resp gid;
+	__u32 num_paths;
+	__u32 reserved;
+	struct ibv_path_data path_data[2];
+};
+
+struct ucma_abi_event_ex {
+	struct ucma_abi_event_resp event;
+	__u32 flags;
+	__u32 reserved;
+	struct ucma_abi_req_info req_info;
+};
+
+struct ucma_abi_get_events_resp {
+	__u32 num_events;
+	__u32 reserved;
+	struct ucma_abi_event_ex events[];
+};
+
 #endif /* RDMA_CMA_ABI_H */
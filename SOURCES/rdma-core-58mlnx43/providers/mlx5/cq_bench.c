@@ -0,0 +1,674 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+/*
+ * Offline benchmark of the mlx5 CQ poll path.
+ *
+ * cq.c is linked into this program as is. CQs and QPs are built over host
+ * memory and the CQ ring is filled with synthetic CQE64 streams mixing
+ * requester, responder and error completions, so that every poll entry
+ * point can be measured, and checked against the expected work
+ * completions, without a device.
+ *
+ * Each mode first polls one lap of the ring and compares every completion
+ * with the one the CQE was generated for, then times the following laps.
+ * The ring is refilled between laps, outside of the measurement.
+ */
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <util/compiler.h>
+#include <infiniband/verbs.h>
+
+#include "mlx5.h"
+
+#define BENCH_WQE_CNT 256
+#define BENCH_QPN_BASE 0x1000
+
+enum {
+	STALL_NONE,
+	STALL,
+	STALL_ADAPTIVE,
+};
+
+struct bench_mode {
+	bool ex;
+	int cqe_ver;
+	bool single;
+	int stall;
+	bool clock;
+};
+
+struct bench_expect {
+	uint64_t wr_id;
+	enum ibv_wc_status status;
+	enum ibv_wc_opcode opcode;
+	unsigned int wc_flags;
+	uint32_t qp_num;
+	uint32_t byte_len;
+	bool check_len;
+	uint8_t vendor_err;
+};
+
+struct bench {
+	unsigned int nent;
+	unsigned int cqe_sz;
+	unsigned int nqps;
+	unsigned int resp_pct;
+	unsigned int err_pct;
+	unsigned int batch;
+	unsigned int laps;
+	unsigned int seed;
+
+	struct mlx5_context *mctx;
+	struct mlx5_cq cq;
+	__be32 dbrec[2];
+	struct mlx5_qp **qps;
+	void *ring;
+	void *template;
+	struct bench_expect *expect;
+	struct ibv_wc *wc;
+};
+
+static volatile uint64_t bench_sink;
+
+/*
+ * cq.c only reaches the symbols below for SRQs, signature, ODP, inline
+ * scatter and CQ resize, none of which the generated streams use.
+ */
+#ifdef MLX5_DEBUG
+uint32_t mlx5_debug_mask;
+#endif
+int mlx5_freeze_on_error_cqe;
+
+struct mlx5_qp *mlx5_find_qp(struct mlx5_context *ctx, uint32_t qpn)
+{
+	int tind = qpn >> MLX5_QP_TABLE_SHIFT;
+
+	if (ctx->qp_table[tind].refcnt)
+		return ctx->qp_table[tind].table[qpn & MLX5_QP_TABLE_MASK];
+	return NULL;
+}
+
+struct mlx5_srq *mlx5_find_srq(struct mlx5_context *ctx, uint32_t srqn)
+{
+	return NULL;
+}
+
+struct mlx5_mkey *mlx5_find_mkey(struct mlx5_context *ctx, uint32_t mkey)
+{
+	return NULL;
+}
+
+void mlx5_free_srq_wqe(struct mlx5_srq *srq, int ind)
+{
+	abort();
+}
+
+void mlx5_complete_odp_fault(struct mlx5_srq *srq, int ind)
+{
+	abort();
+}
+
+int mlx5_copy_to_recv_wqe(struct mlx5_qp *qp, int idx, void *buf, int size)
+{
+	abort();
+}
+
+int mlx5_copy_to_send_wqe(struct mlx5_qp *qp, int idx, void *buf, int size)
+{
+	abort();
+}
+
+int mlx5_copy_to_recv_srq(struct mlx5_srq *srq, int idx, void *buf, int size)
+{
+	abort();
+}
+
+int mlx5_alloc_prefered_buf(struct mlx5_context *mctx, struct mlx5_buf *buf,
+			    size_t size, int page_size,
+			    enum mlx5_alloc_type alloc_type,
+			    const char *component)
+{
+	return ENOMEM;
+}
+
+int mlx5_free_actual_buf(struct mlx5_context *ctx, struct mlx5_buf *buf)
+{
+	return 0;
+}
+
+void mlx5_get_alloc_type(struct mlx5_context *context, struct ibv_pd *pd,
+			 const char *component,
+			 enum mlx5_alloc_type *alloc_type,
+			 enum mlx5_alloc_type default_alloc_type)
+{
+	*alloc_type = default_alloc_type;
+}
+
+int mlx5_use_huge(const char *key)
+{
+	return 0;
+}
+
+int mlx5dv_get_clock_info(struct ibv_context *context,
+			  struct mlx5dv_clock_info *clock_info)
+{
+	return 0;
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void mode_name(const struct bench_mode *mode, char *buf, size_t len)
+{
+	static const char *const stall[] = { "", " stall", " adaptive" };
+
+	snprintf(buf, len, "%s v%d %s%s%s", mode->ex ? "poll_ex" : "poll_cq",
+		 mode->cqe_ver, mode->single ? "single" : "lock",
+		 stall[mode->stall], mode->clock ? " clock" : "");
+}
+
+static struct mlx5_cqe64 *ring_cqe64(void *ring, struct bench *b,
+				     unsigned int i)
+{
+	void *cqe = ring + i * b->cqe_sz;
+
+	return b->cqe_sz == 64 ? cqe : cqe + 64;
+}
+
+static int setup(struct bench *b)
+{
+	unsigned int q, i;
+	int tind;
+
+	b->mctx = calloc(1, sizeof(*b->mctx));
+	b->qps = calloc(b->nqps, sizeof(*b->qps));
+	b->expect = calloc(b->nent, sizeof(*b->expect));
+	b->wc = calloc(b->nent, sizeof(*b->wc));
+	if (!b->mctx || !b->qps || !b->expect || !b->wc)
+		return ENOMEM;
+	if (posix_memalign(&b->ring, 4096, b->nent * b->cqe_sz) ||
+	    posix_memalign(&b->template, 4096, b->nent * b->cqe_sz))
+		return ENOMEM;
+
+	/* QPNs live in qp_table slot 1 and user indexes in uidx_table slot 0 */
+	tind = BENCH_QPN_BASE >> MLX5_QP_TABLE_SHIFT;
+	b->mctx->qp_table[tind].table =
+		calloc(MLX5_QP_TABLE_MASK + 1, sizeof(struct mlx5_qp *));
+	b->mctx->uidx_table[0].table =
+		calloc(MLX5_UIDX_TABLE_MASK + 1, sizeof(struct mlx5_resource *));
+	if (!b->mctx->qp_table[tind].table || !b->mctx->uidx_table[0].table)
+		return ENOMEM;
+	b->mctx->qp_table[tind].refcnt = 1;
+	b->mctx->uidx_table[0].refcnt = 1;
+	b->mctx->flags |= MLX5_CTX_FLAGS_REAL_TIME_TS_SUPPORTED;
+
+	for (q = 0; q != b->nqps; q++) {
+		struct mlx5_qp *qp = calloc(1, sizeof(*qp));
+		struct mlx5_wq *wqs[2];
+
+		if (!qp)
+			return ENOMEM;
+		b->qps[q] = qp;
+		qp->rsc.type = MLX5_RSC_TYPE_QP;
+		wqs[0] = &qp->sq;
+		wqs[1] = &qp->rq;
+		for (i = 0; i != 2; i++) {
+			struct mlx5_wq *wq = wqs[i];
+			unsigned int j;
+
+			wq->wqe_cnt = BENCH_WQE_CNT;
+			wq->wrid = calloc(BENCH_WQE_CNT, sizeof(*wq->wrid));
+			wq->wqe_head = calloc(BENCH_WQE_CNT,
+					      sizeof(*wq->wqe_head));
+			wq->wr_data = calloc(BENCH_WQE_CNT,
+					     sizeof(*wq->wr_data));
+			if (!wq->wrid || !wq->wqe_head || !wq->wr_data)
+				return ENOMEM;
+			for (j = 0; j != BENCH_WQE_CNT; j++) {
+				wq->wrid[j] = (uint64_t)q << 32 | i << 16 | j;
+				wq->wqe_head[j] = j;
+			}
+		}
+		b->mctx->qp_table[tind].table[(BENCH_QPN_BASE + q) &
+					      MLX5_QP_TABLE_MASK] = qp;
+		b->mctx->uidx_table[0].table[q + 1] = &qp->rsc;
+	}
+
+	return 0;
+}
+
+/*
+ * Generate one lap of CQEs with the owner bit clear, and the completion
+ * each of them must be reported as, for a CQ and QPs in their initial
+ * state.
+ */
+static void generate(struct bench *b, int cqe_ver)
+{
+	static const uint8_t req_ops[] = {
+		MLX5_OPCODE_SEND, MLX5_OPCODE_RDMA_WRITE, MLX5_OPCODE_RDMA_READ,
+	};
+	static const enum ibv_wc_opcode req_wc_ops[] = {
+		IBV_WC_SEND, IBV_WC_RDMA_WRITE, IBV_WC_RDMA_READ,
+	};
+	static const uint8_t resp_ops[] = {
+		MLX5_CQE_RESP_SEND, MLX5_CQE_RESP_SEND_IMM, MLX5_CQE_RESP_WR_IMM,
+	};
+	unsigned int sq_ctr[b->nqps], rq_ctr[b->nqps];
+	unsigned int seed = b->seed;
+	unsigned int i;
+
+	memset(sq_ctr, 0, sizeof(sq_ctr));
+	memset(rq_ctr, 0, sizeof(rq_ctr));
+	memset(b->template, 0, b->nent * b->cqe_sz);
+	memset(b->expect, 0, b->nent * sizeof(*b->expect));
+
+	for (i = 0; i != b->nent; i++) {
+		struct mlx5_cqe64 *cqe = ring_cqe64(b->template, b, i);
+		struct bench_expect *exp = &b->expect[i];
+		unsigned int q = rand_r(&seed) % b->nqps;
+		uint32_t qpn = BENCH_QPN_BASE + q;
+		bool resp = (unsigned int)rand_r(&seed) % 100 < b->resp_pct;
+		bool err = (unsigned int)rand_r(&seed) % 100 < b->err_pct;
+		unsigned int op = rand_r(&seed) % 3;
+		uint32_t len = 64 + rand_r(&seed) % 4096;
+		struct mlx5_qp *qp = b->qps[q];
+		struct mlx5_wq *wq = resp ? &qp->rq : &qp->sq;
+		unsigned int ctr = resp ? rq_ctr[q]++ : sq_ctr[q]++;
+		uint8_t opcode;
+
+		exp->qp_num = qpn;
+		exp->wr_id = wq->wrid[ctr & (wq->wqe_cnt - 1)];
+
+		cqe->srqn_uidx = htobe32(cqe_ver ? q + 1 : 0);
+		cqe->byte_cnt = htobe32(len);
+		cqe->wqe_counter = htobe16(ctr);
+		cqe->flags_rqpn = htobe32(0x800000 | q);
+
+		if (err) {
+			struct mlx5_err_cqe *ecqe = (struct mlx5_err_cqe *)cqe;
+
+			opcode = resp ? MLX5_CQE_RESP_ERR : MLX5_CQE_REQ_ERR;
+			cqe->sop_drop_qpn = htobe32(qpn);
+			ecqe->syndrome = MLX5_CQE_SYNDROME_WR_FLUSH_ERR;
+			ecqe->vendor_err_synd = 0x79;
+			exp->status = IBV_WC_WR_FLUSH_ERR;
+			exp->vendor_err = 0x79;
+		} else if (resp) {
+			opcode = resp_ops[op];
+			cqe->sop_drop_qpn = htobe32(qpn);
+			cqe->imm_inval_pkey = htobe32(i);
+			exp->opcode = opcode == MLX5_CQE_RESP_WR_IMM ?
+				      IBV_WC_RECV_RDMA_WITH_IMM : IBV_WC_RECV;
+			exp->wc_flags = opcode == MLX5_CQE_RESP_SEND ?
+					0 : IBV_WC_WITH_IMM;
+			exp->byte_len = len;
+			exp->check_len = true;
+		} else {
+			opcode = MLX5_CQE_REQ;
+			cqe->sop_drop_qpn = htobe32(req_ops[op] << 24 | qpn);
+			exp->opcode = req_wc_ops[op];
+			exp->byte_len = len;
+			exp->check_len = req_ops[op] == MLX5_OPCODE_RDMA_READ;
+		}
+		cqe->op_own = opcode << 4;
+	}
+}
+
+static void fill_ring(struct bench *b, unsigned int lap)
+{
+	unsigned int i;
+
+	memcpy(b->ring, b->template, b->nent * b->cqe_sz);
+	if (lap & 1)
+		for (i = 0; i != b->nent; i++)
+			ring_cqe64(b->ring, b, i)->op_own |= MLX5_CQE_OWNER_MASK;
+}
+
+static int setup_mode(struct bench *b, const struct bench_mode *mode)
+{
+	struct ibv_cq_init_attr_ex attr = {
+		.wc_flags = IBV_WC_STANDARD_FLAGS,
+	};
+	struct mlx5_cq *cq = &b->cq;
+	unsigned int q;
+
+	memset(cq, 0, sizeof(*cq));
+	cq->verbs_cq.cq.context = &b->mctx->ibv_ctx.context;
+	cq->verbs_cq.cq.cqe = b->nent - 1;
+	cq->buf_a.buf = b->ring;
+	cq->buf_a.length = b->nent * b->cqe_sz;
+	cq->active_buf = &cq->buf_a;
+	cq->cqe_sz = b->cqe_sz;
+	cq->dbrec = b->dbrec;
+	if (mlx5_spinlock_init(&cq->lock, !mode->single))
+		return errno;
+	if (mode->single)
+		cq->flags |= MLX5_CQ_FLAGS_SINGLE_THREADED;
+	cq->stall_enable = mode->stall != STALL_NONE;
+	cq->stall_adaptive_enable = mode->stall == STALL_ADAPTIVE;
+	cq->stall_cycles = mlx5_stall_cq_poll_min;
+
+	b->mctx->cqe_version = mode->cqe_ver;
+	for (q = 0; q != b->nqps; q++) {
+		struct mlx5_qp *qp = b->qps[q];
+
+		qp->rsc.rsn = mode->cqe_ver ? q + 1 : BENCH_QPN_BASE + q;
+		qp->sq.tail = 0;
+		qp->rq.tail = 0;
+	}
+
+	if (mode->ex) {
+		if (mode->clock)
+			attr.wc_flags |= IBV_WC_EX_WITH_COMPLETION_TIMESTAMP_WALLCLOCK;
+		return mlx5_cq_fill_pfns(cq, &attr, b->mctx);
+	}
+	return 0;
+}
+
+/* Poll until the CQ is empty, storing the completions if wc is set */
+static int poll_lap_cq(struct bench *b, const struct bench_mode *mode,
+		       struct ibv_wc *wc, uint64_t *sum)
+{
+	struct ibv_cq *ibcq = &b->cq.verbs_cq.cq;
+	struct ibv_wc batch[b->batch];
+	unsigned int total = 0;
+	int n, i;
+
+	while (1) {
+		if (mode->cqe_ver)
+			n = mlx5_poll_cq_v1(ibcq, b->batch, batch);
+		else
+			n = mlx5_poll_cq(ibcq, b->batch, batch);
+		if (n < 0)
+			return -1;
+		if (!n)
+			break;
+		for (i = 0; i != n; i++)
+			*sum += batch[i].wr_id + batch[i].status +
+				batch[i].byte_len;
+		if (wc)
+			memcpy(wc + total, batch, n * sizeof(*batch));
+		total += n;
+	}
+	return total;
+}
+
+static void read_ex(struct ibv_cq_ex *cq, struct ibv_wc *wc)
+{
+	wc->wr_id = cq->wr_id;
+	wc->status = cq->status;
+	wc->qp_num = ibv_wc_read_qp_num(cq);
+	if (cq->status == IBV_WC_SUCCESS) {
+		wc->opcode = ibv_wc_read_opcode(cq);
+		wc->wc_flags = ibv_wc_read_wc_flags(cq);
+		wc->byte_len = ibv_wc_read_byte_len(cq);
+	} else {
+		wc->vendor_err = ibv_wc_read_vendor_err(cq);
+	}
+}
+
+static int poll_lap_ex(struct bench *b, struct ibv_wc *wc, uint64_t *sum)
+{
+	struct ibv_cq_ex *cq = &b->cq.verbs_cq.cq_ex;
+	struct ibv_poll_cq_attr attr = {};
+	unsigned int total = 0;
+	unsigned int n;
+	int ret;
+
+	while (1) {
+		ret = ibv_start_poll(cq, &attr);
+		if (ret == ENOENT)
+			break;
+		if (ret)
+			return -1;
+
+		n = 0;
+		do {
+			if (wc)
+				read_ex(cq, wc + total + n);
+			if (cq->status == IBV_WC_SUCCESS)
+				*sum += cq->wr_id + ibv_wc_read_opcode(cq) +
+					ibv_wc_read_byte_len(cq);
+			else
+				*sum += cq->wr_id + cq->status;
+			n++;
+		} while (n != b->batch && !(ret = ibv_next_poll(cq)));
+		ibv_end_poll(cq);
+		if (ret && ret != ENOENT)
+			return -1;
+		total += n;
+	}
+	return total;
+}
+
+static int poll_lap(struct bench *b, const struct bench_mode *mode,
+		    struct ibv_wc *wc, uint64_t *sum)
+{
+	return mode->ex ? poll_lap_ex(b, wc, sum) :
+			  poll_lap_cq(b, mode, wc, sum);
+}
+
+static int check_lap(struct bench *b, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i != b->nent; i++) {
+		const struct bench_expect *exp = &b->expect[i];
+		const struct ibv_wc *wc = &b->wc[i];
+		bool bad;
+
+		bad = wc->wr_id != exp->wr_id || wc->status != exp->status ||
+		      wc->qp_num != exp->qp_num;
+		if (exp->status == IBV_WC_SUCCESS)
+			bad |= wc->opcode != exp->opcode ||
+			       wc->wc_flags != exp->wc_flags ||
+			       (exp->check_len && wc->byte_len != exp->byte_len);
+		else
+			bad |= wc->vendor_err != exp->vendor_err;
+		if (bad) {
+			fprintf(stderr,
+				"%s: CQE %u: got wr_id 0x%llx status %d opcode %d flags 0x%x qpn 0x%x len %u, expected wr_id 0x%llx status %d opcode %d flags 0x%x qpn 0x%x len %u\n",
+				name, i, (unsigned long long)wc->wr_id,
+				wc->status, wc->opcode, wc->wc_flags,
+				wc->qp_num, wc->byte_len,
+				(unsigned long long)exp->wr_id, exp->status,
+				exp->opcode, exp->wc_flags, exp->qp_num,
+				exp->byte_len);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int run_mode(struct bench *b, const struct bench_mode *mode,
+		    const char *filter)
+{
+	double start, elapsed = 0;
+	uint64_t sum = 0;
+	unsigned int lap;
+	char name[64];
+	int n, ret;
+
+	mode_name(mode, name, sizeof(name));
+	if (filter && !strstr(name, filter))
+		return 0;
+
+	ret = setup_mode(b, mode);
+	if (ret) {
+		fprintf(stderr, "%s: setup failed: %s\n", name, strerror(ret));
+		return 1;
+	}
+	generate(b, mode->cqe_ver);
+
+	memset(b->wc, 0, b->nent * sizeof(*b->wc));
+	fill_ring(b, 0);
+	n = poll_lap(b, mode, b->wc, &sum);
+	if (n != (int)b->nent) {
+		fprintf(stderr, "%s: polled %d of %u CQEs\n", name, n, b->nent);
+		return 1;
+	}
+	if (check_lap(b, name))
+		return 1;
+
+	for (lap = 1; lap <= b->laps; lap++) {
+		fill_ring(b, lap);
+		start = now_ns();
+		n = poll_lap(b, mode, NULL, &sum);
+		elapsed += now_ns() - start;
+		if (n != (int)b->nent) {
+			fprintf(stderr, "%s: polled %d of %u CQEs in lap %u\n",
+				name, n, b->nent, lap);
+			return 1;
+		}
+	}
+
+	/* Keep the completion reads from being optimized out */
+	bench_sink = sum;
+	printf("  %-36s %8.2f ns/CQE\n", name,
+	       elapsed / ((double)b->nent * b->laps));
+	mlx5_spinlock_destroy(&b->cq.lock);
+	return 0;
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s            benchmark mlx5 CQE parsing on synthetic CQ rings\n", argv0);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -n, --entries=<num>    CQ ring entries, a power of 2 (default 4096)\n");
+	printf("  -s, --cqe-size=<size>  CQE size, 64 or 128 (default 64)\n");
+	printf("  -q, --qps=<num>        number of QPs completing on the CQ (default 16)\n");
+	printf("  -r, --resp=<pct>       percentage of responder CQEs (default 50)\n");
+	printf("  -e, --err=<pct>        percentage of error CQEs (default 1)\n");
+	printf("  -b, --batch=<num>      CQEs polled per call or start_poll (default 16)\n");
+	printf("  -l, --laps=<num>       timed laps of the ring per mode (default 200)\n");
+	printf("  -S, --seed=<num>       seed of the CQE stream (default 1)\n");
+	printf("  -m, --mode=<str>       only run modes whose name contains <str>\n");
+	printf("  -h, --help             print a help text and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+	struct bench b = {
+		.nent = 4096,
+		.cqe_sz = 64,
+		.nqps = 16,
+		.resp_pct = 50,
+		.err_pct = 1,
+		.batch = 16,
+		.laps = 200,
+		.seed = 1,
+	};
+	struct bench_mode mode = {};
+	char *filter = NULL;
+	int ret, bad = 0;
+
+	while (1) {
+		int c;
+		static struct option long_options[] = {
+			{ .name = "entries",  .has_arg = 1, .val = 'n' },
+			{ .name = "cqe-size", .has_arg = 1, .val = 's' },
+			{ .name = "qps",      .has_arg = 1, .val = 'q' },
+			{ .name = "resp",     .has_arg = 1, .val = 'r' },
+			{ .name = "err",      .has_arg = 1, .val = 'e' },
+			{ .name = "batch",    .has_arg = 1, .val = 'b' },
+			{ .name = "laps",     .has_arg = 1, .val = 'l' },
+			{ .name = "seed",     .has_arg = 1, .val = 'S' },
+			{ .name = "mode",     .has_arg = 1, .val = 'm' },
+			{ .name = "help",     .has_arg = 0, .val = 'h' },
+			{}
+		};
+
+		ret = 1;
+		c = getopt_long(argc, argv, "n:s:q:r:e:b:l:S:m:h", long_options,
+				NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 'n':
+			b.nent = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			b.cqe_sz = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			b.nqps = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			b.resp_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 'e':
+			b.err_pct = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			b.batch = strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			b.laps = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			b.seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			filter = optarg;
+			break;
+		case 'h':
+			ret = 0;
+			SWITCH_FALLTHROUGH;
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+	if (b.nent < 2 || b.nent & (b.nent - 1) ||
+	    (b.cqe_sz != 64 && b.cqe_sz != 128) || !b.nqps ||
+	    b.nqps > MLX5_UIDX_TABLE_MASK || b.resp_pct > 100 ||
+	    b.err_pct > 100 || !b.batch || !b.laps) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	ret = setup(&b);
+	if (ret) {
+		fprintf(stderr, "setup failed: %s\n", strerror(ret));
+		return 1;
+	}
+
+	printf("%u x %u byte CQEs, %u QPs, %u%% responder, %u%% error, batch %u\n",
+	       b.nent, b.cqe_sz, b.nqps, b.resp_pct, b.err_pct, b.batch);
+
+	/* Every poll_cq variant and every entry of the cq_ex ops table */
+	for (mode.ex = false;; mode.ex = true) {
+		for (mode.cqe_ver = 0; mode.cqe_ver != 2; mode.cqe_ver++)
+			for (mode.single = false;; mode.single = true) {
+				for (mode.stall = STALL_NONE;
+				     mode.stall <= STALL_ADAPTIVE; mode.stall++) {
+					mode.clock = false;
+					bad |= run_mode(&b, &mode, filter);
+					if (mode.ex) {
+						mode.clock = true;
+						bad |= run_mode(&b, &mode, filter);
+					}
+				}
+				if (mode.single)
+					break;
+			}
+		if (mode.ex)
+			break;
+	}
+
+	return bad;
+}
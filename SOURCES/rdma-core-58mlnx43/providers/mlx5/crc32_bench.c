@@ -0,0 +1,194 @@
+/* GPLv2 or OpenIB.org BSD (MIT) See COPYING file */
+/*
+ * Check the CPU accelerated steering hash CRC against the slicing-by-8 table
+ * version, then time both for the STE tag sizes that dr_ste_calc_hash_index()
+ * hashes.
+ *
+ * dr_crc32.c is linked into this program as is. No device is needed.
+ */
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+
+#include <util/compiler.h>
+
+#include "mlx5dv_dr.h"
+
+#define BENCH_MAX_LEN 512
+#define BENCH_ALIGN 16
+
+static volatile uint32_t bench_sink;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void fill_random(uint8_t *buf, size_t len, unsigned int *seed)
+{
+	size_t i;
+
+	for (i = 0; i != len; i++)
+		buf[i] = rand_r(seed);
+}
+
+/* Every length up to BENCH_MAX_LEN at every alignment, on random data */
+static int check(unsigned int rounds, unsigned int seed)
+{
+	uint8_t buf[BENCH_MAX_LEN + BENCH_ALIGN] __attribute__((aligned(16)));
+	uint32_t ref, hw, calc;
+	unsigned int round;
+	size_t len, off;
+
+	if (dr_crc32_slice8_calc(NULL, 16) || dr_crc32_hw_calc(NULL, 16)) {
+		fprintf(stderr, "NULL input must hash to 0\n");
+		return 1;
+	}
+
+	for (round = 0; round != rounds; round++) {
+		fill_random(buf, sizeof(buf), &seed);
+		for (off = 0; off != BENCH_ALIGN; off++) {
+			for (len = 0; len <= BENCH_MAX_LEN; len++) {
+				ref = dr_crc32_slice8_calc(buf + off, len);
+				hw = dr_crc32_hw_calc(buf + off, len);
+				calc = dr_crc32_calc(buf + off, len);
+				if (hw == ref && calc == ref)
+					continue;
+
+				fprintf(stderr,
+					"mismatch at length %zu offset %zu round %u: table 0x%08x hw 0x%08x dispatch 0x%08x\n",
+					len, off, round, ref, hw, calc);
+				return 1;
+			}
+		}
+	}
+
+	/* Masked tags are mostly zero bytes */
+	memset(buf, 0, sizeof(buf));
+	for (len = 0; len <= BENCH_MAX_LEN; len++) {
+		if (dr_crc32_hw_calc(buf, len) != dr_crc32_slice8_calc(buf, len)) {
+			fprintf(stderr, "mismatch on zeroes at length %zu\n", len);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static double time_calc(uint32_t (*calc)(const void *, size_t),
+			const uint8_t *tags, size_t len, unsigned int ntags,
+			unsigned int iters)
+{
+	unsigned int i, n;
+	uint32_t sum = 0;
+	double start;
+
+	start = now_ns();
+	for (i = 0; i != iters; i++)
+		for (n = 0; n != ntags; n++)
+			sum += calc(tags + n * len, len);
+	bench_sink = sum;
+
+	return (now_ns() - start) / ((double)iters * ntags);
+}
+
+static void usage(const char *argv0)
+{
+	printf("Usage:\n");
+	printf("  %s            check and time the steering hash CRC\n", argv0);
+	printf("\n");
+	printf("Options:\n");
+	printf("  -s, --size=<bytes>     time this input size instead of the STE tag sizes\n");
+	printf("  -i, --iters=<num>      passes over 1024 inputs (default 10000)\n");
+	printf("  -r, --rounds=<num>     random rounds of the equivalence check (default 20)\n");
+	printf("  -S, --seed=<num>       seed of the random data (default 1)\n");
+	printf("  -h, --help             print a help text and exit\n");
+}
+
+int main(int argc, char *argv[])
+{
+	size_t sizes[] = { DR_STE_SIZE_TAG, DR_STE_SIZE_MATCH_TAG };
+	unsigned int iters = 10000, rounds = 20, seed = 1;
+	unsigned int ntags = 1024;
+	unsigned int nsizes = 2;
+	double table, hw;
+	uint8_t *tags;
+	unsigned int i;
+	int ret;
+
+	while (1) {
+		int c;
+		static struct option long_options[] = {
+			{ .name = "size",   .has_arg = 1, .val = 's' },
+			{ .name = "iters",  .has_arg = 1, .val = 'i' },
+			{ .name = "rounds", .has_arg = 1, .val = 'r' },
+			{ .name = "seed",   .has_arg = 1, .val = 'S' },
+			{ .name = "help",   .has_arg = 0, .val = 'h' },
+			{}
+		};
+
+		ret = 1;
+		c = getopt_long(argc, argv, "s:i:r:S:h", long_options, NULL);
+		if (c == -1)
+			break;
+		switch (c) {
+		case 's':
+			sizes[0] = strtoul(optarg, NULL, 0);
+			nsizes = 1;
+			break;
+		case 'i':
+			iters = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			rounds = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			ret = 0;
+			SWITCH_FALLTHROUGH;
+		default:
+			usage(argv[0]);
+			return ret;
+		}
+	}
+	if (!sizes[0] || !iters) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	dr_crc32_init_table();
+	printf("CPU CRC32 instructions %s\n",
+	       dr_crc32_hw_supported() ? "in use" : "not available");
+
+	if (check(rounds, seed))
+		return 1;
+	printf("  equivalence check passed\n");
+
+	for (i = 0; i != nsizes; i++) {
+		tags = malloc(sizes[i] * ntags);
+		if (!tags) {
+			perror("malloc");
+			return 1;
+		}
+		fill_random(tags, sizes[i] * ntags, &seed);
+
+		table = time_calc(dr_crc32_slice8_calc, tags, sizes[i], ntags,
+				  iters);
+		hw = time_calc(dr_crc32_calc, tags, sizes[i], ntags, iters);
+		printf("  %4zu bytes: table %7.2f ns  dispatched %7.2f ns  (x%.2f)\n",
+		       sizes[i], table, hw, table / hw);
+		free(tags);
+	}
+
+	return 0;
+}
@@ -56,10 +56,27 @@
 #include <string.h>
 #include "mlx5dv_dr.h"
 
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <sys/auxv.h>
+#include <arm_acle.h>
+#endif
+
 #define DR_STE_CRC_POLY		0xEDB88320L
 
 static uint32_t dr_ste_crc_tab32[8][256];
 
+static uint32_t (*dr_crc32_calc_fn)(const void *input_data, size_t length) =
+	dr_crc32_slice8_calc;
+
+static uint32_t dr_crc32_swab(uint32_t crc)
+{
+	return ((crc>>24) & 0xff) | ((crc<<8) & 0xff0000) |
+		((crc>>8) & 0xff00) | ((crc<<24) & 0xff000000);
+}
+
 static void dr_crc32_calc_lookup_entry(uint32_t (*tbl)[256], uint8_t i,
 				       uint8_t j)
 {
@@ -91,6 +108,9 @@ void dr_crc32_init_table(void)
 		dr_crc32_calc_lookup_entry(dr_ste_crc_tab32, 6, i);
 		dr_crc32_calc_lookup_entry(dr_ste_crc_tab32, 7, i);
 	}
+
+	if (dr_crc32_hw_supported())
+		dr_crc32_calc_fn = dr_crc32_hw_calc;
 }
 
 /* Compute CRC32 (Slicing-by-8 algorithm) */
@@ -126,6 +146,128 @@ uint32_t dr_crc32_slice8_calc(const void *input_data, size_t length)
 		crc = (crc >> 8) ^ dr_ste_crc_tab32[0][(crc & 0xff)
 			^ *current_char++];
 
-	return ((crc>>24) & 0xff) | ((crc<<8) & 0xff0000) |
-		((crc>>8) & 0xff00) | ((crc<<24) & 0xff000000);
+	return dr_crc32_swab(crc);
+}
+
+#if defined(__x86_64__)
+/*
+ * Constants of the reflected CRC-32 polynomial for carry-less
+ * multiplication, see "Fast CRC Computation for Generic Polynomials Using
+ * PCLMULQDQ Instruction" by Intel: the 128 bit fold constants
+ * x^(128+32) and x^(128-32) mod P(x), the 64 bit fold constant
+ * x^64 mod P(x), and the Barrett reduction constant and polynomial.
+ */
+#define DR_CRC32_K3	0x1751997d0ULL
+#define DR_CRC32_K4	0x0ccaa009eULL
+#define DR_CRC32_K5	0x163cd6124ULL
+#define DR_CRC32_MU	0x1f7011641ULL
+#define DR_CRC32_P	0x1db710641ULL
+
+bool dr_crc32_hw_supported(void)
+{
+	unsigned int ax, bx, cx, dx;
+
+	if (!__get_cpuid(1, &ax, &bx, &cx, &dx))
+		return false;
+	return cx & bit_PCLMUL;
+}
+
+/* Compute CRC32 by folding 16 bytes at a time with PCLMULQDQ */
+uint32_t __attribute__((target("pclmul")))
+dr_crc32_hw_calc(const void *input_data, size_t length)
+{
+	const __m128i mask32 = _mm_set_epi32(0, 0, 0, ~0);
+	const uint8_t *current_char = input_data;
+	__m128i x, y, k;
+	uint32_t crc;
+
+	if (!input_data)
+		return 0;
+
+	if (length < 16)
+		return dr_crc32_slice8_calc(input_data, length);
+
+	k = _mm_set_epi64x(DR_CRC32_K4, DR_CRC32_K3);
+	x = _mm_loadu_si128((const __m128i *)current_char);
+	current_char += 16;
+	length -= 16;
+
+	while (length >= 16) {
+		y = _mm_clmulepi64_si128(x, k, 0x00);
+		x = _mm_clmulepi64_si128(x, k, 0x11);
+		x = _mm_xor_si128(x, y);
+		x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)current_char));
+		current_char += 16;
+		length -= 16;
+	}
+
+	/* Fold 128 bits to 64, then to 32 */
+	y = _mm_clmulepi64_si128(k, x, 0x01);
+	x = _mm_xor_si128(_mm_srli_si128(x, 8), y);
+
+	k = _mm_set_epi64x(0, DR_CRC32_K5);
+	y = _mm_srli_si128(x, 4);
+	x = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k, 0x00);
+	x = _mm_xor_si128(x, y);
+
+	/* Barrett reduction to the 32 bit remainder */
+	k = _mm_set_epi64x(DR_CRC32_MU, DR_CRC32_P);
+	y = x;
+	x = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k, 0x10);
+	x = _mm_clmulepi64_si128(_mm_and_si128(x, mask32), k, 0x00);
+	x = _mm_xor_si128(x, y);
+	crc = _mm_cvtsi128_si32(_mm_srli_si128(x, 4));
+
+	/* Remaining 1 to 15 bytes (standard algorithm) */
+	while (length-- != 0)
+		crc = (crc >> 8) ^ dr_ste_crc_tab32[0][(crc & 0xff)
+			^ *current_char++];
+
+	return dr_crc32_swab(crc);
+}
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+bool dr_crc32_hw_supported(void)
+{
+	return getauxval(AT_HWCAP) & HWCAP_CRC32;
+}
+
+/* Compute CRC32 with the ARMv8 CRC32 instructions */
+uint32_t __attribute__((target("+crc")))
+dr_crc32_hw_calc(const void *input_data, size_t length)
+{
+	const uint8_t *current_char = input_data;
+	uint32_t crc = 0;
+	uint64_t val;
+
+	if (!input_data)
+		return 0;
+
+	while (length >= 8) {
+		memcpy(&val, current_char, sizeof(val));
+		crc = __crc32d(crc, val);
+		current_char += 8;
+		length -= 8;
+	}
+
+	while (length-- != 0)
+		crc = __crc32b(crc, *current_char++);
+
+	return dr_crc32_swab(crc);
+}
+#else
+bool dr_crc32_hw_supported(void)
+{
+	return false;
+}
+
+uint32_t dr_crc32_hw_calc(const void *input_data, size_t length)
+{
+	return dr_crc32_slice8_calc(input_data, length);
+}
+#endif
+
+/* Compute CRC32 with the fastest implementation the CPU supports */
+uint32_t dr_crc32_calc(const void *input_data, size_t length)
+{
+	return dr_crc32_calc_fn(input_data, length);
 }
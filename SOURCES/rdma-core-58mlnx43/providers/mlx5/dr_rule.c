@@ -36,6 +36,8 @@
 
 /* +1 for the cross GVMI STE */
 #define DR_RULE_MAX_STE_CHAIN (DR_RULE_MAX_STES + DR_ACTION_MAX_STES + 1)
+/* Rules inserted per matcher lock hold by mlx5dv_dr_rule_create_bulk() */
+#define DR_RULE_BULK_MAX_RULES 256
 
 static int dr_rule_append_to_miss_list(struct dr_ste_ctx *ste_ctx,
 				       struct dr_ste *new_last_ste,
@@ -131,14 +133,8 @@ free_tbl:
 	return NULL;
 }
 
-static int dr_rule_handle_one_ste_in_update_list(struct dr_ste_send_info *ste_info,
-						 struct mlx5dv_dr_domain *dmn,
-						 uint8_t send_ring_idx)
+static void dr_rule_update_ste_from_info(struct dr_ste_send_info *ste_info)
 {
-	int ret;
-
-	list_del(&ste_info->send_list);
-
 	/* Copy data to ste, only reduced size or control, the last 16B (mask)
 	 * is already written to the hw.
 	 */
@@ -146,6 +142,17 @@ static int dr_rule_handle_one_ste_in_update_list(struct dr_ste_send_info *ste_in
 		memcpy(ste_info->ste->hw_ste, ste_info->data, DR_STE_SIZE_CTRL);
 	else
 		memcpy(ste_info->ste->hw_ste, ste_info->data, ste_info->ste->size);
+}
+
+static int dr_rule_handle_one_ste_in_update_list(struct dr_ste_send_info *ste_info,
+						 struct mlx5dv_dr_domain *dmn,
+						 uint8_t send_ring_idx)
+{
+	int ret;
+
+	list_del(&ste_info->send_list);
+
+	dr_rule_update_ste_from_info(ste_info);
 
 	ret = dr_send_postsend_ste(dmn, ste_info->ste, ste_info->data,
 				   ste_info->size, ste_info->offset,
@@ -189,6 +196,131 @@ int dr_rule_send_update_list(struct list_head *send_ste_list,
 	return 0;
 }
 
+static void dr_rule_free_send_list(struct list_head *send_list)
+{
+	struct dr_ste_send_info *ste_info, *tmp_ste_info;
+
+	list_for_each_safe(send_list, ste_info, tmp_ste_info, send_list) {
+		list_del(&ste_info->send_list);
+		free(ste_info);
+	}
+}
+
+/*
+ * Queue the reverse update list of a rule on the bulk insertion batch rather
+ * than posting it. The STEs are updated now since the next rules look them
+ * up, and the data is copied as it may point to the caller stack.
+ */
+static void dr_rule_queue_update_list(struct list_head *send_ste_list,
+				      struct dr_rule_send_batch *batch)
+{
+	struct dr_ste_send_info *ste_info, *tmp_ste_info;
+
+	list_for_each_rev_safe(send_ste_list, ste_info, tmp_ste_info,
+			       send_list) {
+		list_del(&ste_info->send_list);
+
+		dr_rule_update_ste_from_info(ste_info);
+		if (ste_info->data != ste_info->data_cont) {
+			memcpy(ste_info->data_cont, ste_info->data,
+			       ste_info->size);
+			ste_info->data = ste_info->data_cont;
+		}
+
+		/* The last one sent hooks the rule into the existing tables */
+		if (list_empty(send_ste_list))
+			list_add_tail(&batch->connect_list, &ste_info->send_list);
+		else
+			list_add_tail(&batch->ste_list, &ste_info->send_list);
+	}
+}
+
+struct dr_rule_send_sort_ent {
+	uint64_t			icm_addr;
+	uint32_t			idx;
+	struct dr_ste_send_info		*ste_info;
+};
+
+static int dr_rule_send_sort_cmp(const void *a, const void *b)
+{
+	const struct dr_rule_send_sort_ent *ea = a, *eb = b;
+
+	if (ea->icm_addr != eb->icm_addr)
+		return ea->icm_addr < eb->icm_addr ? -1 : 1;
+
+	/* Keep the queue order of writes to the same STE */
+	return ea->idx < eb->idx ? -1 : ea->idx > eb->idx;
+}
+
+/* Sort a send list by ICM address, so neighbour STEs are written together */
+static void dr_rule_sort_send_list(struct list_head *send_list)
+{
+	struct dr_rule_send_sort_ent *ents;
+	struct dr_ste_send_info *ste_info;
+	uint32_t num = 0, i;
+
+	list_for_each(send_list, ste_info, send_list)
+		num++;
+
+	if (num < 2)
+		return;
+
+	/* Sorting only merges writes, without memory they are sent as is */
+	ents = malloc(num * sizeof(*ents));
+	if (!ents)
+		return;
+
+	i = 0;
+	list_for_each(send_list, ste_info, send_list) {
+		ents[i].icm_addr = dr_ste_get_mr_addr(ste_info->ste) +
+				   ste_info->offset;
+		ents[i].idx = i;
+		ents[i].ste_info = ste_info;
+		i++;
+	}
+
+	qsort(ents, num, sizeof(*ents), dr_rule_send_sort_cmp);
+
+	for (i = 0; i < num; i++) {
+		list_del(&ents[i].ste_info->send_list);
+		list_add_tail(send_list, &ents[i].ste_info->send_list);
+	}
+
+	free(ents);
+}
+
+/*
+ * Post the STE writes queued by a bulk insertion. The writes to tables not
+ * yet reachable by HW go first, then the writes connecting the rules, so HW
+ * never walks into a partially written rule.
+ */
+static int dr_rule_flush_send_batch(struct mlx5dv_dr_domain *dmn,
+				    struct dr_matcher_rx_tx *nic_matcher)
+{
+	struct dr_rule_send_batch *batch = nic_matcher->send_batch;
+	int ret;
+
+	if (!batch)
+		return 0;
+
+	dr_rule_sort_send_list(&batch->ste_list);
+	dr_rule_sort_send_list(&batch->connect_list);
+
+	/* Matchers which are not fixed size always use send ring 0 */
+	ret = dr_send_postsend_ste_list(dmn, &batch->ste_list, 0);
+	if (ret) {
+		dr_dbg(dmn, "Failed sending queued STEs\n");
+		dr_rule_free_send_list(&batch->connect_list);
+		return ret;
+	}
+
+	ret = dr_send_postsend_ste_list(dmn, &batch->connect_list, 0);
+	if (ret)
+		dr_dbg(dmn, "Failed sending queued rule connections\n");
+
+	return ret;
+}
+
 static struct dr_ste *dr_rule_find_ste_in_miss_list(struct list_head *miss_list,
 						    uint8_t *hw_ste,
 						    uint8_t tag_size)
@@ -1103,6 +1235,10 @@ again:
 			/* Hash table index in use, try to resize of the hash */
 			skip_rehash = true;
 
+			/* The new table is copied from the queued STEs */
+			if (dr_rule_flush_send_batch(dmn, nic_matcher))
+				return NULL;
+
 			/*
 			 * Hold the table till we update.
 			 * Release in dr_rule_create_rule_nr()
@@ -1356,7 +1492,8 @@ dr_rule_create_rule_nic(struct mlx5dv_dr_rule *rule,
 			struct dr_rule_rx_tx *nic_rule,
 			struct dr_match_param *param,
 			size_t num_actions,
-			struct mlx5dv_dr_action *actions[])
+			struct mlx5dv_dr_action *actions[],
+			bool bulk)
 {
 	uint8_t hw_ste_arr[DR_RULE_MAX_STE_CHAIN * DR_STE_SIZE] = {};
 	struct dr_matcher_rx_tx *nic_matcher = nic_rule->nic_matcher;
@@ -1382,7 +1519,9 @@ dr_rule_create_rule_nic(struct mlx5dv_dr_rule *rule,
 	if (ret)
 		return ret;
 
-	dr_rule_lock(nic_rule, hw_ste_arr);
+	/* A bulk insertion holds the matcher lock for all its rules */
+	if (!bulk)
+		dr_rule_lock(nic_rule, hw_ste_arr);
 
 	/* Set the actions values/addresses inside the ste array */
 	ret = dr_actions_build_ste_arr(matcher, nic_matcher, actions,
@@ -1430,10 +1569,23 @@ dr_rule_create_rule_nic(struct mlx5dv_dr_rule *rule,
 		dr_dbg(dmn, "Failed apply actions\n");
 		goto free_rule;
 	}
-	ret = dr_rule_send_update_list(&send_ste_list, dmn, true, nic_rule->lock_index);
-	if (ret) {
-		dr_dbg(dmn, "Failed sending ste!\n");
-		goto free_rule;
+
+	/*
+	 * After a rehash the old table is released below, the write moving HW
+	 * to the new table must be posted before that.
+	 */
+	if (nic_matcher->send_batch && !cross_dmn_p.cross_dmn_action && !htbl) {
+		dr_rule_queue_update_list(&send_ste_list,
+					  nic_matcher->send_batch);
+	} else {
+		ret = dr_rule_flush_send_batch(dmn, nic_matcher);
+		if (!ret)
+			ret = dr_rule_send_update_list(&send_ste_list, dmn, true,
+						       nic_rule->lock_index);
+		if (ret) {
+			dr_dbg(dmn, "Failed sending ste!\n");
+			goto free_rule;
+		}
 	}
 
 	if (htbl)
@@ -1442,6 +1594,9 @@ dr_rule_create_rule_nic(struct mlx5dv_dr_rule *rule,
 	goto out_unlock;
 
 free_rule:
+	/* Queued writes of previous rules may touch the STEs released here */
+	dr_rule_flush_send_batch(dmn, nic_matcher);
+
 	if (cross_dmn_p.cross_dmn_action) {
 		dr_rule_clean_cross_dmn_rule_members(rule, nic_rule,
 						     &send_ste_list,
@@ -1455,7 +1610,8 @@ free_rule:
 		}
 	}
 out_unlock:
-	dr_rule_unlock(nic_rule);
+	if (!bulk)
+		dr_rule_unlock(nic_rule);
 	return ret;
 }
 
@@ -1463,7 +1619,8 @@ static int
 dr_rule_create_rule_fdb(struct mlx5dv_dr_rule *rule,
 			struct dr_match_param *param,
 			size_t num_actions,
-			struct mlx5dv_dr_action *actions[])
+			struct mlx5dv_dr_action *actions[],
+			bool bulk)
 {
 	struct dr_match_param copy_param = {};
 	int ret;
@@ -1475,19 +1632,26 @@ dr_rule_create_rule_fdb(struct mlx5dv_dr_rule *rule,
 	memcpy(&copy_param, param, sizeof(struct dr_match_param));
 
 	ret = dr_rule_create_rule_nic(rule, &rule->rx, param,
-				      num_actions, actions);
+				      num_actions, actions, bulk);
 	if (ret)
 		return ret;
 
 	ret = dr_rule_create_rule_nic(rule, &rule->tx, &copy_param,
-				      num_actions, actions);
+				      num_actions, actions, bulk);
 	if (ret)
 		goto destroy_rule_nic_rx;
 
 	return 0;
 
 destroy_rule_nic_rx:
-	dr_rule_destroy_rule_nic(rule, &rule->rx);
+	if (bulk) {
+		/* The rx lock is held and the rx STEs may still be queued */
+		dr_rule_flush_send_batch(rule->matcher->tbl->dmn,
+					 rule->rx.nic_matcher);
+		dr_rule_clean_rule_members(rule, &rule->rx);
+	} else {
+		dr_rule_destroy_rule_nic(rule, &rule->rx);
+	}
 	return ret;
 }
 
@@ -1495,7 +1659,8 @@ static struct mlx5dv_dr_rule *
 dr_rule_create_rule(struct mlx5dv_dr_matcher *matcher,
 		    struct mlx5dv_flow_match_parameters *value,
 		    size_t num_actions,
-		    struct mlx5dv_dr_action *actions[])
+		    struct mlx5dv_dr_action *actions[],
+		    bool bulk)
 {
 	struct mlx5dv_dr_domain *dmn = matcher->tbl->dmn;
 	struct dr_match_param param = {};
@@ -1523,18 +1688,18 @@ dr_rule_create_rule(struct mlx5dv_dr_matcher *matcher,
 	case MLX5DV_DR_DOMAIN_TYPE_NIC_RX:
 		rule->rx.nic_matcher = &matcher->rx;
 		ret = dr_rule_create_rule_nic(rule, &rule->rx, &param,
-					      num_actions, actions);
+					      num_actions, actions, bulk);
 		break;
 	case MLX5DV_DR_DOMAIN_TYPE_NIC_TX:
 		rule->tx.nic_matcher = &matcher->tx;
 		ret = dr_rule_create_rule_nic(rule, &rule->tx, &param,
-					      num_actions, actions);
+					      num_actions, actions, bulk);
 		break;
 	case MLX5DV_DR_DOMAIN_TYPE_FDB:
 		rule->rx.nic_matcher = &matcher->rx;
 		rule->tx.nic_matcher = &matcher->tx;
 		ret = dr_rule_create_rule_fdb(rule, &param,
-					      num_actions, actions);
+					      num_actions, actions, bulk);
 		break;
 	default:
 		ret = EINVAL;
@@ -1545,9 +1710,15 @@ dr_rule_create_rule(struct mlx5dv_dr_matcher *matcher,
 	if (ret)
 		goto remove_action_members;
 
-	pthread_spin_lock(&dmn->debug_lock);
-	list_add_tail(&matcher->rule_list, &rule->rule_list);
-	pthread_spin_unlock(&dmn->debug_lock);
+	/*
+	 * The dump takes debug_lock before the matcher locks, a bulk insertion
+	 * adds its rules once it dropped them.
+	 */
+	if (!bulk) {
+		pthread_spin_lock(&dmn->debug_lock);
+		list_add_tail(&matcher->rule_list, &rule->rule_list);
+		pthread_spin_unlock(&dmn->debug_lock);
+	}
 
 	return rule;
 
@@ -1634,7 +1805,8 @@ struct mlx5dv_dr_rule *mlx5dv_dr_rule_create(struct mlx5dv_dr_matcher *matcher,
 	if (dr_is_root_table(matcher->tbl))
 		rule = dr_rule_create_rule_root(matcher, value, num_actions, actions);
 	else
-		rule = dr_rule_create_rule(matcher, value, num_actions, actions);
+		rule = dr_rule_create_rule(matcher, value, num_actions, actions,
+					   false);
 
 	if (!rule)
 		atomic_fetch_sub(&matcher->refcount, 1);
@@ -1642,6 +1814,192 @@ struct mlx5dv_dr_rule *mlx5dv_dr_rule_create(struct mlx5dv_dr_matcher *matcher,
 	return rule;
 }
 
+/*
+ * Grow the matcher start table once for the whole bulk, instead of rehashing
+ * it step by step while its rules are added.
+ */
+static void dr_rule_bulk_presize(struct mlx5dv_dr_matcher *matcher,
+				 struct dr_matcher_rx_tx *nic_matcher,
+				 size_t num_rules)
+{
+	struct dr_domain_rx_tx *nic_dmn = nic_matcher->nic_tbl->nic_dmn;
+	struct mlx5dv_dr_domain *dmn = matcher->tbl->dmn;
+	struct dr_ste_htbl *cur_htbl, *new_htbl;
+	uint32_t new_size, max_size;
+	LIST_HEAD(update_list);
+	uint64_t num_entries;
+
+	pthread_spin_lock(&nic_dmn->locks[0]);
+
+	cur_htbl = nic_matcher->s_htbl;
+	if (!dr_ste_htbl_may_grow(cur_htbl))
+		goto out_unlock;
+
+	/* Same limits as dr_rule_need_enlarge_hash() */
+	max_size = min_t(uint32_t, dmn->info.max_log_sw_icm_sz,
+			 DR_CHUNK_SIZE_MAX - 1);
+	if (cur_htbl->type == DR_STE_HTBL_TYPE_LEGACY)
+		max_size = min_t(uint32_t, max_size,
+				 dr_get_bits_per_mask(cur_htbl->byte_mask) * CHAR_BIT);
+
+	/* One entry per rule, rehash grows the table at about that load */
+	num_entries = cur_htbl->ctrl.num_of_valid_entries + num_rules;
+	new_size = min_t(uint32_t, ilog64(num_entries - 1), max_size);
+	if (new_size <= cur_htbl->chunk_size)
+		goto out_unlock;
+
+	/* Hold the table till we update, as on rehash of a single rule */
+	dr_htbl_get(cur_htbl);
+
+	new_htbl = dr_rule_rehash_htbl_common(matcher, nic_matcher, cur_htbl,
+					      1, &update_list, new_size, 0);
+	if (!new_htbl) {
+		dr_dbg(dmn, "Failed creating rehash table, htbl-log_size: %d\n",
+		       new_size);
+		goto put_htbl;
+	}
+
+	if (dr_rule_send_update_list(&update_list, dmn, true, 0))
+		dr_dbg(dmn, "Failed sending ste!\n");
+
+put_htbl:
+	dr_htbl_put(cur_htbl);
+out_unlock:
+	pthread_spin_unlock(&nic_dmn->locks[0]);
+}
+
+static int dr_rule_bulk_get_nic_matchers(struct mlx5dv_dr_matcher *matcher,
+					 struct dr_matcher_rx_tx **nic_matchers)
+{
+	switch (matcher->tbl->dmn->type) {
+	case MLX5DV_DR_DOMAIN_TYPE_NIC_RX:
+		nic_matchers[0] = &matcher->rx;
+		return 1;
+	case MLX5DV_DR_DOMAIN_TYPE_NIC_TX:
+		nic_matchers[0] = &matcher->tx;
+		return 1;
+	case MLX5DV_DR_DOMAIN_TYPE_FDB:
+		/* Same lock order as dr_domain_lock() */
+		nic_matchers[0] = &matcher->rx;
+		nic_matchers[1] = &matcher->tx;
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static int dr_rule_create_bulk_single(struct mlx5dv_dr_matcher *matcher,
+				      struct mlx5dv_dr_rule_attr *attrs,
+				      struct mlx5dv_dr_rule **rules,
+				      size_t num_rules)
+{
+	size_t i;
+	int ret;
+
+	for (i = 0; i < num_rules; i++) {
+		rules[i] = mlx5dv_dr_rule_create(matcher, attrs[i].value,
+						 attrs[i].num_actions,
+						 attrs[i].actions);
+		if (!rules[i])
+			goto destroy_rules;
+	}
+
+	return 0;
+
+destroy_rules:
+	ret = errno ? errno : EINVAL;
+	while (i--)
+		mlx5dv_dr_rule_destroy(rules[i]);
+
+	errno = ret;
+	return ret;
+}
+
+int mlx5dv_dr_rule_create_bulk(struct mlx5dv_dr_matcher *matcher,
+			       struct mlx5dv_dr_rule_attr *attrs,
+			       struct mlx5dv_dr_rule **rules,
+			       size_t num_rules)
+{
+	/* Both rx and tx on FDB */
+	struct dr_matcher_rx_tx *nic_matchers[2];
+	struct dr_rule_send_batch batch[2];
+	struct mlx5dv_dr_domain *dmn = matcher->tbl->dmn;
+	size_t i = 0, start, end;
+	int num_nics, n;
+	int ret = 0;
+
+	if (!num_rules)
+		return 0;
+
+	/*
+	 * Root tables are written by the kernel, and fixed size matchers
+	 * spread their rules over several locks and send rings.
+	 */
+	if (dr_is_root_table(matcher->tbl) ||
+	    matcher->rx.fixed_size || matcher->tx.fixed_size)
+		return dr_rule_create_bulk_single(matcher, attrs, rules,
+						  num_rules);
+
+	num_nics = dr_rule_bulk_get_nic_matchers(matcher, nic_matchers);
+	if (!num_nics) {
+		errno = EINVAL;
+		return EINVAL;
+	}
+
+	for (n = 0; n < num_nics; n++)
+		dr_rule_bulk_presize(matcher, nic_matchers[n], num_rules);
+
+	while (i < num_rules) {
+		start = i;
+		end = min_t(size_t, num_rules, i + DR_RULE_BULK_MAX_RULES);
+
+		for (n = 0; n < num_nics; n++) {
+			pthread_spin_lock(&nic_matchers[n]->nic_tbl->nic_dmn->locks[0]);
+			list_head_init(&batch[n].ste_list);
+			list_head_init(&batch[n].connect_list);
+			nic_matchers[n]->send_batch = &batch[n];
+		}
+
+		for (; i < end; i++) {
+			atomic_fetch_add(&matcher->refcount, 1);
+			rules[i] = dr_rule_create_rule(matcher, attrs[i].value,
+						       attrs[i].num_actions,
+						       attrs[i].actions, true);
+			if (!rules[i]) {
+				atomic_fetch_sub(&matcher->refcount, 1);
+				ret = errno ? errno : EINVAL;
+				break;
+			}
+		}
+
+		for (n = num_nics - 1; n >= 0; n--) {
+			int err = dr_rule_flush_send_batch(dmn, nic_matchers[n]);
+
+			if (err && !ret)
+				ret = err;
+			nic_matchers[n]->send_batch = NULL;
+			pthread_spin_unlock(&nic_matchers[n]->nic_tbl->nic_dmn->locks[0]);
+		}
+
+		pthread_spin_lock(&dmn->debug_lock);
+		for (; start < i; start++)
+			list_add_tail(&matcher->rule_list, &rules[start]->rule_list);
+		pthread_spin_unlock(&dmn->debug_lock);
+
+		if (ret)
+			goto destroy_rules;
+	}
+
+	return 0;
+
+destroy_rules:
+	while (i--)
+		mlx5dv_dr_rule_destroy(rules[i]);
+
+	errno = ret;
+	return ret;
+}
+
 int mlx5dv_dr_rule_destroy(struct mlx5dv_dr_rule *rule)
 {
 	struct mlx5dv_dr_matcher *matcher = rule->matcher;
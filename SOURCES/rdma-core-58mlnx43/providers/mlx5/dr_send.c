@@ -588,18 +588,20 @@ static void dr_rdma_segments(struct dr_qp *dr_qp, uint64_t remote_addr,
 		dr_post_send_db(dr_qp, ctrl);
 }
 
-static void dr_post_send(struct dr_qp *dr_qp, struct postsend_info *send_info)
+static void dr_post_send(struct dr_qp *dr_qp, struct postsend_info *send_info,
+			 bool send_now)
 {
 	if (send_info->type == WRITE_ICM) {
 		/* false, because we delay the post_send_db till the coming READ */
 		dr_rdma_segments(dr_qp, send_info->remote_addr, send_info->rkey,
 				 &send_info->write, MLX5_OPCODE_RDMA_WRITE, false);
-		/* true, because we send WRITE + READ together */
+		/* send_now, because we send WRITE + READ together */
 		dr_rdma_segments(dr_qp, send_info->remote_addr, send_info->rkey,
-				 &send_info->read, MLX5_OPCODE_RDMA_READ, true);
+				 &send_info->read, MLX5_OPCODE_RDMA_READ, send_now);
 	} else { /* GTA_ARG */
 		dr_rdma_segments(dr_qp, send_info->remote_addr, send_info->rkey,
-				 &send_info->write, MLX5_OPCODE_FLOW_TBL_ACCESS, true);
+				 &send_info->write, MLX5_OPCODE_FLOW_TBL_ACCESS,
+				 send_now);
 	}
 }
 
@@ -747,6 +749,31 @@ static void dr_fill_data_segs(struct mlx5dv_dr_domain *dmn,
 		dr_fill_write_args_segs(send_ring, send_info);
 }
 
+/*
+ * Post one request on a locked send ring. The doorbell may be delayed by
+ * clearing send_now, it is still rung for signaled requests since
+ * dr_handle_pending_wc() waits for their completion.
+ */
+static int dr_postsend_icm_data_locked(struct mlx5dv_dr_domain *dmn,
+				       struct dr_send_ring *send_ring,
+				       struct postsend_info *send_info,
+				       bool send_now)
+{
+	int ret;
+
+	ret = dr_handle_pending_wc(dmn, send_ring);
+	if (ret)
+		return ret;
+
+	dr_fill_data_segs(dmn, send_ring, send_info);
+	if ((send_info->write.send_flags | send_info->read.send_flags) &
+	    IBV_SEND_SIGNALED)
+		send_now = true;
+
+	dr_post_send(send_ring->qp, send_info, send_now);
+	return 0;
+}
+
 static int dr_postsend_icm_data(struct mlx5dv_dr_domain *dmn,
 				struct postsend_info *send_info,
 				int ring_idx)
@@ -756,14 +783,7 @@ static int dr_postsend_icm_data(struct mlx5dv_dr_domain *dmn,
 	int ret;
 
 	pthread_spin_lock(&send_ring->lock);
-	ret = dr_handle_pending_wc(dmn, send_ring);
-	if (ret)
-		goto out_unlock;
-
-	dr_fill_data_segs(dmn, send_ring, send_info);
-	dr_post_send(send_ring->qp, send_info);
-
-out_unlock:
+	ret = dr_postsend_icm_data_locked(dmn, send_ring, send_info, true);
 	pthread_spin_unlock(&send_ring->lock);
 	return ret;
 }
@@ -827,6 +847,85 @@ int dr_send_postsend_ste(struct mlx5dv_dr_domain *dmn, struct dr_ste *ste,
 	return dr_postsend_icm_data(dmn, &send_info, ring_idx);
 }
 
+/*
+ * dr_send_postsend_ste_list: write the STEs of a send list, in list order,
+ * and free the list entries.
+ *
+ * The send ring is locked once for the whole list. Entries that continue the
+ * ICM range of the previous ones are merged into a single write, and the
+ * doorbell is rung only for signaled requests and for the last one.
+ *
+ * Return: 0 on success.
+ */
+int dr_send_postsend_ste_list(struct mlx5dv_dr_domain *dmn,
+			      struct list_head *send_list,
+			      uint8_t ring_idx)
+{
+	struct dr_send_ring *send_ring =
+		dmn->send_ring[ring_idx % DR_MAX_SEND_RINGS];
+	struct dr_ste_send_info *ste_info, *tmp_ste_info;
+	struct postsend_info send_info = {};
+	uint64_t remote_addr;
+	uint32_t rkey;
+	uint8_t *data;
+	int ret = 0;
+
+	data = malloc(dmn->info.max_send_size);
+	if (!data) {
+		errno = ENOMEM;
+		ret = ENOMEM;
+		goto free_list;
+	}
+
+	pthread_spin_lock(&send_ring->lock);
+	list_for_each_safe(send_list, ste_info, tmp_ste_info, send_list) {
+		remote_addr = dr_ste_get_mr_addr(ste_info->ste) + ste_info->offset;
+		rkey = ste_info->ste->htbl->chunk->rkey;
+
+		if (send_info.write.length &&
+		    (rkey != send_info.rkey ||
+		     remote_addr != send_info.remote_addr + send_info.write.length ||
+		     send_info.write.length + ste_info->size > dmn->info.max_send_size)) {
+			ret = dr_postsend_icm_data_locked(dmn, send_ring,
+							  &send_info, false);
+			if (ret)
+				goto out_unlock;
+
+			memset(&send_info, 0, sizeof(send_info));
+		}
+
+		if (!send_info.write.length) {
+			send_info.write.addr	= (uintptr_t) data;
+			send_info.write.lkey	= 0;
+			send_info.remote_addr	= remote_addr;
+			send_info.rkey		= rkey;
+		}
+
+		dr_ste_prepare_for_postsend(dmn->ste_ctx, ste_info->data,
+					    ste_info->size);
+		memcpy(data + send_info.write.length, ste_info->data,
+		       ste_info->size);
+		send_info.write.length += ste_info->size;
+
+		list_del(&ste_info->send_list);
+		free(ste_info);
+	}
+
+	if (send_info.write.length)
+		ret = dr_postsend_icm_data_locked(dmn, send_ring, &send_info,
+						  true);
+
+out_unlock:
+	pthread_spin_unlock(&send_ring->lock);
+	free(data);
+free_list:
+	list_for_each_safe(send_list, ste_info, tmp_ste_info, send_list) {
+		list_del(&ste_info->send_list);
+		free(ste_info);
+	}
+	return ret;
+}
+
 int dr_send_postsend_htbl(struct mlx5dv_dr_domain *dmn, struct dr_ste_htbl *htbl,
 			  uint8_t *formated_ste, uint8_t *mask,
 			  uint8_t send_ring_idx)
@@ -1186,6 +1186,16 @@ struct mlx5dv_dr_table {
 	struct list_node		tbl_list;
 };
 
+/*
+ * STE writes queued by a bulk rule insertion. The last write of each rule is
+ * the one connecting it to tables already seen by HW, the others go to
+ * tables only reachable through it.
+ */
+struct dr_rule_send_batch {
+	struct list_head		ste_list;
+	struct list_head		connect_list;
+};
+
 struct dr_matcher_rx_tx {
 	struct dr_ste_htbl		*s_htbl;
 	struct dr_ste_htbl		*e_anchor;
@@ -1194,6 +1204,8 @@ struct dr_matcher_rx_tx {
 	uint64_t			default_icm_addr;
 	struct dr_table_rx_tx		*nic_tbl;
 	bool				fixed_size;
+	/* set under the matcher lock while a bulk insertion is running */
+	struct dr_rule_send_batch	*send_batch;
 };
 
 struct mlx5dv_dr_matcher {
@@ -1654,6 +1666,9 @@ void dr_ste_copy_param(uint8_t match_criteria,
 
 void dr_crc32_init_table(void);
 uint32_t dr_crc32_slice8_calc(const void *input_data, size_t length);
+bool dr_crc32_hw_supported(void);
+uint32_t dr_crc32_hw_calc(const void *input_data, size_t length);
+uint32_t dr_crc32_calc(const void *input_data, size_t length);
 
 struct dr_wq {
 	unsigned	*wqe_head;
@@ -1722,6 +1737,9 @@ bool dr_send_allow_fl(struct dr_devx_caps *caps);
 int dr_send_postsend_ste(struct mlx5dv_dr_domain *dmn, struct dr_ste *ste,
 			 uint8_t *data, uint16_t size, uint16_t offset,
 			 uint8_t ring_idx);
+int dr_send_postsend_ste_list(struct mlx5dv_dr_domain *dmn,
+			      struct list_head *send_list,
+			      uint8_t ring_idx);
 int dr_send_postsend_htbl(struct mlx5dv_dr_domain *dmn, struct dr_ste_htbl *htbl,
 			  uint8_t *formated_ste, uint8_t *mask,
 			  uint8_t send_ring_idx);
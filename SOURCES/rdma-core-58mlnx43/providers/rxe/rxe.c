@@ -227,6 +227,40 @@ static struct ibv_mr *rxe_reg_mr(struct ibv_pd *pd, void *addr, size_t length,
 	return &vmr->ibv_mr;
 }
 
+static int rxe_reg_mr_batch(struct ibv_pd *pd,
+			    const struct ibv_mr_batch_attr *attrs,
+			    struct ibv_mr **mrs, unsigned int num)
+{
+	struct verbs_mr **vmrs;
+	unsigned int i;
+	int ret = ENOMEM;
+
+	vmrs = calloc(num, sizeof(*vmrs));
+	if (!vmrs)
+		return ENOMEM;
+
+	for (i = 0; i != num; i++) {
+		vmrs[i] = calloc(1, sizeof(*vmrs[i]));
+		if (!vmrs[i])
+			goto out;
+	}
+
+	ret = ibv_cmd_reg_mr_batch(pd, attrs, vmrs, NULL, num);
+	if (ret)
+		goto out;
+
+	for (i = 0; i != num; i++)
+		mrs[i] = &vmrs[i]->ibv_mr;
+
+out:
+	if (ret) {
+		for (i = 0; i != num; i++)
+			free(vmrs[i]);
+	}
+	free(vmrs);
+	return ret;
+}
+
 static int rxe_dereg_mr(struct verbs_mr *vmr)
 {
 	int ret;
@@ -415,40 +449,23 @@ enum rxe_sup_wc_flags {
 				// add extended flags here
 };
 
-static struct ibv_cq_ex *rxe_create_cq_ex(struct ibv_context *context,
-					  struct ibv_cq_init_attr_ex *attr)
+/* Map the queue of a CQ created by the kernel and set up the poll ops */
+static int rxe_map_cq(struct ibv_context *context, struct rxe_cq *cq,
+		      struct ibv_cq_init_attr_ex *attr, struct mminfo *mi)
 {
-	int ret;
-	struct rxe_cq *cq;
-	struct urxe_create_cq_ex_resp resp = {};
-
-	/* user is asking for flags we don't support */
-	if (attr->wc_flags & ~RXE_SUP_WC_EX_FLAGS) {
-		errno = EOPNOTSUPP;
-		goto err;
-	}
-
-	cq = calloc(1, sizeof(*cq));
-	if (!cq)
-		goto err;
-
-	ret = ibv_cmd_create_cq_ex(context, attr, &cq->vcq,
-				   NULL, 0,
-				   &resp.ibv_resp, sizeof(resp), 0);
-	if (ret)
-		goto err_free;
-
-	cq->queue = mmap(NULL, resp.mi.size, PROT_READ | PROT_WRITE, MAP_SHARED,
-			 context->cmd_fd, resp.mi.offset);
+	cq->queue = mmap(NULL, mi->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			 context->cmd_fd, mi->offset);
 	if ((void *)cq->queue == MAP_FAILED)
-		goto err_destroy;
+		return errno;
 
 	cq->wc_size = 1ULL << cq->queue->log2_elem_size;
 
-	if (cq->wc_size < sizeof(struct ib_uverbs_wc))
-		goto err_unmap;
+	if (cq->wc_size < sizeof(struct ib_uverbs_wc)) {
+		munmap(cq->queue, mi->size);
+		return EINVAL;
+	}
 
-	cq->mmap_info = resp.mi;
+	cq->mmap_info = *mi;
 	pthread_spin_init(&cq->lock, PTHREAD_PROCESS_PRIVATE);
 
 	cq->vcq.cq_ex.start_poll	= cq_start_poll;
@@ -486,11 +503,38 @@ static struct ibv_cq_ex *rxe_create_cq_ex(struct ibv_context *context,
 		cq->vcq.cq_ex.read_dlid_path_bits
 			= cq_read_dlid_path_bits;
 
+	return 0;
+}
+
+static struct ibv_cq_ex *rxe_create_cq_ex(struct ibv_context *context,
+					  struct ibv_cq_init_attr_ex *attr)
+{
+	int ret;
+	struct rxe_cq *cq;
+	struct urxe_create_cq_ex_resp resp = {};
+
+	/* user is asking for flags we don't support */
+	if (attr->wc_flags & ~RXE_SUP_WC_EX_FLAGS) {
+		errno = EOPNOTSUPP;
+		goto err;
+	}
+
+	cq = calloc(1, sizeof(*cq));
+	if (!cq)
+		goto err;
+
+	ret = ibv_cmd_create_cq_ex(context, attr, &cq->vcq,
+				   NULL, 0,
+				   &resp.ibv_resp, sizeof(resp), 0);
+	if (ret)
+		goto err_free;
+
+	ret = rxe_map_cq(context, cq, attr, &resp.mi);
+	if (ret)
+		goto err_destroy;
+
 	return &cq->vcq.cq_ex;
 
-err_unmap:
-	if (cq->mmap_info.size)
-		munmap(cq->queue, cq->mmap_info.size);
 err_destroy:
 	ibv_cmd_destroy_cq(&cq->vcq.cq);
 err_free:
@@ -499,6 +543,69 @@ err:
 	return NULL;
 }
 
+static int rxe_create_cq_batch(struct ibv_context *context,
+			       struct ibv_cq_init_attr_ex *attrs,
+			       struct ibv_cq_ex **cqs, unsigned int num)
+{
+	struct rxe_create_cq_resp *resp;
+	struct ibv_batch_udata *udata;
+	struct verbs_cq **vcqs;
+	unsigned int i, j;
+	int ret = ENOMEM;
+
+	for (i = 0; i != num; i++) {
+		if (attrs[i].wc_flags & ~RXE_SUP_WC_EX_FLAGS)
+			return EOPNOTSUPP;
+	}
+
+	resp = calloc(num, sizeof(*resp));
+	udata = calloc(num, sizeof(*udata));
+	vcqs = calloc(num, sizeof(*vcqs));
+	if (!resp || !udata || !vcqs)
+		goto out;
+
+	for (i = 0; i != num; i++) {
+		struct rxe_cq *cq = calloc(1, sizeof(*cq));
+
+		if (!cq)
+			goto err_free;
+		vcqs[i] = &cq->vcq;
+		udata[i].resp = &resp[i];
+		udata[i].resp_size = sizeof(resp[i]);
+	}
+
+	ret = ibv_cmd_create_cq_batch(context, attrs, vcqs, udata, num);
+	if (ret)
+		goto err_free;
+
+	for (i = 0; i != num; i++) {
+		ret = rxe_map_cq(context, to_rcq(&vcqs[i]->cq), &attrs[i],
+				 &resp[i].mi);
+		if (ret)
+			goto err_destroy;
+		cqs[i] = &vcqs[i]->cq_ex;
+	}
+	goto out;
+
+err_destroy:
+	for (j = 0; j != num; j++) {
+		if (j < i)
+			munmap(to_rcq(&vcqs[j]->cq)->queue,
+			       resp[j].mi.size);
+		ibv_cmd_destroy_cq(&vcqs[j]->cq);
+	}
+err_free:
+	for (j = 0; j != num; j++) {
+		if (vcqs[j])
+			free(to_rcq(&vcqs[j]->cq));
+	}
+out:
+	free(vcqs);
+	free(udata);
+	free(resp);
+	return ret;
+}
+
 static int rxe_resize_cq(struct ibv_cq *ibcq, int cqe)
 {
 	struct rxe_cq *cq = to_rcq(ibcq);
@@ -1330,6 +1437,82 @@ err:
 	return NULL;
 }
 
+static int rxe_destroy_qp(struct ibv_qp *ibqp);
+
+static int rxe_create_qp_batch(struct ibv_context *context,
+			       struct ibv_qp_init_attr_ex *attrs,
+			       struct ibv_qp **qps, unsigned int num)
+{
+	struct rxe_create_qp_resp *resp;
+	struct ibv_batch_udata *udata;
+	struct verbs_qp **vqps;
+	unsigned int i, j;
+	int ret = ENOMEM;
+
+	for (i = 0; i != num; i++) {
+		ret = check_qp_init_attr(&attrs[i]);
+		if (ret)
+			return ret;
+	}
+
+	resp = calloc(num, sizeof(*resp));
+	udata = calloc(num, sizeof(*udata));
+	vqps = calloc(num, sizeof(*vqps));
+	if (!resp || !udata || !vqps) {
+		ret = ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i != num; i++) {
+		struct rxe_qp *qp = calloc(1, sizeof(*qp));
+
+		if (!qp) {
+			ret = ENOMEM;
+			goto err_free;
+		}
+		if (attrs[i].comp_mask & IBV_QP_INIT_ATTR_SEND_OPS_FLAGS)
+			set_qp_send_ops(qp, attrs[i].send_ops_flags);
+		vqps[i] = &qp->vqp;
+		udata[i].resp = &resp[i];
+		udata[i].resp_size = sizeof(resp[i]);
+	}
+
+	ret = ibv_cmd_create_qp_batch(context, attrs, vqps, udata, num);
+	if (ret)
+		goto err_free;
+
+	for (i = 0; i != num; i++) {
+		vqps[i]->comp_mask |= VERBS_QP_EX;
+		ret = map_queue_pair(context->cmd_fd, to_rqp(&vqps[i]->qp),
+				     (struct ibv_qp_init_attr *)&attrs[i],
+				     &resp[i]);
+		if (ret)
+			goto err_destroy;
+		qps[i] = &vqps[i]->qp;
+	}
+	goto out;
+
+err_destroy:
+	for (j = 0; j != num; j++) {
+		if (j < i) {
+			rxe_destroy_qp(&vqps[j]->qp);
+			vqps[j] = NULL;
+		} else {
+			ibv_cmd_destroy_qp(&vqps[j]->qp);
+		}
+	}
+err_free:
+	for (j = 0; j != num; j++) {
+		if (vqps[j])
+			free(to_rqp(&vqps[j]->qp));
+	}
+out:
+	free(vqps);
+	free(udata);
+	free(resp);
+	return ret;
+}
+
 static int rxe_query_qp(struct ibv_qp *ibqp, struct ibv_qp_attr *attr,
 			int attr_mask, struct ibv_qp_init_attr *init_attr)
 {
@@ -1735,12 +1918,14 @@ static const struct verbs_context_ops rxe_ctx_ops = {
 	.alloc_pd = rxe_alloc_pd,
 	.dealloc_pd = rxe_dealloc_pd,
 	.reg_mr = rxe_reg_mr,
+	.reg_mr_batch = rxe_reg_mr_batch,
 	.dereg_mr = rxe_dereg_mr,
 	.alloc_mw = rxe_alloc_mw,
 	.dealloc_mw = rxe_dealloc_mw,
 	.bind_mw = rxe_bind_mw,
 	.create_cq = rxe_create_cq,
 	.create_cq_ex = rxe_create_cq_ex,
+	.create_cq_batch = rxe_create_cq_batch,
 	.poll_cq = rxe_poll_cq,
 	.req_notify_cq = ibv_cmd_req_notify_cq,
 	.resize_cq = rxe_resize_cq,
@@ -1752,6 +1937,7 @@ static const struct verbs_context_ops rxe_ctx_ops = {
 	.post_srq_recv = rxe_post_srq_recv,
 	.create_qp = rxe_create_qp,
 	.create_qp_ex = rxe_create_qp_ex,
+	.create_qp_batch = rxe_create_qp_batch,
 	.query_qp = rxe_query_qp,
 	.modify_qp = rxe_modify_qp,
 	.destroy_qp = rxe_destroy_qp,
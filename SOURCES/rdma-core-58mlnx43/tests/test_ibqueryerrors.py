@@ -0,0 +1,273 @@
+# SPDX-License-Identifier: (GPL-2.0 OR Linux-OpenIB)
+# Copyright (c) 2022 Nvidia, Inc. All rights reserved. See COPYING file
+"""
+Test ibqueryerrors' pipelined PMA collection (--parallel, --snapshot and
+--delta) against the umad_simd fabric simulator.
+"""
+
+import subprocess
+import tempfile
+import unittest
+import struct
+import shutil
+import time
+import sys
+import os
+import re
+
+
+SNAP_HDR = struct.Struct('<8sIIIIQ')
+SNAP_NUM_CTRS = 17
+SNAP_REC = struct.Struct('<QBB6x%dQ' % SNAP_NUM_CTRS)
+SNAP_SYM_ERR = 0
+SNAP_XMT_BYTES = 13
+
+NUM_SWITCHES = 3
+HOSTS_PER_SWITCH = 6
+# Enhanced port 0 and the two ring links of every switch, one port per host
+NUM_PORTS = NUM_SWITCHES * (HOSTS_PER_SWITCH + 3) + \
+            NUM_SWITCHES * HOSTS_PER_SWITCH
+SW_GUID_BASE = 0x248a070300aa0000
+HOST_GUID_BASE = 0x0002c90300000000
+
+
+def build_bin_dir():
+    """
+    Test executables are only built into the bin directory next to the
+    python directory that run_tests.py puts on PYTHONPATH.
+    """
+    for path in sys.path:
+        bin_dir = os.path.join(os.path.dirname(os.path.abspath(path)), 'bin')
+        if os.path.exists(os.path.join(bin_dir, 'umad_simd')):
+            return bin_dir
+    return None
+
+
+def topology():
+    """
+    A ring of switches with hosts on each of them, in ibnetdiscover format.
+    """
+    sw_guid = lambda s: SW_GUID_BASE + (s << 8)
+    host_guid = lambda s, h: HOST_GUID_BASE + (s << 12) + (h << 4)
+    sw_lid = lambda s: s + 1
+    host_lid = lambda s, h: NUM_SWITCHES + s * HOSTS_PER_SWITCH + h + 1
+    lines = []
+    for s in range(NUM_SWITCHES):
+        lines += ['vendid=0x2c9', 'devid=0xc738',
+                  f'sysimgguid={sw_guid(s):#x}',
+                  f'switchguid={sw_guid(s):#x}({sw_guid(s):x})',
+                  f'Switch\t{HOSTS_PER_SWITCH + 2} "S-{sw_guid(s):016x}"\t\t'
+                  f'# "sw{s}" enhanced port 0 lid {sw_lid(s)} lmc 0']
+        for h in range(HOSTS_PER_SWITCH):
+            lines.append(f'[{h + 1}]\t"H-{host_guid(s, h):016x}"[1]'
+                         f'({host_guid(s, h) + 1:x})\t\t# "host{s}-{h}" '
+                         f'lid {host_lid(s, h)} 4xEDR')
+        nxt = (s + 1) % NUM_SWITCHES
+        prv = (s - 1) % NUM_SWITCHES
+        lines.append(f'[{HOSTS_PER_SWITCH + 1}]\t"S-{sw_guid(nxt):016x}"'
+                     f'[{HOSTS_PER_SWITCH + 2}]\t\t# "sw{nxt}" '
+                     f'lid {sw_lid(nxt)} 4xEDR')
+        lines.append(f'[{HOSTS_PER_SWITCH + 2}]\t"S-{sw_guid(prv):016x}"'
+                     f'[{HOSTS_PER_SWITCH + 1}]\t\t# "sw{prv}" '
+                     f'lid {sw_lid(prv)} 4xEDR')
+        lines.append('')
+    for s in range(NUM_SWITCHES):
+        for h in range(HOSTS_PER_SWITCH):
+            g = host_guid(s, h)
+            lines += ['vendid=0x2c9', 'devid=0x1017',
+                      f'sysimgguid={g + 3:#x}', f'caguid={g:#x}',
+                      f'Ca\t1 "H-{g:016x}"\t\t# "host{s}-{h}"',
+                      f'[1]({g + 1:x})\t"S-{sw_guid(s):016x}"[{h + 1}]\t\t'
+                      f'# lid {host_lid(s, h)} lmc 0 "sw{s}" '
+                      f'lid {sw_lid(s)} 4xEDR',
+                      '']
+    return '\n'.join(lines)
+
+
+def port_guid(node_guid, port):
+    """
+    Switch ports share the switch GUID, a host port GUID follows its node
+    GUID in topology().
+    """
+    if node_guid & ~0xffff == SW_GUID_BASE:
+        return node_guid
+    return node_guid + port
+
+
+def read_snapshot(path):
+    with open(path, 'rb') as f:
+        buf = f.read()
+    magic, version, num_ctrs, rec_size, num_recs, _ = \
+        SNAP_HDR.unpack_from(buf, 0)
+    if magic != b'IBPMASNP' or num_ctrs != SNAP_NUM_CTRS or \
+            rec_size != SNAP_REC.size:
+        raise ValueError(f'{path} is not a counter snapshot')
+    recs = []
+    for i in range(num_recs):
+        guid, port, flags, *ctrs = \
+            SNAP_REC.unpack_from(buf, SNAP_HDR.size + i * SNAP_REC.size)
+        recs.append((guid, port, ctrs))
+    return recs
+
+
+class IbqueryerrorsTest(unittest.TestCase):
+    """
+    Every test starts its own simulator; injected errors and failures are a
+    deterministic function of the node and port GUIDs.
+    """
+    def setUp(self):
+        self.bin_dir = build_bin_dir()
+        if not self.bin_dir:
+            raise unittest.SkipTest('umad_simd is not built')
+        self.tmp = tempfile.mkdtemp()
+        self.topo = os.path.join(self.tmp, 'fabric.topo')
+        with open(self.topo, 'w') as f:
+            f.write(topology())
+        self.sock = os.path.join(self.tmp, 'umad.sock')
+        self.thresholds = os.path.join(self.tmp, 'thresholds')
+        with open(self.thresholds, 'w') as f:
+            f.write('SymbolErrorCounter=0\nPortRcvErrors=0\n')
+        self.sim = None
+
+    def tearDown(self):
+        if self.sim:
+            self.sim.kill()
+            self.sim.wait()
+        shutil.rmtree(self.tmp)
+
+    def start_sim(self, *args):
+        self.sim = subprocess.Popen([os.path.join(self.bin_dir, 'umad_simd'),
+                                     '-t', self.topo, '-s', self.sock,
+                                     '-e', '40', *args],
+                                    stdout=subprocess.DEVNULL)
+        for _ in range(100):
+            if os.path.exists(self.sock):
+                break
+            time.sleep(0.05)
+        else:
+            self.fail('umad_simd did not start')
+        # let the injected error counters move off zero
+        time.sleep(1.1)
+
+    def ibqueryerrors(self, *args):
+        env = dict(os.environ, UMAD_SIM_SOCKET=self.sock)
+        res = subprocess.run([os.path.join(self.bin_dir, 'ibqueryerrors'),
+                              '--threshold-file', self.thresholds, *args],
+                             env=env, stdout=subprocess.PIPE,
+                             stderr=subprocess.PIPE, universal_newlines=True,
+                             timeout=60)
+        return res.stdout, res.stderr
+
+    @staticmethod
+    def ports_checked(out):
+        return int(re.search(r'(\d+) ports checked', out).group(1))
+
+    @staticmethod
+    def error_fields(out):
+        """
+        Map the ports with reported errors to their counter names; the
+        values grow with time so they differ between runs. The aggregate
+        line of an AllPortSelect query has port None.
+        """
+        res = {}
+        for m in re.finditer(r'GUID (0x[0-9a-f]+)(?: "[^"]*")? '
+                             r'port (\d+|ALL):(.*)', out):
+            port = None if m.group(2) == 'ALL' else int(m.group(2))
+            res[(int(m.group(1), 16), port)] = \
+                sorted(re.findall(r'\[(\w+) ==', m.group(3)))
+        return res
+
+    def test_parallel_matches_serial(self):
+        """
+        Pipelined collection reports the same ports and counters as the one
+        port at a time walk.
+        """
+        self.start_sim()
+        serial, _ = self.ibqueryerrors()
+        parallel, _ = self.ibqueryerrors('--parallel', '8')
+        self.assertEqual(self.ports_checked(parallel),
+                         self.ports_checked(serial))
+        self.assertEqual(re.findall(r'^Errors for .*$', parallel, re.M),
+                         re.findall(r'^Errors for .*$', serial, re.M))
+        fields = self.error_fields(parallel)
+        self.assertTrue(fields)
+        # switches with errors report the AllPortSelect aggregate first
+        self.assertTrue([k for k in fields if k[1] is None])
+        self.assertEqual(fields, self.error_fields(serial))
+
+    def test_clear_errors(self):
+        """
+        Clearing the error counters takes effect on every port, including
+        the switch ports cleared through AllPortSelect.
+        """
+        self.start_sim()
+        out, _ = self.ibqueryerrors('--parallel', '8', '-k')
+        self.assertTrue(self.error_fields(out))
+        out, _ = self.ibqueryerrors('--parallel', '8')
+        self.assertFalse(self.error_fields(out))
+
+    def test_snapshot_delta(self):
+        """
+        A snapshot holds one sorted record per port, and --delta reports the
+        counters that grew since it was taken.
+        """
+        self.start_sim()
+        snap = os.path.join(self.tmp, 'snap')
+        self.ibqueryerrors('--parallel', '8', '--snapshot', snap)
+        recs = read_snapshot(snap)
+        self.assertEqual(len(recs), NUM_PORTS)
+        keys = [(guid, port) for guid, port, _ in recs]
+        self.assertEqual(keys, sorted(keys))
+        injected = {(port_guid(guid, port), port) for guid, port, ctrs in recs
+                    if ctrs[SNAP_SYM_ERR]}
+        self.assertTrue(injected)
+
+        # injected ports gain one symbol error per second
+        time.sleep(1.1)
+        delta, _ = self.ibqueryerrors('--parallel', '8', '--delta', snap)
+        self.assertIn('## Counter deltas over', delta)
+        self.assertIn('Errors for ', delta)
+        fields = self.error_fields(delta)
+        self.assertEqual(set(fields), injected)
+        for names in fields.values():
+            self.assertIn('SymbolErrorCounter', names)
+        for m in re.finditer(r'SymbolErrorCounter == \+(\d+)', delta):
+            self.assertIn(int(m.group(1)), (1, 2, 3))
+
+    def test_failed_ports_left_out(self):
+        """
+        Ports whose PMA queries time out are neither reported nor written to
+        the snapshot.
+        """
+        self.start_sim('--pma-timeouts', '30')
+        snap = os.path.join(self.tmp, 'snap')
+        out, err = self.ibqueryerrors('--parallel', '8', '--snapshot', snap)
+        failed = {int(g, 16) for g in
+                  re.findall(r'query failed on (0x[0-9a-f]+)', err)}
+        self.assertTrue(failed)
+        self.assertIn('PMA query failures', out)
+        recs = read_snapshot(snap)
+        self.assertEqual(len(recs), self.ports_checked(out))
+        self.assertLess(len(recs), NUM_PORTS)
+        self.assertFalse(failed & {guid for guid, _, _ in recs})
+
+    def test_aborted_collection(self):
+        """
+        When the umad port goes away in the middle of the collection, the
+        ports that were not answered are counted as failures instead of
+        being reported clean with zero counters.
+        """
+        self.start_sim('--pma-limit', '45')
+        snap = os.path.join(self.tmp, 'snap')
+        out, err = self.ibqueryerrors('--parallel', '8', '--snapshot', snap)
+        self.assertIn('PMA collection aborted', err)
+        self.assertIn('PMA query failures', out)
+        recs = read_snapshot(snap)
+        self.assertEqual(len(recs), self.ports_checked(out))
+        self.assertGreater(len(recs), 0)
+        self.assertLess(len(recs), NUM_PORTS)
+        # every connected port moves data, port 0 of a switch has no link
+        for guid, port, ctrs in recs:
+            if port:
+                self.assertNotEqual(ctrs[SNAP_XMT_BYTES], 0,
+                                    f'{guid:#x} port {port}')